@@ -35,6 +35,13 @@ class AddressIndexTest(BitcoinTestFramework):
         self.is_network_split = False
         self.sync_all()
 
+    def assert_invalid_parameter(self, fun, request):
+        try:
+            fun(request)
+            raise AssertionError("Request should have been rejected")
+        except JSONRPCException as e:
+            assert_equal(e.error["code"], -8)
+
     def run_test(self):
         print "Mining blocks..."
         self.nodes[0].generate(105)
@@ -105,6 +112,53 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(multitxids[4], txid2)
         assert_equal(multitxids[5], txidb2)
 
+        # Check that paging walks the addresses in request order
+        print "Testing paging..."
+        addresses = ["93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB", "yMNJePdcKvXtWWQnFYHNeJ5u8TF2v1dfK4"]
+        pages = []
+        cursor = None
+        while True:
+            request = {"addresses": addresses, "limit": 2}
+            if cursor is not None:
+                request["cursor"] = cursor
+            page = self.nodes[1].getaddresstxids(request)
+            pages.append(page["results"])
+            cursor = page["next"]
+            if cursor is None:
+                break
+        assert_equal(pages, [[txidb0, txidb1], [txidb2, txid0], [txid1, txid2]])
+
+        # A page that ends exactly with an address continues at the start of the next one
+        page1 = self.nodes[1].getaddresstxids({"addresses": addresses, "limit": 3})
+        assert_equal(page1["results"], [txidb0, txidb1, txidb2])
+        assert(page1["next"] is not None)
+        page2 = self.nodes[1].getaddresstxids({"addresses": addresses, "limit": 3, "cursor": page1["next"]})
+        assert_equal(page2["results"], [txid0, txid1, txid2])
+        assert_equal(page2["next"], None)
+
+        utxopage1 = self.nodes[1].getaddressutxos({"addresses": [addresses[1]], "limit": 2})
+        assert_equal(len(utxopage1["results"]), 2)
+        utxopage2 = self.nodes[1].getaddressutxos({"addresses": [addresses[1]], "limit": 2, "cursor": utxopage1["next"]})
+        assert_equal(len(utxopage2["results"]), 1)
+        assert_equal(utxopage2["next"], None)
+        utxotxids = sorted([utxo["txid"] for utxo in utxopage1["results"] + utxopage2["results"]])
+        assert_equal(utxotxids, sorted([txid0, txid1, txid2]))
+
+        deltapage = self.nodes[1].getaddressdeltas({"addresses": [addresses[0]], "start": 105, "end": 111, "limit": 1})
+        assert_equal(len(deltapage["results"]), 1)
+        assert_equal(deltapage["results"][0]["txid"], txidb0)
+
+        # Bad limits and cursors are rejected
+        self.assert_invalid_parameter(self.nodes[1].getaddresstxids, {"addresses": addresses, "limit": 0})
+        self.assert_invalid_parameter(self.nodes[1].getaddresstxids, {"addresses": addresses, "limit": -1})
+        self.assert_invalid_parameter(self.nodes[1].getaddresstxids, {"addresses": addresses, "limit": 2, "cursor": "zz"})
+        self.assert_invalid_parameter(self.nodes[1].getaddresstxids, {"addresses": addresses, "limit": 2, "cursor": "00"})
+        cursor = self.nodes[1].getaddresstxids({"addresses": addresses, "limit": 2})["next"]
+        self.assert_invalid_parameter(self.nodes[1].getaddresstxids, {"addresses": [addresses[1]], "limit": 2, "cursor": cursor})
+        # The cursor is only valid for the height range it was made for
+        self.assert_invalid_parameter(self.nodes[1].getaddressdeltas,
+            {"addresses": [addresses[0]], "start": 105, "end": 110, "limit": 1, "cursor": deltapage["next"]})
+
         # Check that balances are correct
         balance0 = self.nodes[1].getaddressbalance("93bVhahvUKmQu8gu9g3QnPPa2cxFK98pMB")
         assert_equal(balance0["balance"], 45 * 100000000)
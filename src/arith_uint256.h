@@ -169,6 +169,11 @@ public:
     base_uint& operator*=(uint32_t b32);
     base_uint& operator*=(const base_uint& b);
     base_uint& operator/=(const base_uint& b);
+    /**
+     * Same result as operator/= for a divisor that fits 32 bits, in one pass
+     * over the words instead of a bit by bit long division.
+     */
+    base_uint& DivideSmall(uint32_t b32);
 
     base_uint& operator++()
     {
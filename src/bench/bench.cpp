@@ -4,12 +4,20 @@
 
 #include "bench.h"
 
+#include <fstream>
 #include <iostream>
+#include <stdlib.h>
 #include <sys/time.h>
 
 using namespace benchmark;
 
-std::map<std::string, BenchFunction> BenchRunner::benchmarks;
+std::map<std::string, BenchFunction>& BenchRunner::benchmarks()
+{
+    // Function-local so registration from other translation units does not
+    // depend on static initialization order.
+    static std::map<std::string, BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
 
 static double gettimedouble(void) {
     struct timeval tv;
@@ -19,28 +27,159 @@ static double gettimedouble(void) {
 
 BenchRunner::BenchRunner(std::string name, BenchFunction func)
 {
-    benchmarks.insert(std::make_pair(name, func));
+    benchmarks().insert(std::make_pair(name, func));
 }
 
-void
-BenchRunner::RunAll(double elapsedTimeForOne)
+bool benchmark::ReadResultsCSV(const std::string& path, std::vector<Result>& results)
 {
-    std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+    std::ifstream file(path.c_str());
+    if (!file.is_open())
+        return false;
 
-    for (std::map<std::string,BenchFunction>::iterator it = benchmarks.begin();
-         it != benchmarks.end(); ++it) {
+    std::string line;
+    if (!std::getline(file, line) || line.compare(0, 9, "Benchmark") != 0)
+        return false;
+    while (std::getline(file, line)) {
+        if (line.empty())
+            continue;
+        std::vector<std::string> fields;
+        size_t pos = 0, comma;
+        while ((comma = line.find(',', pos)) != std::string::npos) {
+            fields.push_back(line.substr(pos, comma - pos));
+            pos = comma + 1;
+        }
+        fields.push_back(line.substr(pos));
+        if (fields.size() < 5)
+            return false;
+        Result result;
+        result.name = fields[0];
+        result.count = atoll(fields[1].c_str());
+        result.minTime = atof(fields[2].c_str());
+        result.maxTime = atof(fields[3].c_str());
+        result.average = atof(fields[4].c_str());
+        results.push_back(result);
+    }
+    return true;
+}
 
-        State state(it->first, elapsedTimeForOne);
+static const Result* FindResult(const std::vector<Result>& results, const std::string& name)
+{
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].name == name)
+            return &results[i];
+    }
+    return NULL;
+}
+
+/** Relative change of the average against the baseline, in percent (positive is slower). */
+static double ChangePercent(const Result& result, const Result& baseline)
+{
+    if (baseline.average <= 0)
+        return 0;
+    return (result.average - baseline.average) / baseline.average * 100.0;
+}
+
+static void PrintCSV(const std::vector<Result>& results, const std::vector<Result>* baseline)
+{
+    std::cout << "Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average";
+    if (baseline)
+        std::cout << "," << "baseline" << "," << "change%";
+    std::cout << "\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::cout << r.name << "," << r.count << "," << r.minTime << "," << r.maxTime << "," << r.average;
+        if (baseline) {
+            const Result* base = FindResult(*baseline, r.name);
+            if (base)
+                std::cout << "," << base->average << "," << ChangePercent(r, *base);
+            else
+                std::cout << ",,";
+        }
+        std::cout << "\n";
+    }
+}
+
+static void PrintJSON(const std::vector<Result>& results, const std::vector<Result>* baseline)
+{
+    // Benchmark names are C identifiers, so they need no escaping.
+    std::cout << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::cout << "  {\"name\": \"" << r.name << "\", \"count\": " << r.count
+                  << ", \"min\": " << r.minTime << ", \"max\": " << r.maxTime << ", \"average\": " << r.average;
+        if (baseline) {
+            const Result* base = FindResult(*baseline, r.name);
+            if (base)
+                std::cout << ", \"baseline\": " << base->average << ", \"change_percent\": " << ChangePercent(r, *base);
+        }
+        std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "]\n";
+}
+
+bool
+BenchRunner::RunAll(const RunOptions& options)
+{
+    std::vector<Result> baseline;
+    if (!options.baselineFile.empty() && !ReadResultsCSV(options.baselineFile, baseline)) {
+        std::cerr << "Error reading baseline file " << options.baselineFile << "\n";
+        return false;
+    }
+
+    std::vector<Result> results;
+    for (std::map<std::string,BenchFunction>::iterator it = benchmarks().begin();
+         it != benchmarks().end(); ++it) {
+
+        if (!options.filter.empty() && it->first.find(options.filter) == std::string::npos)
+            continue;
+
+        Result result;
+        State state(it->first, options.elapsedTimeForOne, &result);
         BenchFunction& func = it->second;
         func(state);
+        results.push_back(result);
+    }
+
+    const std::vector<Result>* compare = options.baselineFile.empty() ? NULL : &baseline;
+    if (options.format == OUTPUT_JSON)
+        PrintJSON(results, compare);
+    else
+        PrintCSV(results, compare);
+
+    bool fOk = true;
+    for (size_t i = 0; compare && i < results.size(); i++) {
+        const Result* base = FindResult(baseline, results[i].name);
+        if (base && ChangePercent(results[i], *base) > options.maxRegression) {
+            std::cerr << "Regression: " << results[i].name << " is " << ChangePercent(results[i], *base)
+                      << "% slower than the baseline\n";
+            fOk = false;
+        }
     }
+    return fOk;
+}
+
+double State::Now() const
+{
+    return gettimedouble() - pausedTime;
+}
+
+void State::PauseTiming()
+{
+    pauseBegin = gettimedouble();
+}
+
+void State::ResumeTiming()
+{
+    pausedTime += gettimedouble() - pauseBegin;
 }
 
 bool State::KeepRunning()
 {
-    double now;
+    double now, wallNow;
     if (count == 0) {
-        beginTime = now = gettimedouble();
+        beginTime = now = Now();
+        wallBeginTime = wallNow = gettimedouble();
     }
     else {
         // timeCheckCount is used to avoid calling gettime most of the time,
@@ -49,22 +188,29 @@ bool State::KeepRunning()
             ++count;
             return true; // keep going
         }
-        now = gettimedouble();
+        now = Now();
+        wallNow = gettimedouble();
         double elapsedOne = (now - lastTime)/timeCheckCount;
         if (elapsedOne < minTime) minTime = elapsedOne;
         if (elapsedOne > maxTime) maxTime = elapsedOne;
-        if (elapsedOne*timeCheckCount < maxElapsed/16) timeCheckCount *= 2;
+        if (wallNow - lastWallTime < maxElapsed/16) timeCheckCount *= 2;
     }
     lastTime = now;
+    lastWallTime = wallNow;
     ++count;
 
-    if (now - beginTime < maxElapsed) return true; // Keep going
+    // Paused setup does not count towards maxElapsed, but is bounded so
+    // benchmarks with expensive setup still finish in reasonable time.
+    if (now - beginTime < maxElapsed && wallNow - wallBeginTime < maxElapsed * MAX_PAUSED_FACTOR) return true; // Keep going
 
     --count;
 
-    // Output results
-    double average = (now-beginTime)/count;
-    std::cout << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
+    // Record results, RunAll prints them once every benchmark has finished
+    result->name = name;
+    result->count = count;
+    result->minTime = minTime;
+    result->maxTime = maxTime;
+    result->average = (now-beginTime)/count;
 
     return false;
 }
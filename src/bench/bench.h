@@ -5,8 +5,10 @@
 #ifndef BITCOIN_BENCH_BENCH_H
 #define BITCOIN_BENCH_BENCH_H
 
+#include <limits>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/function.hpp>
 #include <boost/preprocessor/cat.hpp>
@@ -32,37 +34,82 @@ static void CODE_TO_TIME(benchmark::State& state)
 
 BENCHMARK(CODE_TO_TIME);
 
+Setup that has to be repeated for every iteration can be kept out of the
+measurement by bracketing it with state.PauseTiming() / state.ResumeTiming().
+
  */
  
 namespace benchmark {
 
+    /** Timings of one finished benchmark, in seconds per iteration. */
+    struct Result {
+        std::string name;
+        int64_t count;
+        double minTime, maxTime, average;
+    };
+
+    /** Wall-clock time a benchmark may take, as a multiple of its timed budget. */
+    static const double MAX_PAUSED_FACTOR = 10.0;
+
     class State {
         std::string name;
         double maxElapsed;
         double beginTime;
         double lastTime, minTime, maxTime;
+        double pausedTime, pauseBegin;
+        double wallBeginTime, lastWallTime;
         int64_t count;
         int64_t timeCheckCount;
+        Result* result;
+
+        double Now() const;
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
+        State(std::string _name, double _maxElapsed, Result* _result) : name(_name), maxElapsed(_maxElapsed), pausedTime(0), pauseBegin(0), count(0), result(_result) {
             minTime = std::numeric_limits<double>::max();
             maxTime = std::numeric_limits<double>::min();
             timeCheckCount = 1;
         }
         bool KeepRunning();
+        /** Stop the clock, e.g. while rebuilding state the next iteration consumes. */
+        void PauseTiming();
+        void ResumeTiming();
     };
 
     typedef boost::function<void(State&)> BenchFunction;
 
+    enum OutputFormat {
+        OUTPUT_CSV,
+        OUTPUT_JSON
+    };
+
+    /** Options of a benchmark run, see bench_futurocoin -? */
+    struct RunOptions {
+        double elapsedTimeForOne;
+        std::string filter;          //!< only run benchmarks whose name contains this
+        OutputFormat format;
+        std::string baselineFile;    //!< CSV output of an earlier run to compare against
+        double maxRegression;        //!< allowed slowdown against the baseline, in percent
+
+        RunOptions() : elapsedTimeForOne(1.0), format(OUTPUT_CSV), maxRegression(10.0) {}
+    };
+
     class BenchRunner
     {
-        static std::map<std::string, BenchFunction> benchmarks;
+        static std::map<std::string, BenchFunction>& benchmarks();
 
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne=1.0);
+        /**
+         * Run all benchmarks matching the filter and print the results.
+         * Returns false if a baseline was given and could not be read, or if any
+         * benchmark got slower than the baseline by more than maxRegression.
+         */
+        static bool RunAll(const RunOptions& options=RunOptions());
     };
+
+    /** Parse the CSV printed by RunAll into results. Returns false on I/O or format errors. */
+    bool ReadResultsCSV(const std::string& path, std::vector<Result>& results);
 }
 
 // BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
@@ -0,0 +1,89 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench_chain.h"
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "validation.h"
+
+#include <assert.h>
+
+BenchChain::BenchChain(int nHeight, int nTx) : coins(&viewDummy)
+{
+    const CChainParams& chainparams = Params();
+
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // Header-only chain on top of the regtest genesis block
+    vHashes.resize(nHeight + 1);
+    vIndex.resize(nHeight + 1);
+    for (int i = 0; i <= nHeight; i++) {
+        CBlockIndex& index = vIndex[i];
+        vHashes[i] = i == 0 ? chainparams.GenesisBlock().GetHash() : ArithToUint256(arith_uint256(i));
+        index.phashBlock = &vHashes[i];
+        index.pprev = i == 0 ? NULL : &vIndex[i - 1];
+        index.nHeight = i;
+        index.nVersion = 4;
+        index.nTime = chainparams.GenesisBlock().nTime + 60 * i;
+        index.nBits = chainparams.GenesisBlock().nBits;
+        index.nChainWork = (i == 0 ? arith_uint256(0) : vIndex[i - 1].nChainWork) + GetBlockProof(index);
+        index.BuildSkip();
+    }
+    coins.SetBestBlock(Tip()->GetBlockHash());
+
+    // One coin per transaction, created outside the chain so none is a coinbase
+    vFunding.reserve(nTx);
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        vFunding.push_back(tx);
+        coins.ModifyNewCoins(vFunding.back().GetHash())->FromTx(vFunding.back(), 1);
+    }
+
+    const CAmount nFee = 1000;
+    block.nVersion = 4;
+    block.hashPrevBlock = Tip()->GetBlockHash();
+    block.nTime = Tip()->nTime + 60;
+    block.nBits = Tip()->nBits;
+    block.nNonce = 0;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << (nHeight + 1) << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = GetBlockSubsidy(Tip()->nBits, Tip()->nHeight, chainparams.GetConsensus()) + nFee * nTx;
+    coinbase.vout[0].scriptPubKey = scriptPubKey;
+    block.vtx.push_back(coinbase);
+
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(vFunding[i].GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN - nFee;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        bool fSigned = SignSignature(keystore, vFunding[i], tx, 0);
+        assert(fSigned);
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    hashBlock = block.GetHash();
+
+    indexBlock = CBlockIndex(block);
+    indexBlock.phashBlock = &hashBlock;
+    indexBlock.pprev = Tip();
+    indexBlock.nHeight = nHeight + 1;
+    indexBlock.BuildSkip();
+}
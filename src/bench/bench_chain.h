@@ -0,0 +1,57 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_CHAIN_H
+#define BITCOIN_BENCH_BENCH_CHAIN_H
+
+#include "chain.h"
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "primitives/block.h"
+#include "script/script.h"
+
+#include <vector>
+
+/**
+ * A synthetic regtest chain for benchmarks that need consensus state: a
+ * header-only chain of block indexes, a coins view holding one P2PKH coin
+ * per transaction, and a valid block on top of the chain that spends all
+ * of those coins. Each instance uses a fresh key, so signatures verified
+ * by one benchmark never hit the signature cache of another.
+ *
+ * Requires SelectParams() to have been called.
+ */
+class BenchChain
+{
+public:
+    BenchChain(int nHeight, int nTx);
+
+    CBasicKeyStore keystore;
+    CScript scriptPubKey;
+
+    /** Transactions whose first output is a coin spent by block.vtx[i + 1]. */
+    std::vector<CTransaction> vFunding;
+
+    CCoinsView viewDummy;
+    /** Holds the funding coins, best block is the chain tip. */
+    CCoinsViewCache coins;
+
+    /** Coinbase plus one signed single-input transaction per coin, paying a fee. */
+    CBlock block;
+    uint256 hashBlock;
+    /** Index entry of block, its pprev is Tip(). */
+    CBlockIndex indexBlock;
+
+    CBlockIndex* Tip() { return &vIndex.back(); }
+
+private:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    BenchChain(const BenchChain&);
+    BenchChain& operator=(const BenchChain&);
+};
+
+#endif // BITCOIN_BENCH_BENCH_CHAIN_H
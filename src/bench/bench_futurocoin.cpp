@@ -4,18 +4,56 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
+#include "crypto/x11.h"
 #include "key.h"
+#include "script/sigcache.h"
 #include "validation.h"
 #include "util.h"
 
+#include <stdio.h>
+
 int
 main(int argc, char** argv)
 {
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        std::string strUsage = "Usage:\n  bench_futurocoin [options]\n\n";
+        strUsage += HelpMessageGroup("Options:");
+        strUsage += HelpMessageOpt("-?", "This help message");
+        strUsage += HelpMessageOpt("-filter=<substring>", "Only run benchmarks whose name contains <substring>");
+        strUsage += HelpMessageOpt("-output=<format>", "Print results as csv or json (default: csv)");
+        strUsage += HelpMessageOpt("-time=<seconds>", "Time spent in each benchmark (default: 1)");
+        strUsage += HelpMessageOpt("-baseline=<file>", "Compare against the CSV output of an earlier run and fail on regressions");
+        strUsage += HelpMessageOpt("-maxregression=<percent>", "Slowdown of a benchmark's average against the baseline that counts as a regression (default: 10)");
+        fprintf(stdout, "%s", strUsage.c_str());
+        return 0;
+    }
+
+    benchmark::RunOptions options;
+    options.filter = GetArg("-filter", "");
+    options.baselineFile = GetArg("-baseline", "");
+    options.elapsedTimeForOne = atof(GetArg("-time", "1").c_str());
+    options.maxRegression = atof(GetArg("-maxregression", "10").c_str());
+    std::string format = GetArg("-output", "csv");
+    if (format == "json") {
+        options.format = benchmark::OUTPUT_JSON;
+    } else if (format != "csv") {
+        fprintf(stderr, "Error: unknown output format '%s'\n", format.c_str());
+        return 1;
+    }
+
     ECC_Start();
+    X11AutoDetect();
     SetupEnvironment();
+    InitSignatureCache();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    // The block and chain benchmarks build a synthetic regtest chain
+    SelectParams(CBaseChainParams::REGTEST);
 
-    benchmark::BenchRunner::RunAll();
+    bool fOk = benchmark::BenchRunner::RunAll(options);
 
     ECC_Stop();
+    return fOk ? 0 : 1;
 }
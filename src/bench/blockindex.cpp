@@ -0,0 +1,93 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <random>
+#include <vector>
+
+// Long enough that the index does not fit into the CPU caches
+static const int BENCH_INDEX_HEIGHT = 200000;
+
+/**
+ * A header-only chain of block index entries allocated from an arena. The
+ * entries are laid out either in height order, as LoadBlockIndexGuts leaves
+ * them, or in random order, as they used to end up when each one was
+ * allocated separately while loading the index in hash order.
+ */
+class ArenaChain
+{
+public:
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vByHeight;
+
+    ArenaChain(int nHeight, bool fShuffled)
+    {
+        std::vector<int> vOrder(nHeight + 1);
+        for (int i = 0; i <= nHeight; i++)
+            vOrder[i] = i;
+        if (fShuffled)
+            std::shuffle(vOrder.begin(), vOrder.end(), std::mt19937(42));
+
+        vByHeight.resize(nHeight + 1);
+        arena.Reserve(nHeight + 1);
+        for (int i = 0; i <= nHeight; i++)
+            vByHeight[vOrder[i]] = arena.Allocate();
+
+        for (int i = 0; i <= nHeight; i++) {
+            CBlockIndex* pindex = vByHeight[i];
+            pindex->nHeight = i;
+            pindex->nTime = 1500000000 + 150 * i;
+            pindex->nBits = 0x1e0ffff0;
+            pindex->pprev = i == 0 ? NULL : vByHeight[i - 1];
+            pindex->BuildSkip();
+        }
+    }
+
+    CBlockIndex* Tip() { return vByHeight.back(); }
+};
+
+// Follow pprev from the tip back to the genesis block, reading the header
+// fields difficulty retargeting looks at.
+static void BlockIndexWalk(benchmark::State& state, bool fShuffled)
+{
+    ArenaChain chain(BENCH_INDEX_HEIGHT, fShuffled);
+    while (state.KeepRunning()) {
+        uint64_t nSum = 0;
+        for (const CBlockIndex* pindex = chain.Tip(); pindex; pindex = pindex->pprev)
+            nSum += pindex->nTime + pindex->nBits;
+        assert(nSum > 0);
+    }
+}
+
+// 1000 GetAncestor() lookups of random heights from the tip, through the skip list.
+static void BlockIndexGetAncestor(benchmark::State& state, bool fShuffled)
+{
+    ArenaChain chain(BENCH_INDEX_HEIGHT, fShuffled);
+    std::mt19937 rng(7);
+    std::vector<int> vHeights(1000);
+    for (size_t i = 0; i < vHeights.size(); i++)
+        vHeights[i] = rng() % (BENCH_INDEX_HEIGHT + 1);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vHeights.size(); i++) {
+            const CBlockIndex* pindex = chain.Tip()->GetAncestor(vHeights[i]);
+            assert(pindex->nHeight == vHeights[i]);
+        }
+    }
+}
+
+static void BlockIndexWalk_HeightOrder(benchmark::State& state) { BlockIndexWalk(state, false); }
+static void BlockIndexWalk_Shuffled(benchmark::State& state) { BlockIndexWalk(state, true); }
+static void BlockIndexGetAncestor_HeightOrder(benchmark::State& state) { BlockIndexGetAncestor(state, false); }
+static void BlockIndexGetAncestor_Shuffled(benchmark::State& state) { BlockIndexGetAncestor(state, true); }
+
+BENCHMARK(BlockIndexWalk_HeightOrder);
+BENCHMARK(BlockIndexWalk_Shuffled);
+BENCHMARK(BlockIndexGetAncestor_HeightOrder);
+BENCHMARK(BlockIndexGetAncestor_Shuffled);
@@ -0,0 +1,54 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include <assert.h>
+
+#include <boost/scoped_ptr.hpp>
+
+// Number of coins a block benchmark fetches or flushes per iteration
+static const int BENCH_COINS = 2000;
+
+// Pull every coin of a block into an empty child cache, as ConnectBlock does
+// for the inputs of a new block.
+static void CCoinsCachingFetch(benchmark::State& state)
+{
+    BenchChain chain(1, BENCH_COINS);
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&chain.coins);
+        for (size_t i = 0; i < chain.vFunding.size(); i++) {
+            const CCoins* coins = view.AccessCoins(chain.vFunding[i].GetHash());
+            assert(coins && coins->IsAvailable(0));
+        }
+    }
+}
+
+// Spend every coin in a child cache and write the changes back to its parent.
+static void CCoinsCachingFlush(benchmark::State& state)
+{
+    BenchChain chain(1, BENCH_COINS);
+    boost::scoped_ptr<CCoinsViewCache> base, view;
+    while (state.KeepRunning()) {
+        // Only Flush() is timed, building and tearing down the caches is not
+        state.PauseTiming();
+        view.reset();
+        base.reset(new CCoinsViewCache(&chain.coins));
+        for (size_t i = 0; i < chain.vFunding.size(); i++)
+            base->AccessCoins(chain.vFunding[i].GetHash());
+        view.reset(new CCoinsViewCache(base.get()));
+        for (size_t i = 0; i < chain.vFunding.size(); i++) {
+            CCoinsModifier coins = view->ModifyCoins(chain.vFunding[i].GetHash());
+            coins->Spend(0);
+        }
+        state.ResumeTiming();
+
+        bool fFlushed = view->Flush();
+        assert(fFlushed);
+    }
+}
+
+BENCHMARK(CCoinsCachingFetch);
+BENCHMARK(CCoinsCachingFlush);
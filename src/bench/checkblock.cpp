@@ -0,0 +1,75 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "streams.h"
+#include "validation.h"
+#include "version.h"
+
+#include <assert.h>
+
+// Chain height and block size used by the block benchmarks. The chain is
+// tall enough for the supermajority checks in ConnectBlock to see a full
+// window of version 4 blocks.
+static const int BENCH_CHAIN_HEIGHT = 1000;
+static const int BENCH_BLOCK_TXS = 1000;
+
+static void SerializeBlock(benchmark::State& state)
+{
+    BenchChain chain(BENCH_CHAIN_HEIGHT, BENCH_BLOCK_TXS);
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << chain.block;
+        assert(stream.size() > 0);
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    BenchChain chain(BENCH_CHAIN_HEIGHT, BENCH_BLOCK_TXS);
+    CDataStream raw(SER_NETWORK, PROTOCOL_VERSION);
+    raw << chain.block;
+    while (state.KeepRunning()) {
+        CDataStream stream(raw.begin(), raw.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        stream >> block;
+        assert(block.vtx.size() == chain.block.vtx.size());
+    }
+}
+
+static void CheckBlockNoPoW(benchmark::State& state)
+{
+    BenchChain chain(BENCH_CHAIN_HEIGHT, BENCH_BLOCK_TXS);
+    while (state.KeepRunning()) {
+        // Without the PoW check the result is not cached in fChecked
+        CValidationState validationState;
+        bool fValid = CheckBlock(chain.block, validationState, false, true);
+        assert(fValid);
+    }
+}
+
+static void ConnectBlockJustCheck(benchmark::State& state)
+{
+    // Script results are cached after the first iteration (fJustCheck keeps
+    // fCacheResults on), so this times the UTXO and contextual checks of an
+    // already-verified block, as seen when connecting a block whose
+    // transactions went through our mempool.
+    BenchChain chain(BENCH_CHAIN_HEIGHT, BENCH_BLOCK_TXS);
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&chain.coins);
+        CValidationState validationState;
+        bool fValid = ConnectBlock(chain.block, validationState, &chain.indexBlock, view, true);
+        assert(fValid);
+    }
+}
+
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(CheckBlockNoPoW);
+BENCHMARK(ConnectBlockJustCheck);
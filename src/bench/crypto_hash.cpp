@@ -0,0 +1,102 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/x11.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+
+#include <string.h>
+#include <vector>
+
+static void X11Stage(benchmark::State& state, int stage)
+{
+    unsigned char buf[2][64];
+    memset(buf, 0x5a, sizeof(buf));
+    X11Stage64 func = X11SelectedStage(stage);
+    int i = 0;
+    while (state.KeepRunning()) {
+        func(buf[i ^ 1], buf[i]);
+        i ^= 1;
+    }
+}
+
+// One benchmark per stage, timing whichever implementation X11AutoDetect() picked
+#define X11_STAGE_BENCHMARK(name, stage) \
+static void X11_##name(benchmark::State& state) { X11Stage(state, stage); } \
+BENCHMARK(X11_##name);
+
+X11_STAGE_BENCHMARK(01_blake512, X11_BLAKE)
+X11_STAGE_BENCHMARK(02_bmw512, X11_BMW)
+X11_STAGE_BENCHMARK(03_groestl512, X11_GROESTL)
+X11_STAGE_BENCHMARK(04_skein512, X11_SKEIN)
+X11_STAGE_BENCHMARK(05_jh512, X11_JH)
+X11_STAGE_BENCHMARK(06_keccak512, X11_KECCAK)
+X11_STAGE_BENCHMARK(07_luffa512, X11_LUFFA)
+X11_STAGE_BENCHMARK(08_cubehash512, X11_CUBEHASH)
+X11_STAGE_BENCHMARK(09_shavite512, X11_SHAVITE)
+X11_STAGE_BENCHMARK(10_simd512, X11_SIMD)
+X11_STAGE_BENCHMARK(11_echo512, X11_ECHO)
+
+#undef X11_STAGE_BENCHMARK
+
+static void X11_BlockHeader(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1517356800;
+    header.nBits = 0x1e0ffff0;
+    header.nNonce = 0;
+    while (state.KeepRunning()) {
+        header.GetHash();
+        header.nNonce++;
+    }
+}
+
+static void X11_BlockHeaderBatch(benchmark::State& state)
+{
+    // Reported per batch of X11_BATCH_LANES headers
+    std::vector<CBlockHeader> headers(X11_BATCH_LANES);
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nVersion = 4;
+        headers[i].hashPrevBlock = GetRandHash();
+        headers[i].hashMerkleRoot = GetRandHash();
+        headers[i].nTime = 1517356800;
+        headers[i].nBits = 0x1e0ffff0;
+        headers[i].nNonce = i;
+    }
+    std::vector<uint256> hashes(headers.size());
+    while (state.KeepRunning()) {
+        HashX11Batch(&headers[0], headers.size(), &hashes[0]);
+        for (size_t i = 0; i < headers.size(); i++)
+            headers[i].nNonce += headers.size();
+    }
+}
+
+static void X11_NonceScan(benchmark::State& state)
+{
+    // Reported per batch of X11_BATCH_LANES nonces of one header, as the miner hashes them
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1517356800;
+    header.nBits = 0x1e0ffff0;
+    header.nNonce = 0;
+    CX11NonceScanner scanner(header);
+    uint256 hashes[X11_BATCH_LANES];
+    uint32_t nNonce = 0;
+    while (state.KeepRunning()) {
+        scanner.Hash(nNonce, hashes);
+        nNonce += X11_BATCH_LANES;
+    }
+}
+
+BENCHMARK(X11_BlockHeader);
+BENCHMARK(X11_BlockHeaderBatch);
+BENCHMARK(X11_NonceScan);
@@ -0,0 +1,60 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "amount.h"
+#include "txmempool.h"
+
+#include <assert.h>
+#include <list>
+
+#include <boost/scoped_ptr.hpp>
+
+// Transactions moved through the mempool per iteration
+static const int BENCH_MEMPOOL_TXS = 1000;
+
+static void AddBlockTxs(CTxMemPool& pool, const BenchChain& chain)
+{
+    for (size_t i = 1; i < chain.block.vtx.size(); i++) {
+        const CTransaction& tx = chain.block.vtx[i];
+        CAmount nValueIn = chain.vFunding[i - 1].vout[0].nValue;
+        CTxMemPoolEntry entry(tx, nValueIn - tx.GetValueOut(), 0, 0.0, 1, true, nValueIn, false, 1, LockPoints());
+        pool.addUnchecked(tx.GetHash(), entry);
+    }
+}
+
+static void MempoolAddUnchecked(benchmark::State& state)
+{
+    BenchChain chain(1, BENCH_MEMPOOL_TXS);
+    boost::scoped_ptr<CTxMemPool> pool;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        pool.reset(new CTxMemPool(CFeeRate(1000)));
+        state.ResumeTiming();
+
+        AddBlockTxs(*pool, chain);
+        assert(pool->size() == chain.block.vtx.size() - 1);
+    }
+}
+
+static void MempoolRemoveForBlock(benchmark::State& state)
+{
+    BenchChain chain(1, BENCH_MEMPOOL_TXS);
+    boost::scoped_ptr<CTxMemPool> pool;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        pool.reset(new CTxMemPool(CFeeRate(1000)));
+        AddBlockTxs(*pool, chain);
+        state.ResumeTiming();
+
+        std::list<CTransaction> conflicts;
+        pool->removeForBlock(chain.block.vtx, 2, conflicts);
+        assert(pool->size() == 0);
+    }
+}
+
+BENCHMARK(MempoolAddUnchecked);
+BENCHMARK(MempoolRemoveForBlock);
@@ -0,0 +1,65 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "pow.h"
+
+#include <assert.h>
+#include <vector>
+
+/** A header-only chain with varying block times and targets */
+class PowChain
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> blocks;
+
+    PowChain(int nBlocks)
+        : vHashes(nBlocks), blocks(nBlocks)
+    {
+        const arith_uint256 bnPowLimit = UintToArith256(Params().GetConsensus().powLimit);
+        for (int i = 0; i < nBlocks; i++) {
+            vHashes[i] = ArithToUint256(arith_uint256(i + 1));
+            blocks[i].phashBlock = &vHashes[i];
+            blocks[i].pprev = i ? &blocks[i - 1] : NULL;
+            blocks[i].nHeight = i;
+            blocks[i].nTime = 1500000000 + 150 * i + (i * 7919) % 300;
+            arith_uint256 bnTarget = bnPowLimit >> (8 + i % 5);
+            blocks[i].nBits = bnTarget.GetCompact();
+        }
+    }
+};
+
+// DarkGravityWave for every block of the chain. Without a hash the result
+// is computed each time, as for a header that is not in the index yet.
+static void DarkGravityWaveUncached(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    PowChain chain(1000);
+    for (size_t i = 0; i < chain.blocks.size(); i++)
+        chain.blocks[i].phashBlock = NULL;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < chain.blocks.size(); i++)
+            assert(GetNextWorkRequired(&chain.blocks[i], NULL, Params().GetConsensus()) != 0);
+    }
+}
+
+// The same tip asked for over and over, like headers and blocks building on
+// it being checked and block templates being created.
+static void DarkGravityWaveSameTip(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    PowChain chain(1000);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++)
+            assert(GetNextWorkRequired(&chain.blocks.back(), NULL, Params().GetConsensus()) != 0);
+    }
+}
+
+BENCHMARK(DarkGravityWaveUncached);
+BENCHMARK(DarkGravityWaveSameTip);
@@ -0,0 +1,93 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "pubkey.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+
+#include <assert.h>
+
+#include <boost/thread.hpp>
+
+/** A signature of the benchmark block with the public key and hash it signs */
+struct SigCacheEntry
+{
+    std::vector<unsigned char> vchSig;
+    CPubKey pubkey;
+    uint256 sighash;
+};
+
+// Signature cache lookups from nThreads threads at once, the access pattern
+// of the script check queue while connecting a block. Every lookup hits,
+// with fStore unset the hits are erased as ConnectBlock does, which only
+// flags them as reusable so they keep hitting. One iteration is 1024
+// lookups per thread.
+static void SigCacheContention(benchmark::State& state, int nThreads, bool fStore)
+{
+    const int nTx = 256;
+    const int nLookups = 1024;
+    BenchChain chain(1, nTx);
+
+    std::vector<SigCacheEntry> vEntries(nTx);
+    for (int i = 0; i < nTx; i++) {
+        const CTransaction& tx = chain.block.vtx[1 + i];
+        SigCacheEntry& entry = vEntries[i];
+        CScript::const_iterator pc = tx.vin[0].scriptSig.begin();
+        opcodetype opcode;
+        std::vector<unsigned char> vchPubKey;
+        bool fParsed = tx.vin[0].scriptSig.GetOp(pc, opcode, entry.vchSig) && tx.vin[0].scriptSig.GetOp(pc, opcode, vchPubKey);
+        assert(fParsed);
+        entry.pubkey = CPubKey(vchPubKey);
+        int nHashType = entry.vchSig.back();
+        entry.vchSig.pop_back();
+        entry.sighash = SignatureHash(chain.scriptPubKey, tx, 0, nHashType);
+
+        // Verify once to put the signature into the cache
+        bool fValid = CachingTransactionSignatureChecker(&tx, 0, true).VerifySignature(entry.vchSig, entry.pubkey, entry.sighash);
+        assert(fValid);
+    }
+
+    boost::barrier start(nThreads + 1);
+    boost::barrier done(nThreads + 1);
+    bool fStop = false;
+    boost::thread_group threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.create_thread([&, t] {
+            CachingTransactionSignatureChecker checker(&chain.block.vtx[1], 0, fStore);
+            while (true) {
+                start.wait();
+                if (fStop)
+                    return;
+                for (int i = 0; i < nLookups; i++) {
+                    const SigCacheEntry& entry = vEntries[(i + t * 31) % nTx];
+                    bool fValid = checker.VerifySignature(entry.vchSig, entry.pubkey, entry.sighash);
+                    assert(fValid);
+                }
+                done.wait();
+            }
+        });
+    }
+
+    while (state.KeepRunning()) {
+        start.wait();
+        done.wait();
+    }
+    // The barrier orders the write of fStop before the workers read it
+    fStop = true;
+    start.wait();
+    threads.join_all();
+}
+
+static void SigCacheHit_1Thread(benchmark::State& state) { SigCacheContention(state, 1, true); }
+static void SigCacheHit_4Threads(benchmark::State& state) { SigCacheContention(state, 4, true); }
+static void SigCacheHit_8Threads(benchmark::State& state) { SigCacheContention(state, 8, true); }
+static void SigCacheErase_8Threads(benchmark::State& state) { SigCacheContention(state, 8, false); }
+
+BENCHMARK(SigCacheHit_1Thread);
+BENCHMARK(SigCacheHit_4Threads);
+BENCHMARK(SigCacheHit_8Threads);
+BENCHMARK(SigCacheErase_8Threads);
@@ -0,0 +1,31 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench_chain.h"
+
+#include "policy/policy.h"
+#include "validation.h"
+
+#include <assert.h>
+
+// Verify the P2PKH input of one transaction, the unit of work ConnectBlock
+// hands to the script check queue. Results are not stored in the signature
+// cache, so every iteration runs the full ECDSA verification.
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    const int nTx = 64;
+    BenchChain chain(1, nTx);
+    int i = 0;
+    while (state.KeepRunning()) {
+        const CTransaction& tx = chain.block.vtx[1 + i];
+        const CCoins* coins = chain.coins.AccessCoins(tx.vin[0].prevout.hash);
+        CScriptCheck check(*coins, tx, 0, STANDARD_SCRIPT_VERIFY_FLAGS, false);
+        bool fValid = check();
+        assert(fValid);
+        i = (i + 1) % nTx;
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
@@ -7,6 +7,49 @@
 
 using namespace std;
 
+/**
+ * CBlockIndexArena implementation
+ */
+void CBlockIndexArena::Reserve(size_t n) {
+    if (!vChunks.empty() && vChunks.back().nSize - vChunks.back().nUsed >= n)
+        return;
+    Chunk chunk;
+    chunk.pentries = new CBlockIndex[n];
+    chunk.nSize = n;
+    chunk.nUsed = 0;
+    vChunks.push_back(chunk);
+}
+
+CBlockIndex* CBlockIndexArena::Allocate() {
+    if (vChunks.empty() || vChunks.back().nUsed == vChunks.back().nSize)
+        Reserve(DEFAULT_CHUNK_SIZE);
+    nEntries++;
+    return &vChunks.back().pentries[vChunks.back().nUsed++];
+}
+
+void CBlockIndexArena::Splice(CBlockIndexArena& other) {
+    if (other.vChunks.empty())
+        return;
+    // Keep the partly used chunk last so Allocate() continues filling it
+    Chunk chunkLast = vChunks.empty() ? Chunk() : vChunks.back();
+    bool fHasLast = !vChunks.empty() && chunkLast.nUsed < chunkLast.nSize;
+    if (fHasLast)
+        vChunks.pop_back();
+    vChunks.insert(vChunks.end(), other.vChunks.begin(), other.vChunks.end());
+    if (fHasLast)
+        vChunks.push_back(chunkLast);
+    nEntries += other.nEntries;
+    other.vChunks.clear();
+    other.nEntries = 0;
+}
+
+void CBlockIndexArena::Clear() {
+    for (size_t i = 0; i < vChunks.size(); i++)
+        delete[] vChunks[i].pentries;
+    vChunks.clear();
+    nEntries = 0;
+}
+
 /**
  * CChain implementation
  */
@@ -100,8 +100,10 @@ enum BlockStatus {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
-    const uint256* phashBlock;
+    // Members read while walking the chain (pprev/pskip walks, GetAncestor,
+    // difficulty retargeting) come first, so a walk reads only the first 32
+    // bytes of each entry. Entries are not cache line aligned, so these span
+    // one or two lines. The rest is only read for a few entries.
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex* pprev;
@@ -112,6 +114,19 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! block header fields used by difficulty retargeting, the rest of the header is below
+    unsigned int nTime;
+    unsigned int nBits;
+
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
+    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    const uint256* phashBlock;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -121,9 +136,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
@@ -133,14 +145,9 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
-
-    //! block header
+    //! rest of the block header
     int nVersion;
     uint256 hashMerkleRoot;
-    unsigned int nTime;
-    unsigned int nBits;
     unsigned int nNonce;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
@@ -329,6 +336,12 @@ public:
     {
         if(hash != uint256()) return hash;
         // should never really get here, keeping this as a fallback
+        return ComputeBlockHash();
+    }
+
+    /** Hash the stored header, ignoring the stored hash */
+    uint256 ComputeBlockHash() const
+    {
         CBlockHeader block;
         block.nVersion        = nVersion;
         block.hashPrevBlock   = hashPrev;
@@ -351,6 +364,47 @@ public:
     }
 };
 
+/**
+ * Storage for CBlockIndex objects in large contiguous chunks instead of one
+ * heap allocation per entry. Entries are only freed all at once by Clear(),
+ * so pointers to them stay valid until then.
+ */
+class CBlockIndexArena
+{
+private:
+    struct Chunk {
+        CBlockIndex* pentries;
+        size_t nSize;
+        size_t nUsed;
+    };
+
+    static const size_t DEFAULT_CHUNK_SIZE = 4096;
+
+    std::vector<Chunk> vChunks;
+    size_t nEntries;
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    void operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : nEntries(0) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    /** Make sure the next n entries are allocated from one contiguous chunk */
+    void Reserve(size_t n);
+
+    /** A new default constructed entry */
+    CBlockIndex* Allocate();
+
+    /** Take over all entries of other, which is left empty */
+    void Splice(CBlockIndexArena& other);
+
+    /** Free all entries */
+    void Clear();
+
+    size_t size() const { return nEntries; }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
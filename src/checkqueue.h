@@ -127,6 +127,9 @@ private:
     }
 
 public:
+    //! Mutex to ensure only one concurrent CCheckQueueControl
+    boost::mutex ControlMutex;
+
     //! Create a new check queue
     CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
 
@@ -171,7 +174,8 @@ public:
 
 /** 
  * RAII-style controller object for a CCheckQueue that guarantees the passed
- * queue is finished before continuing.
+ * queue is finished before continuing. Controllers of the same queue take
+ * turns, the queue is held from construction until Wait() returns.
  */
 template <typename T>
 class CCheckQueueControl
@@ -179,23 +183,46 @@ class CCheckQueueControl
 private:
     CCheckQueue<T>* pqueue;
     bool fDone;
+    boost::unique_lock<boost::mutex> lock;
 
 public:
     CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
-        // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
+            lock = boost::unique_lock<boost::mutex>(pqueue->ControlMutex);
+            bool isIdle = pqueue->IsIdle();
+            assert(isIdle);
+        }
+    }
+
+    //! Only take the queue if no other controller holds it, see IsActive()
+    CCheckQueueControl(CCheckQueue<T>* pqueueIn, boost::try_to_lock_t) : pqueue(pqueueIn), fDone(false)
+    {
+        if (pqueue != NULL) {
+            lock = boost::unique_lock<boost::mutex>(pqueue->ControlMutex, boost::try_to_lock);
+            if (!lock.owns_lock()) {
+                pqueue = NULL;
+                return;
+            }
             bool isIdle = pqueue->IsIdle();
             assert(isIdle);
         }
     }
 
+    //! Whether checks are run on the queue, Add() drops them otherwise
+    bool IsActive() const
+    {
+        return pqueue != NULL;
+    }
+
     bool Wait()
     {
         if (pqueue == NULL)
             return true;
         bool fRet = pqueue->Wait();
         fDone = true;
+        lock.unlock();
+        pqueue = NULL;
         return fRet;
     }
 
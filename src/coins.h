@@ -412,6 +412,13 @@ public:
      */
     bool HaveCoinsInCache(const uint256 &txid) const;
 
+    /**
+     * Add coins that were read from the backing view ahead of time, exactly
+     * as a cache miss on txid would have. Nothing is changed if txid is
+     * already cached. The contents of coins are swapped into the cache.
+     */
+    void WarmCoins(const uint256 &txid, CCoins &coins);
+
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
      * more efficient than GetCoins. Modifications to other cache entries are
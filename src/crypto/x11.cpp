@@ -0,0 +1,352 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "futurocoin-config.h"
+#endif
+
+#include "crypto/x11.h"
+
+#include "crypto/common.h"
+#include "crypto/sph_blake.h"
+#include "crypto/sph_bmw.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_jh.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_skein.h"
+#include "crypto/sph_luffa.h"
+#include "crypto/sph_cubehash.h"
+#include "crypto/sph_shavite.h"
+#include "crypto/sph_simd.h"
+#include "crypto/sph_echo.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_AESNI)
+namespace x11_aesni
+{
+void Groestl512(unsigned char out[64], const unsigned char in[64]);
+void Shavite512(unsigned char out[64], const unsigned char in[64]);
+void Echo512(unsigned char out[64], const unsigned char in[64]);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace x11_avx2
+{
+void Luffa512(unsigned char out[64], const unsigned char in[64]);
+void CubeHash512(unsigned char out[64], const unsigned char in[64]);
+void Blake512_80x4(unsigned char out[256], const unsigned char in[320]);
+void Blake512_80x4Mid(unsigned char out[256], const uint64_t m[16], const uint64_t v[16], uint32_t nNonce);
+void Bmw512x4(unsigned char out[256], const unsigned char in[256]);
+void Skein512x4(unsigned char out[256], const unsigned char in[256]);
+void Jh512x4(unsigned char out[256], const unsigned char in[256]);
+void Keccak512x4(unsigned char out[256], const unsigned char in[256]);
+}
+#endif
+
+namespace
+{
+
+#define X11_PORTABLE_STAGE(name, ctxtype) \
+void name##64(unsigned char out[64], const unsigned char in[64]) \
+{ \
+    ctxtype ctx; \
+    name##_init(&ctx); \
+    name(&ctx, in, 64); \
+    name##_close(&ctx, out); \
+}
+
+X11_PORTABLE_STAGE(sph_blake512, sph_blake512_context)
+X11_PORTABLE_STAGE(sph_bmw512, sph_bmw512_context)
+X11_PORTABLE_STAGE(sph_groestl512, sph_groestl512_context)
+X11_PORTABLE_STAGE(sph_skein512, sph_skein512_context)
+X11_PORTABLE_STAGE(sph_jh512, sph_jh512_context)
+X11_PORTABLE_STAGE(sph_keccak512, sph_keccak512_context)
+X11_PORTABLE_STAGE(sph_luffa512, sph_luffa512_context)
+X11_PORTABLE_STAGE(sph_cubehash512, sph_cubehash512_context)
+X11_PORTABLE_STAGE(sph_shavite512, sph_shavite512_context)
+X11_PORTABLE_STAGE(sph_simd512, sph_simd512_context)
+X11_PORTABLE_STAGE(sph_echo512, sph_echo512_context)
+
+#undef X11_PORTABLE_STAGE
+
+const char* const stageNames[X11_STAGE_COUNT] = {
+    "blake512", "bmw512", "groestl512", "skein512", "jh512", "keccak512",
+    "luffa512", "cubehash512", "shavite512", "simd512", "echo512"
+};
+
+const X11Stage64 portableStages[X11_STAGE_COUNT] = {
+    sph_blake51264, sph_bmw51264, sph_groestl51264, sph_skein51264, sph_jh51264, sph_keccak51264,
+    sph_luffa51264, sph_cubehash51264, sph_shavite51264, sph_simd51264, sph_echo51264
+};
+
+// Written once by X11AutoDetect() during startup, read-only afterwards.
+X11Stage64 selectedStages[X11_STAGE_COUNT] = {
+    sph_blake51264, sph_bmw51264, sph_groestl51264, sph_skein51264, sph_jh51264, sph_keccak51264,
+    sph_luffa51264, sph_cubehash51264, sph_shavite51264, sph_simd51264, sph_echo51264
+};
+
+/** A stage applied to X11_BATCH_LANES inputs at once, stored back to back. */
+typedef void (*X11StageBatch)(unsigned char* out, const unsigned char* in);
+/** Blake512 of X11_BATCH_LANES consecutive nonces from a midstate. */
+typedef void (*X11BlakeMidBatch)(unsigned char* out, const uint64_t m[16], const uint64_t v[16], uint32_t nNonce);
+
+// Multi-lane stage implementations, NULL where there is none. Written once
+// by X11AutoDetect() like selectedStages.
+X11StageBatch selectedBlake80Batch = NULL;
+X11BlakeMidBatch selectedBlakeMidBatch = NULL;
+X11StageBatch selectedBatchStages[X11_STAGE_COUNT] = {};
+
+const uint64_t BLAKE_IV512[8] = {
+    0x6A09E667F3BCC908, 0xBB67AE8584CAA73B, 0x3C6EF372FE94F82B, 0xA54FF53A5F1D36F1,
+    0x510E527FADE682D1, 0x9B05688C2B3E6C1F, 0x1F83D9ABFB41BD6B, 0x5BE0CD19137E2179
+};
+
+const uint64_t BLAKE_CB[16] = {
+    0x243F6A8885A308D3, 0x13198A2E03707344, 0xA4093822299F31D0, 0x082EFA98EC4E6C89,
+    0x452821E638D01377, 0xBE5466CF34E90C6C, 0xC0AC29B7C97C50DD, 0x3F84D5B5B5470917,
+    0x9216D5D98979FB1B, 0xD1310BA698DFB5AC, 0x2FFD72DBD01ADFB7, 0xB8E1AFED6A267E96,
+    0xBA7C9045F12C7F99, 0x24A19947B3916CF7, 0x0801F2E2858EFC16, 0x636920D871574E69
+};
+
+const uint8_t BLAKE_SIGMA[10][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+    { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+    { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+    { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+    { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+    { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+    { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+    { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+    { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 }
+};
+
+inline uint64_t Rotr64(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+inline void BlakeG(const uint64_t m[16], const uint8_t* s, int i, uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d)
+{
+    a = a + b + (m[s[2 * i]] ^ BLAKE_CB[s[2 * i + 1]]);
+    d = Rotr64(d ^ a, 32);
+    c = c + d;
+    b = Rotr64(b ^ c, 25);
+    a = a + b + (m[s[2 * i + 1]] ^ BLAKE_CB[s[2 * i]]);
+    d = Rotr64(d ^ a, 16);
+    c = c + d;
+    b = Rotr64(b ^ c, 11);
+}
+
+inline void BlakeColumns(const uint64_t m[16], const uint8_t* s, uint64_t v[16])
+{
+    BlakeG(m, s, 0, v[0], v[4], v[8], v[12]);
+    BlakeG(m, s, 1, v[1], v[5], v[9], v[13]);
+    BlakeG(m, s, 2, v[2], v[6], v[10], v[14]);
+    BlakeG(m, s, 3, v[3], v[7], v[11], v[15]);
+}
+
+inline void BlakeDiagonals(const uint64_t m[16], const uint8_t* s, uint64_t v[16])
+{
+    BlakeG(m, s, 4, v[0], v[5], v[10], v[15]);
+    BlakeG(m, s, 5, v[1], v[6], v[11], v[12]);
+    BlakeG(m, s, 6, v[2], v[7], v[8], v[13]);
+    BlakeG(m, s, 7, v[3], v[4], v[9], v[14]);
+}
+
+/** Finish blake512 of one nonce from the midstate. */
+void Blake512FromMidstate(unsigned char out[64], const X11Midstate& mid, uint32_t nNonce)
+{
+    uint64_t m[16], v[16];
+    memcpy(m, mid.m, sizeof(m));
+    memcpy(v, mid.v, sizeof(v));
+    // The nonce is stored little-endian in the header, blake512 reads it big-endian
+    m[9] |= ((nNonce & 0xff) << 24) | ((nNonce & 0xff00) << 8) | ((nNonce >> 8) & 0xff00) | (nNonce >> 24);
+    BlakeDiagonals(m, BLAKE_SIGMA[0], v);
+    for (int r = 1; r < 16; r++) {
+        BlakeColumns(m, BLAKE_SIGMA[r % 10], v);
+        BlakeDiagonals(m, BLAKE_SIGMA[r % 10], v);
+    }
+    for (int i = 0; i < 8; i++) {
+        WriteBE64(out + 8 * i, BLAKE_IV512[i] ^ v[i] ^ v[i + 8]);
+    }
+}
+
+/** Stages 2 to 11 over X11_BATCH_LANES blake512 digests in src, using dst as scratch. */
+void X11ChainBatch(unsigned char* out, unsigned char* src, unsigned char* dst)
+{
+    // Every stage runs over all lanes before the next one starts, so each
+    // stage's code and tables stay hot while the lanes pass through it.
+    for (int stage = X11_BMW; stage < X11_STAGE_COUNT; stage++) {
+        if (stage == X11_ECHO)
+            dst = out;
+        if (selectedBatchStages[stage]) {
+            selectedBatchStages[stage](dst, src);
+        } else {
+            for (size_t i = 0; i < X11_BATCH_LANES; i++) {
+                selectedStages[stage](dst + 64 * i, src + 64 * i);
+            }
+        }
+        std::swap(src, dst);
+    }
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+void inline GetCPUID(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+}
+
+#if defined(ENABLE_AVX2)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+#endif
+
+} // namespace
+
+void X11UsePortable()
+{
+    for (int i = 0; i < X11_STAGE_COUNT; i++) {
+        selectedStages[i] = portableStages[i];
+        selectedBatchStages[i] = NULL;
+    }
+    selectedBlake80Batch = NULL;
+    selectedBlakeMidBatch = NULL;
+}
+
+std::string X11AutoDetect()
+{
+    std::string ret;
+    X11UsePortable();
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+
+#if defined(ENABLE_AESNI)
+    bool have_ssse3 = (ecx >> 9) & 1;
+    bool have_aesni = (ecx >> 25) & 1;
+    if (have_ssse3 && have_aesni) {
+        selectedStages[X11_GROESTL] = x11_aesni::Groestl512;
+        selectedStages[X11_SHAVITE] = x11_aesni::Shavite512;
+        selectedStages[X11_ECHO] = x11_aesni::Echo512;
+        ret = "aesni(groestl,shavite,echo)";
+    }
+#endif
+
+#if defined(ENABLE_AVX2)
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx && AVXEnabled()) {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        if ((ebx >> 5) & 1) {
+            selectedStages[X11_LUFFA] = x11_avx2::Luffa512;
+            selectedStages[X11_CUBEHASH] = x11_avx2::CubeHash512;
+            selectedBlake80Batch = x11_avx2::Blake512_80x4;
+            selectedBlakeMidBatch = x11_avx2::Blake512_80x4Mid;
+            selectedBatchStages[X11_BMW] = x11_avx2::Bmw512x4;
+            selectedBatchStages[X11_SKEIN] = x11_avx2::Skein512x4;
+            selectedBatchStages[X11_JH] = x11_avx2::Jh512x4;
+            selectedBatchStages[X11_KECCAK] = x11_avx2::Keccak512x4;
+            ret += ret.empty() ? "avx2(luffa,cubehash)" : ",avx2(luffa,cubehash)";
+            ret += ",avx2-4way(blake,bmw,skein,jh,keccak)";
+        }
+    }
+#endif
+#endif
+
+    return ret.empty() ? "standard" : ret;
+}
+
+const char* X11StageName(int stage)
+{
+    return stageNames[stage];
+}
+
+X11Stage64 X11SelectedStage(int stage)
+{
+    return selectedStages[stage];
+}
+
+X11Stage64 X11PortableStage(int stage)
+{
+    return portableStages[stage];
+}
+
+void X11Chain(unsigned char out[64], const unsigned char in[64])
+{
+    unsigned char a[64], b[64];
+    selectedStages[X11_BMW](a, in);
+    selectedStages[X11_GROESTL](b, a);
+    selectedStages[X11_SKEIN](a, b);
+    selectedStages[X11_JH](b, a);
+    selectedStages[X11_KECCAK](a, b);
+    selectedStages[X11_LUFFA](b, a);
+    selectedStages[X11_CUBEHASH](a, b);
+    selectedStages[X11_SHAVITE](b, a);
+    selectedStages[X11_SIMD](a, b);
+    selectedStages[X11_ECHO](out, a);
+}
+
+void X11Batch80(unsigned char out[X11_BATCH_LANES * 64], const unsigned char in[X11_BATCH_LANES * 80])
+{
+    unsigned char a[X11_BATCH_LANES * 64], b[X11_BATCH_LANES * 64];
+    if (selectedBlake80Batch) {
+        selectedBlake80Batch(a, in);
+    } else {
+        for (size_t i = 0; i < X11_BATCH_LANES; i++) {
+            sph_blake512_context ctx;
+            sph_blake512_init(&ctx);
+            sph_blake512(&ctx, in + 80 * i, 80);
+            sph_blake512_close(&ctx, a + 64 * i);
+        }
+    }
+    X11ChainBatch(out, a, b);
+}
+
+void X11PrepareMidstate(X11Midstate& mid, const unsigned char in[76])
+{
+    // Single padded block: header, 0x80, zeros, 0x01 at byte 111 and the
+    // 128-bit big-endian bit count (640).
+    for (int i = 0; i < 9; i++) {
+        mid.m[i] = ReadBE64(in + 8 * i);
+    }
+    mid.m[9] = (uint64_t)ReadBE32(in + 72) << 32;
+    mid.m[10] = 0x8000000000000000;
+    mid.m[11] = mid.m[12] = 0;
+    mid.m[13] = 1;
+    mid.m[14] = 0;
+    mid.m[15] = 640;
+
+    for (int i = 0; i < 8; i++) {
+        mid.v[i] = BLAKE_IV512[i];
+        mid.v[i + 8] = BLAKE_CB[i];
+    }
+    mid.v[12] ^= 640;
+    mid.v[13] ^= 640;
+    BlakeColumns(mid.m, BLAKE_SIGMA[0], mid.v);
+}
+
+void X11ScanBatch(unsigned char out[X11_BATCH_LANES * 64], const X11Midstate& mid, uint32_t nNonce)
+{
+    unsigned char a[X11_BATCH_LANES * 64], b[X11_BATCH_LANES * 64];
+    if (selectedBlakeMidBatch) {
+        selectedBlakeMidBatch(a, mid.m, mid.v, nNonce);
+    } else {
+        for (size_t i = 0; i < X11_BATCH_LANES; i++) {
+            Blake512FromMidstate(a + 64 * i, mid, nNonce + i);
+        }
+    }
+    X11ChainBatch(out, a, b);
+}
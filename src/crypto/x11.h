@@ -0,0 +1,98 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_X11_H
+#define BITCOIN_CRYPTO_X11_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** The eleven chained 512-bit stages of X11, in hashing order. */
+enum X11StageIndex {
+    X11_BLAKE = 0,
+    X11_BMW,
+    X11_GROESTL,
+    X11_SKEIN,
+    X11_JH,
+    X11_KECCAK,
+    X11_LUFFA,
+    X11_CUBEHASH,
+    X11_SHAVITE,
+    X11_SIMD,
+    X11_ECHO,
+    X11_STAGE_COUNT
+};
+
+/**
+ * One X11 stage applied to a 64-byte input (the previous stage's digest),
+ * writing a 64-byte digest. Input and output may not overlap.
+ */
+typedef void (*X11Stage64)(unsigned char out[64], const unsigned char in[64]);
+
+/**
+ * Select the fastest available implementation of every stage for the CPU
+ * we are running on. Must be called before any other thread hashes.
+ * Returns a description of the selected implementations.
+ */
+std::string X11AutoDetect();
+
+/**
+ * Select the portable sph_* implementation of every stage, whatever the CPU
+ * supports. For comparing the other implementations against it; the same
+ * threading rule as for X11AutoDetect() applies.
+ */
+void X11UsePortable();
+
+/** Human-readable name of a stage ("blake512", "groestl512", ...). */
+const char* X11StageName(int stage);
+
+/** Currently selected implementation of a stage, applied to 64 bytes of input. */
+X11Stage64 X11SelectedStage(int stage);
+
+/** Portable sph_* implementation of a stage, applied to 64 bytes of input. */
+X11Stage64 X11PortableStage(int stage);
+
+/**
+ * Run stages 2 to 11 (bmw512 .. echo512) over the 64-byte blake512 digest
+ * of the input, using the selected implementations.
+ */
+void X11Chain(unsigned char out[64], const unsigned char in[64]);
+
+/** Number of independent inputs X11Batch80() hashes per call. */
+static const size_t X11_BATCH_LANES = 4;
+
+/**
+ * X11 of X11_BATCH_LANES independent 80-byte inputs (block headers) stored
+ * back to back, writing the 64-byte digests back to back. Stages with a
+ * multi-lane implementation hash all inputs at once, the others fall back
+ * to the selected single-input implementation.
+ */
+void X11Batch80(unsigned char out[X11_BATCH_LANES * 64], const unsigned char in[X11_BATCH_LANES * 80]);
+
+/**
+ * The part of hashing an 80-byte block header that does not depend on its
+ * nonce. Blake512 hashes the header as one padded 128-byte block in which
+ * only message word 9 (nBits and nNonce) changes from nonce to nonce, so the
+ * padded message and the first round's column step, which does not read that
+ * word, are computed once per header instead of once per nonce.
+ */
+struct X11Midstate
+{
+    uint64_t m[16]; //!< padded message words, with the nonce half of m[9] zero
+    uint64_t v[16]; //!< blake512 state after the first round's column step
+};
+
+/** Compute the midstate of an 80-byte input from its first 76 bytes. */
+void X11PrepareMidstate(X11Midstate& mid, const unsigned char in[76]);
+
+/**
+ * X11 of the X11_BATCH_LANES 80-byte inputs that start with the 76 bytes
+ * mid was prepared from and end in the little-endian nonces nNonce,
+ * nNonce + 1, ..., writing the 64-byte digests back to back. Same result as
+ * X11Batch80() on those inputs.
+ */
+void X11ScanBatch(unsigned char out[X11_BATCH_LANES * 64], const X11Midstate& mid, uint32_t nNonce);
+
+#endif // BITCOIN_CRYPTO_X11_H
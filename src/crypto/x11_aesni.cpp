@@ -0,0 +1,354 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// AES-NI implementations of the Groestl-512, SHAvite-512 and ECHO-512 X11
+// stages, specialized for the 64-byte inputs X11 feeds them. This file is
+// built with -maes -mssse3 and only called after CPUID says so.
+
+#ifdef ENABLE_AESNI
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+namespace x11_aesni {
+namespace {
+
+/** Byte-wise multiplication by x in GF(2^8) modulo the AES polynomial. */
+inline __m128i Mul2(__m128i x)
+{
+    const __m128i hi = _mm_cmplt_epi8(x, _mm_setzero_si128());
+    return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(hi, _mm_set1_epi8(0x1b)));
+}
+
+/* ----------- Groestl-512 ------------------------------------------------- */
+
+// The 8x16 byte state is held row-wise, one register per row, so that
+// AddRoundConstant, SubBytes and ShiftBytes each act on whole registers and
+// MixBytes is a linear combination of rows.
+
+// Applied after AESENCLAST (which does SubBytes then ShiftRows): undoes
+// ShiftRows and performs the ShiftBytes rotation of each row.
+alignas(16) const uint8_t GROESTL_SHIFT_P[8][16] = {
+    { 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3 },
+    { 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0 },
+    { 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13 },
+    { 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10 },
+    { 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7 },
+    { 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4 },
+    { 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1 },
+    { 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2 }
+};
+
+alignas(16) const uint8_t GROESTL_SHIFT_Q[8][16] = {
+    { 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0 },
+    { 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10 },
+    { 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4 },
+    { 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2 },
+    { 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3 },
+    { 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13 },
+    { 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7 },
+    { 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1 }
+};
+
+/**
+ * MixBytes: new row i = sum over k of circ(02,02,03,04,05,03,05,07)[k] * row (i+k) mod 8,
+ * evaluated with the shared-subexpression schedule from the Groestl submission:
+ * t_i = a_i + a_(i+1), x_i = t_i + t_(i+3), y_i = t_i + t_(i+2) + a_(i+6),
+ * w_i = 2 x_i + y_(i+4), b_i = 2 w_(i+3) + y_(i+4).
+ */
+inline void GroestlMixBytes(__m128i a[8])
+{
+    __m128i t[8], x[8], y[8], w[8];
+    for (int i = 0; i < 8; i++) {
+        t[i] = _mm_xor_si128(a[i], a[(i + 1) & 7]);
+    }
+    for (int i = 0; i < 8; i++) {
+        x[i] = _mm_xor_si128(t[i], t[(i + 3) & 7]);
+        y[i] = _mm_xor_si128(_mm_xor_si128(t[i], t[(i + 2) & 7]), a[(i + 6) & 7]);
+    }
+    for (int i = 0; i < 8; i++) {
+        w[i] = Mul2(_mm_xor_si128(Mul2(x[i]), y[(i + 4) & 7]));
+    }
+    for (int i = 0; i < 8; i++) {
+        a[i] = _mm_xor_si128(w[(i + 3) & 7], y[(i + 4) & 7]);
+    }
+}
+
+inline __m128i GroestlColumns()
+{
+    return _mm_setr_epi8(0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70,
+                         (char)0x80, (char)0x90, (char)0xa0, (char)0xb0, (char)0xc0, (char)0xd0, (char)0xe0, (char)0xf0);
+}
+
+inline void GroestlRoundP(__m128i x[8], int r)
+{
+    x[0] = _mm_xor_si128(x[0], _mm_xor_si128(GroestlColumns(), _mm_set1_epi8(r)));
+    for (int i = 0; i < 8; i++) {
+        x[i] = _mm_shuffle_epi8(_mm_aesenclast_si128(x[i], _mm_setzero_si128()), _mm_load_si128((const __m128i*)GROESTL_SHIFT_P[i]));
+    }
+    GroestlMixBytes(x);
+}
+
+inline void GroestlRoundQ(__m128i x[8], int r)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    for (int i = 0; i < 7; i++) {
+        x[i] = _mm_xor_si128(x[i], ones);
+    }
+    x[7] = _mm_xor_si128(x[7], _mm_xor_si128(ones, _mm_xor_si128(GroestlColumns(), _mm_set1_epi8(r))));
+    for (int i = 0; i < 8; i++) {
+        x[i] = _mm_shuffle_epi8(_mm_aesenclast_si128(x[i], _mm_setzero_si128()), _mm_load_si128((const __m128i*)GROESTL_SHIFT_Q[i]));
+    }
+    GroestlMixBytes(x);
+}
+
+/** Load a 128-byte block (column-major: byte 8*j+i is row i, column j) into rows. */
+void GroestlLoadRows(__m128i x[8], const unsigned char block[128])
+{
+    alignas(16) unsigned char rows[8][16];
+    for (int j = 0; j < 16; j++) {
+        for (int i = 0; i < 8; i++) {
+            rows[i][j] = block[8 * j + i];
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        x[i] = _mm_load_si128((const __m128i*)rows[i]);
+    }
+}
+
+/* ----------- SHAvite-512 ------------------------------------------------- */
+
+const uint32_t SHAVITE_IV512[16] = {
+    0x72FCCDD8, 0x79CA4727, 0x128A077B, 0x40D55AEC, 0xD1901A06, 0x430AE307, 0xB29F5CD1, 0xDF07FBFC,
+    0x8E45D73D, 0x681AB538, 0xBDE86578, 0xDD577E47, 0xE275EADE, 0x502D9FCD, 0xB9357178, 0x022A4B9A
+};
+
+/** Nonlinear key expansion step producing rk[u..u+3]. */
+inline void ShaviteExpandNonlinear(uint32_t* rk, int u)
+{
+    __m128i x = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(rk + u - 32)), 0x39);
+    x = _mm_aesenc_si128(x, _mm_setzero_si128());
+    x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i*)(rk + u - 4)));
+    _mm_storeu_si128((__m128i*)(rk + u), x);
+}
+
+/** Linear key expansion step producing rk[u..u+3]. */
+inline void ShaviteExpandLinear(uint32_t* rk, int u)
+{
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(rk + u - 32)), _mm_loadu_si128((const __m128i*)(rk + u - 7)));
+    _mm_storeu_si128((__m128i*)(rk + u), x);
+}
+
+inline void ShaviteXorCounter(uint32_t* rk, int u, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(rk + u)), _mm_setr_epi32(a, b, c, d));
+    _mm_storeu_si128((__m128i*)(rk + u), x);
+}
+
+/* ----------- ECHO-512 ---------------------------------------------------- */
+
+inline void EchoMixColumn(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+    __m128i ab = _mm_xor_si128(a, b);
+    __m128i bc = _mm_xor_si128(b, c);
+    __m128i cd = _mm_xor_si128(c, d);
+    __m128i abx = Mul2(ab);
+    __m128i bcx = Mul2(bc);
+    __m128i cdx = Mul2(cd);
+    __m128i na = _mm_xor_si128(abx, _mm_xor_si128(bc, d));
+    __m128i nb = _mm_xor_si128(bcx, _mm_xor_si128(a, cd));
+    __m128i nc = _mm_xor_si128(cdx, _mm_xor_si128(ab, d));
+    __m128i nd = _mm_xor_si128(_mm_xor_si128(abx, bcx), _mm_xor_si128(_mm_xor_si128(cdx, ab), c));
+    a = na;
+    b = nb;
+    c = nc;
+    d = nd;
+}
+
+} // namespace
+
+void Groestl512(unsigned char out[64], const unsigned char in[64])
+{
+    // Single padded block: message, 0x80, zeros, 64-bit big-endian block count (1).
+    unsigned char block[128];
+    memcpy(block, in, 64);
+    memset(block + 64, 0, 64);
+    block[64] = 0x80;
+    block[127] = 1;
+
+    __m128i m[8], p[8], h[8];
+    GroestlLoadRows(m, block);
+    // The IV is all zero except for the output size (512 = 0x0200) in its last column.
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_setzero_si128();
+    }
+    h[6] = _mm_insert_epi16(h[6], 0x0200, 7);
+
+    for (int i = 0; i < 8; i++) {
+        p[i] = _mm_xor_si128(h[i], m[i]);
+    }
+    // P and Q are independent; interleaving their rounds keeps the AES unit busy.
+    for (int r = 0; r < 14; r++) {
+        GroestlRoundP(p, r);
+        GroestlRoundQ(m, r);
+    }
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_xor_si128(h[i], _mm_xor_si128(p[i], m[i]));
+        p[i] = h[i];
+    }
+
+    // Output transformation: the last 512 bits (columns 8 to 15) of P(h) ^ h.
+    for (int r = 0; r < 14; r++) {
+        GroestlRoundP(p, r);
+    }
+    alignas(16) unsigned char rows[8][16];
+    for (int i = 0; i < 8; i++) {
+        _mm_store_si128((__m128i*)rows[i], _mm_xor_si128(p[i], h[i]));
+    }
+    for (int j = 8; j < 16; j++) {
+        for (int i = 0; i < 8; i++) {
+            out[8 * (j - 8) + i] = rows[i][j];
+        }
+    }
+}
+
+void Shavite512(unsigned char out[64], const unsigned char in[64])
+{
+    // Single padded block: message, 0x80, zeros, 128-bit bit count (512) at
+    // offset 110 and the 16-bit digest size (512) at offset 126.
+    uint32_t rk[448];
+    unsigned char* block = (unsigned char*)rk;
+    memcpy(block, in, 64);
+    memset(block + 64, 0, 64);
+    block[64] = 0x80;
+    block[111] = 0x02;
+    block[127] = 0x02;
+
+    const uint32_t count0 = 512, count1 = 0, count2 = 0, count3 = 0;
+    int u = 32;
+    for (;;) {
+        for (int s = 0; s < 4; s++) {
+            ShaviteExpandNonlinear(rk, u);
+            if (u == 32) {
+                ShaviteXorCounter(rk, u, count0, count1, count2, ~count3);
+            } else if (u == 440) {
+                ShaviteXorCounter(rk, u, count1, count0, count3, ~count2);
+            }
+            u += 4;
+            ShaviteExpandNonlinear(rk, u);
+            if (u == 164) {
+                ShaviteXorCounter(rk, u, count3, count2, count1, ~count0);
+            } else if (u == 316) {
+                ShaviteXorCounter(rk, u, count2, count3, count0, ~count1);
+            }
+            u += 4;
+        }
+        if (u == 448)
+            break;
+        for (int s = 0; s < 8; s++) {
+            ShaviteExpandLinear(rk, u);
+            u += 4;
+        }
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i h0 = _mm_loadu_si128((const __m128i*)(SHAVITE_IV512 + 0));
+    const __m128i h1 = _mm_loadu_si128((const __m128i*)(SHAVITE_IV512 + 4));
+    const __m128i h2 = _mm_loadu_si128((const __m128i*)(SHAVITE_IV512 + 8));
+    const __m128i h3 = _mm_loadu_si128((const __m128i*)(SHAVITE_IV512 + 12));
+    __m128i p0 = h0, p1 = h1, p2 = h2, p3 = h3;
+    const __m128i* k = (const __m128i*)rk;
+    for (int r = 0; r < 14; r++) {
+        __m128i x = _mm_xor_si128(p1, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, zero);
+        p0 = _mm_xor_si128(p0, x);
+
+        x = _mm_xor_si128(p3, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k++));
+        x = _mm_aesenc_si128(x, zero);
+        p2 = _mm_xor_si128(p2, x);
+
+        x = p3;
+        p3 = p2;
+        p2 = p1;
+        p1 = p0;
+        p0 = x;
+    }
+
+    _mm_storeu_si128((__m128i*)(out + 0), _mm_xor_si128(h0, p0));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_xor_si128(h1, p1));
+    _mm_storeu_si128((__m128i*)(out + 32), _mm_xor_si128(h2, p2));
+    _mm_storeu_si128((__m128i*)(out + 48), _mm_xor_si128(h3, p3));
+}
+
+void Echo512(unsigned char out[64], const unsigned char in[64])
+{
+    // Single padded block: message, 0x80, zeros, 16-bit digest size (512) at
+    // offset 110 and the 128-bit bit count (512) at offset 112.
+    unsigned char block[128];
+    memcpy(block, in, 64);
+    memset(block + 64, 0, 64);
+    block[64] = 0x80;
+    block[111] = 0x02;
+    block[113] = 0x02;
+
+    const __m128i v = _mm_setr_epi32(512, 0, 0, 0);
+    __m128i w[16];
+    for (int i = 0; i < 8; i++) {
+        w[i] = v;
+        w[i + 8] = _mm_loadu_si128((const __m128i*)(block + 16 * i));
+    }
+
+    // The salt/counter starts at the message bit count and is incremented
+    // once per word; at most 160 increments never carry out of the low word.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_setr_epi32(1, 0, 0, 0);
+    __m128i k = v;
+    for (int r = 0; r < 10; r++) {
+        for (int n = 0; n < 16; n++) {
+            w[n] = _mm_aesenc_si128(_mm_aesenc_si128(w[n], k), zero);
+            k = _mm_add_epi32(k, one);
+        }
+
+        __m128i t = w[1];
+        w[1] = w[5];
+        w[5] = w[9];
+        w[9] = w[13];
+        w[13] = t;
+        t = w[2];
+        w[2] = w[10];
+        w[10] = t;
+        t = w[6];
+        w[6] = w[14];
+        w[14] = t;
+        t = w[15];
+        w[15] = w[11];
+        w[11] = w[7];
+        w[7] = w[3];
+        w[3] = t;
+
+        EchoMixColumn(w[0], w[1], w[2], w[3]);
+        EchoMixColumn(w[4], w[5], w[6], w[7]);
+        EchoMixColumn(w[8], w[9], w[10], w[11]);
+        EchoMixColumn(w[12], w[13], w[14], w[15]);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        __m128i x = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)(block + 16 * i)));
+        x = _mm_xor_si128(x, _mm_xor_si128(w[i], w[i + 8]));
+        _mm_storeu_si128((__m128i*)(out + 16 * i), x);
+    }
+}
+
+} // namespace x11_aesni
+
+#endif // ENABLE_AESNI
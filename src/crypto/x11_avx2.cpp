@@ -0,0 +1,286 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// AVX2 implementations of the Luffa-512 and CubeHash-512 X11 stages.
+// This file is built with -mavx2 and only called after CPUID says so.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace x11_avx2 {
+namespace {
+
+inline __m256i Rotl(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+
+/* ----------- CubeHash-512 ------------------------------------------------ */
+
+// The 32-word state lives in four registers: words 0-7, 8-15, 16-23, 24-31.
+const uint32_t CUBEHASH_IV512[32] = {
+    0x2AEA2A61, 0x50F494D4, 0x2D538B8B, 0x4167D83E, 0x3FEE2313, 0xC701CF8C, 0xCC39968E, 0x50AC5695,
+    0x4D42C787, 0xA647A8B3, 0x97CF0BEF, 0x825B4537, 0xEEF864D2, 0xF22090C4, 0xD0E5CD33, 0xA23911AE,
+    0xFCD398D9, 0x148FE485, 0x1B017BEF, 0xB6444532, 0x6A536159, 0x2FF5781C, 0x91FA7934, 0x0DBADEA9,
+    0xD65C8A2B, 0xA5A70E75, 0xB1C62456, 0xBC796576, 0x1921C8F7, 0xE7989AF1, 0x7795D246, 0xD43E3B44
+};
+
+inline void CubeHashRounds(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, int rounds)
+{
+    for (int r = 0; r < rounds; ++r) {
+        x2 = _mm256_add_epi32(x0, x2);
+        x3 = _mm256_add_epi32(x1, x3);
+        __m256i y0 = x1;
+        x1 = Rotl(x0, 7);
+        x0 = Rotl(y0, 7);
+        x0 = _mm256_xor_si256(x0, x2);
+        x1 = _mm256_xor_si256(x1, x3);
+        x2 = _mm256_shuffle_epi32(x2, 0x4e);
+        x3 = _mm256_shuffle_epi32(x3, 0x4e);
+        x2 = _mm256_add_epi32(x0, x2);
+        x3 = _mm256_add_epi32(x1, x3);
+        x0 = Rotl(_mm256_permute4x64_epi64(x0, 0x4e), 11);
+        x1 = Rotl(_mm256_permute4x64_epi64(x1, 0x4e), 11);
+        x0 = _mm256_xor_si256(x0, x2);
+        x1 = _mm256_xor_si256(x1, x3);
+        x2 = _mm256_shuffle_epi32(x2, 0xb1);
+        x3 = _mm256_shuffle_epi32(x3, 0xb1);
+    }
+}
+
+/* ----------- Luffa-512 --------------------------------------------------- */
+
+// The five 256-bit sub-states are kept transposed: register k holds word k
+// of every sub-state, sub-state j in 32-bit slot j (slots 5-7 are unused and
+// never mixed into 0-4), so the five step functions run side by side.
+const uint32_t LUFFA_V_INIT[5][8] = {
+    { 0x6d251e69, 0x44b051e0, 0x4eaa6fb4, 0xdbf78465, 0x6e292011, 0x90152df4, 0xee058139, 0xdef610bb },
+    { 0xc3b44b95, 0xd9d2f256, 0x70eee9a0, 0xde099fa3, 0x5d9b0557, 0x8fc944b3, 0xcf1ccf0e, 0x746cd581 },
+    { 0xf7efc89d, 0x5dba5781, 0x04016ce5, 0xad659c05, 0x0306194f, 0x666d1836, 0x24aa230a, 0x8b264ae7 },
+    { 0x858075d5, 0x36d79cce, 0xe571f7d7, 0x204b1f67, 0x35870c6a, 0x57e9e923, 0x14bcb808, 0x7cde72ce },
+    { 0x6c68e9be, 0x5ec41e22, 0xc825b7c7, 0xaffb4363, 0xf5df3999, 0x0fc688f1, 0xb07224cc, 0x03e86cea }
+};
+
+// Round constants per round, one slot per sub-state: RC0 is added to word 0, RC4 to word 4.
+const uint32_t LUFFA_RC0[8][8] = {
+    { 0x303994a6, 0xb6de10ed, 0xfc20d9d2, 0xb213afa5, 0xf0d2e9e3, 0, 0, 0 },
+    { 0xc0e65299, 0x70f47aae, 0x34552e25, 0xc84ebe95, 0xac11d7fa, 0, 0, 0 },
+    { 0x6cc33a12, 0x0707a3d4, 0x7ad8818f, 0x4e608a22, 0x1bcb66f2, 0, 0, 0 },
+    { 0xdc56983e, 0x1c1e8f51, 0x8438764a, 0x56d858fe, 0x6f2d9bc9, 0, 0, 0 },
+    { 0x1e00108f, 0x707a3d45, 0xbb6de032, 0x343b138f, 0x78602649, 0, 0, 0 },
+    { 0x7800423d, 0xaeb28562, 0xedb780c8, 0xd0ec4e3d, 0x8edae952, 0, 0, 0 },
+    { 0x8f5b7882, 0xbaca1589, 0xd9847356, 0x2ceb4882, 0x3b6ba548, 0, 0, 0 },
+    { 0x96e1db12, 0x40a46f3e, 0xa2c78434, 0xb3ad2208, 0xedae9520, 0, 0, 0 }
+};
+
+const uint32_t LUFFA_RC4[8][8] = {
+    { 0xe0337818, 0x01685f3d, 0xe25e72c1, 0xe028c9bf, 0x5090d577, 0, 0, 0 },
+    { 0x441ba90d, 0x05a17cf4, 0xe623bb72, 0x44756f91, 0x2d1925ab, 0, 0, 0 },
+    { 0x7f34d442, 0xbd09caca, 0x5c58a4a4, 0x7e8fce32, 0xb46496ac, 0, 0, 0 },
+    { 0x9389217f, 0xf4272b28, 0x1e38e2e7, 0x956548be, 0xd1925ab0, 0, 0, 0 },
+    { 0xe5a8bce6, 0x144ae5cc, 0x78e38b9d, 0xfe191be2, 0x29131ab6, 0, 0, 0 },
+    { 0x5274baf4, 0xfaa7ae2b, 0x27586719, 0x3cb226e5, 0x0fc053c3, 0, 0, 0 },
+    { 0x26889ba7, 0x2e48f1c1, 0x36eda57f, 0x5944a28e, 0x3f014f0c, 0, 0, 0 },
+    { 0x9a226e9d, 0xb923c704, 0x703aace7, 0xa1c4c355, 0xfc053c31, 0, 0, 0 }
+};
+
+/** Multiplication by 2 of every sub-state, i.e. a renaming of words with three feedback xors. */
+inline void LuffaMul2(__m256i v[8])
+{
+    __m256i tmp = v[7];
+    v[7] = v[6];
+    v[6] = v[5];
+    v[5] = v[4];
+    v[4] = _mm256_xor_si256(v[3], tmp);
+    v[3] = _mm256_xor_si256(v[2], tmp);
+    v[2] = v[1];
+    v[1] = _mm256_xor_si256(v[0], tmp);
+    v[0] = tmp;
+}
+
+inline void LuffaMul2(uint32_t m[8])
+{
+    uint32_t tmp = m[7];
+    m[7] = m[6];
+    m[6] = m[5];
+    m[5] = m[4];
+    m[4] = m[3] ^ tmp;
+    m[3] = m[2] ^ tmp;
+    m[2] = m[1];
+    m[1] = m[0] ^ tmp;
+    m[0] = tmp;
+}
+
+inline void LuffaSubCrumb(__m256i& a0, __m256i& a1, __m256i& a2, __m256i& a3)
+{
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i tmp = a0;
+    a0 = _mm256_or_si256(a0, a1);
+    a2 = _mm256_xor_si256(a2, a3);
+    a1 = _mm256_xor_si256(a1, ones);
+    a0 = _mm256_xor_si256(a0, a3);
+    a3 = _mm256_and_si256(a3, tmp);
+    a1 = _mm256_xor_si256(a1, a3);
+    a3 = _mm256_xor_si256(a3, a2);
+    a2 = _mm256_and_si256(a2, a0);
+    a0 = _mm256_xor_si256(a0, ones);
+    a2 = _mm256_xor_si256(a2, a1);
+    a1 = _mm256_or_si256(a1, a3);
+    tmp = _mm256_xor_si256(tmp, a1);
+    a3 = _mm256_xor_si256(a3, a2);
+    a2 = _mm256_and_si256(a2, a1);
+    a1 = _mm256_xor_si256(a1, a0);
+    a0 = tmp;
+}
+
+inline void LuffaMixWord(__m256i& u, __m256i& v)
+{
+    v = _mm256_xor_si256(v, u);
+    u = _mm256_xor_si256(Rotl(u, 2), v);
+    v = _mm256_xor_si256(Rotl(v, 14), u);
+    u = _mm256_xor_si256(Rotl(u, 10), v);
+    v = Rotl(v, 1);
+}
+
+/** Message injection MI5 followed by the step functions of all five sub-states. */
+void LuffaRound(__m256i v[8], const uint32_t msg[8])
+{
+    // Slot j <- slot j+1 (mod 5) and slot j <- slot j-1 (mod 5); slots 5-7 map to themselves.
+    const __m256i next = _mm256_setr_epi32(1, 2, 3, 4, 0, 5, 6, 7);
+    const __m256i prev = _mm256_setr_epi32(4, 0, 1, 2, 3, 5, 6, 7);
+
+    // a = M2(V0 ^ V1 ^ V2 ^ V3 ^ V4), added to every sub-state.
+    __m256i a[8];
+    for (int k = 0; k < 8; k++) {
+        __m256i t = _mm256_permutevar8x32_epi32(v[k], next);
+        __m256i s = _mm256_xor_si256(v[k], t);
+        t = _mm256_permutevar8x32_epi32(t, next);
+        s = _mm256_xor_si256(s, t);
+        t = _mm256_permutevar8x32_epi32(t, next);
+        s = _mm256_xor_si256(s, t);
+        t = _mm256_permutevar8x32_epi32(t, next);
+        a[k] = _mm256_xor_si256(s, t);
+    }
+    LuffaMul2(a);
+    for (int k = 0; k < 8; k++) {
+        v[k] = _mm256_xor_si256(v[k], a[k]);
+    }
+
+    // Vj = M2(Vj) ^ V(j+1), then Vj = M2(Vj) ^ V(j-1); both passes are simultaneous in j.
+    __m256i w[8];
+    for (int k = 0; k < 8; k++) {
+        w[k] = _mm256_permutevar8x32_epi32(v[k], next);
+    }
+    LuffaMul2(v);
+    for (int k = 0; k < 8; k++) {
+        v[k] = _mm256_xor_si256(v[k], w[k]);
+        w[k] = _mm256_permutevar8x32_epi32(v[k], prev);
+    }
+    LuffaMul2(v);
+    for (int k = 0; k < 8; k++) {
+        v[k] = _mm256_xor_si256(v[k], w[k]);
+    }
+
+    // Vj ^= M2^j(M); all-zero blocks (the blank rounds of the finalization) skip this.
+    if (msg) {
+        uint32_t m[5][8];
+        memcpy(m[0], msg, 32);
+        for (int j = 1; j < 5; j++) {
+            memcpy(m[j], m[j - 1], 32);
+            LuffaMul2(m[j]);
+        }
+        for (int k = 0; k < 8; k++) {
+            v[k] = _mm256_xor_si256(v[k], _mm256_setr_epi32(m[0][k], m[1][k], m[2][k], m[3][k], m[4][k], 0, 0, 0));
+        }
+    }
+
+    // Tweak: words 4-7 of sub-state j are rotated left by j.
+    const __m256i tweak = _mm256_setr_epi32(0, 1, 2, 3, 4, 0, 0, 0);
+    const __m256i untweak = _mm256_sub_epi32(_mm256_set1_epi32(32), tweak);
+    for (int k = 4; k < 8; k++) {
+        v[k] = _mm256_or_si256(_mm256_sllv_epi32(v[k], tweak), _mm256_srlv_epi32(v[k], untweak));
+    }
+
+    for (int r = 0; r < 8; r++) {
+        LuffaSubCrumb(v[0], v[1], v[2], v[3]);
+        LuffaSubCrumb(v[5], v[6], v[7], v[4]);
+        LuffaMixWord(v[0], v[4]);
+        LuffaMixWord(v[1], v[5]);
+        LuffaMixWord(v[2], v[6]);
+        LuffaMixWord(v[3], v[7]);
+        v[0] = _mm256_xor_si256(v[0], _mm256_loadu_si256((const __m256i*)LUFFA_RC0[r]));
+        v[4] = _mm256_xor_si256(v[4], _mm256_loadu_si256((const __m256i*)LUFFA_RC4[r]));
+    }
+}
+
+inline uint32_t ReadBE32(const unsigned char* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]; }
+
+inline void WriteBE32(unsigned char* p, uint32_t x)
+{
+    p[0] = x >> 24;
+    p[1] = x >> 16;
+    p[2] = x >> 8;
+    p[3] = x;
+}
+
+/** Emit one 256-bit half of the digest: the xor of all five sub-states. */
+void LuffaOutput(const __m256i v[8], unsigned char* out)
+{
+    uint32_t words[8] __attribute__((aligned(32)));
+    for (int k = 0; k < 8; k++) {
+        _mm256_store_si256((__m256i*)words, v[k]);
+        WriteBE32(out + 4 * k, words[0] ^ words[1] ^ words[2] ^ words[3] ^ words[4]);
+    }
+}
+
+} // namespace
+
+void CubeHash512(unsigned char out[64], const unsigned char in[64])
+{
+    __m256i x0 = _mm256_loadu_si256((const __m256i*)(CUBEHASH_IV512 + 0));
+    __m256i x1 = _mm256_loadu_si256((const __m256i*)(CUBEHASH_IV512 + 8));
+    __m256i x2 = _mm256_loadu_si256((const __m256i*)(CUBEHASH_IV512 + 16));
+    __m256i x3 = _mm256_loadu_si256((const __m256i*)(CUBEHASH_IV512 + 24));
+
+    x0 = _mm256_xor_si256(x0, _mm256_loadu_si256((const __m256i*)(in + 0)));
+    CubeHashRounds(x0, x1, x2, x3, 16);
+    x0 = _mm256_xor_si256(x0, _mm256_loadu_si256((const __m256i*)(in + 32)));
+    CubeHashRounds(x0, x1, x2, x3, 16);
+    // Padding block: a single 0x80 byte, then ten final blocks of rounds.
+    x0 = _mm256_xor_si256(x0, _mm256_setr_epi32(0x80, 0, 0, 0, 0, 0, 0, 0));
+    CubeHashRounds(x0, x1, x2, x3, 16);
+    x3 = _mm256_xor_si256(x3, _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 0, 1));
+    CubeHashRounds(x0, x1, x2, x3, 160);
+
+    _mm256_storeu_si256((__m256i*)(out + 0), x0);
+    _mm256_storeu_si256((__m256i*)(out + 32), x1);
+}
+
+void Luffa512(unsigned char out[64], const unsigned char in[64])
+{
+    __m256i v[8];
+    for (int k = 0; k < 8; k++) {
+        v[k] = _mm256_setr_epi32(LUFFA_V_INIT[0][k], LUFFA_V_INIT[1][k], LUFFA_V_INIT[2][k], LUFFA_V_INIT[3][k], LUFFA_V_INIT[4][k], 0, 0, 0);
+    }
+
+    uint32_t msg[8];
+    for (int block = 0; block < 2; block++) {
+        for (int k = 0; k < 8; k++) {
+            msg[k] = ReadBE32(in + 32 * block + 4 * k);
+        }
+        LuffaRound(v, msg);
+    }
+    // Padding block, then two blank rounds each producing half of the digest.
+    memset(msg, 0, sizeof(msg));
+    msg[0] = 0x80000000;
+    LuffaRound(v, msg);
+    LuffaRound(v, nullptr);
+    LuffaOutput(v, out);
+    LuffaRound(v, nullptr);
+    LuffaOutput(v, out + 32);
+}
+
+} // namespace x11_avx2
+
+#endif // ENABLE_AVX2
@@ -0,0 +1,606 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Four-lane AVX2 implementations of the 64-bit X11 stages: blake512 (on
+// 80-byte block headers), bmw512, skein512, jh512 and keccak512. Lane i of
+// every register holds the same state word of message i, so four
+// independent hashes advance per instruction. Inputs and outputs are stored
+// back to back, one message per 64 (or 80) bytes.
+// This file is built with -mavx2 and only called after CPUID says so.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+namespace x11_avx2 {
+namespace {
+
+inline __m256i Add(__m256i a, __m256i b) { return _mm256_add_epi64(a, b); }
+inline __m256i Sub(__m256i a, __m256i b) { return _mm256_sub_epi64(a, b); }
+inline __m256i Xor(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+inline __m256i Shl(__m256i x, int n) { return _mm256_slli_epi64(x, n); }
+inline __m256i Shr(__m256i x, int n) { return _mm256_srli_epi64(x, n); }
+inline __m256i Rotl(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+inline __m256i Rotr(__m256i x, int n) { return Rotl(x, 64 - n); }
+inline __m256i Const(uint64_t c) { return _mm256_set1_epi64x(c); }
+
+/** 64-bit word w of each of the four messages, which are stride bytes apart. */
+inline __m256i Load(const unsigned char* in, size_t stride, int w)
+{
+    uint64_t v[4];
+    for (int i = 0; i < 4; i++) {
+        memcpy(&v[i], in + i * stride + 8 * w, 8);
+    }
+    return _mm256_setr_epi64x(v[0], v[1], v[2], v[3]);
+}
+
+inline void Store(unsigned char* out, int w, __m256i x)
+{
+    alignas(32) uint64_t v[4];
+    _mm256_store_si256((__m256i*)v, x);
+    for (int i = 0; i < 4; i++) {
+        memcpy(out + i * 64 + 8 * w, &v[i], 8);
+    }
+}
+
+/** Byte swap within each 64-bit lane. */
+inline __m256i Bswap(__m256i x)
+{
+    const __m256i mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                          7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+/* ----------- BLAKE-512 --------------------------------------------------- */
+
+const uint64_t BLAKE_IV512[8] = {
+    0x6A09E667F3BCC908, 0xBB67AE8584CAA73B, 0x3C6EF372FE94F82B, 0xA54FF53A5F1D36F1,
+    0x510E527FADE682D1, 0x9B05688C2B3E6C1F, 0x1F83D9ABFB41BD6B, 0x5BE0CD19137E2179
+};
+
+const uint64_t BLAKE_CB[16] = {
+    0x243F6A8885A308D3, 0x13198A2E03707344, 0xA4093822299F31D0, 0x082EFA98EC4E6C89,
+    0x452821E638D01377, 0xBE5466CF34E90C6C, 0xC0AC29B7C97C50DD, 0x3F84D5B5B5470917,
+    0x9216D5D98979FB1B, 0xD1310BA698DFB5AC, 0x2FFD72DBD01ADFB7, 0xB8E1AFED6A267E96,
+    0xBA7C9045F12C7F99, 0x24A19947B3916CF7, 0x0801F2E2858EFC16, 0x636920D871574E69
+};
+
+const uint8_t BLAKE_SIGMA[10][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3 },
+    { 11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4 },
+    { 7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8 },
+    { 9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13 },
+    { 2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9 },
+    { 12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11 },
+    { 13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10 },
+    { 6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5 },
+    { 10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0 }
+};
+
+inline void BlakeG(const __m256i m[16], const uint8_t* s, int i, __m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    a = Add(Add(a, b), Xor(m[s[2 * i]], Const(BLAKE_CB[s[2 * i + 1]])));
+    d = Rotr(Xor(d, a), 32);
+    c = Add(c, d);
+    b = Rotr(Xor(b, c), 25);
+    a = Add(Add(a, b), Xor(m[s[2 * i + 1]], Const(BLAKE_CB[s[2 * i]])));
+    d = Rotr(Xor(d, a), 16);
+    c = Add(c, d);
+    b = Rotr(Xor(b, c), 11);
+}
+
+inline void BlakeColumns(const __m256i m[16], const uint8_t* s, __m256i v[16])
+{
+    BlakeG(m, s, 0, v[0], v[4], v[8], v[12]);
+    BlakeG(m, s, 1, v[1], v[5], v[9], v[13]);
+    BlakeG(m, s, 2, v[2], v[6], v[10], v[14]);
+    BlakeG(m, s, 3, v[3], v[7], v[11], v[15]);
+}
+
+inline void BlakeDiagonals(const __m256i m[16], const uint8_t* s, __m256i v[16])
+{
+    BlakeG(m, s, 4, v[0], v[5], v[10], v[15]);
+    BlakeG(m, s, 5, v[1], v[6], v[11], v[12]);
+    BlakeG(m, s, 6, v[2], v[7], v[8], v[13]);
+    BlakeG(m, s, 7, v[3], v[4], v[9], v[14]);
+}
+
+/** The rest of the 16 rounds after the first round's column step, and the output. */
+inline void BlakeFinish(unsigned char out[256], const __m256i m[16], __m256i v[16])
+{
+    BlakeDiagonals(m, BLAKE_SIGMA[0], v);
+    for (int r = 1; r < 16; r++) {
+        BlakeColumns(m, BLAKE_SIGMA[r % 10], v);
+        BlakeDiagonals(m, BLAKE_SIGMA[r % 10], v);
+    }
+    for (int i = 0; i < 8; i++) {
+        Store(out, i, Bswap(Xor(Const(BLAKE_IV512[i]), Xor(v[i], v[i + 8]))));
+    }
+}
+
+/* ----------- BMW-512 ----------------------------------------------------- */
+
+inline __m256i BmwS0(__m256i x) { return Xor(Xor(Shr(x, 1), Shl(x, 3)), Xor(Rotl(x, 4), Rotl(x, 37))); }
+inline __m256i BmwS1(__m256i x) { return Xor(Xor(Shr(x, 1), Shl(x, 2)), Xor(Rotl(x, 13), Rotl(x, 43))); }
+inline __m256i BmwS2(__m256i x) { return Xor(Xor(Shr(x, 2), Shl(x, 1)), Xor(Rotl(x, 19), Rotl(x, 53))); }
+inline __m256i BmwS3(__m256i x) { return Xor(Xor(Shr(x, 2), Shl(x, 2)), Xor(Rotl(x, 28), Rotl(x, 59))); }
+inline __m256i BmwS4(__m256i x) { return Xor(Shr(x, 1), x); }
+inline __m256i BmwS5(__m256i x) { return Xor(Shr(x, 2), x); }
+
+inline __m256i BmwS(int i, __m256i x)
+{
+    switch (i % 5) {
+    case 0: return BmwS0(x);
+    case 1: return BmwS1(x);
+    case 2: return BmwS2(x);
+    case 3: return BmwS3(x);
+    default: return BmwS4(x);
+    }
+}
+
+/** AddElement(j) of the BMW specification. */
+inline __m256i BmwAddElement(const __m256i m[16], const __m256i h[16], int j)
+{
+    const int a = (j - 16) & 15, b = (j - 13) & 15, c = (j - 6) & 15;
+    __m256i k = Const((uint64_t)j * 0x0555555555555555ULL);
+    return Xor(Sub(Add(Add(Rotl(m[a], a + 1), Rotl(m[b], b + 1)), k), Rotl(m[c], c + 1)), h[(j - 9) & 15]);
+}
+
+/** The BMW-512 compression function: h = f(h, m). */
+void BmwCompress(__m256i h[16], const __m256i m[16])
+{
+    __m256i x[16], w[16], q[32];
+    for (int i = 0; i < 16; i++) {
+        x[i] = Xor(m[i], h[i]);
+    }
+    w[0] = Add(Add(Add(Sub(x[5], x[7]), x[10]), x[13]), x[14]);
+    w[1] = Sub(Add(Add(Sub(x[6], x[8]), x[11]), x[14]), x[15]);
+    w[2] = Add(Sub(Add(Add(x[0], x[7]), x[9]), x[12]), x[15]);
+    w[3] = Add(Sub(Add(Sub(x[0], x[1]), x[8]), x[10]), x[13]);
+    w[4] = Sub(Sub(Add(Add(x[1], x[2]), x[9]), x[11]), x[14]);
+    w[5] = Add(Sub(Add(Sub(x[3], x[2]), x[10]), x[12]), x[15]);
+    w[6] = Add(Sub(Sub(Sub(x[4], x[0]), x[3]), x[11]), x[13]);
+    w[7] = Sub(Sub(Sub(Sub(x[1], x[4]), x[5]), x[12]), x[14]);
+    w[8] = Sub(Add(Sub(Sub(x[2], x[5]), x[6]), x[13]), x[15]);
+    w[9] = Add(Sub(Add(Sub(x[0], x[3]), x[6]), x[7]), x[14]);
+    w[10] = Add(Sub(Sub(Sub(x[8], x[1]), x[4]), x[7]), x[15]);
+    w[11] = Add(Sub(Sub(Sub(x[8], x[0]), x[2]), x[5]), x[9]);
+    w[12] = Add(Sub(Sub(Add(x[1], x[3]), x[6]), x[9]), x[10]);
+    w[13] = Add(Add(Add(Add(x[2], x[4]), x[7]), x[10]), x[11]);
+    w[14] = Sub(Sub(Add(Sub(x[3], x[5]), x[8]), x[11]), x[12]);
+    w[15] = Add(Sub(Sub(Sub(x[12], x[4]), x[6]), x[9]), x[13]);
+    for (int i = 0; i < 16; i++) {
+        q[i] = Add(BmwS(i, w[i]), h[(i + 1) & 15]);
+    }
+
+    for (int j = 16; j < 18; j++) {
+        __m256i t = BmwAddElement(m, h, j);
+        for (int i = 0; i < 16; i += 4) {
+            t = Add(t, Add(Add(BmwS1(q[j - 16 + i]), BmwS2(q[j - 15 + i])), Add(BmwS3(q[j - 14 + i]), BmwS0(q[j - 13 + i]))));
+        }
+        q[j] = t;
+    }
+    for (int j = 18; j < 32; j++) {
+        __m256i t = Add(BmwAddElement(m, h, j), Add(BmwS4(q[j - 2]), BmwS5(q[j - 1])));
+        t = Add(t, Add(Add(q[j - 16], q[j - 14]), Add(q[j - 12], q[j - 10])));
+        t = Add(t, Add(Add(q[j - 8], q[j - 6]), q[j - 4]));
+        t = Add(t, Add(Add(Rotl(q[j - 15], 5), Rotl(q[j - 13], 11)), Add(Rotl(q[j - 11], 27), Rotl(q[j - 9], 32))));
+        t = Add(t, Add(Add(Rotl(q[j - 7], 37), Rotl(q[j - 5], 43)), Rotl(q[j - 3], 53)));
+        q[j] = t;
+    }
+
+    __m256i xl = Xor(Xor(Xor(q[16], q[17]), Xor(q[18], q[19])), Xor(Xor(q[20], q[21]), Xor(q[22], q[23])));
+    __m256i xh = Xor(xl, Xor(Xor(Xor(q[24], q[25]), Xor(q[26], q[27])), Xor(Xor(q[28], q[29]), Xor(q[30], q[31]))));
+    h[0] = Add(Xor(Xor(Shl(xh, 5), Shr(q[16], 5)), m[0]), Xor(Xor(xl, q[24]), q[0]));
+    h[1] = Add(Xor(Xor(Shr(xh, 7), Shl(q[17], 8)), m[1]), Xor(Xor(xl, q[25]), q[1]));
+    h[2] = Add(Xor(Xor(Shr(xh, 5), Shl(q[18], 5)), m[2]), Xor(Xor(xl, q[26]), q[2]));
+    h[3] = Add(Xor(Xor(Shr(xh, 1), Shl(q[19], 5)), m[3]), Xor(Xor(xl, q[27]), q[3]));
+    h[4] = Add(Xor(Xor(Shr(xh, 3), q[20]), m[4]), Xor(Xor(xl, q[28]), q[4]));
+    h[5] = Add(Xor(Xor(Shl(xh, 6), Shr(q[21], 6)), m[5]), Xor(Xor(xl, q[29]), q[5]));
+    h[6] = Add(Xor(Xor(Shr(xh, 4), Shl(q[22], 6)), m[6]), Xor(Xor(xl, q[30]), q[6]));
+    h[7] = Add(Xor(Xor(Shr(xh, 11), Shl(q[23], 2)), m[7]), Xor(Xor(xl, q[31]), q[7]));
+    h[8] = Add(Add(Rotl(h[4], 9), Xor(Xor(xh, q[24]), m[8])), Xor(Xor(Shl(xl, 8), q[23]), q[8]));
+    h[9] = Add(Add(Rotl(h[5], 10), Xor(Xor(xh, q[25]), m[9])), Xor(Xor(Shr(xl, 6), q[16]), q[9]));
+    h[10] = Add(Add(Rotl(h[6], 11), Xor(Xor(xh, q[26]), m[10])), Xor(Xor(Shl(xl, 6), q[17]), q[10]));
+    h[11] = Add(Add(Rotl(h[7], 12), Xor(Xor(xh, q[27]), m[11])), Xor(Xor(Shl(xl, 4), q[18]), q[11]));
+    h[12] = Add(Add(Rotl(h[0], 13), Xor(Xor(xh, q[28]), m[12])), Xor(Xor(Shr(xl, 3), q[19]), q[12]));
+    h[13] = Add(Add(Rotl(h[1], 14), Xor(Xor(xh, q[29]), m[13])), Xor(Xor(Shr(xl, 4), q[20]), q[13]));
+    h[14] = Add(Add(Rotl(h[2], 15), Xor(Xor(xh, q[30]), m[14])), Xor(Xor(Shr(xl, 7), q[21]), q[14]));
+    h[15] = Add(Add(Rotl(h[3], 16), Xor(Xor(xh, q[31]), m[15])), Xor(Xor(Shr(xl, 2), q[22]), q[15]));
+}
+
+/* ----------- Skein-512 --------------------------------------------------- */
+
+const uint64_t SKEIN_IV512[8] = {
+    0x4903ADFF749C51CE, 0x0D95DE399746DF03, 0x8FD1934127C79BCE, 0x9A255629FF352CB1,
+    0x5DB62599DF6CA7B0, 0xEABE394CA9D5C3F4, 0x991112C71A75B523, 0xAE18A40B660FCC33
+};
+
+inline void SkeinMix(__m256i& a, __m256i& b, int r)
+{
+    a = Add(a, b);
+    b = Xor(Rotl(b, r), a);
+}
+
+/** Key injection s: x += subkey s derived from the key words k and tweak t. */
+inline void SkeinInject(__m256i x[8], const __m256i k[9], const uint64_t t[3], int s)
+{
+    for (int i = 0; i < 8; i++) {
+        x[i] = Add(x[i], k[(s + i) % 9]);
+    }
+    x[5] = Add(x[5], Const(t[s % 3]));
+    x[6] = Add(x[6], Const(t[(s + 1) % 3]));
+    x[7] = Add(x[7], Const(s));
+}
+
+/** Eight Threefish-512 rounds (two key schedule steps), starting at subkey s. */
+inline void SkeinRounds8(__m256i x[8], const __m256i k[9], const uint64_t t[3], int s)
+{
+    SkeinInject(x, k, t, s);
+    SkeinMix(x[0], x[1], 46); SkeinMix(x[2], x[3], 36); SkeinMix(x[4], x[5], 19); SkeinMix(x[6], x[7], 37);
+    SkeinMix(x[2], x[1], 33); SkeinMix(x[4], x[7], 27); SkeinMix(x[6], x[5], 14); SkeinMix(x[0], x[3], 42);
+    SkeinMix(x[4], x[1], 17); SkeinMix(x[6], x[3], 49); SkeinMix(x[0], x[5], 36); SkeinMix(x[2], x[7], 39);
+    SkeinMix(x[6], x[1], 44); SkeinMix(x[0], x[7], 9); SkeinMix(x[2], x[5], 54); SkeinMix(x[4], x[3], 56);
+    SkeinInject(x, k, t, s + 1);
+    SkeinMix(x[0], x[1], 39); SkeinMix(x[2], x[3], 30); SkeinMix(x[4], x[5], 34); SkeinMix(x[6], x[7], 24);
+    SkeinMix(x[2], x[1], 13); SkeinMix(x[4], x[7], 50); SkeinMix(x[6], x[5], 10); SkeinMix(x[0], x[3], 17);
+    SkeinMix(x[4], x[1], 25); SkeinMix(x[6], x[3], 29); SkeinMix(x[0], x[5], 39); SkeinMix(x[2], x[7], 43);
+    SkeinMix(x[6], x[1], 8); SkeinMix(x[0], x[7], 35); SkeinMix(x[2], x[5], 56); SkeinMix(x[4], x[3], 22);
+}
+
+/** One UBI call: h = Threefish-512(key h, tweak t0/t1, m) ^ m. */
+void SkeinUbi(__m256i h[8], const __m256i m[8], uint64_t t0, uint64_t t1)
+{
+    __m256i k[9], x[8];
+    k[8] = Const(0x1BD11BDAA9FC1A22);
+    for (int i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+        x[i] = m[i];
+    }
+    const uint64_t t[3] = { t0, t1, t0 ^ t1 };
+    for (int s = 0; s < 18; s += 2) {
+        SkeinRounds8(x, k, t, s);
+    }
+    SkeinInject(x, k, t, 18);
+    for (int i = 0; i < 8; i++) {
+        h[i] = Xor(x[i], m[i]);
+    }
+}
+
+/* ----------- JH-512 ------------------------------------------------------ */
+
+// Bitsliced state words h0h, h0l, ..., h7h, h7l with the little-endian
+// constants of sph_jh, so message words are plain little-endian loads.
+const uint64_t JH_IV512[16] = {
+    0x17aa003e964bd16f, 0x43d5157a052e6a63, 0x0bef970c8d5e228a, 0x61c3b3f2591234e9,
+    0x1e806f53c1a01d89, 0x806d2bea6b05a92a, 0xa6ba7520dbcc8e58, 0xf73bf8ba763a0fa9,
+    0x694ae34105e66901, 0x5ae66f2e8e8ab546, 0x243c84c1d0a74710, 0x99c15a2db1716e3b,
+    0x56f8b19decf657cf, 0x56b116577c8806a7, 0xfb1785e6dffcc2e3, 0x4bdd8ccc78465a54
+};
+
+const uint64_t JH_C[168] = {
+    0x67f815dfa2ded572, 0x571523b70a15847b, 0xf6875a4d90d6ab81, 0x402bd1c3c54f9f4e,
+    0x9cfa455ce03a98ea, 0x9a99b26699d2c503, 0x8a53bbf2b4960266, 0x31a2db881a1456b5,
+    0xdb0e199a5c5aa303, 0x1044c1870ab23f40, 0x1d959e848019051c, 0xdccde75eadeb336f,
+    0x416bbf029213ba10, 0xd027bbf7156578dc, 0x5078aa3739812c0a, 0xd3910041d2bf1a3f,
+    0x907eccf60d5a2d42, 0xce97c0929c9f62dd, 0xac442bc70ba75c18, 0x23fcc663d665dfd1,
+    0x1ab8e09e036c6e97, 0xa8ec6c447e450521, 0xfa618e5dbb03f1ee, 0x97818394b29796fd,
+    0x2f3003db37858e4a, 0x956a9ffb2d8d672a, 0x6c69b8f88173fe8a, 0x14427fc04672c78a,
+    0xc45ec7bd8f15f4c5, 0x80bb118fa76f4475, 0xbc88e4aeb775de52, 0xf4a3a6981e00b882,
+    0x1563a3a9338ff48e, 0x89f9b7d524565faa, 0xfde05a7c20edf1b6, 0x362c42065ae9ca36,
+    0x3d98fe4e433529ce, 0xa74b9a7374f93a53, 0x86814e6f591ff5d0, 0x9f5ad8af81ad9d0e,
+    0x6a6234ee670605a7, 0x2717b96ebe280b8b, 0x3f1080c626077447, 0x7b487ec66f7ea0e0,
+    0xc0a4f84aa50a550d, 0x9ef18e979fe7e391, 0xd48d605081727686, 0x62b0e5f3415a9e7e,
+    0x7a205440ec1f9ffc, 0x84c9f4ce001ae4e3, 0xd895fa9df594d74f, 0xa554c324117e2e55,
+    0x286efebd2872df5b, 0xb2c4a50fe27ff578, 0x2ed349eeef7c8905, 0x7f5928eb85937e44,
+    0x4a3124b337695f70, 0x65e4d61df128865e, 0xe720b95104771bc7, 0x8a87d423e843fe74,
+    0xf2947692a3e8297d, 0xc1d9309b097acbdd, 0xe01bdc5bfb301b1d, 0xbf829cf24f4924da,
+    0xffbf70b431bae7a4, 0x48bcf8de0544320d, 0x39d3bb5332fcae3b, 0xa08b29e0c1c39f45,
+    0x0f09aef7fd05c9e5, 0x34f1904212347094, 0x95ed44e301b771a2, 0x4a982f4f368e3be9,
+    0x15f66ca0631d4088, 0xffaf52874b44c147, 0x30c60ae2f14abb7e, 0xe68c6eccc5b67046,
+    0x00ca4fbd56a4d5a4, 0xae183ec84b849dda, 0xadd1643045ce5773, 0x67255c1468cea6e8,
+    0x16e10ecbf28cdaa3, 0x9a99949a5806e933, 0x7b846fc220b2601f, 0x1885d1a07facced1,
+    0xd319dd8da15b5932, 0x46b4a5aac01c9a50, 0xba6b04e467633d9f, 0x7eee560bab19caf6,
+    0x742128a9ea79b11f, 0xee51363b35f7bde9, 0x76d350755aac571d, 0x01707da3fec2463a,
+    0x42d8a498afc135f7, 0x79676b9e20eced78, 0xa8db3aea15638341, 0x832c83324d3bc3fa,
+    0xf347271c1f3b40a7, 0x9a762db734f04059, 0xfd4f21d26c4e3ee7, 0xef5957dc398dfdb8,
+    0xdaeb492b490c9b8d, 0x0d70f36849d7a25b, 0x84558d7ad0ae3b7d, 0x658ef8e4f0e9a5f5,
+    0x533b1036f4a2b8a0, 0x5aec3e759e07a80c, 0x4f88e85692946891, 0x4cbcbaf8555cb05b,
+    0x7b9487f3993bbbe3, 0x5d1c6b72d6f4da75, 0x6db334dc28acae64, 0x71db28b850a5346c,
+    0x2a518d10f2e261f8, 0xfc75dd593364dbe3, 0xa23fce43f1bcac1c, 0xb043e8023cd1bb67,
+    0x75a12988ca5b0a33, 0x5c5316b44d19347f, 0x1e4d790ec3943b92, 0x3fafeeb6d7757479,
+    0x21391abef7d4a8ea, 0x5127234c097ef45c, 0xd23c32ba5324a326, 0xadd5a66d4a17a344,
+    0x08c9f2afa63e1db5, 0x563c6b91983d5983, 0x4d608672a17cf84c, 0xf6c76e08cc3ee246,
+    0x5e76bcb1b333982f, 0x2ae6c4efa566d62b, 0x36d4c1bee8b6f406, 0x6321efbc1582ee74,
+    0x69c953f40d4ec1fd, 0x26585806c45a7da7, 0x16fae0061614c17e, 0x3f9d63283daf907e,
+    0x0cd29b00e3f2c9d2, 0x300cd4b730ceaa5f, 0x9832e0f216512a74, 0x9af8cee3d830eb0d,
+    0x9279f1b57b9ec54b, 0xd36886046ee651ff, 0x316796e6574d239b, 0x05750a17f3a6e6cc,
+    0xce6c3213d98176b1, 0x62a205f88452173c, 0x47154778b3cb2bf4, 0x486a9323825446ff,
+    0x65655e4e0758df38, 0x8e5086fc897cfcf2, 0x86ca0bd0442e7031, 0x4e477830a20940f0,
+    0x8338f7d139eea065, 0xbd3a2ce437e95ef7, 0x6ff8130126b29721, 0xe7de9fefd1ed44a3,
+    0xd992257615dfa08b, 0xbe42dc12f6f7853c, 0x7eb027ab7ceca7d8, 0xdea83eaada7d8d53,
+    0xd86902bd93ce25aa, 0xf908731afd43f65a, 0xa5194a17daef5fc0, 0x6a21fd4c33664d97,
+    0x701541db3198b435, 0x9b54cdedbb0f1eea, 0x72409751a163d09a, 0xe26f4791bf9d75f6
+};
+
+inline void JhSb(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, __m256i c)
+{
+    x3 = Xor(x3, Const(~(uint64_t)0));
+    x0 = Xor(x0, _mm256_andnot_si256(x2, c));
+    __m256i tmp = Xor(c, _mm256_and_si256(x0, x1));
+    x0 = Xor(x0, _mm256_and_si256(x2, x3));
+    x3 = Xor(x3, _mm256_andnot_si256(x1, x2));
+    x1 = Xor(x1, _mm256_and_si256(x0, x2));
+    x2 = Xor(x2, _mm256_andnot_si256(x3, x0));
+    x0 = Xor(x0, _mm256_or_si256(x1, x3));
+    x3 = Xor(x3, _mm256_and_si256(x1, x2));
+    x1 = Xor(x1, _mm256_and_si256(tmp, x0));
+    x2 = Xor(x2, tmp);
+}
+
+inline void JhLb(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, __m256i& x4, __m256i& x5, __m256i& x6, __m256i& x7)
+{
+    x4 = Xor(x4, x1);
+    x5 = Xor(x5, x2);
+    x6 = Xor(x6, Xor(x3, x0));
+    x7 = Xor(x7, x0);
+    x0 = Xor(x0, x5);
+    x1 = Xor(x1, x6);
+    x2 = Xor(x2, Xor(x7, x4));
+    x3 = Xor(x3, x4);
+}
+
+/** Swap adjacent groups of n bits selected by mask c. */
+inline __m256i JhSwap(__m256i x, uint64_t c, int n)
+{
+    const __m256i m = Const(c);
+    return _mm256_or_si256(Shl(_mm256_and_si256(x, m), n), _mm256_and_si256(Shr(x, n), m));
+}
+
+/** The E8 permutation over h[2 * i] (high) and h[2 * i + 1] (low) halves of word i. */
+void JhE8(__m256i h[16])
+{
+    static const uint64_t masks[6] = {
+        0x5555555555555555, 0x3333333333333333, 0x0F0F0F0F0F0F0F0F,
+        0x00FF00FF00FF00FF, 0x0000FFFF0000FFFF, 0x00000000FFFFFFFF
+    };
+    for (int r = 0; r < 42; r++) {
+        for (int half = 0; half < 2; half++) {
+            JhSb(h[0 + half], h[4 + half], h[8 + half], h[12 + half], Const(JH_C[4 * r + half]));
+            JhSb(h[2 + half], h[6 + half], h[10 + half], h[14 + half], Const(JH_C[4 * r + 2 + half]));
+            JhLb(h[0 + half], h[4 + half], h[8 + half], h[12 + half], h[2 + half], h[6 + half], h[10 + half], h[14 + half]);
+        }
+        const int ro = r % 7;
+        for (int i = 2; i < 16; i += 4) {
+            if (ro < 6) {
+                h[i] = JhSwap(h[i], masks[ro], 1 << ro);
+                h[i + 1] = JhSwap(h[i + 1], masks[ro], 1 << ro);
+            } else {
+                __m256i t = h[i];
+                h[i] = h[i + 1];
+                h[i + 1] = t;
+            }
+        }
+    }
+}
+
+void JhBlock(__m256i h[16], const __m256i m[8])
+{
+    for (int i = 0; i < 8; i++) {
+        h[i] = Xor(h[i], m[i]);
+    }
+    JhE8(h);
+    for (int i = 0; i < 8; i++) {
+        h[i + 8] = Xor(h[i + 8], m[i]);
+    }
+}
+
+/* ----------- Keccak-512 -------------------------------------------------- */
+
+const uint64_t KECCAK_RC[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808A, 0x8000000080008000,
+    0x000000000000808B, 0x0000000080000001, 0x8000000080008081, 0x8000000000008009,
+    0x000000000000008A, 0x0000000000000088, 0x0000000080008009, 0x000000008000000A,
+    0x000000008000808B, 0x800000000000008B, 0x8000000000008089, 0x8000000000008003,
+    0x8000000000008002, 0x8000000000000080, 0x000000000000800A, 0x800000008000000A,
+    0x8000000080008081, 0x8000000000008080, 0x0000000080000001, 0x8000000080008008
+};
+
+inline __m256i Xor5(__m256i a, __m256i b, __m256i c, __m256i d, __m256i e)
+{
+    return Xor(Xor(Xor(a, b), Xor(c, d)), e);
+}
+
+/** Chi on one row of five lanes. */
+inline void KeccakChi(__m256i a[5], const __m256i b[5])
+{
+    a[0] = Xor(b[0], _mm256_andnot_si256(b[1], b[2]));
+    a[1] = Xor(b[1], _mm256_andnot_si256(b[2], b[3]));
+    a[2] = Xor(b[2], _mm256_andnot_si256(b[3], b[4]));
+    a[3] = Xor(b[3], _mm256_andnot_si256(b[4], b[0]));
+    a[4] = Xor(b[4], _mm256_andnot_si256(b[0], b[1]));
+}
+
+void KeccakF(__m256i a[25])
+{
+    __m256i b[25], c[5], d[5];
+    for (int r = 0; r < 24; r++) {
+        c[0] = Xor5(a[0], a[5], a[10], a[15], a[20]);
+        c[1] = Xor5(a[1], a[6], a[11], a[16], a[21]);
+        c[2] = Xor5(a[2], a[7], a[12], a[17], a[22]);
+        c[3] = Xor5(a[3], a[8], a[13], a[18], a[23]);
+        c[4] = Xor5(a[4], a[9], a[14], a[19], a[24]);
+        d[0] = Xor(c[4], Rotl(c[1], 1));
+        d[1] = Xor(c[0], Rotl(c[2], 1));
+        d[2] = Xor(c[1], Rotl(c[3], 1));
+        d[3] = Xor(c[2], Rotl(c[4], 1));
+        d[4] = Xor(c[3], Rotl(c[0], 1));
+        // Rho and pi: b[y + 5 * ((2x + 3y) % 5)] = rotl(a[x + 5y] ^ d[x], r[x][y]),
+        // written out so that every rotation count is an immediate.
+        b[0] = Xor(a[0], d[0]);
+        b[10] = Rotl(Xor(a[1], d[1]), 1);
+        b[20] = Rotl(Xor(a[2], d[2]), 62);
+        b[5] = Rotl(Xor(a[3], d[3]), 28);
+        b[15] = Rotl(Xor(a[4], d[4]), 27);
+        b[16] = Rotl(Xor(a[5], d[0]), 36);
+        b[1] = Rotl(Xor(a[6], d[1]), 44);
+        b[11] = Rotl(Xor(a[7], d[2]), 6);
+        b[21] = Rotl(Xor(a[8], d[3]), 55);
+        b[6] = Rotl(Xor(a[9], d[4]), 20);
+        b[7] = Rotl(Xor(a[10], d[0]), 3);
+        b[17] = Rotl(Xor(a[11], d[1]), 10);
+        b[2] = Rotl(Xor(a[12], d[2]), 43);
+        b[12] = Rotl(Xor(a[13], d[3]), 25);
+        b[22] = Rotl(Xor(a[14], d[4]), 39);
+        b[23] = Rotl(Xor(a[15], d[0]), 41);
+        b[8] = Rotl(Xor(a[16], d[1]), 45);
+        b[18] = Rotl(Xor(a[17], d[2]), 15);
+        b[3] = Rotl(Xor(a[18], d[3]), 21);
+        b[13] = Rotl(Xor(a[19], d[4]), 8);
+        b[14] = Rotl(Xor(a[20], d[0]), 18);
+        b[24] = Rotl(Xor(a[21], d[1]), 2);
+        b[9] = Rotl(Xor(a[22], d[2]), 61);
+        b[19] = Rotl(Xor(a[23], d[3]), 56);
+        b[4] = Rotl(Xor(a[24], d[4]), 14);
+        KeccakChi(a + 0, b + 0);
+        KeccakChi(a + 5, b + 5);
+        KeccakChi(a + 10, b + 10);
+        KeccakChi(a + 15, b + 15);
+        KeccakChi(a + 20, b + 20);
+        a[0] = Xor(a[0], Const(KECCAK_RC[r]));
+    }
+}
+
+} // namespace
+
+void Blake512_80x4(unsigned char out[256], const unsigned char in[320])
+{
+    // Single padded block: header, 0x80, zeros, 0x01 at byte 111 and the
+    // 128-bit big-endian bit count (640).
+    __m256i m[16], v[16];
+    for (int i = 0; i < 10; i++) {
+        m[i] = Bswap(Load(in, 80, i));
+    }
+    m[10] = Const(0x8000000000000000);
+    m[11] = m[12] = Const(0);
+    m[13] = Const(1);
+    m[14] = Const(0);
+    m[15] = Const(640);
+
+    for (int i = 0; i < 8; i++) {
+        v[i] = Const(BLAKE_IV512[i]);
+        v[i + 8] = Const(BLAKE_CB[i]);
+    }
+    v[12] = Xor(v[12], Const(640));
+    v[13] = Xor(v[13], Const(640));
+    BlakeColumns(m, BLAKE_SIGMA[0], v);
+    BlakeFinish(out, m, v);
+}
+
+void Blake512_80x4Mid(unsigned char out[256], const uint64_t mid_m[16], const uint64_t mid_v[16], uint32_t nNonce)
+{
+    // The midstate has the first round's column step done, and word 9 of
+    // the message without the (byte swapped) nonce in its low half.
+    __m256i m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = Const(mid_m[i]);
+        v[i] = Const(mid_v[i]);
+    }
+    m[9] = _mm256_or_si256(m[9], _mm256_setr_epi64x(__builtin_bswap32(nNonce), __builtin_bswap32(nNonce + 1),
+                                                    __builtin_bswap32(nNonce + 2), __builtin_bswap32(nNonce + 3)));
+    BlakeFinish(out, m, v);
+}
+
+void Bmw512x4(unsigned char out[256], const unsigned char in[256])
+{
+    // Single padded block: message, 0x80, zeros, 64-bit little-endian bit count (512).
+    __m256i h[16], m[16];
+    for (int i = 0; i < 16; i++) {
+        h[i] = Const(0x8081828384858687 + 0x0808080808080808 * (uint64_t)i);
+    }
+    for (int i = 0; i < 8; i++) {
+        m[i] = Load(in, 64, i);
+    }
+    m[8] = Const(0x80);
+    for (int i = 9; i < 15; i++) {
+        m[i] = Const(0);
+    }
+    m[15] = Const(512);
+    BmwCompress(h, m);
+
+    // Final compression of the chaining value under the constant key.
+    __m256i f[16];
+    for (int i = 0; i < 16; i++) {
+        f[i] = Const(0xaaaaaaaaaaaaaaa0 + (uint64_t)i);
+    }
+    BmwCompress(f, h);
+    for (int i = 0; i < 8; i++) {
+        Store(out, i, f[i + 8]);
+    }
+}
+
+void Skein512x4(unsigned char out[256], const unsigned char in[256])
+{
+    __m256i h[8], m[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = Const(SKEIN_IV512[i]);
+        m[i] = Load(in, 64, i);
+    }
+    // Message block (first, final, type 48), then the output block (type 63).
+    SkeinUbi(h, m, 64, 0xF000000000000000);
+    for (int i = 0; i < 8; i++) {
+        m[i] = Const(0);
+    }
+    SkeinUbi(h, m, 8, 0xFF00000000000000);
+    for (int i = 0; i < 8; i++) {
+        Store(out, i, h[i]);
+    }
+}
+
+void Jh512x4(unsigned char out[256], const unsigned char in[256])
+{
+    __m256i h[16], m[8];
+    for (int i = 0; i < 16; i++) {
+        h[i] = Const(JH_IV512[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+        m[i] = Load(in, 64, i);
+    }
+    JhBlock(h, m);
+    // Padding block: 0x80, zeros, 128-bit big-endian bit count (512).
+    m[0] = Const(0x80);
+    for (int i = 1; i < 7; i++) {
+        m[i] = Const(0);
+    }
+    m[7] = Const(0x0002000000000000);
+    JhBlock(h, m);
+    for (int i = 0; i < 8; i++) {
+        Store(out, i, h[i + 8]);
+    }
+}
+
+void Keccak512x4(unsigned char out[256], const unsigned char in[256])
+{
+    // The 64-byte message and its 0x01 ... 0x80 padding fill the 72-byte rate.
+    __m256i a[25];
+    for (int i = 0; i < 8; i++) {
+        a[i] = Load(in, 64, i);
+    }
+    a[8] = Const(0x8000000000000001);
+    for (int i = 9; i < 25; i++) {
+        a[i] = Const(0);
+    }
+    KeccakF(a);
+    for (int i = 0; i < 8; i++) {
+        Store(out, i, a[i]);
+    }
+}
+
+} // namespace x11_avx2
+
+#endif // ENABLE_AVX2
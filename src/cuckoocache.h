@@ -0,0 +1,269 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Namespace CuckooCache provides high performance cache primitives.
+ *
+ * The cache is a fixed size cuckoo hash table: every element has eight
+ * candidate slots, picked by eight independent hash functions, and an
+ * insert that finds all of them taken evicts one of the occupants and
+ * re-inserts it in one of its own candidate slots, up to a depth limit.
+ *
+ * Lookups never write to the table, and erasing only sets a per-slot
+ * "collectable" flag atomically. So any number of threads may call
+ * contains() concurrently, including with erase=true, as long as no
+ * thread runs insert() or setup() at the same time.
+ */
+namespace CuckooCache
+{
+
+/**
+ * A fixed size array of flags packed into bytes that can be set and
+ * cleared atomically. Used to mark slots whose element may be evicted.
+ */
+class bit_packed_atomic_flags
+{
+    std::unique_ptr<std::atomic<uint8_t>[]> mem;
+
+public:
+    bit_packed_atomic_flags() = delete;
+
+    /** All flags start set, i.e. every slot is collectable. */
+    explicit bit_packed_atomic_flags(uint32_t size)
+    {
+        // pad out the size if needed
+        size = (size + 7) / 8;
+        mem.reset(new std::atomic<uint8_t>[size]);
+        for (uint32_t i = 0; i < size; ++i)
+            mem[i].store(0xFF);
+    }
+
+    /** Resize to b flags, all set. Not thread safe. */
+    void setup(uint32_t b)
+    {
+        bit_packed_atomic_flags d(b);
+        std::swap(mem, d.mem);
+    }
+
+    inline void bit_set(uint32_t s)
+    {
+        mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed);
+    }
+
+    inline void bit_unset(uint32_t s)
+    {
+        mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed);
+    }
+
+    inline bool bit_is_set(uint32_t s) const
+    {
+        return (1 << (s & 7)) & mem[s >> 3].load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * A cache of elements with bounded memory.
+ *
+ * Eviction is generation based: elements inserted since the last epoch
+ * boundary belong to the current generation. Once enough of the current
+ * generation is still in use, all older elements that were not erased are
+ * marked collectable at once, so elements that keep getting looked up
+ * without being erased survive longer than the ones that never do.
+ *
+ * Element must be copyable and comparable with ==. Hash must provide
+ * template<uint8_t n> uint32_t operator()(const Element&) for n in 0..7,
+ * each returning an independent, uniformly distributed value.
+ */
+template <typename Element, typename Hash>
+class cache
+{
+private:
+    std::vector<Element> table;
+
+    uint32_t size;
+
+    /** Set for slots that may be overwritten, see allow_erase/please_keep */
+    mutable bit_packed_atomic_flags collection_flags;
+
+    /** Set for slots holding an element of the current generation */
+    mutable std::vector<bool> epoch_flags;
+
+    /** Inserts left before epoch_check() scans the table again */
+    uint32_t epoch_heuristic_counter;
+
+    /** Number of live elements of the current generation that ends it */
+    uint32_t epoch_size;
+
+    /** Maximum number of evictions one insert may chain, log2(size) */
+    uint8_t depth_limit;
+
+    const Hash hash_function;
+
+    /**
+     * Map the eight hashes of e onto [0, size) without a division, by
+     * taking the high half of hash * size.
+     */
+    inline std::array<uint32_t, 8> compute_hashes(const Element& e) const
+    {
+        return {{(uint32_t)(((uint64_t)hash_function.template operator()<0>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<1>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<2>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<3>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<4>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<5>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<6>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)(((uint64_t)hash_function.template operator()<7>(e) * (uint64_t)size) >> 32)}};
+    }
+
+    constexpr uint32_t invalid() const
+    {
+        return ~(uint32_t)0;
+    }
+
+    inline void allow_erase(uint32_t n) const
+    {
+        collection_flags.bit_set(n);
+    }
+
+    inline void please_keep(uint32_t n) const
+    {
+        collection_flags.bit_unset(n);
+    }
+
+    /**
+     * Start a new generation if enough of the current one is live. Scanning
+     * the table is expensive, so after a scan that did not end the epoch the
+     * next one is skipped for at least as many inserts as could be needed
+     * to end it.
+     */
+    void epoch_check()
+    {
+        if (epoch_heuristic_counter != 0) {
+            --epoch_heuristic_counter;
+            return;
+        }
+        uint32_t epoch_unused_count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            epoch_unused_count += epoch_flags[i] && !collection_flags.bit_is_set(i);
+        if (epoch_unused_count >= epoch_size) {
+            for (uint32_t i = 0; i < size; ++i)
+                if (epoch_flags[i]) {
+                    epoch_flags[i] = false;
+                    allow_erase(i);
+                }
+            epoch_heuristic_counter = epoch_size;
+        } else {
+            epoch_heuristic_counter = std::max(1u, std::max(epoch_size / 16,
+                        epoch_size - std::min(epoch_size, epoch_unused_count)));
+        }
+    }
+
+public:
+    /** An empty cache, setup() must be called before use. */
+    cache() : table(), size(), collection_flags(0), epoch_flags(),
+              epoch_heuristic_counter(), epoch_size(), depth_limit(0), hash_function()
+    {
+    }
+
+    /**
+     * Resize the table to new_size elements (at least 2), dropping all
+     * contents. Not thread safe. Returns the number of elements.
+     */
+    uint32_t setup(uint32_t new_size)
+    {
+        // depth_limit must be at least one otherwise errors can occur.
+        depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(std::max((uint32_t)2, new_size))));
+        size = std::max<uint32_t>(2, new_size);
+        table.assign(size, Element());
+        collection_flags.setup(size);
+        epoch_flags.assign(size, false);
+        // Set to 45% as described above
+        epoch_size = std::max((uint32_t)1, (45 * size) / 100);
+        // Initially set to wait for a whole epoch
+        epoch_heuristic_counter = epoch_size;
+        return size;
+    }
+
+    /** Like setup(), sized to use at most bytes of memory for the table. */
+    uint32_t setup_bytes(size_t bytes)
+    {
+        return setup(bytes / sizeof(Element));
+    }
+
+    /**
+     * Insert e, evicting a collectable element or, failing that, chaining
+     * evictions up to depth_limit. If no slot frees up, the last displaced
+     * element is dropped, which may be e itself. Not thread safe.
+     */
+    inline void insert(Element e)
+    {
+        epoch_check();
+        uint32_t last_loc = invalid();
+        bool last_epoch = true;
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        // Make sure we have not already inserted this element.
+        // If we have, make sure that it does not get deleted.
+        for (uint32_t loc : locs)
+            if (table[loc] == e) {
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+        for (uint8_t depth = 0; depth < depth_limit; ++depth) {
+            // First try to insert to an empty slot, if one exists
+            for (uint32_t loc : locs) {
+                if (!collection_flags.bit_is_set(loc))
+                    continue;
+                table[loc] = std::move(e);
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+            // Swap with the element at the location that was not the last
+            // one looked at. This avoids bouncing between two slots.
+            last_loc = locs[(1 + (std::find(locs.begin(), locs.end(), last_loc) - locs.begin())) & 7];
+            std::swap(table[last_loc], e);
+            // Can't std::swap a std::vector<bool>::reference and a bool&.
+            bool epoch = last_epoch;
+            last_epoch = epoch_flags[last_loc];
+            epoch_flags[last_loc] = epoch;
+
+            // Recompute the locs -- unfortunately happens one too many times!
+            locs = compute_hashes(e);
+        }
+    }
+
+    /**
+     * Whether e is in the cache. With erase set, a hit is marked
+     * collectable so the next insert may reuse its slot. Safe to call from
+     * several threads at once, but not concurrently with insert().
+     */
+    inline bool contains(const Element& e, const bool erase) const
+    {
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (uint32_t loc : locs)
+            if (table[loc] == e) {
+                if (erase)
+                    allow_erase(loc);
+                return true;
+            }
+        return false;
+    }
+};
+} // namespace CuckooCache
+
+#endif // BITCOIN_CUCKOOCACHE_H
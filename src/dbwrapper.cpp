@@ -7,6 +7,8 @@
 #include "util.h"
 #include "random.h"
 
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
 
 #include <leveldb/cache.h>
@@ -29,14 +31,86 @@ void HandleError(const leveldb::Status& status) throw(dbwrapper_error)
     throw dbwrapper_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+CDBOptions::CDBOptions(size_t nCacheSize)
+{
+    nBlockCacheSize = nCacheSize / 2;
+    nWriteBufferSize = nCacheSize / 4;
+    nMaxOpenFiles = 64;
+    fCompression = false;
+    nBloomBits = 10;
+}
+
+/** LevelDB raises max_open_files to at least this (64 table files plus kNumNonTableCacheFiles) */
+static const int MIN_DB_OPEN_FILES = 74;
+
+bool ParseDBOptions(const std::string& strProfile, size_t nCacheSize, CDBOptions& options, std::string& strError)
+{
+    options = CDBOptions(nCacheSize);
+    std::vector<std::string> vSettings;
+    boost::split(vSettings, strProfile, boost::is_any_of(","));
+    for (size_t i = 0; i < vSettings.size(); i++) {
+        const std::string& strSetting = vSettings[i];
+        if (strSetting.empty())
+            continue;
+        size_t nPos = strSetting.find('=');
+        if (nPos == std::string::npos) {
+            if (i != 0) {
+                strError = strprintf("preset '%s' must come first", strSetting);
+                return false;
+            }
+            if (strSetting == "balanced") {
+            } else if (strSetting == "read") {
+                options.nBlockCacheSize = nCacheSize * 3 / 4;
+                options.nWriteBufferSize = nCacheSize / 8;
+            } else {
+                strError = strprintf("unknown preset '%s'", strSetting);
+                return false;
+            }
+            continue;
+        }
+        std::string strKey = strSetting.substr(0, nPos);
+        int32_t nValue;
+        if (!ParseInt32(strSetting.substr(nPos + 1), &nValue) || nValue < 0) {
+            strError = strprintf("invalid value in '%s'", strSetting);
+            return false;
+        }
+        if (strKey == "cache") {
+            options.nBlockCacheSize = (size_t)nValue << 20;
+        } else if (strKey == "writebuffer") {
+            options.nWriteBufferSize = (size_t)nValue << 20;
+        } else if (strKey == "openfiles") {
+            if (nValue < MIN_DB_OPEN_FILES) {
+                strError = strprintf("openfiles must be at least %d", MIN_DB_OPEN_FILES);
+                return false;
+            }
+            options.nMaxOpenFiles = nValue;
+        } else if (strKey == "compression") {
+#ifndef SNAPPY
+            // LevelDB would silently store the blocks uncompressed
+            if (nValue != 0) {
+                strError = "compression is not supported, LevelDB was built without Snappy (see configure --with-snappy)";
+                return false;
+            }
+#endif
+            options.fCompression = nValue != 0;
+        } else if (strKey == "bloom") {
+            options.nBloomBits = nValue;
+        } else {
+            strError = strprintf("unknown setting '%s'", strKey);
+            return false;
+        }
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(const CDBOptions& dbOptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(dbOptions.nBlockCacheSize);
+    options.write_buffer_size = dbOptions.nWriteBufferSize;
+    options.filter_policy = dbOptions.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dbOptions.nBloomBits) : NULL;
+    options.compression = dbOptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbOptions.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -46,13 +120,18 @@ static leveldb::Options GetOptions(size_t nCacheSize)
 }
 
 CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+    : CDBWrapper(path, CDBOptions(nCacheSize), fMemory, fWipe, obfuscate)
+{
+}
+
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, const CDBOptions& dbOptions, bool fMemory, bool fWipe, bool obfuscate)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -25,6 +25,39 @@ public:
 
 void HandleError(const leveldb::Status& status) throw(dbwrapper_error);
 
+/**
+ * LevelDB tuning of one database. A profile starts from the share of
+ * -dbcache the database is given and can be changed from the command line,
+ * see ParseDBOptions().
+ */
+struct CDBOptions
+{
+    //! bytes of the LRU cache of uncompressed table blocks
+    size_t nBlockCacheSize;
+    //! bytes of one memtable, up to two may be held in memory simultaneously
+    size_t nWriteBufferSize;
+    int nMaxOpenFiles;
+    //! Snappy compress table blocks, requires LevelDB built with Snappy (configure --with-snappy)
+    bool fCompression;
+    //! bits per key of the bloom filter, 0 for no filter
+    int nBloomBits;
+
+    //! The balanced profile: half of nCacheSize for blocks, a quarter for each write buffer
+    explicit CDBOptions(size_t nCacheSize = 0);
+};
+
+/**
+ * Parse a database profile given as a comma separated list. It may start
+ * with a preset, which is applied to nCacheSize:
+ *   balanced  half the cache for blocks, a quarter for each write buffer
+ *   read      three quarters of the cache for blocks, for lookup heavy databases
+ * followed by settings that override the preset: cache=<MiB>,
+ * writebuffer=<MiB>, openfiles=<n>, compression=<0|1> and bloom=<bits>.
+ * openfiles below the minimum LevelDB clamps to is rejected, and so is
+ * compression=1 unless LevelDB was built with Snappy.
+ */
+bool ParseDBOptions(const std::string& strProfile, size_t nCacheSize, CDBOptions& options, std::string& strError);
+
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
 {
@@ -40,6 +73,11 @@ public:
      */
     CDBBatch(const std::vector<unsigned char> *obfuscate_key) : obfuscate_key(obfuscate_key) { };
 
+    void Clear()
+    {
+        batch.Clear();
+    }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -170,12 +208,13 @@ private:
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
-     * @param[in] nCacheSize  Configures various leveldb cache settings.
+     * @param[in] dbOptions   Configures the leveldb caches, compression and bloom filter.
      * @param[in] fMemory     If true, use leveldb's memory environment.
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
      */
+    CDBWrapper(const boost::filesystem::path& path, const CDBOptions& dbOptions, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
     CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
     ~CDBWrapper();
 
@@ -17,6 +17,7 @@
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/x11.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -188,7 +189,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -271,6 +271,8 @@ void PrepareShutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete pindexdb;
+        pindexdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -291,6 +293,12 @@ void PrepareShutdown()
         pdsNotificationInterface = NULL;
     }
 
+    if (pblocktemplatecache) {
+        UnregisterValidationInterface(pblocktemplatecache);
+        delete pblocktemplatecache;
+        pblocktemplatecache = NULL;
+    }
+
 #ifndef WIN32
     try {
         boost::filesystem::remove(GetPidFile());
@@ -402,13 +410,16 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
+    strUsage += HelpMessageOpt("-chainstatedbprofile=<profile>", strprintf(_("LevelDB profile of the chain state database: a preset (balanced or read) and/or comma separated cache=<MiB>, writebuffer=<MiB>, openfiles=<n> (at least 74), compression=<0|1> (needs a build with Snappy), bloom=<bits> (default: %s)"), DEFAULT_CHAINSTATE_DB_PROFILE));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-indexdbprofile=<profile>", strprintf(_("LevelDB profile of the address, spent and timestamp index database, see -chainstatedbprofile (default: %s)"), DEFAULT_INDEX_DB_PROFILE));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-parindex", strprintf(_("Build address and spent index entries on a separate thread while connecting blocks, only used with -addressindex or -spentindex (default: %u)"), DEFAULT_PARALLEL_INDEX));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -515,6 +526,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkblockindexhashes", strprintf("Recompute the hash of every block header in the block index at startup, using all cores (default: %u)", DEFAULT_CHECKBLOCKINDEXHASHES));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
 #ifdef ENABLE_WALLET
@@ -533,7 +545,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
     }
-    string debugCategories = "addrman, alert, bench, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq, "
+    string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq, "
                              "futurocoin (or specifically: instantsend, keepass, masternode, mnpayments, mnsync, spork)"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
@@ -553,7 +565,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %d)", DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
         CURRENCY_UNIT, FormatMoney(DEFAULT_LEGACY_MIN_RELAY_TX_FEE)));
@@ -1045,6 +1057,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    fParallelIndex = GetBoolArg("-parindex", DEFAULT_PARALLEL_INDEX);
 
     fServer = GetBoolArg("-server", false);
 
@@ -1130,6 +1143,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
 
+    // Pick the fastest X11 stage implementations this CPU supports
+    std::string x11_algo = X11AutoDetect();
+    LogPrintf("Using the '%s' X11 implementation\n", x11_algo);
+
     // Sanity check
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. FuturoCoin Core is shutting down."));
@@ -1177,6 +1194,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    InitSignatureCache();
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
@@ -1395,6 +1414,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     pdsNotificationInterface = new CDSNotificationInterface(connman);
     RegisterValidationInterface(pdsNotificationInterface);
 
+    pblocktemplatecache = new CBlockTemplateCache(chainparams, CScript() << OP_TRUE);
+    RegisterValidationInterface(pblocktemplatecache);
+
     if (mapArgs.count("-maxuploadtarget")) {
         connman.SetMaxOutboundTarget(GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)*1024*1024);
     }
@@ -1439,14 +1461,31 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", DEFAULT_TXINDEX))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    bool fIndexes = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) || GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    int64_t nIndexDBCache = fIndexes ? nTotalCache / 8 : (1 << 20);
+    nTotalCache -= nIndexDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for address, spent and timestamp index database\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
+    CDBOptions indexDBOptions, coinDBOptions;
+    std::string strProfileError;
+    if (!ParseDBOptions(GetArg("-indexdbprofile", DEFAULT_INDEX_DB_PROFILE), nIndexDBCache, indexDBOptions, strProfileError))
+        return InitError(strprintf(_("Invalid -indexdbprofile: %s"), strProfileError));
+    if (!ParseDBOptions(GetArg("-chainstatedbprofile", DEFAULT_CHAINSTATE_DB_PROFILE), nCoinDBCache, coinDBOptions, strProfileError))
+        return InitError(strprintf(_("Invalid -chainstatedbprofile: %s"), strProfileError));
+    LogPrintf("* Index database: %.1fMiB block cache, %.1fMiB write buffer, %d open files, compression %d, %d bloom bits\n",
+        indexDBOptions.nBlockCacheSize * (1.0 / 1024 / 1024), indexDBOptions.nWriteBufferSize * (1.0 / 1024 / 1024),
+        indexDBOptions.nMaxOpenFiles, indexDBOptions.fCompression, indexDBOptions.nBloomBits);
+    LogPrintf("* Chain state database: %.1fMiB block cache, %.1fMiB write buffer, %d open files, compression %d, %d bloom bits\n",
+        coinDBOptions.nBlockCacheSize * (1.0 / 1024 / 1024), coinDBOptions.nWriteBufferSize * (1.0 / 1024 / 1024),
+        coinDBOptions.nMaxOpenFiles, coinDBOptions.fCompression, coinDBOptions.nBloomBits);
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -1462,9 +1501,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete pindexdb;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                pblocktree = new CBlockTreeDB(CDBOptions(nBlockTreeDBCache), false, fReindex);
+                pindexdb = new CIndexDB(indexDBOptions, false, fReindex);
+                pcoinsdbview = new CCoinsViewDB(coinDBOptions, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
@@ -1565,6 +1606,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // Only the address and spent index entries are built on this thread, and
+    // whether those indexes are enabled is only known once the block index is loaded
+    if (fParallelIndex && (fAddressIndex || fSpentIndex))
+        threadGroup.create_thread(&ThreadConnectIndex);
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
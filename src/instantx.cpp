@@ -17,6 +17,8 @@
 #include "util.h"
 #include "consensus/validation.h"
 
+#include <algorithm>
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
@@ -55,28 +57,74 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
         CTxLockVote vote;
         vRecv >> vote;
 
-        LOCK(cs_main);
-#ifdef ENABLE_WALLET
-        if (pwalletMain)
-            LOCK(pwalletMain->cs_wallet);
-#endif
-        LOCK(cs_instantsend);
-
+        PreVerifyQueuedVotes(pfrom, vote);
 
         uint256 nVoteHash = vote.GetHash();
+        {
+            LOCK(cs_instantsend);
+            if(mapTxLockVotes.count(nVoteHash)) return;
+            mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
+        }
 
-        if(mapTxLockVotes.count(nVoteHash)) return;
-        mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
-
+        // No locks are held here, ProcessTxLockVote takes the ones it needs for each step
         ProcessTxLockVote(pfrom, vote, connman);
 
         return;
     }
 }
 
+void CInstantSend::PreVerifyQueuedVotes(CNode* pfrom, const CTxLockVote& vote)
+{
+    {
+        LOCK(cs_instantsend);
+        // Seen votes are not verified again
+        if (mapTxLockVotes.count(vote.GetHash())) return;
+    }
+
+    // If this vote was part of an earlier batch its signature is cached
+    // already. Queued votes are only handed out once, so they are peeked at
+    // only when there is a batch to add them to.
+    CHashSigBatch batch;
+    vote.AddSignatureToBatch(batch);
+    if (batch.size() == 0) return;
+
+    std::vector<CDataStream> vMessages;
+    pfrom->PeekProcessMsg(NetMsgType::TXLOCKVOTE, HASHSIG_BATCH_LOOKAHEAD, vMessages);
+    std::vector<CTxLockVote> vecVotes;
+    {
+        LOCK(cs_instantsend);
+        BOOST_FOREACH(CDataStream& vRecv, vMessages) {
+            CTxLockVote voteQueued;
+            try {
+                vRecv >> voteQueued;
+            } catch (const std::exception& e) {
+                // ProcessMessages deals with it when it gets there
+                continue;
+            }
+            if (mapTxLockVotes.count(voteQueued.GetHash())) continue;
+            vecVotes.push_back(voteQueued);
+        }
+    }
+
+    BOOST_FOREACH(const CTxLockVote& voteQueued, vecVotes)
+        voteQueued.AddSignatureToBatch(batch);
+
+    if (batch.size() > 1) {
+        batch.Verify();
+        LogPrint("instantsend", "CInstantSend::PreVerifyQueuedVotes -- verified %d signatures of %d queued votes, peer=%d\n",
+                 batch.size(), vMessages.size(), pfrom->id);
+    }
+}
+
 bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman)
 {
-    LOCK2(cs_main, cs_instantsend);
+    // Finalizing the lock below needs cs_wallet, which has to be taken before cs_instantsend
+#ifdef ENABLE_WALLET
+    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+#else
+    LOCK(cs_main);
+#endif
+    LOCK(cs_instantsend);
 
     uint256 txHash = txLockRequest.GetHash();
 
@@ -141,7 +189,7 @@ bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
         mapTxLockCandidates.insert(std::make_pair(txHash, txLockCandidate));
     } else if (!itLockCandidate->second.txLockRequest) {
         // i.e. empty Transaction Lock Candidate was created earlier, let's update it with actual data
-        itLockCandidate->second.txLockRequest = txLockRequest;
+        itLockCandidate->second.SetTxLockRequest(txLockRequest);
         if (itLockCandidate->second.IsTimedOut()) {
             LogPrintf("CInstantSend::CreateTxLockCandidate -- timed out, txid=%s\n", txHash.ToString());
             return false;
@@ -171,13 +219,14 @@ void CInstantSend::CreateEmptyTxLockCandidate(const uint256& txHash)
 void CInstantSend::Vote(const uint256& txHash, CConnman& connman)
 {
     AssertLockHeld(cs_main);
-    LOCK(cs_instantsend);
-
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
-    if (itLockCandidate == mapTxLockCandidates.end()) return;
-    Vote(itLockCandidate->second, connman);
-    // Let's see if our vote changed smth
-    TryToFinalizeLockCandidate(itLockCandidate->second);
+    {
+        LOCK(cs_instantsend);
+        std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+        if (itLockCandidate == mapTxLockCandidates.end()) return;
+        Vote(itLockCandidate->second, connman);
+    }
+    // Let's see if our vote changed smth, cs_wallet has to be taken before cs_instantsend
+    TryToFinalizeLockCandidate(txHash);
 }
 
 void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
@@ -288,16 +337,10 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
 //received a consensus vote
 bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman)
 {
-    // cs_main, cs_wallet and cs_instantsend should be already locked
-    AssertLockHeld(cs_main);
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        AssertLockHeld(pwalletMain->cs_wallet);
-#endif
-    AssertLockHeld(cs_instantsend);
-
     uint256 txHash = vote.GetTxHash();
 
+    // Masternode, rank and signature checks lock cs_main and mnodeman only briefly
+    // on their own, so they must not run while holding cs_instantsend.
     if(!vote.IsValid(pfrom, connman)) {
         // could be because of missing MN
         LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Vote is invalid, txid=%s\n", txHash.ToString());
@@ -307,6 +350,26 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
     // relay valid vote asap
     vote.Relay(connman);
 
+    CTxLockRequest txLockRequestReprocess;
+    bool fTryToFinalize = false;
+    bool fResult = ProcessValidTxLockVote(vote, txLockRequestReprocess, fTryToFinalize);
+
+    // Completing a lock needs cs_main and cs_wallet, which have to be taken before cs_instantsend
+    if(txLockRequestReprocess) {
+        ProcessTxLockRequest(txLockRequestReprocess, connman);
+    } else if(fTryToFinalize) {
+        TryToFinalizeLockCandidate(txHash);
+    }
+
+    return fResult;
+}
+
+bool CInstantSend::ProcessValidTxLockVote(const CTxLockVote& vote, CTxLockRequest& txLockRequestReprocessRet, bool& fTryToFinalizeRet)
+{
+    LOCK(cs_instantsend);
+
+    uint256 txHash = vote.GetTxHash();
+
     // Masternodes will sometimes propagate votes before the transaction is known to the client,
     // will actually process only after the lock request itself has arrived
 
@@ -315,7 +378,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
         if(!mapTxLockVotesOrphan.count(vote.GetHash())) {
             // start timeout countdown after the very first vote
             CreateEmptyTxLockCandidate(txHash);
-            mapTxLockVotesOrphan[vote.GetHash()] = vote;
+            AddOrphanTxLockVote(vote);
             LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Orphan vote: txid=%s  masternode=%s new\n",
                      txHash.ToString(), vote.GetMasternodePubKey().GetID().ToString());
             bool fReprocess = true;
@@ -332,7 +395,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
                 // tx lock request should already be received at this stage.
                 LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Found enough orphan votes, reprocessing Transaction Lock Request: txid=%s\n",
                          txHash.ToString());
-                ProcessTxLockRequest(itLockRequest->second, connman);
+                txLockRequestReprocessRet = itLockRequest->second;
                 return true;
             }
         } else {
@@ -347,7 +410,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
 
         if (!mapMasternodeOrphanVotes.count(vote.GetMasternodePubKey()))
         {
-            mapMasternodeOrphanVotes[vote.GetMasternodePubKey()] = nMasternodeOrphanExpireTime;
+            SetMasternodeOrphanVoteTime(vote.GetMasternodePubKey(), nMasternodeOrphanExpireTime);
         }
         else
         {
@@ -361,7 +424,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
                 return false;
             }
             // not spamming, refresh
-            mapMasternodeOrphanVotes[vote.GetMasternodePubKey()] = nMasternodeOrphanExpireTime;
+            SetMasternodeOrphanVoteTime(vote.GetMasternodePubKey(), nMasternodeOrphanExpireTime);
         }
 
         return true;
@@ -421,27 +484,54 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
     LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Transaction Lock signatures count: %d/%d, vote hash=%s\n",
             nSignatures, nSignaturesMax, vote.GetHash().ToString());
 
-    TryToFinalizeLockCandidate(txLockCandidate);
+    fTryToFinalizeRet = txLockCandidate.IsAllOutPointsReady();
 
     return true;
 }
 
-void CInstantSend::ProcessOrphanTxLockVotes(CConnman& connman)
+void CInstantSend::AddOrphanTxLockVote(const CTxLockVote& vote)
 {
-    LOCK(cs_main);
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        LOCK(pwalletMain->cs_wallet);
-#endif
-    LOCK(cs_instantsend);
+    uint256 nVoteHash = vote.GetHash();
+    mapTxLockVotesOrphan[nVoteHash] = vote;
+    mapTxLockVotesOrphanByTx[vote.GetTxHash()].insert(nVoteHash);
+    mapTxLockVotesOrphanByOutpoint[vote.GetOutpoint()].insert(nVoteHash);
+    mmapTxLockVotesOrphanByTime.insert(std::make_pair(vote.GetTimeCreated(), nVoteHash));
+}
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(ProcessTxLockVote(NULL, it->second, connman)) {
-            mapTxLockVotesOrphan.erase(it++);
-        } else {
-            ++it;
-        }
+void CInstantSend::EraseOrphanTxLockVote(std::map<uint256, CTxLockVote>::iterator it)
+{
+    std::map<uint256, std::set<uint256> >::iterator itByTx = mapTxLockVotesOrphanByTx.find(it->second.GetTxHash());
+    if(itByTx != mapTxLockVotesOrphanByTx.end()) {
+        itByTx->second.erase(it->first);
+        if(itByTx->second.empty()) mapTxLockVotesOrphanByTx.erase(itByTx);
+    }
+    std::map<COutPoint, std::set<uint256> >::iterator itByOutpoint = mapTxLockVotesOrphanByOutpoint.find(it->second.GetOutpoint());
+    if(itByOutpoint != mapTxLockVotesOrphanByOutpoint.end()) {
+        itByOutpoint->second.erase(it->first);
+        if(itByOutpoint->second.empty()) mapTxLockVotesOrphanByOutpoint.erase(itByOutpoint);
+    }
+    mapTxLockVotesOrphan.erase(it);
+}
+
+void CInstantSend::SetMasternodeOrphanVoteTime(const CPubKey& pubKeyMasternode, int64_t nExpireTime)
+{
+    mapMasternodeOrphanVotes[pubKeyMasternode] = nExpireTime;
+    mmapMasternodeOrphanVotesByTime.insert(std::make_pair(nExpireTime, pubKeyMasternode));
+}
+
+void CInstantSend::SetTxLockCandidateConfirmedHeight(std::map<uint256, CTxLockCandidate>::iterator it, int nConfirmedHeight)
+{
+    it->second.SetConfirmedHeight(nConfirmedHeight);
+    if(nConfirmedHeight != -1) {
+        mmapTxLockCandidatesByConfirmedHeight.insert(std::make_pair(nConfirmedHeight, it->first));
+    }
+}
+
+void CInstantSend::SetTxLockVoteConfirmedHeight(std::map<uint256, CTxLockVote>::iterator it, int nConfirmedHeight)
+{
+    it->second.SetConfirmedHeight(nConfirmedHeight);
+    if(nConfirmedHeight != -1) {
+        mmapTxLockVotesByConfirmedHeight.insert(std::make_pair(nConfirmedHeight, it->first));
     }
 }
 
@@ -460,18 +550,19 @@ bool CInstantSend::IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest)
 
 bool CInstantSend::IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, const COutPoint& outpoint)
 {
-    // Scan orphan votes to check if this outpoint has enough orphan votes to be locked in some tx.
-    LOCK2(cs_main, cs_instantsend);
+    // Check orphan votes on this outpoint to see if it has enough of them to be locked in some tx.
+    LOCK(cs_instantsend);
+    std::map<COutPoint, std::set<uint256> >::iterator itByOutpoint = mapTxLockVotesOrphanByOutpoint.find(outpoint);
+    if(itByOutpoint == mapTxLockVotesOrphanByOutpoint.end()) return false;
     int nCountVotes = 0;
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(it->second.GetTxHash() == txHash && it->second.GetOutpoint() == outpoint) {
+    BOOST_FOREACH(const uint256& nVoteHash, itByOutpoint->second) {
+        std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.find(nVoteHash);
+        if(it != mapTxLockVotesOrphan.end() && it->second.GetTxHash() == txHash) {
             nCountVotes++;
             if(nCountVotes >= COutPointLock::SIGNATURES_REQUIRED) {
                 return true;
             }
         }
-        ++it;
     }
     return false;
 }
@@ -480,10 +571,10 @@ void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCand
 {
     if(!sporkManager.IsSporkActive(SPORK_2_INSTANTSEND_ENABLED)) return;
 
-    LOCK(cs_main);
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
-        LOCK(pwalletMain->cs_wallet);
+    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+#else
+    LOCK(cs_main);
 #endif
     LOCK(cs_instantsend);
 
@@ -494,10 +585,41 @@ void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCand
         if(ResolveConflicts(txLockCandidate)) {
             LockTransactionInputs(txLockCandidate);
             UpdateLockedTransaction(txLockCandidate);
+            if(txLockCandidate.GetTimeLockRequest() && IsLockedInstantSendTransaction(txHash)) {
+                int64_t nLatency = GetTimeMicros() - txLockCandidate.GetTimeLockRequest();
+                lockLatencyStats.Add(nLatency);
+                LogPrint("instantsend", "CInstantSend::TryToFinalizeLockCandidate -- Transaction Lock completed in %.2fms, txid=%s\n",
+                         nLatency * 0.001, txHash.ToString());
+            }
         }
     }
 }
 
+void CInstantSend::TryToFinalizeLockCandidate(const uint256& txHash)
+{
+    {
+        // Most votes do not complete a lock, check that before taking cs_main
+        LOCK(cs_instantsend);
+        std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+        if(itLockCandidate == mapTxLockCandidates.end()) return;
+        if(!itLockCandidate->second.IsAllOutPointsReady() || IsLockedInstantSendTransaction(txHash)) return;
+    }
+
+    // cs_main and cs_wallet have to be taken before cs_instantsend
+#ifdef ENABLE_WALLET
+    LOCK2(cs_main, pwalletMain ? &pwalletMain->cs_wallet : NULL);
+#else
+    LOCK(cs_main);
+#endif
+    LOCK(cs_instantsend);
+
+    // The candidate may have been finalized or removed in between, the
+    // overload below checks again whether it is ready and not locked yet
+    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    if(itLockCandidate == mapTxLockCandidates.end()) return;
+    TryToFinalizeLockCandidate(itLockCandidate->second);
+}
+
 void CInstantSend::UpdateLockedTransaction(const CTxLockCandidate& txLockCandidate)
 {
     // cs_wallet and cs_instantsend should be already locked
@@ -585,8 +707,8 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
                     txHash.ToString(), hashConflicting.ToString());
             CTxLockRequest txLockRequest = itLockCandidate->second.txLockRequest;
             CTxLockRequest txLockRequestConflicting = itLockCandidateConflicting->second.txLockRequest;
-            itLockCandidate->second.SetConfirmedHeight(0); // expired
-            itLockCandidateConflicting->second.SetConfirmedHeight(0); // expired
+            SetTxLockCandidateConfirmedHeight(itLockCandidate, 0); // expired
+            SetTxLockCandidateConfirmedHeight(itLockCandidateConflicting, 0); // expired
             CheckAndRemove(); // clean up
             // AlreadyHave should still return "true" for both of them
             mapLockRequestRejected.insert(make_pair(txHash, txLockRequest));
@@ -655,13 +777,16 @@ void CInstantSend::CheckAndRemove()
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.begin();
+    int nKeepLock = Params().GetConsensus().nInstantSendKeepLock;
 
     // remove expired candidates
-    while(itLockCandidate != mapTxLockCandidates.end()) {
-        CTxLockCandidate &txLockCandidate = itLockCandidate->second;
-        uint256 txHash = txLockCandidate.GetHash();
-        if(txLockCandidate.IsExpired(nCachedBlockHeight)) {
+    std::multimap<int, uint256>::iterator itCandidateHeight = mmapTxLockCandidatesByConfirmedHeight.begin();
+    while(itCandidateHeight != mmapTxLockCandidatesByConfirmedHeight.end() &&
+            nCachedBlockHeight - itCandidateHeight->first > nKeepLock) {
+        std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(itCandidateHeight->second);
+        if(itLockCandidate != mapTxLockCandidates.end() && itLockCandidate->second.IsExpired(nCachedBlockHeight)) {
+            CTxLockCandidate &txLockCandidate = itLockCandidate->second;
+            uint256 txHash = txLockCandidate.GetHash();
             LogPrintf("CInstantSend::CheckAndRemove -- Removing expired Transaction Lock Candidate: txid=%s\n", txHash.ToString());
             std::map<COutPoint, COutPointLock>::iterator itOutpointLock = txLockCandidate.mapOutPointLocks.begin();
             while(itOutpointLock != txLockCandidate.mapOutPointLocks.end()) {
@@ -671,53 +796,51 @@ void CInstantSend::CheckAndRemove()
             }
             mapLockRequestAccepted.erase(txHash);
             mapLockRequestRejected.erase(txHash);
-            mapTxLockCandidates.erase(itLockCandidate++);
-        } else {
-            ++itLockCandidate;
+            mapTxLockCandidates.erase(itLockCandidate);
         }
+        mmapTxLockCandidatesByConfirmedHeight.erase(itCandidateHeight++);
     }
 
     // remove expired votes
-    std::map<uint256, CTxLockVote>::iterator itVote = mapTxLockVotes.begin();
-    while(itVote != mapTxLockVotes.end()) {
-        if(itVote->second.IsExpired(nCachedBlockHeight)) {
+    std::multimap<int, uint256>::iterator itVoteHeight = mmapTxLockVotesByConfirmedHeight.begin();
+    while(itVoteHeight != mmapTxLockVotesByConfirmedHeight.end() &&
+            nCachedBlockHeight - itVoteHeight->first > nKeepLock) {
+        std::map<uint256, CTxLockVote>::iterator itVote = mapTxLockVotes.find(itVoteHeight->second);
+        if(itVote != mapTxLockVotes.end() && itVote->second.IsExpired(nCachedBlockHeight)) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired vote: txid=%s  masternode=%s\n",
                      itVote->second.GetTxHash().ToString(),
                      itVote->second.GetMasternodePubKey().GetID().ToString());
-            mapTxLockVotes.erase(itVote++);
-        } else {
-            ++itVote;
+            mapTxLockVotes.erase(itVote);
         }
+        mmapTxLockVotesByConfirmedHeight.erase(itVoteHeight++);
     }
 
     // remove expired orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while (itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if (itOrphanVote->second.IsTimedOut()) {
+    std::multimap<int64_t, uint256>::iterator itOrphanVoteTime = mmapTxLockVotesOrphanByTime.begin();
+    while(itOrphanVoteTime != mmapTxLockVotesOrphanByTime.end() &&
+            GetTime() - itOrphanVoteTime->first > INSTANTSEND_TIMEOUT_SECONDS) {
+        std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.find(itOrphanVoteTime->second);
+        if(itOrphanVote != mapTxLockVotesOrphan.end() && itOrphanVote->second.IsTimedOut()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing timed out orphan vote: txid=%s  masternode=%s\n",
                      itOrphanVote->second.GetTxHash().ToString(),
                      itOrphanVote->second.GetMasternodePubKey().GetID().ToString());
             mapTxLockVotes.erase(itOrphanVote->first);
-            mapTxLockVotesOrphan.erase(itOrphanVote++);
-        } else {
-            ++itOrphanVote;
+            EraseOrphanTxLockVote(itOrphanVote);
         }
+        mmapTxLockVotesOrphanByTime.erase(itOrphanVoteTime++);
     }
 
     // remove expired masternode orphan votes (DOS protection)
-    std::map<CPubKey, int64_t>::iterator itMasternodeOrphan = mapMasternodeOrphanVotes.begin();
-    while (itMasternodeOrphan != mapMasternodeOrphanVotes.end())
-    {
-        if (itMasternodeOrphan->second < GetTime())
-        {
+    std::multimap<int64_t, CPubKey>::iterator itMasternodeOrphanTime = mmapMasternodeOrphanVotesByTime.begin();
+    while(itMasternodeOrphanTime != mmapMasternodeOrphanVotesByTime.end() &&
+            itMasternodeOrphanTime->first < GetTime()) {
+        std::map<CPubKey, int64_t>::iterator itMasternodeOrphan = mapMasternodeOrphanVotes.find(itMasternodeOrphanTime->second);
+        if(itMasternodeOrphan != mapMasternodeOrphanVotes.end() && itMasternodeOrphan->second < GetTime()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired orphan masternode vote: masternode=%s\n",
                      itMasternodeOrphan->first.GetID().ToString());
-            mapMasternodeOrphanVotes.erase(itMasternodeOrphan++);
-        }
-        else
-        {
-            ++itMasternodeOrphan;
+            mapMasternodeOrphanVotes.erase(itMasternodeOrphan);
         }
+        mmapMasternodeOrphanVotesByTime.erase(itMasternodeOrphanTime++);
     }
     LogPrintf("CInstantSend::CheckAndRemove -- %s\n", ToString());
 }
@@ -759,6 +882,16 @@ bool CInstantSend::GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLoc
     return true;
 }
 
+void CInstantSend::GetAcceptedLockRequests(std::vector<CTransaction>& vtxRet)
+{
+    LOCK(cs_instantsend);
+
+    vtxRet.reserve(vtxRet.size() + mapLockRequestAccepted.size());
+    for (std::map<uint256, CTxLockRequest>::const_iterator it = mapLockRequestAccepted.begin(); it != mapLockRequestAccepted.end(); ++it) {
+        vtxRet.push_back(it->second);
+    }
+}
+
 bool CInstantSend::GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet)
 {
     LOCK(cs_instantsend);
@@ -855,6 +988,16 @@ void CInstantSend::UpdatedBlockTip(const CBlockIndex *pindex)
     nCachedBlockHeight = pindex->nHeight;
 }
 
+static bool IsHeaderOfBlockIndex(const CBlockHeader& header, const CBlockIndex* pindex)
+{
+    return header.nVersion == pindex->nVersion &&
+           header.hashMerkleRoot == pindex->hashMerkleRoot &&
+           header.nTime == pindex->nTime &&
+           header.nBits == pindex->nBits &&
+           header.nNonce == pindex->nNonce &&
+           header.hashPrevBlock == (pindex->pprev ? pindex->pprev->GetBlockHash() : uint256());
+}
+
 void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
 {
     // Update lock candidates and votes if corresponding tx confirmed
@@ -869,14 +1012,22 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     // When tx is 0-confirmed or conflicted, pblock is NULL and nHeightNew should be set to -1
     CBlockIndex* pblockindex = NULL;
     if(pblock) {
-        uint256 blockHash = pblock->GetHash();
-        BlockMap::iterator mi = mapBlockIndex.find(blockHash);
-        if(mi == mapBlockIndex.end() || !mi->second) {
-            // shouldn't happen
-            LogPrint("instantsend", "CTxLockRequest::SyncTransaction -- Failed to find block %s\n", blockHash.ToString());
-            return;
+        // This is called for every transaction of a block and blocks are
+        // connected as the new tip, so match the tip's header fields first
+        // instead of hashing the block again for each transaction.
+        CBlockIndex* pindexTip = chainActive.Tip();
+        if(pindexTip && IsHeaderOfBlockIndex(*pblock, pindexTip)) {
+            pblockindex = pindexTip;
+        } else {
+            uint256 blockHash = pblock->GetHash();
+            BlockMap::iterator mi = mapBlockIndex.find(blockHash);
+            if(mi == mapBlockIndex.end() || !mi->second) {
+                // shouldn't happen
+                LogPrint("instantsend", "CTxLockRequest::SyncTransaction -- Failed to find block %s\n", blockHash.ToString());
+                return;
+            }
+            pblockindex = mi->second;
         }
-        pblockindex = mi->second;
     }
     int nHeightNew = pblockindex ? pblockindex->nHeight : -1;
 
@@ -887,7 +1038,7 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     if(itLockCandidate != mapTxLockCandidates.end()) {
         LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d lock candidate updated\n",
                 txHash.ToString(), nHeightNew);
-        itLockCandidate->second.SetConfirmedHeight(nHeightNew);
+        SetTxLockCandidateConfirmedHeight(itLockCandidate, nHeightNew);
         // Loop through outpoint locks
         std::map<COutPoint, COutPointLock>::iterator itOutpointLock = itLockCandidate->second.mapOutPointLocks.begin();
         while(itOutpointLock != itLockCandidate->second.mapOutPointLocks.end()) {
@@ -901,7 +1052,7 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
                         txHash.ToString(), nHeightNew, nVoteHash.ToString());
                 it = mapTxLockVotes.find(nVoteHash);
                 if(it != mapTxLockVotes.end()) {
-                    it->second.SetConfirmedHeight(nHeightNew);
+                    SetTxLockVoteConfirmedHeight(it, nHeightNew);
                 }
                 ++itVote;
             }
@@ -910,23 +1061,53 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 
     // check orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(itOrphanVote->second.GetTxHash() == txHash) {
+    std::map<uint256, std::set<uint256> >::iterator itOrphanVotes = mapTxLockVotesOrphanByTx.find(txHash);
+    if(itOrphanVotes != mapTxLockVotesOrphanByTx.end()) {
+        BOOST_FOREACH(const uint256& nVoteHash, itOrphanVotes->second) {
             LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
-                    txHash.ToString(), nHeightNew, itOrphanVote->first.ToString());
-            mapTxLockVotes[itOrphanVote->first].SetConfirmedHeight(nHeightNew);
+                    txHash.ToString(), nHeightNew, nVoteHash.ToString());
+            std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotes.find(nVoteHash);
+            if(it != mapTxLockVotes.end()) {
+                SetTxLockVoteConfirmedHeight(it, nHeightNew);
+            }
         }
-        ++itOrphanVote;
     }
 }
 
+CTxLockLatencyStats CInstantSend::GetLockLatencyStats()
+{
+    LOCK(cs_instantsend);
+    return lockLatencyStats;
+}
+
 std::string CInstantSend::ToString()
 {
     LOCK(cs_instantsend);
     return strprintf("Lock Candidates: %llu, Votes %llu", mapTxLockCandidates.size(), mapTxLockVotes.size());
 }
 
+//
+// CTxLockLatencyStats
+//
+
+void CTxLockLatencyStats::Add(int64_t nLatency)
+{
+    nCount++;
+    nTotal += nLatency;
+    nMax = std::max(nMax, nLatency);
+    dqRecent.push_back(nLatency);
+    if(dqRecent.size() > INSTANTSEND_LATENCY_SAMPLES) dqRecent.pop_front();
+}
+
+int64_t CTxLockLatencyStats::GetRecentPercentile(int nPercent) const
+{
+    if(dqRecent.empty()) return 0;
+    std::vector<int64_t> vSorted(dqRecent.begin(), dqRecent.end());
+    size_t nIndex = std::min(vSorted.size() - 1, vSorted.size() * nPercent / 100);
+    std::nth_element(vSorted.begin(), vSorted.begin() + nIndex, vSorted.end());
+    return vSorted[nIndex];
+}
+
 //
 // CTxLockRequest
 //
@@ -1050,10 +1231,15 @@ uint256 CTxLockVote::GetHash() const
     return ss.GetHash();
 }
 
+std::string CTxLockVote::GetSignatureMessage() const
+{
+    return txHash.ToString() + outpoint.ToStringShort();
+}
+
 bool CTxLockVote::CheckSignature() const
 {
     std::string strError;
-    std::string strMessage = txHash.ToString() + outpoint.ToStringShort();
+    std::string strMessage = GetSignatureMessage();
 
     masternode_info_t infoMn;
 
@@ -1072,10 +1258,18 @@ bool CTxLockVote::CheckSignature() const
     return true;
 }
 
+void CTxLockVote::AddSignatureToBatch(CHashSigBatch& batch) const
+{
+    masternode_info_t infoMn;
+    if (mnodeman.GetMasternodeInfo(masternodePubKey, infoMn)) {
+        batch.AddMessage(GetSignatureMessage(), infoMn.pubKeyMasternode, vchMasternodeSignature);
+    }
+}
+
 bool CTxLockVote::Sign()
 {
     std::string strError;
-    std::string strMessage = txHash.ToString() + outpoint.ToStringShort();
+    std::string strMessage = GetSignatureMessage();
 
     if(!CMessageSigner::SignMessage(strMessage, vchMasternodeSignature, activeMasternode.keyMasternode)) {
         LogPrintf("CTxLockVote::Sign -- SignMessage() failed\n");
@@ -9,6 +9,9 @@
 #include "primitives/transaction.h"
 #include "pubkey.h"
 
+#include <deque>
+
+class CHashSigBatch;
 class CTxLockVote;
 class COutPointLock;
 class CTxLockRequest;
@@ -33,12 +36,29 @@ static const int INSTANTSEND_TIMEOUT_SECONDS        = 15;
 
 static const int MIN_INSTANTSEND_PROTO_VERSION      = 70208;
 
+// number of most recent lock latencies kept for percentiles
+static const size_t INSTANTSEND_LATENCY_SAMPLES     = 1000;
+
 extern int nInstantSendDepth;
 extern int nCompleteTXLocks;
 
+/** Time from receiving a lock request to completing its lock, in microseconds */
+class CTxLockLatencyStats
+{
+public:
+    int64_t nCount{};
+    int64_t nTotal{};
+    int64_t nMax{};
+    std::deque<int64_t> dqRecent{}; // oldest first
+
+    void Add(int64_t nLatency);
+    // nPercent-th percentile of the recent samples, 0 if there are none
+    int64_t GetRecentPercentile(int nPercent) const;
+};
+
 class CInstantSend
 {
-private:
+protected:
     // Keep track of current block height
     int nCachedBlockHeight;
 
@@ -47,6 +67,9 @@ private:
     std::map<uint256, CTxLockRequest> mapLockRequestRejected; // tx hash - tx
     std::map<uint256, CTxLockVote> mapTxLockVotes; // vote hash - vote
     std::map<uint256, CTxLockVote> mapTxLockVotesOrphan; // vote hash - vote
+    // indexes into mapTxLockVotesOrphan, kept in sync by Add/EraseOrphanTxLockVote
+    std::map<uint256, std::set<uint256> > mapTxLockVotesOrphanByTx; // tx hash - vote hash set
+    std::map<COutPoint, std::set<uint256> > mapTxLockVotesOrphanByOutpoint; // utxo - vote hash set
 
     std::map<uint256, CTxLockCandidate> mapTxLockCandidates; // tx hash - lock candidate
 
@@ -56,18 +79,34 @@ private:
     //track masternodes who voted with no txreq (for DOS protection)
     std::map<CPubKey, int64_t> mapMasternodeOrphanVotes; // mn outpoint - time
 
+    // expiry queues, soonest first, so that CheckAndRemove only visits the entries that are due;
+    // entries whose object changed or is gone in the meantime are skipped when they come up
+    std::multimap<int, uint256> mmapTxLockCandidatesByConfirmedHeight; // confirmed height - tx hash
+    std::multimap<int, uint256> mmapTxLockVotesByConfirmedHeight; // confirmed height - vote hash
+    std::multimap<int64_t, uint256> mmapTxLockVotesOrphanByTime; // time created - vote hash
+    std::multimap<int64_t, CPubKey> mmapMasternodeOrphanVotesByTime; // expiration time - mn pubkey
+
+    CTxLockLatencyStats lockLatencyStats;
+
     bool CreateTxLockCandidate(const CTxLockRequest& txLockRequest);
     void CreateEmptyTxLockCandidate(const uint256& txHash);
     void Vote(CTxLockCandidate& txLockCandidate, CConnman& connman);
 
     //process consensus vote message
     bool ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman);
-    void ProcessOrphanTxLockVotes(CConnman& connman);
+    // state changes for a vote that passed IsValid, only cs_instantsend is taken
+    bool ProcessValidTxLockVote(const CTxLockVote& vote, CTxLockRequest& txLockRequestReprocessRet, bool& fTryToFinalizeRet);
+    void AddOrphanTxLockVote(const CTxLockVote& vote);
+    void EraseOrphanTxLockVote(std::map<uint256, CTxLockVote>::iterator it);
+    void SetMasternodeOrphanVoteTime(const CPubKey& pubKeyMasternode, int64_t nExpireTime);
+    void SetTxLockCandidateConfirmedHeight(std::map<uint256, CTxLockCandidate>::iterator it, int nConfirmedHeight);
+    void SetTxLockVoteConfirmedHeight(std::map<uint256, CTxLockVote>::iterator it, int nConfirmedHeight);
     bool IsEnoughOrphanVotesForTx(const CTxLockRequest& txLockRequest);
     bool IsEnoughOrphanVotesForTxAndOutPoint(const uint256& txHash, const COutPoint& outpoint);
     int64_t GetAverageMasternodeOrphanVoteTime();
 
     void TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCandidate);
+    void TryToFinalizeLockCandidate(const uint256& txHash);
     void LockTransactionInputs(const CTxLockCandidate& txLockCandidate);
     //update UI and notify external script if any
     void UpdateLockedTransaction(const CTxLockCandidate& txLockCandidate);
@@ -79,6 +118,8 @@ public:
     CCriticalSection cs_instantsend;
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /// Verify the signatures of vote and the votes queued behind it from pfrom as one batch
+    void PreVerifyQueuedVotes(CNode* pfrom, const CTxLockVote& vote);
 
     bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman);
     void Vote(const uint256& txHash, CConnman& connman);
@@ -89,6 +130,8 @@ public:
     void RejectLockRequest(const CTxLockRequest& txLockRequest);
     bool HasTxLockRequest(const uint256& txHash);
     bool GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLockRequestRet);
+    /// Transactions of all accepted lock requests, used to reconstruct compact blocks
+    void GetAcceptedLockRequests(std::vector<CTransaction>& vtxRet);
 
     bool GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet);
 
@@ -101,6 +144,8 @@ public:
     // get instantsend confirmations (only)
     int GetConfirmations(const uint256 &nTXHash);
 
+    CTxLockLatencyStats GetLockLatencyStats();
+
     // remove expired entries from maps
     void CheckAndRemove();
     // verify if transaction lock timed out
@@ -182,9 +227,13 @@ public:
     void SetConfirmedHeight(int nConfirmedHeightIn) { nConfirmedHeight = nConfirmedHeightIn; }
     bool IsExpired(int nHeight) const;
     bool IsTimedOut() const;
+    int64_t GetTimeCreated() const { return nTimeCreated; }
 
+    std::string GetSignatureMessage() const;
     bool Sign();
     bool CheckSignature() const;
+    /// Queue the signature for CheckSignature() in a batch verification, if the masternode is known
+    void AddSignatureToBatch(CHashSigBatch& batch) const;
 
     void Relay(CConnman& connman) const;
 };
@@ -222,11 +271,13 @@ class CTxLockCandidate
 private:
     int nConfirmedHeight; // when corresponding tx is 0-confirmed or conflicted, nConfirmedHeight is -1
     int64_t nTimeCreated;
+    int64_t nTimeLockRequest; // in microseconds, 0 while there is no lock request yet
 
 public:
     CTxLockCandidate(const CTxLockRequest& txLockRequestIn) :
         nConfirmedHeight(-1),
         nTimeCreated(GetTime()),
+        nTimeLockRequest(txLockRequestIn ? GetTimeMicros() : 0),
         txLockRequest(txLockRequestIn),
         mapOutPointLocks()
         {}
@@ -236,6 +287,13 @@ public:
 
     uint256 GetHash() const { return txLockRequest.GetHash(); }
 
+    void SetTxLockRequest(const CTxLockRequest& txLockRequestIn)
+    {
+        txLockRequest = txLockRequestIn;
+        nTimeLockRequest = GetTimeMicros();
+    }
+    int64_t GetTimeLockRequest() const { return nTimeLockRequest; }
+
     void AddOutPointLock(const COutPoint& outpoint);
     void MarkOutpointAsAttacked(const COutPoint& outpoint);
     bool AddVote(const CTxLockVote& vote);
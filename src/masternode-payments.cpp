@@ -103,6 +103,14 @@ void CMasternodePayments::Clear()
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
     mapMasternodeBlocks.clear();
     mapMasternodePaymentVotes.clear();
+    mmapPaymentVotesByHeight.clear();
+    nScheduledPayeesHeight = -1;
+}
+
+void CMasternodePayments::AddPaymentVoteByHeight(const CMasternodePaymentVote& vote)
+{
+    AssertLockHeld(cs_mapMasternodePaymentVotes);
+    mmapPaymentVotesByHeight.insert(std::make_pair(vote.nBlockHeight, vote.GetHash()));
 }
 
 bool CMasternodePayments::CanVote(CPubKey pubKey, int nBlockHeight)
@@ -207,6 +215,8 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
 
         pfrom->setAskFor.erase(nHash);
 
+        PreVerifyQueuedVotes(pfrom, vote);
+
         {
             LOCK(cs_mapMasternodePaymentVotes);
             if(mapMasternodePaymentVotes.count(nHash)) {
@@ -216,6 +226,7 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
 
             // Avoid processing same vote multiple times
             mapMasternodePaymentVotes[nHash] = vote;
+            AddPaymentVoteByHeight(vote);
             // but first mark vote as non-verified,
             // AddPaymentVote() below should take care of it if vote is actually ok
             mapMasternodePaymentVotes[nHash].MarkAsNotVerified();
@@ -282,12 +293,70 @@ void CMasternodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand,
     }
 }
 
-bool CMasternodePaymentVote::Sign()
+std::string CMasternodePaymentVote::GetSignatureMessage(const CPubKey& pubKeyMasternode) const
 {
-    std::string strError;
-    std::string strMessage = pubKeyMasternode.GetID().ToString() +
+    return pubKeyMasternode.GetID().ToString() +
                 boost::lexical_cast<std::string>(nBlockHeight) +
                 ScriptToAsmStr(payee);
+}
+
+void CMasternodePayments::AddVoteSignatureToBatch(const CMasternodePaymentVote& vote, CHashSigBatch& batch)
+{
+    // Votes out of range are dropped before their signature is checked
+    int nFirstBlock = nCachedBlockHeight - GetStorageLimit();
+    if (vote.nBlockHeight < nFirstBlock || vote.nBlockHeight > nCachedBlockHeight+20) return;
+    masternode_info_t mnInfo;
+    if (!mnodeman.GetMasternodeInfo(vote.pubKeyMasternode, mnInfo)) return;
+    vote.AddSignatureToBatch(mnInfo.pubKeyMasternode, batch);
+}
+
+void CMasternodePayments::PreVerifyQueuedVotes(CNode* pfrom, const CMasternodePaymentVote& vote)
+{
+    {
+        LOCK(cs_mapMasternodePaymentVotes);
+        // Seen votes are not verified again
+        if (mapMasternodePaymentVotes.count(vote.GetHash())) return;
+    }
+
+    // If this vote was part of an earlier batch its signature is cached
+    // already. Queued votes are only handed out once, so they are peeked at
+    // only when there is a batch to add them to.
+    CHashSigBatch batch;
+    AddVoteSignatureToBatch(vote, batch);
+    if (batch.size() == 0) return;
+
+    std::vector<CDataStream> vMessages;
+    pfrom->PeekProcessMsg(NetMsgType::MASTERNODEPAYMENTVOTE, HASHSIG_BATCH_LOOKAHEAD, vMessages);
+    std::vector<CMasternodePaymentVote> vecVotes;
+    {
+        LOCK(cs_mapMasternodePaymentVotes);
+        BOOST_FOREACH(CDataStream& vRecv, vMessages) {
+            CMasternodePaymentVote voteQueued;
+            try {
+                vRecv >> voteQueued;
+            } catch (const std::exception& e) {
+                // ProcessMessages deals with it when it gets there
+                continue;
+            }
+            if (mapMasternodePaymentVotes.count(voteQueued.GetHash())) continue;
+            vecVotes.push_back(voteQueued);
+        }
+    }
+
+    BOOST_FOREACH(const CMasternodePaymentVote& voteQueued, vecVotes)
+        AddVoteSignatureToBatch(voteQueued, batch);
+
+    if (batch.size() > 1) {
+        batch.Verify();
+        LogPrint("mnpayments", "CMasternodePayments::PreVerifyQueuedVotes -- verified %d signatures of %d queued votes, peer=%d\n",
+                 batch.size(), vMessages.size(), pfrom->id);
+    }
+}
+
+bool CMasternodePaymentVote::Sign()
+{
+    std::string strError;
+    std::string strMessage = GetSignatureMessage(pubKeyMasternode);
 
     if (!CMessageSigner::SignMessage(strMessage, vchSig, activeMasternode.keyMasternode)) {
         LogPrintf("CMasternodePaymentVote::Sign -- SignMessage() failed\n");
@@ -311,6 +380,23 @@ bool CMasternodePayments::GetBlockPayee(int nBlockHeight, CScript& payee)
     return false;
 }
 
+void CMasternodePayments::UpdateScheduledPayees()
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+
+    if (nScheduledPayeesHeight == nCachedBlockHeight) return;
+
+    mapScheduledPayees.clear();
+    CScript payee;
+    for (int h = nCachedBlockHeight; h <= nCachedBlockHeight + 8; h++) {
+        std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(h);
+        if (it != mapMasternodeBlocks.end() && it->second.GetBestPayee(payee)) {
+            mapScheduledPayees[h] = payee;
+        }
+    }
+    nScheduledPayeesHeight = nCachedBlockHeight;
+}
+
 // Is this masternode scheduled to get paid soon?
 // -- Only look ahead up to 8 blocks to allow for propagation of the latest 2 blocks of votes
 bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
@@ -322,12 +408,9 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     CScript mnpayee;
     mnpayee = GetScriptForDestination(mn.payee.Get());
 
-    CScript payee;
-    for (int64_t h = nCachedBlockHeight; h <= nCachedBlockHeight + 8; h++){
-        if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h) &&
-            mapMasternodeBlocks[h].GetBestPayee(payee) &&
-            mnpayee == payee) {
+    UpdateScheduledPayees();
+    for (std::map<int, CScript>::const_iterator it = mapScheduledPayees.begin(); it != mapScheduledPayees.end(); ++it) {
+        if (it->first != nNotBlockHeight && it->second == mnpayee) {
             return true;
         }
     }
@@ -335,6 +418,21 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight)
     return false;
 }
 
+void CMasternodePayments::GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    setPayeesRet.clear();
+    if (!masternodeSync.IsMasternodeListSynced()) return;
+
+    UpdateScheduledPayees();
+    for (std::map<int, CScript>::const_iterator it = mapScheduledPayees.begin(); it != mapScheduledPayees.end(); ++it) {
+        if (it->first != nNotBlockHeight) {
+            setPayeesRet.insert(it->second);
+        }
+    }
+}
+
 bool CMasternodePayments::AddPaymentVote(const CMasternodePaymentVote& vote)
 {
     uint256 blockHash = uint256();
@@ -344,7 +442,13 @@ bool CMasternodePayments::AddPaymentVote(const CMasternodePaymentVote& vote)
 
     LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePaymentVotes);
 
-    mapMasternodePaymentVotes[vote.GetHash()] = vote;
+    std::pair<std::map<uint256, CMasternodePaymentVote>::iterator, bool> ret =
+            mapMasternodePaymentVotes.insert(std::make_pair(vote.GetHash(), vote));
+    if(ret.second) {
+        AddPaymentVoteByHeight(vote);
+    } else {
+        ret.first->second = vote;
+    }
 
     if(!mapMasternodeBlocks.count(vote.nBlockHeight)) {
        CMasternodeBlockPayees blockPayees(vote.nBlockHeight);
@@ -353,6 +457,11 @@ bool CMasternodePayments::AddPaymentVote(const CMasternodePaymentVote& vote)
 
     mapMasternodeBlocks[vote.nBlockHeight].AddPayee(vote);
 
+    // The vote may change the best payee of a scheduled block
+    if (vote.nBlockHeight >= nScheduledPayeesHeight && vote.nBlockHeight <= nScheduledPayeesHeight + 8) {
+        nScheduledPayeesHeight = -1;
+    }
+
     return true;
 }
 
@@ -508,17 +617,14 @@ void CMasternodePayments::CheckAndRemove()
 
     int nLimit = GetStorageLimit();
 
-    std::map<uint256, CMasternodePaymentVote>::iterator it = mapMasternodePaymentVotes.begin();
-    while(it != mapMasternodePaymentVotes.end()) {
-        CMasternodePaymentVote vote = (*it).second;
-
-        if(nCachedBlockHeight - vote.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CheckAndRemove -- Removing old Masternode payment: nBlockHeight=%d\n", vote.nBlockHeight);
-            mapMasternodePaymentVotes.erase(it++);
-            mapMasternodeBlocks.erase(vote.nBlockHeight);
-        } else {
-            ++it;
+    std::multimap<int, uint256>::iterator it = mmapPaymentVotesByHeight.begin();
+    while(it != mmapPaymentVotesByHeight.end() && nCachedBlockHeight - it->first > nLimit) {
+        // the height of a vote is part of its hash, so an entry still in the map has expired
+        if(mapMasternodePaymentVotes.erase(it->second)) {
+            LogPrint("mnpayments", "CMasternodePayments::CheckAndRemove -- Removing old Masternode payment: nBlockHeight=%d\n", it->first);
+            mapMasternodeBlocks.erase(it->first);
         }
+        mmapPaymentVotesByHeight.erase(it++);
     }
     LogPrintf("CMasternodePayments::CheckAndRemove -- %s\n", ToString());
 }
@@ -736,9 +842,7 @@ bool CMasternodePaymentVote::CheckSignature(const CPubKey& pubKeyMasternode, int
     // do not ban by default
     nDos = 0;
 
-    std::string strMessage = pubKeyMasternode.GetID().ToString() +
-                boost::lexical_cast<std::string>(nBlockHeight) +
-                ScriptToAsmStr(payee);
+    std::string strMessage = GetSignatureMessage(pubKeyMasternode);
 
     std::string strError = "";
     if (!CMessageSigner::VerifyMessage(pubKeyMasternode, vchSig, strMessage, strError)) {
@@ -755,6 +859,11 @@ bool CMasternodePaymentVote::CheckSignature(const CPubKey& pubKeyMasternode, int
     return true;
 }
 
+void CMasternodePaymentVote::AddSignatureToBatch(const CPubKey& pubKeyMasternode, CHashSigBatch& batch) const
+{
+    batch.AddMessage(GetSignatureMessage(pubKeyMasternode), pubKeyMasternode, vchSig);
+}
+
 std::string CMasternodePaymentVote::ToString() const
 {
     std::ostringstream info;
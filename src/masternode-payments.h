@@ -12,6 +12,7 @@
 #include "net_processing.h"
 #include "utilstrencodings.h"
 
+class CHashSigBatch;
 class CMasternodePayments;
 class CMasternodePaymentVote;
 class CMasternodeBlockPayees;
@@ -147,8 +148,11 @@ public:
         return ss.GetHash();
     }
 
+    std::string GetSignatureMessage(const CPubKey& pubKeyMasternode) const;
     bool Sign();
     bool CheckSignature(const CPubKey& pubKeyMasternode, int nValidationHeight, int &nDos);
+    /// Queue the signature for CheckSignature() in a batch verification
+    void AddSignatureToBatch(const CPubKey& pubKeyMasternode, CHashSigBatch& batch) const;
 
     bool IsValid(CNode* pnode, int nValidationHeight, std::string& strError, CConnman& connman);
     void Relay(CConnman& connman);
@@ -175,13 +179,29 @@ private:
     // Keep track of current block height
     int nCachedBlockHeight;
 
+    /// Best payees of the blocks nScheduledPayeesHeight..+8 by height, see IsScheduled.
+    /// Rebuilt when the tip moves or a vote for one of these blocks comes in.
+    std::map<int, CScript> mapScheduledPayees;
+    /// Height mapScheduledPayees starts at, -1 if it has to be rebuilt
+    int nScheduledPayeesHeight;
+
+    void UpdateScheduledPayees();
+
+    /// Hashes of mapMasternodePaymentVotes by block height, lowest first, so
+    /// CheckAndRemove only visits the votes that fell out of storage
+    std::multimap<int, uint256> mmapPaymentVotesByHeight;
+
+    void AddPaymentVoteByHeight(const CMasternodePaymentVote& vote);
+    /// Queue the signature of a vote in range from a known masternode
+    void AddVoteSignatureToBatch(const CMasternodePaymentVote& vote, CHashSigBatch& batch);
+
 public:
     std::map<uint256, CMasternodePaymentVote> mapMasternodePaymentVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
     std::map<CPubKey, int> mapMasternodesLastVote;
     std::map<CPubKey, int> mapMasternodesDidNotVote;
 
-    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000) {}
+    CMasternodePayments() : nStorageCoeff(1.25), nMinBlocksToStore(5000), nScheduledPayeesHeight(-1) {}
 
     ADD_SERIALIZE_METHODS;
 
@@ -189,6 +209,13 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(mapMasternodePaymentVotes);
         READWRITE(mapMasternodeBlocks);
+        if(ser_action.ForRead()) {
+            nScheduledPayeesHeight = -1;
+            mmapPaymentVotesByHeight.clear();
+            for (std::map<uint256, CMasternodePaymentVote>::const_iterator it = mapMasternodePaymentVotes.begin(); it != mapMasternodePaymentVotes.end(); ++it) {
+                mmapPaymentVotesByHeight.insert(std::make_pair(it->second.nBlockHeight, it->first));
+            }
+        }
     }
 
     void Clear();
@@ -205,11 +232,15 @@ public:
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
+    /// Payees scheduled to get paid soon in any block but nNotBlockHeight, see IsScheduled
+    void GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet);
 
     bool CanVote(CPubKey pubKey, int nBlockHeight);
 
     int GetMinMasternodePaymentsProto();
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /// Verify the signatures of vote and the votes queued behind it from pfrom as one batch
+    void PreVerifyQueuedVotes(CNode* pfrom, const CMasternodePaymentVote& vote);
     std::string GetRequiredPaymentsString(int nBlockHeight);
     void FillBlockPayee(CMutableTransaction& txNew, int nBlockHeight, CAmount blockReward, CTxOut& txoutMasternodeRet);
     std::string ToString() const;
@@ -53,6 +53,15 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb, CConnman& co
 {
     if(mnb.sigTime <= sigTime && !mnb.fRecovery) return false;
 
+    if (nProtocolVersion != mnb.nProtocolVersion) {
+        // cached ranks filter by protocol version
+        mnodeman.InvalidateScoresCache();
+    }
+    if (addr != mnb.addr) {
+        // mnodeman looks up masternodes by address
+        mnodeman.InvalidateMasternodeAddresses();
+    }
+
     pubKeyMasternode = mnb.pubKeyMasternode;
     sigTime = mnb.sigTime;
     vchSig = mnb.vchSig;
@@ -66,7 +75,7 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb, CConnman& co
         (mnb.lastPing != CMasternodePing() &&
          mnb.lastPing.CheckAndUpdate(this, true, nDos, connman))) {
         lastPing = mnb.lastPing;
-        mnodeman.mapSeenMasternodePing.insert(std::make_pair(lastPing.GetHash(), lastPing));
+        mnodeman.AddSeenMasternodePing(lastPing);
     }
     // if it matches our Masternode privkey...
     if (fMasterNode && pubKeyMasternode == activeMasternode.pubKeyMasternode) {
@@ -275,35 +284,58 @@ void CMasternode::UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScan
 {
     if(!pindex) return;
 
-    const CBlockIndex *BlockReading = pindex;
-
     // ToDo: FIX IT
     CScript mnpayee = GetScriptForDestination(payee.Get());
 
+    // Only payments newer than the last one found and within the scan window count
+    int nMinHeight = std::max(nBlockLastPaid, pindex->nHeight - nMaxBlocksToScanBack);
+
+    // The payment index lists the blocks that paid this payee without reading them from disk
+    std::vector<std::pair<int, unsigned int> > vPayments;
+    int nIndexStart = 0;
+    if(!GetMasternodePayments(mnpayee, nMinHeight, pindex, vPayments, nIndexStart)) return;
+
     LOCK(cs_mapMasternodeBlocks);
 
-    for (int i = 0; BlockReading && BlockReading->nHeight > nBlockLastPaid && i < nMaxBlocksToScanBack; i++) {
+    for (size_t i = 0; i < vPayments.size(); i++) {
+        int nHeight = vPayments[i].first;
+        if(mnpayments.mapMasternodeBlocks.count(nHeight) &&
+            mnpayments.mapMasternodeBlocks[nHeight].HasPayeeWithVotes(mnpayee, 2))
+        {
+            nBlockLastPaid = nHeight;
+            nTimeLastPaid = vPayments[i].second;
+            LogPrint("masternode", "CMasternode::UpdateLastPaidBlock -- "
+                     "searching for block with payment to %s -- found new %d\n",
+                     payee.ToString(), nBlockLastPaid);
+            return;
+        }
+    }
+
+    // Blocks connected before the payment index existed still have to be read from disk
+    if (nIndexStart <= nMinHeight + 1) return;
+
+    const CBlockIndex *BlockReading = pindex->GetAncestor(std::min(pindex->nHeight, nIndexStart - 1));
+
+    while (BlockReading && BlockReading->nHeight > nMinHeight) {
         if(mnpayments.mapMasternodeBlocks.count(BlockReading->nHeight) &&
             mnpayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2))
         {
             CBlock block;
-            if(!ReadBlockFromDisk(block, BlockReading, Params().GetConsensus())) // shouldn't really happen
-                continue;
-
-            CAmount nMasternodePayment = GetMasternodePayment(BlockReading->nHeight, block.vtx[0].GetValueOut());
-
-            BOOST_FOREACH(CTxOut txout, block.vtx[0].vout)
-                if (mnpayee == txout.scriptPubKey && nMasternodePayment == txout.nValue) {
-                    nBlockLastPaid = BlockReading->nHeight;
-                    nTimeLastPaid = BlockReading->nTime;
-                    LogPrint("masternode", "CMasternode::UpdateLastPaidBlock -- "
-                             "searching for block with payment to %s -- found new %d\n",
-                             payee.ToString(), nBlockLastPaid);
-                    return;
-                }
+            if(ReadBlockFromDisk(block, BlockReading, Params().GetConsensus())) { // shouldn't really fail
+                CAmount nMasternodePayment = GetMasternodePayment(BlockReading->nHeight, block.vtx[0].GetValueOut());
+
+                BOOST_FOREACH(CTxOut txout, block.vtx[0].vout)
+                    if (mnpayee == txout.scriptPubKey && nMasternodePayment == txout.nValue) {
+                        nBlockLastPaid = BlockReading->nHeight;
+                        nTimeLastPaid = BlockReading->nTime;
+                        LogPrint("masternode", "CMasternode::UpdateLastPaidBlock -- "
+                                 "searching for block with payment to %s -- found new %d\n",
+                                 payee.ToString(), nBlockLastPaid);
+                        return;
+                    }
+            }
         }
 
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
         BlockReading = BlockReading->pprev;
     }
 
@@ -556,10 +588,7 @@ bool CMasternodeBroadcast::Sign(const CKey& keyMasternode)
 
     sigTime = GetAdjustedTime();
 
-    strMessage = addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
-                    pubKeyMasternode.GetID().ToString() +
-                    payee.ToString() +
-                    boost::lexical_cast<std::string>(nProtocolVersion);
+    strMessage = GetSignatureMessage();
 
     if (!CMessageSigner::SignMessage(strMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodeBroadcast::Sign -- SignMessage() failed\n");
@@ -574,16 +603,21 @@ bool CMasternodeBroadcast::Sign(const CKey& keyMasternode)
     return true;
 }
 
+std::string CMasternodeBroadcast::GetSignatureMessage() const
+{
+    return addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
+                    pubKeyMasternode.GetID().ToString() +
+                    payee.ToString() +
+                    boost::lexical_cast<std::string>(nProtocolVersion);
+}
+
 bool CMasternodeBroadcast::CheckSignature(int& nDos)
 {
     std::string strMessage;
     std::string strError = "";
     nDos = 0;
 
-    strMessage = addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
-                    pubKeyMasternode.GetID().ToString() +
-                    payee.ToString() +
-                    boost::lexical_cast<std::string>(nProtocolVersion);
+    strMessage = GetSignatureMessage();
 
     LogPrint("masternode", "CMasternodeBroadcast::CheckSignature -- strMessage: %s  pubKeyMasternode: %s  sig: %s\n",
              strMessage, pubKeyMasternode.GetID().ToString(),
@@ -599,6 +633,29 @@ bool CMasternodeBroadcast::CheckSignature(int& nDos)
     return true;
 }
 
+bool CMasternodeBroadcast::IsWorthVerifying() const
+{
+    // No point in recovering the keys of a broadcast SimpleCheck rejects anyway
+    if (!IsValidNetAddr(addr)) return false;
+    if (sigTime > GetAdjustedTime() + 60 * 60) return false;
+    if (nProtocolVersion < mnpayments.GetMinMasternodePaymentsProto()) return false;
+    if (GetScriptForDestination(payee.Get()).size() != 25) return false;
+
+    int mainnetDefaultPort = Params(CBaseChainParams::MAIN).GetDefaultPort();
+    if (Params().NetworkIDString() == CBaseChainParams::MAIN) {
+        return addr.GetPort() == mainnetDefaultPort;
+    }
+    return addr.GetPort() != mainnetDefaultPort;
+}
+
+void CMasternodeBroadcast::AddSignaturesToBatch(CHashSigBatch& batch) const
+{
+    batch.AddMessage(GetSignatureMessage(), pubKeyMasternode, vchSig);
+    if (lastPing != CMasternodePing()) {
+        lastPing.AddSignatureToBatch(pubKeyMasternode, batch);
+    }
+}
+
 void CMasternodeBroadcast::Relay(CConnman& connman)
 {
     CInv inv(MSG_MASTERNODE_ANNOUNCE, GetHash());
@@ -621,8 +678,7 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = pubKeyMasternode.GetID().ToString() + blockHash.ToString() +
-                             boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage(pubKeyMasternode);
 
     if(!CMessageSigner::SignMessage(strMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign -- SignMessage() failed\n");
@@ -637,10 +693,20 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
     return true;
 }
 
-bool CMasternodePing::CheckSignature(CPubKey& pubKeyMasternode, int &nDos)
+std::string CMasternodePing::GetSignatureMessage(const CPubKey& pubKeyMasternode) const
 {
-    std::string strMessage = pubKeyMasternode.GetID().ToString() + blockHash.ToString() +
+    return pubKeyMasternode.GetID().ToString() + blockHash.ToString() +
                              boost::lexical_cast<std::string>(sigTime);
+}
+
+void CMasternodePing::AddSignatureToBatch(const CPubKey& pubKeyMasternode, CHashSigBatch& batch) const
+{
+    batch.AddMessage(GetSignatureMessage(pubKeyMasternode), pubKeyMasternode, vchSig);
+}
+
+bool CMasternodePing::CheckSignature(CPubKey& pubKeyMasternode, int &nDos)
+{
+    std::string strMessage = GetSignatureMessage(pubKeyMasternode);
     std::string strError = "";
     nDos = 0;
 
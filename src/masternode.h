@@ -13,6 +13,7 @@
 class CMasternode;
 class CMasternodeBroadcast;
 class CConnman;
+class CHashSigBatch;
 
 static const int MASTERNODE_CHECK_SECONDS               =   5;
 static const int MASTERNODE_MIN_MNB_SECONDS             =   5 * 60;
@@ -58,8 +59,11 @@ public:
 
     bool IsExpired() const { return GetAdjustedTime() - sigTime > MASTERNODE_NEW_START_REQUIRED_SECONDS; }
 
+    std::string GetSignatureMessage(const CPubKey& pubKeyMasternode) const;
     bool Sign(const CKey& keyMasternode, const CPubKey& pubKeyMasternode);
     bool CheckSignature(CPubKey& pubKeyMasternode, int &nDos);
+    /// Queue the signature for CheckSignature() in a batch verification
+    void AddSignatureToBatch(const CPubKey& pubKeyMasternode, CHashSigBatch& batch) const;
     bool SimpleCheck(int& nDos);
     bool CheckAndUpdate(CMasternode* pmn, bool fFromNewBroadcast, int& nDos, CConnman& connman);
     void Relay(CConnman& connman);
@@ -307,11 +311,16 @@ public:
                        bool fOffline = false);
 
     bool SimpleCheck(int& nDos);
+    /// The cheap stateless rules of SimpleCheck, without logging
+    bool IsWorthVerifying() const;
     bool Update(CMasternode* pmn, int& nDos, CConnman& connman);
     bool CheckMasternode(int& nDos);
 
+    std::string GetSignatureMessage() const;
     bool Sign(const CKey& keyMasternode);
     bool CheckSignature(int& nDos);
+    /// Queue the signatures of the broadcast and its ping in a batch verification
+    void AddSignaturesToBatch(CHashSigBatch& batch) const;
     void Relay(CConnman& connman);
 };
 
@@ -19,13 +19,13 @@ const std::string CMasternodeMan::SERIALIZATION_VERSION_STRING = "CMasternodeMan
 
 struct CompareLastPaidBlock
 {
-    bool operator()(const std::pair<int, CMasternode*>& t1,
-                    const std::pair<int, CMasternode*>& t2) const
+    template <typename Entry>
+    bool operator()(const Entry& t1, const Entry& t2) const
     {
         // ToDO: VERIFY IT
-        return (t1.first != t2.first)
-            ? (t1.first < t2.first)
-            : (t1.second->pubKeyMasternode < t2.second->pubKeyMasternode);
+        return (t1.nBlockLastPaid != t2.nBlockLastPaid)
+            ? (t1.nBlockLastPaid < t2.nBlockLastPaid)
+            : (t1.pmn->pubKeyMasternode < t2.pmn->pubKeyMasternode);
     }
 };
 
@@ -63,8 +63,16 @@ CMasternodeMan::CMasternodeMan()
   listScheduledMnbRequestConnections(),
   fMasternodesAdded(false),
   fMasternodesRemoved(false),
+  mapScoresCache(MAX_SCORES_CACHE_SIZE),
+  vecPaymentQueue(),
+  fPaymentQueueValid(false),
+  setMasternodeAddresses(),
+  fMasternodeAddressesValid(false),
+  mmapSeenMasternodePingBySigTime(),
+  mmapSeenMasternodeVerificationByHeight(),
   mapSeenMasternodeBroadcast(),
-  mapSeenMasternodePing()
+  mapSeenMasternodePing(),
+  mapSeenMasternodeVerification()
 {}
 
 bool CMasternodeMan::Add(CMasternode &mn)
@@ -76,6 +84,9 @@ bool CMasternodeMan::Add(CMasternode &mn)
     } else {
         mapMasternodes[mn.pubKeyMasternode] = mn;
         fMasternodesAdded = true;
+        InvalidateScoresCache();
+        fPaymentQueueValid = false;
+        fMasternodeAddressesValid = false;
     }
 
     LogPrint("masternode", "CMasternodeMan::Add -- Adding new Masternode: addr=%s, %i now\n",
@@ -181,6 +192,9 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
                 // and finally remove it from the list
                 mapMasternodes.erase(it++);
                 fMasternodesRemoved = true;
+                InvalidateScoresCache();
+                fPaymentQueueValid = false;
+                fMasternodeAddressesValid = false;
             } else {
                 /* Assume the masternode is valid. */
                 bool fAsk = (nAskForMnbRecovery > 0) && masternodeSync.IsSynced() &&
@@ -317,25 +331,27 @@ void CMasternodeMan::CheckAndRemove(CConnman& connman)
         // NOTE: do not expire mapSeenMasternodeBroadcast entries here, clean them on mnb updates!
 
         // remove expired mapSeenMasternodePing
-        std::map<uint256, CMasternodePing>::iterator it4 = mapSeenMasternodePing.begin();
-        while(it4 != mapSeenMasternodePing.end()){
-            if((*it4).second.IsExpired()) {
+        std::multimap<int64_t, uint256>::iterator itPing = mmapSeenMasternodePingBySigTime.begin();
+        while(itPing != mmapSeenMasternodePingBySigTime.end() &&
+                GetAdjustedTime() - itPing->first > MASTERNODE_NEW_START_REQUIRED_SECONDS) {
+            std::map<uint256, CMasternodePing>::iterator it4 = mapSeenMasternodePing.find(itPing->second);
+            if(it4 != mapSeenMasternodePing.end() && (*it4).second.IsExpired()) {
                 LogPrint("masternode", "CMasternodeMan::CheckAndRemove -- Removing expired Masternode ping: hash=%s\n", (*it4).second.GetHash().ToString());
-                mapSeenMasternodePing.erase(it4++);
-            } else {
-                ++it4;
+                mapSeenMasternodePing.erase(it4);
             }
+            mmapSeenMasternodePingBySigTime.erase(itPing++);
         }
 
         // remove expired mapSeenMasternodeVerification
-        std::map<uint256, CMasternodeVerification>::iterator itv2 = mapSeenMasternodeVerification.begin();
-        while(itv2 != mapSeenMasternodeVerification.end()){
-            if((*itv2).second.nBlockHeight < nCachedBlockHeight - MAX_POSE_BLOCKS){
+        std::multimap<int, uint256>::iterator itVerification = mmapSeenMasternodeVerificationByHeight.begin();
+        while(itVerification != mmapSeenMasternodeVerificationByHeight.end() &&
+                itVerification->first < nCachedBlockHeight - MAX_POSE_BLOCKS) {
+            std::map<uint256, CMasternodeVerification>::iterator itv2 = mapSeenMasternodeVerification.find(itVerification->second);
+            if(itv2 != mapSeenMasternodeVerification.end() && (*itv2).second.nBlockHeight < nCachedBlockHeight - MAX_POSE_BLOCKS) {
                 LogPrint("masternode", "CMasternodeMan::CheckAndRemove -- Removing expired Masternode verification: hash=%s\n", (*itv2).first.ToString());
-                mapSeenMasternodeVerification.erase(itv2++);
-            } else {
-                ++itv2;
+                mapSeenMasternodeVerification.erase(itv2);
             }
+            mmapSeenMasternodeVerificationByHeight.erase(itVerification++);
         }
 
         LogPrintf("CMasternodeMan::CheckAndRemove -- %s\n", ToString());
@@ -350,11 +366,42 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    InvalidateScoresCache();
+    fPaymentQueueValid = false;
+    fMasternodeAddressesValid = false;
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    mmapSeenMasternodePingBySigTime.clear();
+}
+
+bool CMasternodeMan::AddSeenMasternodePing(const CMasternodePing& mnp)
+{
+    LOCK(cs);
+    if(!mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp)).second) return false;
+    mmapSeenMasternodePingBySigTime.insert(std::make_pair(mnp.sigTime, mnp.GetHash()));
+    return true;
+}
+
+void CMasternodeMan::AddSeenMasternodeVerification(const CMasternodeVerification& mnv)
+{
+    AssertLockHeld(cs);
+    if(!mapSeenMasternodeVerification.insert(std::make_pair(mnv.GetHash(), mnv)).second) return;
+    mmapSeenMasternodeVerificationByHeight.insert(std::make_pair(mnv.nBlockHeight, mnv.GetHash()));
+}
+
+void CMasternodeMan::InvalidateScoresCache()
+{
+    LOCK(cs);
+    mapScoresCache.Clear();
+}
+
+void CMasternodeMan::InvalidateMasternodeAddresses()
+{
+    LOCK(cs);
+    fMasternodeAddressesValid = false;
 }
 
 int CMasternodeMan::CountMasternodes(int nProtocolVersion)
@@ -479,6 +526,19 @@ bool CMasternodeMan::Has(const CPubKey& pubKey)
     return mapMasternodes.find(pubKey) != mapMasternodes.end();
 }
 
+bool CMasternodeMan::HasAddress(const CNetAddr& addr)
+{
+    LOCK(cs);
+    if (!fMasternodeAddressesValid) {
+        setMasternodeAddresses.clear();
+        for (auto& mnpair : mapMasternodes) {
+            setMasternodeAddresses.insert(CNetAddr(mnpair.second.addr));
+        }
+        fMasternodeAddressesValid = true;
+    }
+    return setMasternodeAddresses.count(addr) > 0;
+}
+
 //
 // Deterministically select the oldest/best masternode to pay on the network
 //
@@ -487,6 +547,50 @@ bool CMasternodeMan::GetNextMasternodeInQueueForPayment(bool fFilterSigTime, boo
     return GetNextMasternodeInQueueForPayment(nCachedBlockHeight, fFilterSigTime, fFilterScheduled, nCountRet, mnInfoRet);
 }
 
+void CMasternodeMan::UpdatePaymentQueue()
+{
+    AssertLockHeld(cs);
+
+    if (!fPaymentQueueValid) {
+        vecPaymentQueue.clear();
+        vecPaymentQueue.reserve(mapMasternodes.size());
+        for (auto& mnpair : mapMasternodes) {
+            payment_queue_entry_t entry;
+            entry.nBlockLastPaid = mnpair.second.GetLastPaidBlock();
+            entry.pmn = &mnpair.second;
+            entry.scriptPayee = GetScriptForDestination(mnpair.second.payee.Get());
+            vecPaymentQueue.push_back(entry);
+        }
+        std::sort(vecPaymentQueue.begin(), vecPaymentQueue.end(), CompareLastPaidBlock());
+        fPaymentQueueValid = true;
+        return;
+    }
+
+    // Only the few masternodes paid since the last update moved. The others
+    // keep their relative order, so take the moved ones out, sort them and
+    // merge them back in.
+    std::vector<payment_queue_entry_t> vecMoved;
+    size_t nKept = 0;
+    for (size_t i = 0; i < vecPaymentQueue.size(); i++) {
+        payment_queue_entry_t& entry = vecPaymentQueue[i];
+        int nBlockLastPaid = entry.pmn->GetLastPaidBlock();
+        if (nBlockLastPaid != entry.nBlockLastPaid) {
+            entry.nBlockLastPaid = nBlockLastPaid;
+            vecMoved.push_back(std::move(entry));
+        } else {
+            if (nKept != i)
+                vecPaymentQueue[nKept] = std::move(entry);
+            nKept++;
+        }
+    }
+    if (vecMoved.empty())
+        return;
+    vecPaymentQueue.erase(vecPaymentQueue.begin() + nKept, vecPaymentQueue.end());
+    std::sort(vecMoved.begin(), vecMoved.end(), CompareLastPaidBlock());
+    vecPaymentQueue.insert(vecPaymentQueue.end(), std::make_move_iterator(vecMoved.begin()), std::make_move_iterator(vecMoved.end()));
+    std::inplace_merge(vecPaymentQueue.begin(), vecPaymentQueue.begin() + nKept, vecPaymentQueue.end(), CompareLastPaidBlock());
+}
+
 bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, bool fFilterScheduled, int& nCountRet, masternode_info_t& mnInfoRet)
 {
     mnInfoRet = masternode_info_t();
@@ -500,42 +604,53 @@ bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool f
     // Need LOCK2 here to ensure consistent locking order because the GetBlockHash call below locks cs_main
     LOCK2(cs_main,cs);
 
-    std::vector<std::pair<int, CMasternode*> > vecMasternodeLastPaid;
+    if (!fPaymentQueueValid) {
+        UpdatePaymentQueue();
+    }
+
+    // Payees of the blocks that are already scheduled, looked up once instead of per masternode
+    std::set<CScript> setScheduledPayees;
+    if (fFilterScheduled) {
+        mnpayments.GetScheduledPayees(nBlockHeight, setScheduledPayees);
+    }
 
     /*
-        Make a vector with all of the last paid times
+        Walk the payment queue, oldest payment first, and keep the first tenth of the eligible masternodes
     */
 
     int nMnCount = CountMasternodes();
+    int nMinProtocol = mnpayments.GetMinMasternodePaymentsProto();
+    int64_t nTimeNow = GetAdjustedTime();
+    int nTenthNetwork = nMnCount/10;
 
-    for (auto& mnpair : mapMasternodes) {
-        if(!mnpair.second.IsValidForPayment()) continue;
+    std::vector<CMasternode*> vecOldest;
+
+    for (const auto& entry : vecPaymentQueue) {
+        CMasternode* pmn = entry.pmn;
+
+        if(!pmn->IsValidForPayment()) continue;
 
         //check protocol version
-        if(mnpair.second.nProtocolVersion < mnpayments.GetMinMasternodePaymentsProto()) continue;
+        if(pmn->nProtocolVersion < nMinProtocol) continue;
 
         //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        if(fFilterScheduled && mnpayments.IsScheduled(mnpair.second, nBlockHeight)) continue;
+        if(fFilterScheduled && setScheduledPayees.count(entry.scriptPayee)) continue;
 
         //it's too new, wait for a cycle
-        if(fFilterSigTime && mnpair.second.sigTime + (nMnCount*2.6*60) > GetAdjustedTime()) continue;
+        if(fFilterSigTime && pmn->sigTime + (nMnCount*2.6*60) > nTimeNow) continue;
 
         //make sure it has at least as many confirmations as there are masternodes
         // ToDo: VERIFY IT!!!
         //if (GetUTXOConfirmations(mnpair.first) < nMnCount) continue;
 
-        vecMasternodeLastPaid.push_back(std::make_pair(mnpair.second.GetLastPaidBlock(), &mnpair.second));
+        if(nCountRet < std::max(nTenthNetwork, 1)) vecOldest.push_back(pmn);
+        nCountRet++;
     }
 
-    nCountRet = (int)vecMasternodeLastPaid.size();
-
     //when the network is in the process of upgrading, don't penalize nodes that recently restarted
     if(fFilterSigTime && nCountRet < nMnCount/3)
         return GetNextMasternodeInQueueForPayment(nBlockHeight, false, fFilterScheduled, nCountRet, mnInfoRet);
 
-    // Sort them low to high
-    sort(vecMasternodeLastPaid.begin(), vecMasternodeLastPaid.end(), CompareLastPaidBlock());
-
     uint256 blockHash;
     if(!GetBlockHash(blockHash, nBlockHeight - 101)) {
         LogPrintf("CMasternode::GetNextMasternodeInQueueForPayment -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", nBlockHeight - 101);
@@ -545,18 +660,14 @@ bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool f
     //  -- This doesn't look at who is being paid in the +8-10 blocks, allowing for double payments very rarely
     //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
     //  -- (chance per block * chances before IsScheduled will fire)
-    int nTenthNetwork = nMnCount/10;
-    int nCountTenth = 0;
     arith_uint256 nHighest = 0;
     CMasternode *pBestMasternode = NULL;
-    BOOST_FOREACH (PAIRTYPE(int, CMasternode*)& s, vecMasternodeLastPaid){
-        arith_uint256 nScore = s.second->CalculateScore(blockHash);
+    BOOST_FOREACH (CMasternode* pmn, vecOldest) {
+        arith_uint256 nScore = pmn->CalculateScore(blockHash);
         if(nScore > nHighest){
             nHighest = nScore;
-            pBestMasternode = s.second;
+            pBestMasternode = pmn;
         }
-        nCountTenth++;
-        if(nCountTenth >= nTenthNetwork) break;
     }
     if (pBestMasternode) {
         mnInfoRet = pBestMasternode->GetInfo();
@@ -564,9 +675,9 @@ bool CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight, bool f
     return mnInfoRet.fInfoValid;
 }
 
-bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeMan::score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol)
+bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeMan::masternode_scores_ptr& scoresRet, int nMinProtocol)
 {
-    vecMasternodeScoresRet.clear();
+    scoresRet.reset();
 
     if (!masternodeSync.IsMasternodeListSynced())
         return false;
@@ -576,15 +687,33 @@ bool CMasternodeMan::GetMasternodeScores(const uint256& nBlockHash, CMasternodeM
     if (mapMasternodes.empty())
         return false;
 
+    // The same block is ranked over and over while votes for it come in, so
+    // scores are calculated and sorted only once per block and protocol.
+    scores_key_t key = std::make_pair(nBlockHash, nMinProtocol);
+    if (mapScoresCache.Get(key, scoresRet) && scoresRet->fDIP0001 == fDIP0001WasLockedIn)
+        return !scoresRet->vecScores.empty();
+
+    std::shared_ptr<masternode_scores_t> scores = std::make_shared<masternode_scores_t>();
+    scores->fDIP0001 = fDIP0001WasLockedIn;
+    scores->vecScores.reserve(mapMasternodes.size());
+
     // calculate scores
     for (auto& mnpair : mapMasternodes) {
         if (mnpair.second.nProtocolVersion >= nMinProtocol) {
-            vecMasternodeScoresRet.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
+            scores->vecScores.push_back(std::make_pair(mnpair.second.CalculateScore(nBlockHash), &mnpair.second));
         }
     }
 
-    sort(vecMasternodeScoresRet.rbegin(), vecMasternodeScoresRet.rend(), CompareScoreMN());
-    return !vecMasternodeScoresRet.empty();
+    sort(scores->vecScores.rbegin(), scores->vecScores.rend(), CompareScoreMN());
+
+    scores->mapRanks.reserve(scores->vecScores.size());
+    for (size_t i = 0; i < scores->vecScores.size(); i++) {
+        scores->mapRanks.insert(std::make_pair(scores->vecScores[i].second->pubKeyMasternode, (int)i + 1));
+    }
+
+    scoresRet = scores;
+    mapScoresCache.Insert(key, scoresRet);
+    return !scoresRet->vecScores.empty();
 }
 
 bool CMasternodeMan::GetMasternodeRank(const CPubKey &pubKey, int& nRankRet, int nBlockHeight, int nMinProtocol)
@@ -603,20 +732,16 @@ bool CMasternodeMan::GetMasternodeRank(const CPubKey &pubKey, int& nRankRet, int
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    masternode_scores_ptr scores;
+    if (!GetMasternodeScores(nBlockHash, scores, nMinProtocol))
         return false;
 
-    int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
-        nRank++;
-        if(scorePair.second->pubKeyMasternode == pubKey) {
-            nRankRet = nRank;
-            return true;
-        }
-    }
+    auto it = scores->mapRanks.find(pubKey);
+    if (it == scores->mapRanks.end())
+        return false;
 
-    return false;
+    nRankRet = it->second;
+    return true;
 }
 
 bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMasternodeRanksRet, int nBlockHeight, int nMinProtocol)
@@ -635,12 +760,13 @@ bool CMasternodeMan::GetMasternodeRanks(CMasternodeMan::rank_pair_vec_t& vecMast
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    masternode_scores_ptr scores;
+    if (!GetMasternodeScores(nBlockHash, scores, nMinProtocol))
         return false;
 
+    vecMasternodeRanksRet.reserve(scores->vecScores.size());
     int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
+    for (auto& scorePair : scores->vecScores) {
         nRank++;
         vecMasternodeRanksRet.push_back(std::make_pair(nRank, *scorePair.second));
     }
@@ -664,23 +790,15 @@ bool CMasternodeMan::GetMasternodeByRank(int nRankIn, masternode_info_t& mnInfoR
 
     LOCK(cs);
 
-    score_pair_vec_t vecMasternodeScores;
-    if (!GetMasternodeScores(nBlockHash, vecMasternodeScores, nMinProtocol))
+    masternode_scores_ptr scores;
+    if (!GetMasternodeScores(nBlockHash, scores, nMinProtocol))
         return false;
 
-    if (vecMasternodeScores.size() < nRankIn)
+    if (nRankIn < 1 || (size_t)nRankIn > scores->vecScores.size())
         return false;
 
-    int nRank = 0;
-    for (auto& scorePair : vecMasternodeScores) {
-        nRank++;
-        if(nRank == nRankIn) {
-            mnInfoRet = *scorePair.second;
-            return true;
-        }
-    }
-
-    return false;
+    mnInfoRet = *scores->vecScores[nRankIn - 1].second;
+    return true;
 }
 
 void CMasternodeMan::ProcessMasternodeConnections(CConnman& connman)
@@ -738,6 +856,8 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         LogPrint("masternode", "MNANNOUNCE -- Masternode announce, masternode=%s\n",
                  mnb.pubKeyMasternode.GetID().ToString());
 
+        PreVerifyQueuedBroadcasts(pfrom, mnb);
+
         int nDos = 0;
 
         if (CheckMnbAndUpdateMasternodeList(pfrom, mnb, nDos, connman)) {
@@ -764,8 +884,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
         LOCK2(cs_main, cs);
 
-        if (mapSeenMasternodePing.count(nHash)) return; //seen
-        mapSeenMasternodePing.insert(std::make_pair(nHash, mnp));
+        if (!AddSeenMasternodePing(mnp)) return; //seen
 
         LogPrint("masternode", "MNPING -- Masternode ping, masternode=%s new\n", mnp.pubKeyMasternode.GetID().ToString());
 
@@ -839,7 +958,7 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
             nInvCount++;
 
             mapSeenMasternodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
-            mapSeenMasternodePing.insert(std::make_pair(hashMNP, mnp));
+            AddSeenMasternodePing(mnp);
 
             if (pubkey == mnpair.first) {
                 LogPrintf("DSEG -- Sent 1 Masternode inv to peer %d\n", pfrom->id);
@@ -1156,7 +1275,7 @@ void CMasternodeMan::ProcessVerifyReply(CNode* pnode, CMasternodeVerification& m
                     }
 
                     mWeAskedForVerification[pnode->addr] = mnv;
-                    mapSeenMasternodeVerification.insert(std::make_pair(mnv.GetHash(), mnv));
+                    AddSeenMasternodeVerification(mnv);
                     mnv.Relay();
 
                 } else {
@@ -1193,7 +1312,7 @@ void CMasternodeMan::ProcessVerifyBroadcast(CNode* pnode, const CMasternodeVerif
         // we already have one
         return;
     }
-    mapSeenMasternodeVerification[mnv.GetHash()] = mnv;
+    AddSeenMasternodeVerification(mnv);
 
     // we don't care about history
     if(mnv.nBlockHeight < nCachedBlockHeight - MAX_POSE_BLOCKS) {
@@ -1309,7 +1428,7 @@ std::string CMasternodeMan::ToString() const
 void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb, CConnman& connman)
 {
     LOCK2(cs_main, cs);
-    mapSeenMasternodePing.insert(std::make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
+    AddSeenMasternodePing(mnb.lastPing);
     mapSeenMasternodeBroadcast.insert(std::make_pair(mnb.GetHash(), std::make_pair(GetTime(), mnb)));
 
     LogPrintf("CMasternodeMan::UpdateMasternodeList -- masternode=%s  addr=%s\n",
@@ -1329,6 +1448,44 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb, CConnman& co
     }
 }
 
+void CMasternodeMan::PreVerifyQueuedBroadcasts(CNode* pfrom, const CMasternodeBroadcast& mnb)
+{
+    CHashSigBatch batch;
+    {
+        LOCK(cs);
+        // Seen announcements are not verified again, and if this one was
+        // part of an earlier batch its signatures are cached already.
+        if (mapSeenMasternodeBroadcast.count(mnb.GetHash())) return;
+        if (!mnb.IsWorthVerifying()) return;
+        mnb.AddSignaturesToBatch(batch);
+        if (batch.size() == 0) return;
+    }
+
+    std::vector<CDataStream> vMessages;
+    pfrom->PeekProcessMsg(NetMsgType::MNANNOUNCE, HASHSIG_BATCH_LOOKAHEAD, vMessages);
+    {
+        LOCK(cs);
+        BOOST_FOREACH(CDataStream& vRecv, vMessages) {
+            CMasternodeBroadcast mnbQueued;
+            try {
+                vRecv >> mnbQueued;
+            } catch (const std::exception& e) {
+                // ProcessMessages deals with it when it gets there
+                continue;
+            }
+            if (mapSeenMasternodeBroadcast.count(mnbQueued.GetHash())) continue;
+            if (!mnbQueued.IsWorthVerifying()) continue;
+            mnbQueued.AddSignaturesToBatch(batch);
+        }
+    }
+
+    if (batch.size() > 1) {
+        batch.Verify();
+        LogPrint("masternode", "CMasternodeMan::PreVerifyQueuedBroadcasts -- verified %d signatures of %d queued announcements, peer=%d\n",
+                 batch.size(), vMessages.size(), pfrom->id);
+    }
+}
+
 bool CMasternodeMan::CheckMnbAndUpdateMasternodeList(CNode* pfrom, CMasternodeBroadcast mnb, int& nDos, CConnman& connman)
 {
     // Need to lock cs_main here to ensure consistent locking order because the SimpleCheck call below locks cs_main
@@ -1451,6 +1608,9 @@ void CMasternodeMan::UpdateLastPaid(const CBlockIndex* pindex)
         mnpair.second.UpdateLastPaid(pindex, nMaxBlocksToScanBack);
     }
 
+    // Re-sort the payment queue now rather than on the next payee lookup
+    UpdatePaymentQueue();
+
     IsFirstRun = false;
 }
 
@@ -1481,7 +1641,7 @@ void CMasternodeMan::SetMasternodeLastPing(const CPubKey& pubKey, const CMastern
         return;
     }
     pmn->lastPing = mnp;
-    mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
+    AddSeenMasternodePing(mnp);
 
     CMasternodeBroadcast mnb(*pmn);
     uint256 hash = mnb.GetHash();
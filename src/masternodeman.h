@@ -14,8 +14,11 @@
 #include "net.h"
 #include "timedata.h"
 
+#include "crypto/common.h"
 #include "primitives/transaction.h"
 #include <boost/lexical_cast.hpp>
+#include <boost/unordered_map.hpp>
+#include <memory>
 
 using namespace std;
 
@@ -24,6 +27,12 @@ class CConnman;
 
 extern CMasternodeMan mnodeman;
 
+/** Hasher for maps keyed by masternode pubkey, the x coordinate is already uniformly distributed */
+struct PubKeyCheapHasher
+{
+    size_t operator()(const CPubKey& pubKey) const { return ReadLE64(pubKey.begin() + 1); }
+};
+
 class CMasternodeMan
 {
 public:
@@ -33,6 +42,18 @@ public:
     typedef std::vector<rank_pair_t> rank_pair_vec_t;
 
 private:
+    /// Masternodes sorted by score for one block hash and minimum protocol
+    struct masternode_scores_t {
+        /// fDIP0001WasLockedIn at the time the scores were calculated
+        bool fDIP0001;
+        /// highest score (rank 1) first
+        score_pair_vec_t vecScores;
+        /// rank of every masternode in vecScores
+        boost::unordered_map<CPubKey, int, PubKeyCheapHasher> mapRanks;
+    };
+    typedef std::shared_ptr<const masternode_scores_t> masternode_scores_ptr;
+    typedef std::pair<uint256, int> scores_key_t;
+
     static const std::string SERIALIZATION_VERSION_STRING;
 
     static const int DSEG_UPDATE_SECONDS        = 3 * 60 * 60;
@@ -50,6 +71,8 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const int MAX_SCORES_CACHE_SIZE          = 32;
+
 
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -79,11 +102,45 @@ private:
     /// Set when masternodes are removed
     bool fMasternodesRemoved;
 
+    /// Recently calculated scores, by block hash and minimum protocol. Entries
+    /// point into mapMasternodes, InvalidateScoresCache() must be called
+    /// whenever a masternode is removed or its protocol version changes.
+    CacheMap<scores_key_t, masternode_scores_ptr> mapScoresCache;
+
+    /// Masternode in the payment queue with its payee script
+    struct payment_queue_entry_t {
+        int nBlockLastPaid;
+        CMasternode* pmn;
+        CScript scriptPayee;
+    };
+
+    /// All masternodes ordered by last paid block (then pubkey), oldest first.
+    /// Entries point into mapMasternodes, fPaymentQueueValid must be reset
+    /// whenever a masternode is added or removed.
+    std::vector<payment_queue_entry_t> vecPaymentQueue;
+    bool fPaymentQueueValid;
+
+    void UpdatePaymentQueue();
+
+    /// Addresses of all masternodes, for HasAddress. Rebuilt when
+    /// fMasternodeAddressesValid was reset, which must happen whenever a
+    /// masternode is added or removed or its address changes.
+    std::set<CNetAddr> setMasternodeAddresses;
+    bool fMasternodeAddressesValid;
+
     friend class CMasternodeSync;
     /// Find an entry
     CMasternode* Find(const CPubKey& pubKey);
 
-    bool GetMasternodeScores(const uint256& nBlockHash, score_pair_vec_t& vecMasternodeScoresRet, int nMinProtocol = 0);
+    bool GetMasternodeScores(const uint256& nBlockHash, masternode_scores_ptr& scoresRet, int nMinProtocol = 0);
+
+    /// Seen pings by sigTime and seen verifications by block height, oldest
+    /// first, so CheckAndRemove only visits the expired ones. Entries whose
+    /// ping or verification is gone already are skipped when they come up.
+    std::multimap<int64_t, uint256> mmapSeenMasternodePingBySigTime;
+    std::multimap<int, uint256> mmapSeenMasternodeVerificationByHeight;
+
+    void AddSeenMasternodeVerification(const CMasternodeVerification& mnv);
 
 public:
     // Keep track of all broadcasts I've seen
@@ -116,8 +173,17 @@ public:
 
         READWRITE(mapSeenMasternodeBroadcast);
         READWRITE(mapSeenMasternodePing);
-        if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
-            Clear();
+        if(ser_action.ForRead()) {
+            mmapSeenMasternodePingBySigTime.clear();
+            for (std::map<uint256, CMasternodePing>::const_iterator it = mapSeenMasternodePing.begin(); it != mapSeenMasternodePing.end(); ++it) {
+                mmapSeenMasternodePingBySigTime.insert(std::make_pair(it->second.sigTime, it->first));
+            }
+            mapScoresCache.Clear();
+            fPaymentQueueValid = false;
+            fMasternodeAddressesValid = false;
+            if (strVersion != SERIALIZATION_VERSION_STRING) {
+                Clear();
+            }
         }
     }
 
@@ -126,6 +192,9 @@ public:
     /// Add an entry
     bool Add(CMasternode &mn);
 
+    /// Remember a ping as seen, returns false if it was seen before
+    bool AddSeenMasternodePing(const CMasternodePing& mnp);
+
     /// Ask (source) node for mnb
     void AskForMN(CNode *pnode, const CPubKey& pubKey, CConnman& connman);
     void AskForMnb(CNode *pnode, const uint256 &hash);
@@ -143,6 +212,11 @@ public:
     /// Clear Masternode vector
     void Clear();
 
+    /// Drop all cached scores and ranks, see mapScoresCache
+    void InvalidateScoresCache();
+    /// Drop the addresses HasAddress looks at, see setMasternodeAddresses
+    void InvalidateMasternodeAddresses();
+
     /// Count Masternodes filtered by nProtocolVersion.
     /// Masternode nProtocolVersion should match or be above the one specified in param here.
     int CountMasternodes(int nProtocolVersion = -1);
@@ -158,6 +232,8 @@ public:
     /// Versions of Find that are safe to use from outside the class
     bool Get(const CPubKey& pubKey, CMasternode& masternodeRet);
     bool Has(const CPubKey& pubKey);
+    /// Whether a masternode in the list runs at this address
+    bool HasAddress(const CNetAddr& addr);
 
     bool GetMasternodeInfo(const CPubKey& pubKeyMasternode, masternode_info_t& mnInfoRet);
     bool GetMasternodeInfo(const CScript& payee, masternode_info_t& mnInfoRet);
@@ -179,6 +255,8 @@ public:
     std::pair<CService, std::set<uint256> > PopScheduledMnbRequestConnection();
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+    /// Verify the signatures of mnb and the announcements queued behind it from pfrom as one batch
+    void PreVerifyQueuedBroadcasts(CNode* pfrom, const CMasternodeBroadcast& mnb);
 
     void DoFullVerificationStep(CConnman& connman);
     void CheckSameAddr();
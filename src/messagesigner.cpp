@@ -3,12 +3,111 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "cuckoocache.h"
 #include "hash.h"
-#include "validation.h" // For strMessageMagic
+#include "random.h"
+#include "validation.h" // For strMessageMagic, RunParallelChecks
 #include "messagesigner.h"
 #include "tinyformat.h"
+#include "util.h"
 #include "utilstrencodings.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+/** Each cuckoo hash is one 32-bit word of the salted entry */
+class HashSigCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+/** Number of entries of the valid hash signature cache, about 2MB */
+static const uint32_t HASHSIG_CACHE_ENTRIES = 1 << 16;
+/** Number of entries of the invalid hash signature cache, about 512kB */
+static const uint32_t HASHSIG_CACHE_INVALID_ENTRIES = 1 << 14;
+
+/**
+ * Checked hash signatures, so messages verified in a batch, and the orphan
+ * InstantSend votes that are checked again and again, do not need another
+ * public key recovery. Invalid ones are kept too, so a peer sending badly
+ * signed messages does not get them recovered once per batch they are in.
+ */
+class CHashSigCache
+{
+private:
+    //! Entries are SHA256(nonce || hash || key id || signature)
+    uint256 nonce;
+    CuckooCache::cache<uint256, HashSigCacheHasher> setValid;
+    CuckooCache::cache<uint256, HashSigCacheHasher> setInvalid;
+    boost::shared_mutex cs_hashsigcache;
+
+public:
+    CHashSigCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup(HASHSIG_CACHE_ENTRIES);
+        setInvalid.setup(HASHSIG_CACHE_INVALID_ENTRIES);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_hashsigcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_hashsigcache);
+        setValid.insert(entry);
+    }
+
+    bool GetInvalid(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_hashsigcache);
+        return setInvalid.contains(entry, false);
+    }
+
+    void SetInvalid(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_hashsigcache);
+        setInvalid.insert(entry);
+    }
+};
+
+CHashSigCache hashSigCache;
+
+/** Check one signature of a CHashSigBatch, run on a script check thread */
+bool CheckHashSig(const uint256* phash, const CKeyID* pkeyID, const std::vector<unsigned char>* pvchSig, char* pfValid)
+{
+    CPubKey pubkeyFromSig;
+    *pfValid = pubkeyFromSig.RecoverCompact(*phash, *pvchSig) && pubkeyFromSig.GetID() == *pkeyID;
+    uint256 entry;
+    hashSigCache.ComputeEntry(entry, *phash, *pkeyID, *pvchSig);
+    if (*pfValid) {
+        hashSigCache.Set(entry);
+    } else {
+        hashSigCache.SetInvalid(entry);
+    }
+    // Always carry on, every signature gets a result
+    return true;
+}
+
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CBitcoinSecret vchSecret;
@@ -23,20 +122,20 @@ bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet
 
 bool CMessageSigner::SignMessage(const std::string strMessage, std::vector<unsigned char>& vchSigRet, const CKey key)
 {
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << strMessageMagic;
-    ss << strMessage;
-
-    return CHashSigner::SignHash(ss.GetHash(), key, vchSigRet);
+    return CHashSigner::SignHash(GetMessageHash(strMessage), key, vchSigRet);
 }
 
 bool CMessageSigner::VerifyMessage(const CPubKey pubkey, const std::vector<unsigned char>& vchSig, const std::string strMessage, std::string& strErrorRet)
+{
+    return CHashSigner::VerifyHash(GetMessageHash(strMessage), pubkey, vchSig, strErrorRet);
+}
+
+uint256 CMessageSigner::GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
-
-    return CHashSigner::VerifyHash(ss.GetHash(), pubkey, vchSig, strErrorRet);
+    return ss.GetHash();
 }
 
 bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet)
@@ -46,18 +145,75 @@ bool CHashSigner::SignHash(const uint256& hash, const CKey key, std::vector<unsi
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    CKeyID keyID = pubkey.GetID();
+    uint256 entry;
+    hashSigCache.ComputeEntry(entry, hash, keyID, vchSig);
+    if(hashSigCache.Get(entry)) {
+        return true;
+    }
+    if(hashSigCache.GetInvalid(entry)) {
+        strErrorRet = strprintf("Signature already known to be invalid: pubkey=%s, hash=%s", keyID.ToString(), hash.ToString());
+        return false;
+    }
+
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
+        hashSigCache.SetInvalid(entry);
         strErrorRet = "Error recovering public key.";
         return false;
     }
 
-    if(pubkeyFromSig.GetID() != pubkey.GetID()) {
+    if(pubkeyFromSig.GetID() != keyID) {
+        hashSigCache.SetInvalid(entry);
         strErrorRet = strprintf("Keys don't match: pubkey=%s, pubkeyFromSig=%s, hash=%s, vchSig=%s",
-                    pubkey.GetID().ToString(), pubkeyFromSig.GetID().ToString(), hash.ToString(),
+                    keyID.ToString(), pubkeyFromSig.GetID().ToString(), hash.ToString(),
                     EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
 
+    hashSigCache.Set(entry);
+    return true;
+}
+
+bool CHashSigBatch::Add(const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig)
+{
+    Item item;
+    item.hash = hash;
+    item.keyID = pubkey.GetID();
+    item.vchSig = vchSig;
+
+    uint256 entry;
+    hashSigCache.ComputeEntry(entry, item.hash, item.keyID, item.vchSig);
+    if(hashSigCache.Get(entry) || hashSigCache.GetInvalid(entry)) {
+        return false;
+    }
+
+    vItems.push_back(item);
     return true;
 }
+
+bool CHashSigBatch::AddMessage(const std::string& strMessage, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig)
+{
+    return Add(CMessageSigner::GetMessageHash(strMessage), pubkey, vchSig);
+}
+
+bool CHashSigBatch::Verify()
+{
+    vValid.assign(vItems.size(), false);
+
+    // vItems and vValid do not change size from here on, the checks point into them
+    std::vector<CParallelCheck> vChecks;
+    vChecks.reserve(vItems.size());
+    for (size_t i = 0; i < vItems.size(); i++) {
+        vChecks.push_back(CParallelCheck(boost::bind(&CheckHashSig, &vItems[i].hash, &vItems[i].keyID, &vItems[i].vchSig, &vValid[i])));
+    }
+
+    // Don't wait for a block being connected, check them here instead
+    if (vChecks.size() < 2 || !RunParallelChecks(vChecks, false)) {
+        for (size_t i = 0; i < vChecks.size(); i++) {
+            vChecks[i]();
+        }
+    }
+
+    return std::find(vValid.begin(), vValid.end(), false) == vValid.end();
+}
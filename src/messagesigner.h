@@ -7,6 +7,11 @@
 
 #include "key.h"
 
+#include <vector>
+
+/** Maximum number of queued network messages whose signatures are verified together with the one being processed */
+static const unsigned int HASHSIG_BATCH_LOOKAHEAD = 64;
+
 /** Helper class for signing messages and checking their signatures
  */
 class CMessageSigner
@@ -18,6 +23,8 @@ public:
     static bool SignMessage(const std::string strMessage, std::vector<unsigned char>& vchSigRet, const CKey key);
     /// Verify the message signature, returns true if succcessful
     static bool VerifyMessage(const CPubKey pubkey, const std::vector<unsigned char>& vchSig, const std::string strMessage, std::string& strErrorRet);
+    /// Get the hash that is signed for the message
+    static uint256 GetMessageHash(const std::string& strMessage);
 };
 
 /** Helper class for signing hashes and checking their signatures
@@ -31,4 +38,37 @@ public:
     static bool VerifyHash(const uint256& hash, const CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
 };
 
+/** Verifies a batch of hash signatures in parallel, on the script check threads.
+ *  Results are remembered, valid and invalid ones alike, so verifying one of
+ *  them again with CHashSigner::VerifyHash afterwards is just a lookup. Every
+ *  signature is checked on its own, so IsValid() tells which ones of a failed
+ *  batch are bad.
+ */
+class CHashSigBatch
+{
+private:
+    struct Item
+    {
+        uint256 hash;
+        CKeyID keyID;
+        std::vector<unsigned char> vchSig;
+    };
+
+    std::vector<Item> vItems;
+    std::vector<char> vValid;
+
+public:
+    /// Queue a signature, returns false if it was checked before and was not queued
+    bool Add(const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig);
+    /// Same as Add() for a signature of strMessage made with CMessageSigner
+    bool AddMessage(const std::string& strMessage, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig);
+
+    size_t size() const { return vItems.size(); }
+
+    /// Verify all queued signatures, returns true if all of them are valid
+    bool Verify();
+    /// Whether the i-th queued signature is valid, after Verify()
+    bool IsValid(size_t i) const { return vValid[i]; }
+};
+
 #endif
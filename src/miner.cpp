@@ -28,6 +28,10 @@
 #include "masternode-sync.h"
 #include "validationinterface.h"
 
+#include <algorithm>
+#include <atomic>
+#include <boost/bind.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -48,16 +52,11 @@ using namespace std;
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-class ScoreCompare
-{
-public:
-    ScoreCompare() {}
+CBlockTemplateCache* pblocktemplatecache = NULL;
 
-    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b)
-    {
-        return CompareTxMemPoolEntryByScore()(*b,*a); // Convert to less than
-    }
-};
+// Minimum number of seconds between rebuilds of a cached template that only
+// lost transactions to the mempool
+static const int64_t TEMPLATE_REBUILD_INTERVAL = 5;
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
@@ -74,253 +73,644 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
-CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn)
+BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
+    : pblocktemplate(NULL), pblock(NULL), chainparams(_chainparams)
+{
+    // Largest block you're willing to create:
+    nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
+    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MaxBlockSize()-1000), nBlockMaxSize));
+
+    // Minimum block size you want to create; block will be filled with free transactions
+    // until there are no more or the block reaches this size:
+    nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+    fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+}
+
+void BlockAssembler::resetBlock(const CScript& scriptPubKeyIn)
 {
+    inBlock.clear();
+
+    // Reserve space for coinbase tx
+    nBlockSize = 1000;
+    nBlockSigOps = 100;
+
+    // These counters do not include coinbase tx
+    nBlockTx = 0;
+    nFees = 0;
+
+    lastFewTxs = 0;
+    blockFinished = false;
+
+    scriptPubKey = scriptPubKeyIn;
+}
+
+CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    resetBlock(scriptPubKeyIn);
+
     // Create new block
-    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
-    if(!pblocktemplate.get())
+    std::unique_ptr<CBlockTemplate> ptemplate(new CBlockTemplate());
+    if(!ptemplate.get())
         return NULL;
-    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
+    pblocktemplate = ptemplate.get();
+    pblock = &pblocktemplate->block; // pointer for convenience
+
+    // Add dummy coinbase tx as first transaction
+    pblock->vtx.push_back(CTransaction());
+    pblocktemplate->vTxFees.push_back(-1); // updated at end
+    pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+
+    LOCK2(cs_main, mempool.cs);
+    pindexPrev = chainActive.Tip();
+    nHeight = pindexPrev->nHeight + 1;
+
+    pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+    // -regtest only: allow overriding block.nVersion with
+    // -blockversion=N to test forking scenarios
+    if (chainparams.MineBlocksOnDemand())
+        pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
+
+    pblock->nTime = GetAdjustedTime();
+    const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
+
+    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                       ? nMedianTimePast
+                       : pblock->GetBlockTime();
+
+    addPriorityTxs();
+    addPackageTxs();
+
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
+    LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
+
+    UpdateCoinbase();
 
+    // Fill in header
+    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
+    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+    pblock->nNonce         = 0;
+
+    CValidationState state;
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+    }
+
+    return ptemplate.release();
+}
+
+void BlockAssembler::UpdateCoinbase()
+{
     // Create coinbase tx
     CMutableTransaction txNew;
     txNew.vin.resize(1);
     txNew.vin[0].prevout.SetNull();
     txNew.vout.resize(1);
-    txNew.vout[0].scriptPubKey = scriptPubKeyIn;
+    txNew.vout[0].scriptPubKey = scriptPubKey;
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MaxBlockSize()-1000), nBlockMaxSize));
+    // NOTE: unlike in bitcoin, we need to pass PREVIOUS block height here
+    CAmount blockReward = nFees + GetBlockSubsidy(pindexPrev->nBits, pindexPrev->nHeight, chainparams.GetConsensus());
 
+    // Compute regular coinbase transaction.
+    txNew.vout[0].nValue = blockReward;
+    txNew.vin[0].scriptSig = CScript() << nHeight << OP_0;
+
+    /**
+     * Update coinbase transaction with additional info about masternode payments,
+     * get some info back to pass to getblocktemplate
+     */
+    if( nHeight > 1 ){
+        FillBlockPayments(txNew, nHeight, blockReward, pblock->txoutMasternode);
+    }
+
+    // Update block coinbase
+    pblock->vtx[0] = txNew;
+    pblocktemplate->vTxFees[0] = -nFees;
+    pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
+}
+
+bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
+{
+    BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
+    {
+        if (!inBlock.count(parent)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
+{
+    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
+        // Only test txs not already in the block
+        if (inBlock.count(*iit)) {
+            testSet.erase(iit++);
+        }
+        else {
+            iit++;
+        }
+    }
+}
+
+bool BlockAssembler::TestPackage(uint64_t packageSize, unsigned int packageSigOps)
+{
+    if (nBlockSize + packageSize >= nBlockMaxSize)
+        return false;
+    if (nBlockSigOps + packageSigOps >= MaxBlockSigOps())
+        return false;
+    return true;
+}
+
+// Block size and sigops have already been tested. Check that all transactions
+// are final.
+bool BlockAssembler::TestPackageFinality(const CTxMemPool::setEntries& package)
+{
+    BOOST_FOREACH (const CTxMemPool::txiter it, package) {
+        if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
+            return false;
+    }
+    return true;
+}
+
+bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
+{
+    if (nBlockSize + iter->GetTxSize() >= nBlockMaxSize) {
+        // If the block is so close to full that no more txs will fit
+        // or if we've tried more than 50 times to fill remaining space
+        // then flag that the block is finished
+        if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
+             blockFinished = true;
+             return false;
+        }
+        // Once we're within 1000 bytes of a full block, only look at 50 more txs
+        // to try to fill the remaining space.
+        if (nBlockSize > nBlockMaxSize - 1000) {
+            lastFewTxs++;
+        }
+        return false;
+    }
+
+    unsigned int nMaxBlockSigOps = MaxBlockSigOps();
+    if (nBlockSigOps + iter->GetSigOpCount() >= nMaxBlockSigOps) {
+        // If the block has room for no more sig ops then
+        // flag that the block is finished
+        if (nBlockSigOps > nMaxBlockSigOps - 2) {
+            blockFinished = true;
+            return false;
+        }
+        // Otherwise attempt to find another tx with fewer sigops
+        // to put in the block.
+        return false;
+    }
+
+    // Must check that lock times are still valid
+    // This can be removed once MTP is always enforced
+    // as long as reorgs keep the mempool consistent.
+    if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
+        return false;
+
+    return true;
+}
+
+void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+{
+    pblock->vtx.push_back(iter->GetTx());
+    pblocktemplate->vTxFees.push_back(iter->GetFee());
+    pblocktemplate->vTxSigOps.push_back(iter->GetSigOpCount());
+    nBlockSize += iter->GetTxSize();
+    ++nBlockTx;
+    nBlockSigOps += iter->GetSigOpCount();
+    nFees += iter->GetFee();
+    inBlock.insert(iter);
+
+    if (fPrintPriority) {
+        double dPriority = iter->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
+        LogPrintf("priority %.1f fee %s txid %s\n",
+                  dPriority,
+                  CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
+                  iter->GetTx().GetHash().ToString());
+    }
+}
+
+void BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
+        indexed_modified_transaction_set &mapModifiedTx)
+{
+    BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
+        CTxMemPool::setEntries descendants;
+        mempool.CalculateDescendants(it, descendants);
+        // Insert all descendants (not yet in block) into the modified set
+        BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
+            if (alreadyAdded.count(desc))
+                continue;
+            modtxiter mit = mapModifiedTx.find(desc);
+            if (mit == mapModifiedTx.end()) {
+                CTxMemPoolModifiedEntry modEntry(desc);
+                modEntry.nSizeWithAncestors -= it->GetTxSize();
+                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
+                modEntry.nSigOpCountWithAncestors -= it->GetSigOpCount();
+                mapModifiedTx.insert(modEntry);
+            } else {
+                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+            }
+        }
+    }
+}
+
+// Skip entries in mapTx that are already in a block or are present
+// in mapModifiedTx (which implies that the mapTx ancestor state is
+// stale due to ancestor inclusion in the block)
+// Also skip transactions that we've already failed to add. This can happen if
+// we consider a transaction in mapModifiedTx and it fails: we can then
+// potentially consider it again while walking mapTx.  It's currently
+// guaranteed to fail again, but as a belt-and-suspenders check we put it in
+// failedTx and avoid re-evaluation, since the re-evaluation would be using
+// cached size/sigops/fee values that are not actually correct.
+bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
+{
+    assert (it != mempool.mapTx.end());
+    if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it))
+        return true;
+    return false;
+}
+
+void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries)
+{
+    // Sort package by ancestor count
+    // If a transaction A depends on transaction B, then A's ancestor count
+    // must be greater than B's.  So this is sufficient to validly order the
+    // transactions for block inclusion.
+    sortedEntries.clear();
+    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
+    std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+}
+
+// This transaction selection algorithm orders the mempool based
+// on feerate of a transaction including all unconfirmed ancestors.
+// Since we don't remove transactions from the mempool as we select them
+// for block inclusion, we need an alternate method of updating the feerate
+// of a transaction with its not-yet-selected ancestors as we go.
+// This is accomplished by walking the in-mempool descendants of selected
+// transactions and storing a temporary modified state in mapModifiedTxs.
+// Each time through the loop, we compare the best transaction in
+// mapModifiedTxs with the next transaction in the mempool to decide what
+// transaction package to work on next.
+void BlockAssembler::addPackageTxs()
+{
+    // mapModifiedTx will store sorted packages after they are modified
+    // because some of their txs are already in the block
+    indexed_modified_transaction_set mapModifiedTx;
+    // Keep track of entries that failed inclusion, to avoid duplicate work
+    CTxMemPool::setEntries failedTx;
+
+    // Start by adding all descendants of previously added txs to mapModifiedTx
+    // and modifying them for their already included ancestors
+    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+
+    // Limit the number of attempts to add transactions to the block when it is
+    // close to full; this is just a simple heuristic to finish quickly if the
+    // mempool has a lot of entries.
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    // Walk the mempool by ancestor score
+    CTxMemPool::indexed_transaction_set::nth_index<4>::type::iterator mi = mempool.mapTx.get<4>().begin();
+    CTxMemPool::txiter iter;
+    while (mi != mempool.mapTx.get<4>().end() || !mapModifiedTx.empty())
+    {
+        // First try to find a new transaction in mapTx to evaluate.
+        if (mi != mempool.mapTx.get<4>().end() &&
+                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
+            ++mi;
+            continue;
+        }
+
+        // Now that mi is not stale, determine which transaction to evaluate:
+        // the next entry from mapTx, or the best from mapModifiedTx?
+        bool fUsingModified = false;
+
+        modtxscoreiter modit = mapModifiedTx.get<1>().begin();
+        if (mi == mempool.mapTx.get<4>().end()) {
+            // We're out of entries in mapTx; use the entry from mapModifiedTx
+            iter = modit->iter;
+            fUsingModified = true;
+        } else {
+            // Try to compare the mapTx entry to the mapModifiedTx entry
+            iter = mempool.mapTx.project<0>(mi);
+            if (modit != mapModifiedTx.get<1>().end() &&
+                    CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
+                // The best entry in mapModifiedTx has higher score
+                // than the one from mapTx.
+                // Switch which transaction (package) to consider
+                iter = modit->iter;
+                fUsingModified = true;
+            } else {
+                // Either no entry in mapModifiedTx, or it's worse than mapTx.
+                // Increment mi for the next loop iteration.
+                ++mi;
+            }
+        }
+
+        // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
+        // contain anything that is inBlock.
+        assert(!inBlock.count(iter));
+
+        uint64_t packageSize = iter->GetSizeWithAncestors();
+        CAmount packageFees = iter->GetModFeesWithAncestors();
+        unsigned int packageSigOps = iter->GetSigOpCountWithAncestors();
+        if (fUsingModified) {
+            packageSize = modit->nSizeWithAncestors;
+            packageFees = modit->nModFeesWithAncestors;
+            packageSigOps = modit->nSigOpCountWithAncestors;
+        }
+
+        if (packageFees < ::minRelayTxFee.GetFee(packageSize) && nBlockSize >= nBlockMinSize) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+
+        if (!TestPackage(packageSize, packageSigOps)) {
+            if (fUsingModified) {
+                // Since we always look at the best entry in mapModifiedTx,
+                // we must erase failed entries so that we can consider the
+                // next best entry on the next loop iteration
+                mapModifiedTx.get<1>().erase(modit);
+                failedTx.insert(iter);
+            }
+
+            ++nConsecutiveFailed;
+
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 1000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(iter);
+
+        // Test if all tx's are Final
+        if (!TestPackageFinality(ancestors)) {
+            if (fUsingModified) {
+                mapModifiedTx.get<1>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
+
+        // This transaction will make it in; reset the failed counter.
+        nConsecutiveFailed = 0;
+
+        // Package can be added. Sort the entries in a valid order.
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+
+        for (size_t i=0; i<sortedEntries.size(); ++i) {
+            AddToBlock(sortedEntries[i]);
+            // Erase from the modified set, if present
+            mapModifiedTx.erase(sortedEntries[i]);
+        }
+
+        // Update transactions that depend on each of these
+        UpdatePackagesForAdded(ancestors, mapModifiedTx);
+    }
+}
+
+void BlockAssembler::addPriorityTxs()
+{
     // How much of the block should be dedicated to high-priority transactions,
     // included regardless of the fees they pay
     unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
     nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
 
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
+    if (nBlockPrioritySize == 0) {
+        return;
+    }
 
     // This vector will be sorted into a priority queue:
-    vector<TxCoinAgePriority> vecPriority;
+    std::vector<TxCoinAgePriority> vecPriority;
     TxCoinAgePriorityCompare pricomparer;
     std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
     typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
     double actualPriority = -1;
 
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
-    bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
-
+    vecPriority.reserve(mempool.mapTx.size());
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+         mi != mempool.mapTx.end(); ++mi)
     {
-        LOCK(cs_main);
+        double dPriority = mi->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+
+    CTxMemPool::txiter iter;
+    while (!vecPriority.empty() && !blockFinished) { // add a tx from priority queue to fill the blockprioritysize
+        iter = vecPriority.front().second;
+        actualPriority = vecPriority.front().first;
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        vecPriority.pop_back();
+
+        // If tx already in block, skip
+        if (inBlock.count(iter)) {
+            assert(false); // shouldn't happen for priority txs
+            continue;
+        }
 
-        CBlockIndex* pindexPrev = chainActive.Tip();
-        const int nHeight = pindexPrev->nHeight + 1;
-        pblock->nTime = GetAdjustedTime();
-        const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
-
-        // Add our coinbase tx as first transaction
-        pblock->vtx.push_back(txNew);
-        pblocktemplate->vTxFees.push_back(-1); // updated at end
-        pblocktemplate->vTxSigOps.push_back(-1); // updated at end
-        pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
-        // -regtest only: allow overriding block.nVersion with
-        // -blockversion=N to test forking scenarios
-        if (chainparams.MineBlocksOnDemand())
-            pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
-
-        int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
-                                ? nMedianTimePast
-                                : pblock->GetBlockTime();
+        // If tx is dependent on other mempool txs which haven't yet been included
+        // then put it in the waitSet
+        if (isStillDependent(iter)) {
+            waitPriMap.insert(std::make_pair(iter, actualPriority));
+            continue;
+        }
 
-        {
-            LOCK(mempool.cs);
+        // If this tx fits in the block add it, otherwise keep looping
+        if (TestForBlock(iter)) {
+            AddToBlock(iter);
 
-            bool fPriorityBlock = nBlockPrioritySize > 0;
-            if (fPriorityBlock) {
-                vecPriority.reserve(mempool.mapTx.size());
-                for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                     mi != mempool.mapTx.end(); ++mi)
-                {
-                    double dPriority = mi->GetPriority(nHeight);
-                    CAmount dummy;
-                    mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                    vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-                }
-                std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+            // If now that this txs is added we've surpassed our desired priority size
+            // or have dropped below the AllowFreeThreshold, then we're done adding priority txs
+            if (nBlockSize >= nBlockPrioritySize || !AllowFree(actualPriority)) {
+                break;
             }
 
-            CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-            CTxMemPool::txiter iter;
-
-            while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
+            // This tx was successfully added, so
+            // add transactions that depend on this one to the priority queue to try again
+            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
             {
-                bool priorityTx = false;
-                if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
-                    priorityTx = true;
-                    iter = vecPriority.front().second;
-                    actualPriority = vecPriority.front().first;
-                    std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                    vecPriority.pop_back();
-                }
-                else if (clearedTxs.empty()) { // add tx with next highest score
-                    iter = mempool.mapTx.project<0>(mi);
-                    mi++;
-                }
-                else {  // try to add a previously postponed child tx
-                    iter = clearedTxs.top();
-                    clearedTxs.pop();
+                waitPriIter wpiter = waitPriMap.find(child);
+                if (wpiter != waitPriMap.end()) {
+                    vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                    waitPriMap.erase(wpiter);
                 }
+            }
+        }
+    }
+}
 
-                if (inBlock.count(iter))
-                    continue; // could have been added to the priorityBlock
+bool BlockAssembler::AddPackage(CTxMemPool::txiter iter)
+{
+    if (inBlock.count(iter))
+        return true;
+
+    CTxMemPool::setEntries ancestors;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+    onlyUnconfirmed(ancestors);
+    ancestors.insert(iter);
+
+    uint64_t packageSize = 0;
+    CAmount packageFees = 0;
+    unsigned int packageSigOps = 0;
+    BOOST_FOREACH(const CTxMemPool::txiter it, ancestors) {
+        packageSize += it->GetTxSize();
+        packageFees += it->GetModifiedFee();
+        packageSigOps += it->GetSigOpCount();
+    }
 
-                const CTransaction& tx = iter->GetTx();
+    // Same rules as addPackageTxs(), a package it would have skipped does
+    // not need a new template either
+    if (packageFees < ::minRelayTxFee.GetFee(packageSize) && nBlockSize >= nBlockMinSize)
+        return true;
+    if (!TestPackageFinality(ancestors))
+        return true;
+    if (!TestPackage(packageSize, packageSigOps))
+        return false;
 
-                bool fOrphan = false;
-                BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-                {
-                    if (!inBlock.count(parent)) {
-                        fOrphan = true;
-                        break;
-                    }
-                }
-                if (fOrphan) {
-                    if (priorityTx)
-                        waitPriMap.insert(std::make_pair(iter,actualPriority));
-                    else
-                        waitSet.insert(iter);
-                    continue;
-                }
+    std::vector<CTxMemPool::txiter> sortedEntries;
+    SortForBlock(ancestors, sortedEntries);
+    for (size_t i = 0; i < sortedEntries.size(); ++i)
+        AddToBlock(sortedEntries[i]);
 
-                unsigned int nTxSize = iter->GetTxSize();
-                if (fPriorityBlock &&
-                    (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
-                    fPriorityBlock = false;
-                    waitPriMap.clear();
-                }
-                if (!priorityTx &&
-                    (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize)) {
-                    break;
-                }
-                if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                    if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-                        break;
-                    }
-                    // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                    // to try to fill the remaining space.
-                    if (nBlockSize > nBlockMaxSize - 1000) {
-                        lastFewTxs++;
-                    }
-                    continue;
-                }
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
 
-                if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
-                    continue;
+    return true;
+}
 
-                unsigned int nTxSigOps = iter->GetSigOpCount();
-                unsigned int nMaxBlockSigOps = MaxBlockSigOps();
-                if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps) {
-                    if (nBlockSigOps > nMaxBlockSigOps - 2) {
-                        break;
-                    }
-                    continue;
-                }
+CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn)
+{
+    return BlockAssembler(chainparams).CreateNewBlock(scriptPubKeyIn);
+}
 
-                CAmount nTxFees = iter->GetFee();
-                // Added
-                pblock->vtx.push_back(tx);
-                pblocktemplate->vTxFees.push_back(nTxFees);
-                pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-                nBlockSize += nTxSize;
-                ++nBlockTx;
-                nBlockSigOps += nTxSigOps;
-                nFees += nTxFees;
-
-                if (fPrintPriority)
-                {
-                    double dPriority = iter->GetPriority(nHeight);
-                    CAmount dummy;
-                    mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
-                    LogPrintf("priority %.1f fee %s txid %s\n",
-                              dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
-                }
+CBlockTemplateCache::CBlockTemplateCache(const CChainParams& _chainparams, const CScript& scriptPubKeyIn)
+    : chainparams(_chainparams), scriptPubKey(scriptPubKeyIn), pindexPrev(NULL),
+      nTransactionsUpdated(0), nTimeRebuilt(0), fStale(false), fInUse(false)
+{
+    connAdded = mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateCache::TransactionAddedToMempool, this, _1));
+    connRemoved = mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateCache::TransactionRemovedFromMempool, this, _1));
+}
 
-                inBlock.insert(iter);
+// Both mempool notifications arrive with mempool.cs held
+void CBlockTemplateCache::TransactionAddedToMempool(const CTransaction& tx)
+{
+    LOCK(cs);
+    if (pblocktemplate && !fStale)
+        vAdded.push_back(tx.GetHash());
+}
 
-                // Add transactions that depend on this one to the priority queue
-                BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-                {
-                    if (fPriorityBlock) {
-                        waitPriIter wpiter = waitPriMap.find(child);
-                        if (wpiter != waitPriMap.end()) {
-                            vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                            waitPriMap.erase(wpiter);
-                        }
-                    }
-                    else {
-                        if (waitSet.count(child)) {
-                            clearedTxs.push(child);
-                            waitSet.erase(child);
-                        }
-                    }
-                }
-            }
+void CBlockTemplateCache::TransactionRemovedFromMempool(const CTransaction& tx)
+{
+    LOCK(cs);
+    if (!pblocktemplate || fStale)
+        return;
+    // The transaction is still in mapTx at this point. Transactions that did
+    // not make it into the template do not change it.
+    CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+    if (it != mempool.mapTx.end() && !assembler->IsInBlock(it))
+        return;
+    fStale = true;
+    vAdded.clear();
+}
 
-        }
+void CBlockTemplateCache::Rebuild()
+{
+    AssertLockHeld(cs);
+    pblocktemplate.reset();
+    pindexPrev = NULL;
+    vAdded.clear();
+    fStale = false;
+
+    nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    nTimeRebuilt = GetTime();
+    CBlockIndex* pindexPrevNew = chainActive.Tip();
+    assembler.reset(new BlockAssembler(chainparams));
+    pblocktemplate.reset(assembler->CreateNewBlock(scriptPubKey));
+
+    // Need to update only after we know CreateNewBlock succeeded
+    if (pblocktemplate)
+        pindexPrev = pindexPrevNew;
+}
 
-        // NOTE: unlike in bitcoin, we need to pass PREVIOUS block height here
-        CAmount blockReward = nFees + GetBlockSubsidy(pindexPrev->nBits, pindexPrev->nHeight, Params().GetConsensus());
-
-        // Compute regular coinbase transaction.
-        txNew.vout[0].nValue = blockReward;
-        txNew.vin[0].scriptSig = CScript() << nHeight << OP_0;
-
-        /**
-         * Update coinbase transaction with additional info about masternode payments,
-         * get some info back to pass to getblocktemplate
-         */
-        if( nHeight > 1 ){
-            FillBlockPayments(txNew, nHeight, blockReward, pblock->txoutMasternode);
-        // LogPrintf("CreateNewBlock -- nBlockHeight %d blockReward %lld txoutMasternode %s txNew %s",
-        //             nHeight, blockReward, pblock->txoutMasternode.ToString(), txNew.ToString());
+CBlockTemplate* CBlockTemplateCache::Get()
+{
+    AssertLockHeld(cs_main);
+    LOCK2(mempool.cs, cs);
+    fInUse = true;
+
+    if (!pblocktemplate || pindexPrev != chainActive.Tip() ||
+        (fStale && GetTime() - nTimeRebuilt > TEMPLATE_REBUILD_INTERVAL)) {
+        Rebuild();
+        return pblocktemplate.get();
+    }
+    // Until then the old selection is still a valid block
+    if (fStale)
+        return pblocktemplate.get();
+
+    if (!vAdded.empty()) {
+        BOOST_FOREACH(const uint256& hash, vAdded) {
+            CTxMemPool::txiter it = mempool.mapTx.find(hash);
+            if (it == mempool.mapTx.end())
+                continue;
+            // Packages that do not fit are skipped, as addPackageTxs() does
+            assembler->AddPackage(it);
         }
+        vAdded.clear();
+        assembler->UpdateCoinbase();
+    }
+    nTransactionsUpdated = mempool.GetTransactionsUpdated();
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
+    return pblocktemplate.get();
+}
 
-        // Update block coinbase
-        pblock->vtx[0] = txNew;
-        pblocktemplate->vTxFees[0] = -nFees;
+unsigned int CBlockTemplateCache::GetTransactionsUpdated()
+{
+    LOCK(cs);
+    return nTransactionsUpdated;
+}
 
-        // Fill in header
-        pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-        UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-        pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-        pblock->nNonce         = 0;
-        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
+void CBlockTemplateCache::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload)
+        return;
 
-        CValidationState state;
-        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
-            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
-        }
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+    // Nobody asked for a template yet, or a later tip already made a new one
+    if (!fInUse || pindexPrev == chainActive.Tip())
+        return;
+    try {
+        Rebuild();
+    } catch (const std::runtime_error& e) {
+        // Get() tries again on the next request
+        LogPrintf("CBlockTemplateCache::%s -- %s\n", __func__, e.what());
     }
-
-    return pblocktemplate.release();
 }
 
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
@@ -403,31 +793,184 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-// ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
-void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
+// Seconds over which the hash rate of a miner thread is measured
+static const int64_t MINER_HASHRATE_INTERVAL = 4;
+// Nonces a miner thread tries between checks for new work
+static const uint32_t MINER_SCAN_NONCES = 256;
+
+bool ScanNonces(const CX11NonceScanner& scanner, uint32_t nNonceBegin, uint32_t nCount, const arith_uint256& hashTarget, uint32_t& nNonceRet)
+{
+    uint256 hashes[X11_BATCH_LANES];
+    for (uint32_t n = 0; n < nCount; n += X11_BATCH_LANES) {
+        scanner.Hash(nNonceBegin + n, hashes);
+        for (size_t i = 0; i < X11_BATCH_LANES; i++) {
+            if (UintToArith256(hashes[i]) <= hashTarget) {
+                nNonceRet = nNonceBegin + n + i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/** A block template the miner threads hash on, with its extranonce applied */
+struct CMinerWork
+{
+    uint64_t nId;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdatedLast;
+    int64_t nStart;
+};
+
+/**
+ * State shared by the miner threads. They all hash the same template, each
+ * on its own slice of the nonce space. The first thread to find the work
+ * stale (new tip, mempool changes or its slice exhausted) builds the next
+ * template with the next extranonce, the others switch over as soon as they
+ * see the new work id.
+ */
+class CMinerContext
+{
+private:
+    boost::mutex cs;
+    // Held while a new template is built, so only one thread builds it and
+    // nExtraNonce keeps counting up. Taken before cs_main, never under cs.
+    boost::mutex csBuild;
+    boost::shared_ptr<const CMinerWork> work;
+    uint64_t nNextWorkId;
+    unsigned int nExtraNonce;
+    // Written by each miner thread for itself, read by getmininginfo
+    boost::scoped_array<std::atomic<double> > vHashesPerSec;
+
+    boost::shared_ptr<const CMinerWork> GetFreshWork(uint64_t nStaleId)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (work && work->nId != nStaleId)
+            return work;
+        return boost::shared_ptr<const CMinerWork>();
+    }
+
+public:
+    const CChainParams& chainparams;
+    CConnman& connman;
+    const int nThreads;
+    boost::shared_ptr<CReserveScript> coinbaseScript;
+
+    CMinerContext(const CChainParams& chainparamsIn, CConnman& connmanIn, int nThreadsIn)
+        : nNextWorkId(1), nExtraNonce(0), vHashesPerSec(new std::atomic<double>[nThreadsIn]),
+          chainparams(chainparamsIn), connman(connmanIn), nThreads(nThreadsIn)
+    {
+        for (int i = 0; i < nThreads; i++)
+            vHashesPerSec[i] = 0;
+        GetMainSignals().ScriptForMining(coinbaseScript);
+    }
+
+    /** The current work, replaced first if it is the work with id nStaleId */
+    boost::shared_ptr<const CMinerWork> GetWork(uint64_t nStaleId)
+    {
+        boost::shared_ptr<const CMinerWork> workFresh = GetFreshWork(nStaleId);
+        if (workFresh)
+            return workFresh;
+
+        boost::unique_lock<boost::mutex> lockBuild(csBuild);
+        // Another thread may have built it while we were waiting
+        workFresh = GetFreshWork(nStaleId);
+        if (workFresh)
+            return workFresh;
+
+        // Built without holding cs, so work id readers never wait on cs_main
+        boost::shared_ptr<CMinerWork> workNew(new CMinerWork());
+        workNew->nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        {
+            LOCK(cs_main);
+            workNew->pindexPrev = chainActive.Tip();
+        }
+        if (!workNew->pindexPrev)
+            return boost::shared_ptr<const CMinerWork>();
+        workNew->nStart = GetTime();
+        workNew->pblocktemplate.reset(CreateNewBlock(chainparams, coinbaseScript->reserveScript));
+        if (!workNew->pblocktemplate)
+            return boost::shared_ptr<const CMinerWork>();
+        CBlock *pblock = &workNew->pblocktemplate->block;
+        IncrementExtraNonce(pblock, workNew->pindexPrev, nExtraNonce);
+
+        LogPrintf("FuturoCoinMiner -- Running miner with %u transactions in block (%u bytes) on %d threads\n", pblock->vtx.size(),
+            ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION), nThreads);
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        workNew->nId = nNextWorkId++;
+        work = workNew;
+        return work;
+    }
+
+    uint64_t GetWorkId()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return work ? work->nId : 0;
+    }
+
+    void KeepScript()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        coinbaseScript->KeepScript();
+    }
+
+    void SetHashRate(int nThread, double dHashesPerSec)
+    {
+        vHashesPerSec[nThread] = dHashesPerSec;
+    }
+
+    std::vector<double> GetHashRates()
+    {
+        std::vector<double> vRet(nThreads);
+        for (int i = 0; i < nThreads; i++)
+            vRet[i] = vHashesPerSec[i];
+        return vRet;
+    }
+};
+
+static boost::mutex csMinerContext;
+static boost::shared_ptr<CMinerContext> pminerContext;
+
+std::vector<double> GetMinerHashRates()
+{
+    boost::unique_lock<boost::mutex> lock(csMinerContext);
+    if (!pminerContext)
+        return std::vector<double>();
+    return pminerContext->GetHashRates();
+}
+
+void static BitcoinMiner(boost::shared_ptr<CMinerContext> ctx, int nThread)
 {
     LogPrintf("FuturoCoinMiner -- started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
     RenameThread("futurocoin-miner");
 
-    unsigned int nExtraNonce = 0;
+    const CChainParams& chainparams = ctx->chainparams;
 
-    boost::shared_ptr<CReserveScript> coinbaseScript;
-    GetMainSignals().ScriptForMining(coinbaseScript);
+    // This thread's slice of the nonce space
+    const uint64_t nSliceSize = (((uint64_t)1 << 32) / ctx->nThreads) / MINER_SCAN_NONCES * MINER_SCAN_NONCES;
+    const uint64_t nNonceBegin = nThread * nSliceSize;
+    const uint64_t nNonceEnd = nNonceBegin + nSliceSize;
+
+    int64_t nRateStart = GetTimeMillis();
+    uint64_t nRateHashes = 0;
 
     try {
         // Throw an error if no script was provided.  This can happen
         // due to some internal error but also if the keypool is empty.
         // In the latter case, already the pointer is NULL.
-        if (!coinbaseScript || coinbaseScript->reserveScript.empty())
+        if (!ctx->coinbaseScript || ctx->coinbaseScript->reserveScript.empty())
             throw std::runtime_error("No coinbase script available (mining requires a wallet)");
 
+        uint64_t nStaleWorkId = 0;
         while (true) {
             if (chainparams.MiningRequiresPeers()) {
                 // Busy-wait for the network to come online so we don't waste time mining
                 // on an obsolete chain. In regtest mode we expect to fly solo.
                 do {
-                    bool fvNodesEmpty = connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0;
+                    bool fvNodesEmpty = ctx->connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0;
                     if (!fvNodesEmpty && !IsInitialBlockDownload() && masternodeSync.IsSynced())
                         break;
                     MilliSleep(1000);
@@ -436,79 +979,85 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
 
 
             //
-            // Create new block
+            // Get the shared block template
             //
-            unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-            CBlockIndex* pindexPrev = chainActive.Tip();
-            if(!pindexPrev) break;
-
-            std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(chainparams, coinbaseScript->reserveScript));
-            if (!pblocktemplate.get())
+            boost::shared_ptr<const CMinerWork> work = ctx->GetWork(nStaleWorkId);
+            if (!work)
             {
                 LogPrintf("FuturoCoinMiner -- Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
                 return;
             }
-            CBlock *pblock = &pblocktemplate->block;
-            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
-
-            LogPrintf("FuturoCoinMiner -- Running miner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
-                ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
+            nStaleWorkId = work->nId;
+            CBlockHeader header = work->pblocktemplate->block.GetBlockHeader();
+            CX11NonceScanner scanner(header);
+            uint64_t nNonce = nNonceBegin;
 
             //
             // Search
             //
-            int64_t nStart = GetTime();
-            arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+            arith_uint256 hashTarget = arith_uint256().SetCompact(header.nBits);
             while (true)
             {
-                unsigned int nHashesDone = 0;
-
-                uint256 hash;
-                while (true)
+                uint32_t nNonceFound;
+                bool fFound = ScanNonces(scanner, nNonce, MINER_SCAN_NONCES, hashTarget, nNonceFound);
+                nRateHashes += MINER_SCAN_NONCES;
+                if (fFound)
                 {
-                    hash = pblock->GetHash();
-                    if (UintToArith256(hash) <= hashTarget)
-                    {
-                        // Found a solution
-                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        LogPrintf("FuturoCoinMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
-                        ProcessBlockFound(pblock, chainparams);
-                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                        coinbaseScript->KeepScript();
-
-                        // In regression test mode, stop mining after a block is found. This
-                        // allows developers to controllably generate a block on demand.
-                        if (chainparams.MineBlocksOnDemand())
-                            throw boost::thread_interrupted();
+                    // Found a solution
+                    CBlock block(work->pblocktemplate->block);
+                    block.nTime = header.nTime;
+                    block.nBits = header.nBits;
+                    block.nNonce = nNonceFound;
+                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                    LogPrintf("FuturoCoinMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", block.GetHash().GetHex(), hashTarget.GetHex());
+                    ProcessBlockFound(&block, chainparams);
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                    ctx->KeepScript();
+
+                    // In regression test mode, stop mining after a block is found. This
+                    // allows developers to controllably generate a block on demand.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
 
-                        break;
-                    }
-                    pblock->nNonce += 1;
-                    nHashesDone += 1;
-                    if ((pblock->nNonce & 0xFF) == 0)
-                        break;
+                    break;
+                }
+                nNonce += MINER_SCAN_NONCES;
+
+                int64_t nNow = GetTimeMillis();
+                if (nNow - nRateStart >= MINER_HASHRATE_INTERVAL * 1000) {
+                    ctx->SetHashRate(nThread, 1000.0 * nRateHashes / (nNow - nRateStart));
+                    nRateStart = nNow;
+                    nRateHashes = 0;
                 }
 
                 // Check for stop or if block needs to be rebuilt
                 boost::this_thread::interruption_point();
                 // Regtest mode doesn't require peers
-                if (connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && chainparams.MiningRequiresPeers())
+                if (ctx->connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && chainparams.MiningRequiresPeers())
                     break;
-                if (pblock->nNonce >= 0xffff0000)
+                if (nNonce >= nNonceEnd)
                     break;
-                if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
+                if (ctx->GetWorkId() != work->nId)
+                    break; // Another thread already moved on
+                if (mempool.GetTransactionsUpdated() != work->nTransactionsUpdatedLast && GetTime() - work->nStart > 60)
                     break;
-                if (pindexPrev != chainActive.Tip())
+                if (work->pindexPrev != chainActive.Tip())
                     break;
 
                 // Update nTime every few seconds
-                if (UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev) < 0)
+                int64_t nTimeDelta = UpdateTime(&header, chainparams.GetConsensus(), work->pindexPrev);
+                if (nTimeDelta < 0)
                     break; // Recreate the block if the clock has run backwards,
                            // so that we can use the correct time.
-                if (chainparams.GetConsensus().fPowAllowMinDifficultyBlocks)
+                if (nTimeDelta > 0)
                 {
-                    // Changing pblock->nTime can change work required on testnet:
-                    hashTarget.SetCompact(pblock->nBits);
+                    // The time is part of the midstate
+                    scanner = CX11NonceScanner(header);
+                    if (chainparams.GetConsensus().fPowAllowMinDifficultyBlocks)
+                    {
+                        // Changing header.nTime can change work required on testnet:
+                        hashTarget.SetCompact(header.nBits);
+                    }
                 }
             }
         }
@@ -539,10 +1088,22 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
         minerThreads = NULL;
     }
 
+    {
+        boost::unique_lock<boost::mutex> lock(csMinerContext);
+        pminerContext.reset();
+    }
+
     if (nThreads == 0 || !fGenerate)
         return;
 
+    // Each thread holds on to the context until it has stopped
+    boost::shared_ptr<CMinerContext> ctx(new CMinerContext(chainparams, connman, nThreads));
+    {
+        boost::unique_lock<boost::mutex> lock(csMinerContext);
+        pminerContext = ctx;
+    }
+
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), boost::ref(connman)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, ctx, i));
 }
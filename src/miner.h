@@ -7,15 +7,26 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "validationinterface.h"
 
 #include <stdint.h>
+#include <memory>
+#include <vector>
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/signals2/connection.hpp>
+
+class arith_uint256;
 class CBlockIndex;
 class CChainParams;
 class CConnman;
 class CReserveKey;
 class CScript;
 class CWallet;
+class CX11NonceScanner;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_GENERATE = false;
@@ -30,8 +41,243 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+// Container for tracking updates to ancestor feerate as we include (parent)
+// transactions in a block
+struct CTxMemPoolModifiedEntry {
+    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+    {
+        iter = entry;
+        nSizeWithAncestors = entry->GetSizeWithAncestors();
+        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
+        nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
+    }
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+};
+
+/** Comparator for CTxMemPool::txiter objects.
+ *  It simply compares the internal memory address of the CTxMemPoolEntry object
+ *  pointed to. This means it has no meaning, and is only useful for using them
+ *  as key in other indexes.
+ */
+struct CompareCTxMemPoolIter {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        return &(*a) < &(*b);
+    }
+};
+
+struct modifiedentry_iter {
+    typedef CTxMemPool::txiter result_type;
+    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
+    {
+        return entry.iter;
+    }
+};
+
+// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
+// except operating on CTxMemPoolModifiedEntry.
+struct CompareModifiedEntry {
+    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        }
+        return f1 > f2;
+    }
+};
+
+// A comparator that sorts transactions based on number of ancestors.
+// This is sufficient to sort an ancestor package in an order that is valid
+// to appear in a block.
+struct CompareTxIterByAncestorCount {
+    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+};
+
+typedef boost::multi_index_container<
+    CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<
+            modifiedentry_iter,
+            CompareCTxMemPoolIter
+        >,
+        // sorted by modified ancestor fee rate
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareModifiedEntry
+        >
+    >
+> indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::nth_index<1>::type::iterator modtxscoreiter;
+
+struct update_for_parent_inclusion
+{
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+
+    void operator() (CTxMemPoolModifiedEntry &e)
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
+    }
+
+    CTxMemPool::txiter iter;
+};
+
+/** Generate a new block, without valid proof-of-work */
+class BlockAssembler
+{
+private:
+    // The template being filled, owned by whoever CreateNewBlock() returned it to
+    CBlockTemplate* pblocktemplate;
+    // A convenience pointer that always refers to the CBlock in pblocktemplate
+    CBlock* pblock;
+
+    // Configuration parameters for the block size
+    unsigned int nBlockMaxSize, nBlockMinSize;
+
+    // Information on the current status of the block
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    CTxMemPool::setEntries inBlock;
+
+    // Chain context for the block
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    const CChainParams& chainparams;
+    CBlockIndex* pindexPrev;
+    CScript scriptPubKey;
+
+    // Variables used for addPriorityTxs
+    int lastFewTxs;
+    bool blockFinished;
+    bool fPrintPriority;
+
+public:
+    BlockAssembler(const CChainParams& chainparams);
+    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn);
+
+    /** Append a mempool transaction to the last template together with its
+     *  ancestors that are not in it yet. Returns false if the package did not
+     *  fit and was left out. Requires the caller to still own the template
+     *  and UpdateCoinbase() to be called after the last addition. */
+    bool AddPackage(CTxMemPool::txiter iter);
+    /** Whether a mempool transaction is part of the last template */
+    bool IsInBlock(CTxMemPool::txiter iter) const { return inBlock.count(iter); }
+    /** Pay the fees of the transactions in the template to the coinbase */
+    void UpdateCoinbase();
+
+private:
+    // utility functions
+    /** Clear the block's state and prepare for assembling a new block */
+    void resetBlock(const CScript& scriptPubKeyIn);
+    /** Add a tx to the block */
+    void AddToBlock(CTxMemPool::txiter iter);
+
+    // Methods for how to add transactions to a block.
+    /** Add transactions based on tx "priority" */
+    void addPriorityTxs();
+    /** Add transactions based on feerate including unconfirmed ancestors */
+    void addPackageTxs();
+
+    // helper functions for addPriorityTxs()
+    /** Test if tx will still "fit" in the block */
+    bool TestForBlock(CTxMemPool::txiter iter);
+    /** Test if tx still has unconfirmed parents not yet in block */
+    bool isStillDependent(CTxMemPool::txiter iter);
+
+    // helper functions for addPackageTxs()
+    /** Remove confirmed (inBlock) entries from given set */
+    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
+    /** Test if a new package would "fit" in the block */
+    bool TestPackage(uint64_t packageSize, unsigned int packageSigOps);
+    /** Test if a set of transactions are all final */
+    bool TestPackageFinality(const CTxMemPool::setEntries& package);
+    /** Return true if given transaction from mapTx has already been evaluated,
+      * or if the transaction's cached data in mapTx is incorrect. */
+    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
+    /** Sort the package in an order that is valid to appear in a block */
+    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
+    /** Add descendants of given transactions to mapModifiedTx with ancestor
+      * state updated assuming given transactions are inBlock. */
+    void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
+};
+
+/**
+ * The block template getblocktemplate hands out, kept in step with the
+ * mempool. Transactions entering the mempool are appended to it with their
+ * missing ancestors, so a request only has to refresh the coinbase; packages
+ * that no longer fit are left out. A new tip rebuilds it right away once it
+ * has been asked for. A template transaction leaving the mempool makes a
+ * request rebuild it, at most once every few seconds.
+ */
+class CBlockTemplateCache : public CValidationInterface
+{
+private:
+    CCriticalSection cs;
+    const CChainParams& chainparams;
+    const CScript scriptPubKey;
+
+    std::unique_ptr<BlockAssembler> assembler;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    const CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    int64_t nTimeRebuilt;
+    // Mempool transactions not looked at since the template was last updated
+    std::vector<uint256> vAdded;
+    // The template has to be rebuilt before it is handed out again
+    bool fStale;
+    // Only rebuild on new tips once there is someone to hand the template to
+    bool fInUse;
+
+    boost::signals2::scoped_connection connAdded;
+    boost::signals2::scoped_connection connRemoved;
+
+    void TransactionAddedToMempool(const CTransaction& tx);
+    void TransactionRemovedFromMempool(const CTransaction& tx);
+    void Rebuild();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
+
+public:
+    CBlockTemplateCache(const CChainParams& chainparams, const CScript& scriptPubKeyIn);
+
+    /** Return the template for the active tip. The caller must hold cs_main
+     *  for as long as it uses the template. */
+    CBlockTemplate* Get();
+    /** The mempool update counter at the time of the last Get() */
+    unsigned int GetTransactionsUpdated();
+};
+
+extern CBlockTemplateCache* pblocktemplatecache;
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams, CConnman& connman);
+/** Hashes per second of each miner thread, empty when the miner is off */
+std::vector<double> GetMinerHashRates();
+/**
+ * Search the nonces nNonceBegin .. nNonceBegin + nCount - 1 of the header
+ * the scanner was made from for a hash at or below hashTarget, and return
+ * the first one found in nNonceRet. nCount must be a multiple of
+ * X11_BATCH_LANES.
+ */
+bool ScanNonces(const CX11NonceScanner& scanner, uint32_t nNonceBegin, uint32_t nCount, const arith_uint256& hashTarget, uint32_t& nNonceRet);
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn);
 /** Modify the extranonce in a block */
@@ -673,6 +673,31 @@ void CNode::copyStats(CNodeStats &stats)
 }
 #undef X
 
+void CNode::PeekProcessMsg(const std::string& strCommand, size_t nMax, std::vector<CDataStream>& vRet)
+{
+    std::vector<const CNetMessage*> vPeeked;
+    {
+        LOCK(cs_vProcessMsg);
+        for (std::list<CNetMessage>::iterator it = vProcessMsg.begin(); it != vProcessMsg.end() && vPeeked.size() < nMax; ++it) {
+            CNetMessage& msg = *it;
+            if (msg.fPeeked || msg.hdr.GetCommand() != strCommand)
+                continue;
+            msg.fPeeked = true;
+            vPeeked.push_back(&msg);
+        }
+    }
+    // Only the message handler thread, which calls this, takes messages off
+    // vProcessMsg, and queued messages are complete and never change, so
+    // they are copied without holding the lock. The checksum is left to
+    // ProcessMessages, a corrupt message only costs its handler a failed
+    // signature check.
+    vRet.reserve(vRet.size() + vPeeked.size());
+    BOOST_FOREACH(const CNetMessage* pmsg, vPeeked) {
+        vRet.push_back(pmsg->vRecv);
+        vRet.back().SetVersion(GetRecvVersion());
+    }
+}
+
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
 {
     complete = false;
@@ -2832,7 +2857,28 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
     if(strm.empty())
         return;
 
-    unsigned int nSize = strm.size() - CMessageHeader::HEADER_SIZE;
+    PushSerializedMessage(pnode, CSerializeData(strm.begin(), strm.end()), sCommand);
+}
+
+void CConnman::PushRawMessage(CNode* pnode, const std::string& sCommand, CSerializeData&& vMsg)
+{
+    assert(vMsg.size() >= CMessageHeader::HEADER_SIZE);
+    unsigned int nSize = vMsg.size() - CMessageHeader::HEADER_SIZE;
+    CMessageHeader hdr(Params().MessageStart(), sCommand.c_str(), nSize);
+    uint256 hash = Hash(vMsg.begin() + CMessageHeader::HEADER_SIZE, vMsg.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << hdr;
+    assert(ssHeader.size() == CMessageHeader::HEADER_SIZE);
+    memcpy(&vMsg[0], &ssHeader[0], CMessageHeader::HEADER_SIZE);
+
+    PushSerializedMessage(pnode, std::move(vMsg), sCommand);
+}
+
+void CConnman::PushSerializedMessage(CNode* pnode, CSerializeData&& vMsg, const std::string& sCommand)
+{
+    unsigned int nSize = vMsg.size() - CMessageHeader::HEADER_SIZE;
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(sCommand.c_str()), nSize, pnode->id);
 
     size_t nBytesSent = 0;
@@ -2842,11 +2888,12 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
             return;
         }
         bool optimisticSend(pnode->vSendMsg.empty());
-        pnode->vSendMsg.emplace_back(strm.begin(), strm.end());
 
         //log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[sCommand] += strm.size();
-        pnode->nSendSize += strm.size();
+        pnode->mapSendBytesPerMsgCmd[sCommand] += vMsg.size();
+        pnode->nSendSize += vMsg.size();
+
+        pnode->vSendMsg.push_back(std::move(vMsg));
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
@@ -201,6 +201,13 @@ public:
         PushMessageWithVersionAndFlag(pnode, 0, 0, sCommand, std::forward<Args>(args)...);
     }
 
+    /**
+     * Send an already serialized payload. vMsg must start with
+     * CMessageHeader::HEADER_SIZE reserved bytes, which are filled in here,
+     * followed by the payload; the buffer is queued without being copied.
+     */
+    void PushRawMessage(CNode* pnode, const std::string& sCommand, CSerializeData&& vMsg);
+
     template<typename Condition, typename Callable>
     bool ForEachNodeContinueIf(const Condition& cond, Callable&& func)
     {
@@ -432,6 +439,7 @@ private:
     CDataStream BeginMessage(CNode* node, int nVersion, int flags, const std::string& sCommand);
     void PushMessage(CNode* pnode, CDataStream& strm, const std::string& sCommand);
     void EndMessage(CDataStream& strm);
+    void PushSerializedMessage(CNode* pnode, CSerializeData&& vMsg, const std::string& sCommand);
 
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
@@ -631,12 +639,15 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
+    bool fPeeked;                   // already handed out by CNode::PeekProcessMsg
+
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fPeeked = false;
     }
 
     bool complete() const
@@ -808,6 +819,12 @@ public:
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
 
+    /** Copy the payloads of up to nMax queued, not yet processed messages of type strCommand,
+     *  so their handler can look ahead at them. Their checksums are not verified yet. Every
+     *  message is handed out at most once, so looking ahead costs at most one check per
+     *  message. Only to be called from the message handler thread. */
+    void PeekProcessMsg(const std::string& strCommand, size_t nMax, std::vector<CDataStream>& vRet);
+
     void SetRecvVersion(int nVersionIn)
     {
         nRecvVersion = nVersionIn;
@@ -11,7 +11,9 @@ CNetFulfilledRequestManager netfulfilledman;
 void CNetFulfilledRequestManager::AddFulfilledRequest(CAddress addr, std::string strRequest)
 {
     LOCK(cs_mapFulfilledRequests);
-    mapFulfilledRequests[addr][strRequest] = GetTime() + Params().FulfilledRequestExpireTime();
+    int64_t nExpireTime = GetTime() + Params().FulfilledRequestExpireTime();
+    mapFulfilledRequests[addr][strRequest] = nExpireTime;
+    mmapFulfilledRequestsByExpiry.insert(std::make_pair(nExpireTime, std::make_pair(CNetAddr(addr), strRequest)));
 }
 
 bool CNetFulfilledRequestManager::HasFulfilledRequest(CAddress addr, std::string strRequest)
@@ -39,22 +41,20 @@ void CNetFulfilledRequestManager::CheckAndRemove()
     LOCK(cs_mapFulfilledRequests);
 
     int64_t now = GetTime();
-    fulfilledreqmap_t::iterator it = mapFulfilledRequests.begin();
+    fulfilledreqexpirymap_t::iterator it_expiry = mmapFulfilledRequestsByExpiry.begin();
 
-    while(it != mapFulfilledRequests.end()) {
-        fulfilledreqmapentry_t::iterator it_entry = it->second.begin();
-        while(it_entry != it->second.end()) {
-            if(now > it_entry->second) {
-                it->second.erase(it_entry++);
-            } else {
-                ++it_entry;
+    while(it_expiry != mmapFulfilledRequestsByExpiry.end() && now > it_expiry->first) {
+        fulfilledreqmap_t::iterator it = mapFulfilledRequests.find(it_expiry->second.first);
+        if(it != mapFulfilledRequests.end()) {
+            fulfilledreqmapentry_t::iterator it_entry = it->second.find(it_expiry->second.second);
+            if(it_entry != it->second.end() && now > it_entry->second) {
+                it->second.erase(it_entry);
+            }
+            if(it->second.size() == 0) {
+                mapFulfilledRequests.erase(it);
             }
         }
-        if(it->second.size() == 0) {
-            mapFulfilledRequests.erase(it++);
-        } else {
-            ++it;
-        }
+        mmapFulfilledRequestsByExpiry.erase(it_expiry++);
     }
 }
 
@@ -62,6 +62,7 @@ void CNetFulfilledRequestManager::Clear()
 {
     LOCK(cs_mapFulfilledRequests);
     mapFulfilledRequests.clear();
+    mmapFulfilledRequestsByExpiry.clear();
 }
 
 std::string CNetFulfilledRequestManager::ToString() const
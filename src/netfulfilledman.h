@@ -17,12 +17,16 @@ extern CNetFulfilledRequestManager netfulfilledman;
 // and from being banned for doing so too often.
 class CNetFulfilledRequestManager
 {
-private:
+protected:
     typedef std::map<std::string, int64_t> fulfilledreqmapentry_t;
     typedef std::map<CNetAddr, fulfilledreqmapentry_t> fulfilledreqmap_t;
+    typedef std::multimap<int64_t, std::pair<CNetAddr, std::string> > fulfilledreqexpirymap_t;
 
     //keep track of what node has/was asked for and when
     fulfilledreqmap_t mapFulfilledRequests;
+    //the same requests by expiry time, soonest first, so that CheckAndRemove only
+    //visits the expired ones; entries of refreshed or removed requests are skipped
+    fulfilledreqexpirymap_t mmapFulfilledRequestsByExpiry;
     CCriticalSection cs_mapFulfilledRequests;
 
 public:
@@ -34,6 +38,14 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         LOCK(cs_mapFulfilledRequests);
         READWRITE(mapFulfilledRequests);
+        if(ser_action.ForRead()) {
+            mmapFulfilledRequestsByExpiry.clear();
+            for(fulfilledreqmap_t::const_iterator it = mapFulfilledRequests.begin(); it != mapFulfilledRequests.end(); ++it) {
+                for(fulfilledreqmapentry_t::const_iterator it_entry = it->second.begin(); it_entry != it->second.end(); ++it_entry) {
+                    mmapFulfilledRequestsByExpiry.insert(std::make_pair(it_entry->second, std::make_pair(it->first, it_entry->first)));
+                }
+            }
+        }
     }
 
     void AddFulfilledRequest(CAddress addr, std::string strRequest); // expire after 1 hour by default
@@ -6,14 +6,28 @@
 #include "pow.h"
 
 #include "arith_uint256.h"
+#include "cachemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util.h"
 
 #include <math.h>
 
+/** Number of recent DarkGravityWave results kept, see GetNextWorkRequired */
+static const uint32_t DGW_CACHE_SIZE = 128;
+
+/**
+ * DarkGravityWave results by the hash of pindexLast. A block hash commits to
+ * all of its ancestors, so the result for it never changes. Each header is
+ * checked when it arrives and again with its block, and every block template
+ * built on the same tip asks for the same result.
+ */
+static CCriticalSection cs_dgwCache;
+static CacheMap<uint256, unsigned int> dgwCache(DGW_CACHE_SIZE);
+
 unsigned int static DarkGravityWave(const CBlockIndex* pindexLast, const Consensus::Params& params) {
     /* current difficulty formula, dash - DarkGravity v3, written by Evan Duffield - evan@dash.org */
     const arith_uint256 bnPowLimit = UintToArith256(params.powLimit);
@@ -27,13 +41,18 @@ unsigned int static DarkGravityWave(const CBlockIndex* pindexLast, const Consens
     const CBlockIndex *pindex = pindexLast;
     arith_uint256 bnPastTargetAvg;
 
+    // Every step truncates and reweighs all earlier targets, so the result
+    // cannot be rolled forward from the previous block's window. Dividing
+    // by small integers keeps the steps cheap instead.
     for (unsigned int nCountBlocks = 1; nCountBlocks <= nPastBlocks; nCountBlocks++) {
         arith_uint256 bnTarget = arith_uint256().SetCompact(pindex->nBits);
         if (nCountBlocks == 1) {
             bnPastTargetAvg = bnTarget;
         } else {
             // NOTE: that's not an average really...
-            bnPastTargetAvg = (bnPastTargetAvg * nCountBlocks + bnTarget) / (nCountBlocks + 1);
+            bnPastTargetAvg *= nCountBlocks;
+            bnPastTargetAvg += bnTarget;
+            bnPastTargetAvg.DivideSmall(nCountBlocks + 1);
         }
 
         if(nCountBlocks != nPastBlocks) {
@@ -55,7 +74,7 @@ unsigned int static DarkGravityWave(const CBlockIndex* pindexLast, const Consens
 
     // Retarget
     bnNew *= nActualTimespan;
-    bnNew /= nTargetTimespan;
+    bnNew.DivideSmall(nTargetTimespan);
 
     if (bnNew > bnPowLimit) {
         bnNew = bnPowLimit;
@@ -66,7 +85,23 @@ unsigned int static DarkGravityWave(const CBlockIndex* pindexLast, const Consens
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
-    return DarkGravityWave(pindexLast, params);
+    // Entries that are not in the block index have no hash to cache them by
+    if (!pindexLast || !pindexLast->phashBlock)
+        return DarkGravityWave(pindexLast, params);
+
+    const uint256 hashLast = pindexLast->GetBlockHash();
+    unsigned int nBits;
+    {
+        LOCK(cs_dgwCache);
+        if (dgwCache.Get(hashLast, nBits))
+            return nBits;
+    }
+
+    nBits = DarkGravityWave(pindexLast, params);
+
+    LOCK(cs_dgwCache);
+    dgwCache.Insert(hashLast, nBits);
+    return nBits;
 }
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
@@ -15,6 +15,39 @@ uint256 CBlockHeader::GetHash() const
     return HashX11(BEGIN(nVersion), END(nNonce));
 }
 
+void HashX11Batch(const CBlockHeader* headers, size_t n, uint256* out)
+{
+    unsigned char in[X11_BATCH_LANES * 80];
+    unsigned char digests[X11_BATCH_LANES * 64];
+    size_t i = 0;
+    for (; i + X11_BATCH_LANES <= n; i += X11_BATCH_LANES) {
+        for (size_t j = 0; j < X11_BATCH_LANES; j++) {
+            memcpy(in + 80 * j, BEGIN(headers[i + j].nVersion), 80);
+        }
+        X11Batch80(digests, in);
+        for (size_t j = 0; j < X11_BATCH_LANES; j++) {
+            memcpy(out[i + j].begin(), digests + 64 * j, 32);
+        }
+    }
+    for (; i < n; i++) {
+        out[i] = headers[i].GetHash();
+    }
+}
+
+CX11NonceScanner::CX11NonceScanner(const CBlockHeader& header)
+{
+    X11PrepareMidstate(mid, (const unsigned char*)BEGIN(header.nVersion));
+}
+
+void CX11NonceScanner::Hash(uint32_t nNonce, uint256 out[X11_BATCH_LANES]) const
+{
+    unsigned char digests[X11_BATCH_LANES * 64];
+    X11ScanBatch(digests, mid, nNonce);
+    for (size_t j = 0; j < X11_BATCH_LANES; j++) {
+        memcpy(out[j].begin(), digests + 64 * j, 32);
+    }
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -218,6 +218,32 @@ extern const char *REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char *SENDHEADERS;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number.
+ * Indicates that a node is willing to provide blocks via "cmpctblock" messages.
+ * May indicate that a node prefers to receive new block announcements via a
+ * "cmpctblock" message rather than an "inv", depending on message contents.
+ * @since protocol version 70208, negotiated by "sendcmpct", as described by BIP 152
+ */
+extern const char *SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids".
+ * @since protocol version 70208, negotiated by "sendcmpct", as described by BIP 152
+ */
+extern const char *CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * @since protocol version 70208, negotiated by "sendcmpct", as described by BIP 152
+ */
+extern const char *GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * @since protocol version 70208, negotiated by "sendcmpct", as described by BIP 152
+ */
+extern const char *BLOCKTXN;
 
 // FuturoCoin message types
 // NOTE: do NOT declare non-implmented here, we don't want them to be exposed to the outside
@@ -357,6 +383,9 @@ enum {
     MSG_DSTX,
     MSG_MASTERNODE_VERIFY,
     MSG_MNLIST,
+    // Nodes may always request a MSG_CMPCT_BLOCK in a getdata, however,
+    // MSG_CMPCT_BLOCK should not appear in any invs except as a part of getdata.
+    MSG_CMPCT_BLOCK, //!< Defined in BIP152
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -12,6 +12,7 @@
 #include "consensus/params.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "hash.h"
 #include "init.h"
 #include "validation.h"
 #include "miner.h"
@@ -174,10 +175,13 @@ UniValue generate(const UniValue& params, bool fHelp)
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (!CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
+        CX11NonceScanner scanner(*pblock);
+        arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+        uint32_t nNonce = 0;
+        while (!ScanNonces(scanner, nNonce, X11_BATCH_LANES, hashTarget, pblock->nNonce)) {
             // Yes, there is a chance every nonce could fail to satisfy the -regtest
             // target -- 1 in 2^(2^32). That ain't gonna happen.
-            ++pblock->nNonce;
+            nNonce += X11_BATCH_LANES;
         }
         if (!ProcessNewBlock(Params(), pblock, true, NULL, NULL))
             throw JSONRPCError(RPC_INTERNAL_ERROR, "ProcessNewBlock, block not accepted");
@@ -249,6 +253,8 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"errors\": \"...\"          (string) Current errors\n"
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
             "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see getgenerate or setgenerate calls)\n"
+            "  \"hashespersec\": n          (numeric) The hashes per second of the built-in miner, summed over its threads\n"
+            "  \"threadhashespersec\": [n, ...] (array) The hashes per second of each thread of the built-in miner\n"
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
@@ -259,6 +265,9 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
         );
 
 
+    // Read before taking cs_main, the miner threads build templates under it
+    std::vector<double> vHashesPerSec = GetMinerHashRates();
+
     LOCK(cs_main);
 
     UniValue obj(UniValue::VOBJ);
@@ -268,6 +277,14 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty",       (double)GetDifficulty()));
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
     obj.push_back(Pair("genproclimit",     (int)GetArg("-genproclimit", DEFAULT_GENERATE_THREADS)));
+    UniValue threadHashesPerSec(UniValue::VARR);
+    double dHashesPerSec = 0;
+    BOOST_FOREACH(double d, vHashesPerSec) {
+        threadHashesPerSec.push_back(d);
+        dHashesPerSec += d;
+    }
+    obj.push_back(Pair("hashespersec",     dHashesPerSec));
+    obj.push_back(Pair("threadhashespersec", threadHashesPerSec));
     obj.push_back(Pair("networkhashps",    getnetworkhashps(params, false)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("testnet",          Params().TestnetToBeDeprecatedFieldRPC()));
@@ -547,34 +564,12 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     }
 
     // Update block
-    static CBlockIndex* pindexPrev;
-    static int64_t nStart;
-    static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
-        // Clear pindexPrev so future calls make a new block, despite any failures from here on
-        pindexPrev = NULL;
-
-        // Store the chainActive.Tip() used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex* pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
+    CBlockTemplate* pblocktemplate = pblocktemplatecache->Get();
+    if (!pblocktemplate)
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    nTransactionsUpdatedLast = pblocktemplatecache->GetTransactionsUpdated();
+    CBlockIndex* pindexPrev = chainActive.Tip();
 
-        // Create new block
-        if(pblocktemplate)
-        {
-            delete pblocktemplate;
-            pblocktemplate = NULL;
-        }
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = CreateNewBlock(Params(), scriptDummy);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
     const Consensus::Params& consensusParams = Params().GetConsensus();
 
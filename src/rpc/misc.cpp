@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
+#include "instantx.h"
 #include "validation.h"
 #include "net.h"
 #include "netbase.h"
@@ -23,6 +24,7 @@
 #include "wallet/walletdb.h"
 #endif
 
+#include <functional>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -177,6 +179,40 @@ UniValue mnsync(const UniValue& params, bool fHelp)
     return "failure";
 }
 
+UniValue getinstantsendinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getinstantsendinfo\n"
+            "Returns how long InstantSend locks took to complete, from receiving the lock request.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"completedlocks\": xxxxx,     (numeric) Locks completed since startup\n"
+            "  \"averagelatency\": x.xxx,     (numeric) Average latency of all completed locks in milliseconds\n"
+            "  \"maxlatency\": x.xxx,         (numeric) Highest latency of all completed locks in milliseconds\n"
+            "  \"recentlocks\": xxxxx,        (numeric) Number of most recent locks the percentiles below are taken from\n"
+            "  \"medianlatency\": x.xxx,      (numeric) Median latency of the recent locks in milliseconds\n"
+            "  \"p90latency\": x.xxx,         (numeric) 90th percentile latency of the recent locks in milliseconds\n"
+            "  \"p99latency\": x.xxx          (numeric) 99th percentile latency of the recent locks in milliseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getinstantsendinfo", "")
+            + HelpExampleRpc("getinstantsendinfo", "")
+        );
+
+    CTxLockLatencyStats stats = instantsend.GetLockLatencyStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("completedlocks", stats.nCount));
+    obj.push_back(Pair("averagelatency", stats.nCount ? stats.nTotal * 0.001 / stats.nCount : 0.0));
+    obj.push_back(Pair("maxlatency", stats.nMax * 0.001));
+    obj.push_back(Pair("recentlocks", (uint64_t)stats.dqRecent.size()));
+    obj.push_back(Pair("medianlatency", stats.GetRecentPercentile(50) * 0.001));
+    obj.push_back(Pair("p90latency", stats.GetRecentPercentile(90) * 0.001));
+    obj.push_back(Pair("p99latency", stats.GetRecentPercentile(99) * 0.001));
+    return obj;
+}
+
 #ifdef ENABLE_WALLET
 class DescribeAddressVisitor : public boost::static_visitor<UniValue>
 {
@@ -615,6 +651,155 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
+/**
+ * Encode an index key to resume an address index listing at, see
+ * getAddressIndexPage(). The height range of the listing is included, so a
+ * cursor cannot be used to continue with a different range.
+ */
+template <typename Key>
+static std::string encodeAddressCursor(const Key& key, int start, int end)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key << start << end;
+    return HexStr(ss.begin(), ss.end());
+}
+
+/**
+ * Parse the optional "limit" and "cursor" fields of an address index request
+ * over the height range start to end (0 for all heights). Returns false if
+ * the request is not paged. Otherwise sets nLimit and, if a cursor was given,
+ * keyFrom and the position of its address in addresses.
+ */
+template <typename Key>
+static bool getPagingFromParams(const UniValue& params, const std::vector<std::pair<uint160, int> >& addresses,
+                                int start, int end, size_t& nLimit, bool& fHaveCursor, Key& keyFrom, size_t& nAddressFrom)
+{
+    fHaveCursor = false;
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return false;
+
+    if (!limitValue.isNum() || limitValue.get_int() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be a positive number");
+    nLimit = limitValue.get_int();
+
+    if (cursorValue.isNull())
+        return true;
+
+    if (!cursorValue.isStr() || !IsHex(cursorValue.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    std::vector<unsigned char> data(ParseHex(cursorValue.get_str()));
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    int nCursorStart, nCursorEnd;
+    try {
+        ss >> keyFrom >> nCursorStart >> nCursorEnd;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!ss.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    if (nCursorStart != start || nCursorEnd != end)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor belongs to a different start and end");
+
+    for (nAddressFrom = 0; nAddressFrom < addresses.size(); nAddressFrom++) {
+        if (addresses[nAddressFrom].first == keyFrom.hashBytes && addresses[nAddressFrom].second == (int)keyFrom.type) {
+            fHaveCursor = true;
+            return true;
+        }
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not belong to the requested addresses");
+}
+
+/**
+ * Read one page of at most nLimit index entries of the given addresses, in
+ * address order and then in index key order, seeking the index directly to
+ * where the previous page ended. Sets cursorRet to the key the next page
+ * starts at, or leaves it empty if this is the last page.
+ *
+ * read(address, nLimit, pkeyFrom, entries) appends at most nLimit entries of
+ * one address; addressStart(address) is the first possible key of an address.
+ * start and end are the height range of the request, kept in the cursor.
+ */
+template <typename Key, typename Value>
+static void getAddressIndexPage(const std::vector<std::pair<uint160, int> >& addresses, int start, int end, size_t nLimit,
+                                bool fHaveCursor, const Key& keyFrom, size_t nAddressFrom,
+                                std::function<bool(const std::pair<uint160, int>&, size_t, const Key*, std::vector<std::pair<Key, Value> >&)> read,
+                                std::function<Key(const std::pair<uint160, int>&)> addressStart,
+                                std::vector<std::pair<Key, Value> >& page, std::string& cursorRet)
+{
+    for (size_t i = fHaveCursor ? nAddressFrom : 0; i < addresses.size(); i++) {
+        size_t nRemaining = nLimit - page.size();
+        if (nRemaining == 0) {
+            cursorRet = encodeAddressCursor(addressStart(addresses[i]), start, end);
+            return;
+        }
+
+        // Read one entry more than fits, it is where the next page starts
+        std::vector<std::pair<Key, Value> > entries;
+        if (!read(addresses[i], nRemaining + 1, (fHaveCursor && i == nAddressFrom) ? &keyFrom : NULL, entries)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        if (entries.size() > nRemaining) {
+            cursorRet = encodeAddressCursor(entries.back().first, start, end);
+            entries.pop_back();
+            page.insert(page.end(), entries.begin(), entries.end());
+            return;
+        }
+        page.insert(page.end(), entries.begin(), entries.end());
+    }
+}
+
+/** Wrap one page of results, with the cursor of the next page or null after the last one */
+static UniValue addressIndexPageResult(const UniValue& results, const std::string& cursor)
+{
+    UniValue page(UniValue::VOBJ);
+    page.push_back(Pair("results", results));
+    page.push_back(Pair("next", cursor.empty() ? NullUniValue : UniValue(cursor)));
+    return page;
+}
+
+/**
+ * Read the address index entries of a getaddressdeltas/getaddresstxids request,
+ * either all of them or one page. Returns whether the request is paged.
+ */
+static bool getAddressIndexFromParams(const UniValue& params, const std::vector<std::pair<uint160, int> >& addresses,
+                                      int start, int end, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                                      std::string& cursor)
+{
+    if (!(start > 0 && end > 0)) {
+        start = 0;
+        end = 0;
+    }
+
+    size_t nLimit = 0;
+    bool fHaveCursor;
+    CAddressIndexKey keyFrom;
+    size_t nAddressFrom = 0;
+    if (getPagingFromParams(params, addresses, start, end, nLimit, fHaveCursor, keyFrom, nAddressFrom)) {
+        getAddressIndexPage<CAddressIndexKey, CAmount>(addresses, start, end, nLimit, fHaveCursor, keyFrom, nAddressFrom,
+            [start, end](const std::pair<uint160, int>& address, size_t nMax, const CAddressIndexKey* pkeyFrom,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> >& entries) {
+                return GetAddressIndex(address.first, address.second, entries, start, end, nMax, pkeyFrom);
+            },
+            [start](const std::pair<uint160, int>& address) {
+                return CAddressIndexKey(address.second, address.first, start, 0, uint256(), 0, false);
+            },
+            addressIndex, cursor);
+        return true;
+    }
+
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+    return false;
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -709,6 +894,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
             "    ]\n"
+            "  \"limit\" (number, optional) Return at most this many outputs, wrapped in a page object\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -721,8 +908,14 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit)\n"
+            "{\n"
+            "  \"results\"  (array) Outputs as above, ordered by address and txid instead of height\n"
+            "  \"next\"  (string) Cursor of the next page, null on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"]}'")
+            + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"]}")
         );
 
@@ -732,15 +925,34 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    size_t nLimit = 0;
+    bool fHaveCursor;
+    CAddressUnspentKey keyFrom;
+    size_t nAddressFrom = 0;
+    bool fPaged = getPagingFromParams(params, addresses, 0, 0, nLimit, fHaveCursor, keyFrom, nAddressFrom);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::string cursor;
+
+    if (fPaged) {
+        getAddressIndexPage<CAddressUnspentKey, CAddressUnspentValue>(addresses, 0, 0, nLimit, fHaveCursor, keyFrom, nAddressFrom,
+            [](const std::pair<uint160, int>& address, size_t nMax, const CAddressUnspentKey* pkeyFrom,
+               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& entries) {
+                return GetAddressUnspent(address.first, address.second, entries, nMax, pkeyFrom);
+            },
+            [](const std::pair<uint160, int>& address) {
+                return CAddressUnspentKey(address.second, address.first, uint256(), 0);
+            },
+            unspentOutputs, cursor);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue result(UniValue::VARR);
 
@@ -760,6 +972,9 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         result.push_back(output);
     }
 
+    if (fPaged)
+        return addressIndexPageResult(result, cursor);
+
     return result;
 }
 
@@ -778,6 +993,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many deltas, wrapped in a page object\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page, start and end must not change\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -789,8 +1006,14 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit)\n"
+            "{\n"
+            "  \"results\"  (array) Deltas as above, ordered by address and height\n"
+            "  \"next\"  (string) Cursor of the next page, null on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"]}'")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"]}")
         );
 
@@ -816,18 +1039,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
+    std::string cursor;
+    bool fPaged = getAddressIndexFromParams(params, addresses, start, end, addressIndex, cursor);
 
     UniValue result(UniValue::VARR);
 
@@ -847,6 +1060,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         result.push_back(delta);
     }
 
+    if (fPaged)
+        return addressIndexPageResult(result, cursor);
+
     return result;
 }
 
@@ -880,22 +1096,16 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAmount addressBalance, addressReceived;
+        if (!GetAddressBalance((*it).first, (*it).second, addressBalance, addressReceived)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += addressBalance;
+        received += addressReceived;
     }
 
     UniValue result(UniValue::VOBJ);
@@ -921,14 +1131,23 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most this many address deltas, wrapped in a page object\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page, start and end must not change\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit)\n"
+            "{\n"
+            "  \"results\"  (array) Txids as above, ordered by address and height. A transaction\n"
+            "                      may show up on two pages if its deltas span the page boundary\n"
+            "  \"next\"  (string) Cursor of the next page, null on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"]}'")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"], \"limit\": 1000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"FVFWySYTq8z7PLqXf13Y48Wis9JfjTPKyk\"]}")
         );
 
@@ -950,18 +1169,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
+    std::string cursor;
+    bool fPaged = getAddressIndexFromParams(params, addresses, start, end, addressIndex, cursor);
 
     std::set<std::pair<int, std::string> > txids;
     UniValue result(UniValue::VARR);
@@ -970,7 +1179,7 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
 
-        if (addresses.size() > 1) {
+        if (addresses.size() > 1 && !fPaged) {
             txids.insert(std::make_pair(height, txid));
         } else {
             if (txids.insert(std::make_pair(height, txid)).second) {
@@ -979,12 +1188,15 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
-    if (addresses.size() > 1) {
+    if (addresses.size() > 1 && !fPaged) {
         for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
             result.push_back(it->second);
         }
     }
 
+    if (fPaged)
+        return addressIndexPageResult(result, cursor);
+
     return result;
 
 }
@@ -348,6 +348,7 @@ static const CRPCCommand vRPCCommands[] =
     { "futurocoin",               "masternodelist",         &masternodelist,         true  },
     { "futurocoin",               "masternodebroadcast",    &masternodebroadcast,    true  },
     { "futurocoin",               "mnsync",                 &mnsync,                 true  },
+    { "futurocoin",               "getinstantsendinfo",     &getinstantsendinfo,     true  },
     { "futurocoin",               "spork",                  &spork,                  true  },
     { "futurocoin",               "mnlist",                 &mnlist,                 true  },
 #ifdef ENABLE_WALLET
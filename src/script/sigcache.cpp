@@ -5,43 +5,67 @@
 
 #include "sigcache.h"
 
-#include "memusage.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
 #include <boost/thread.hpp>
-#include <boost/unordered_set.hpp>
 
 namespace {
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
+ * blinding in the hash computation. Each of the eight cuckoo hashes is a
+ * different 32-bit word of the entry.
  */
-class CSignatureCacheHasher
+class SignatureCacheHasher
 {
 public:
-    size_t operator()(const uint256& key) const {
-        return key.GetCheapHash();
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
     }
 };
 
+/** Number of independently locked parts of the signature cache, a power of two */
+static const unsigned int SIGCACHE_SHARDS = 16;
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * The cache is split into shards by the first byte of the entry, each a
+ * cuckoo cache with its own lock on a separate cache line. Lookups and
+ * erases are locked too, but only in shared mode: erasing just flags the
+ * slot as reusable, so they do not exclude each other and only wait for an
+ * insert into the same shard, which locks it exclusively. Taking the shared
+ * lock still writes to the shard's lock.
  */
 class CSignatureCache
 {
 private:
+    struct alignas(64) Shard
+    {
+        boost::shared_mutex cs_shard;
+        CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    };
+
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    Shard shards[SIGCACHE_SHARDS];
 
+    Shard& GetShard(const uint256& entry)
+    {
+        // The cuckoo hashes use the high bits of each word, the shard the low bits of the first
+        return shards[*entry.begin() & (SIGCACHE_SHARDS - 1)];
+    }
 
 public:
     CSignatureCache()
@@ -56,52 +80,54 @@ public:
     }
 
     bool
-    Get(const uint256& entry)
+    Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
+        Shard& shard = GetShard(entry);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs_shard);
+        return shard.setValid.contains(entry, erase);
     }
 
-    void Erase(const uint256& entry)
+    void Set(const uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        Shard& shard = GetShard(entry);
+        boost::unique_lock<boost::shared_mutex> lock(shard.cs_shard);
+        shard.setValid.insert(entry);
     }
 
-    void Set(const uint256& entry)
+    /** Size all shards to use nBytes in total, dropping their contents. Returns the number of entries. */
+    size_t Setup(size_t nBytes)
     {
-        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
-        {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s)) {
-                setValid.erase(*it);
-            }
+        size_t nElems = 0;
+        for (unsigned int i = 0; i < SIGCACHE_SHARDS; i++) {
+            boost::unique_lock<boost::shared_mutex> lock(shards[i].cs_shard);
+            nElems += shards[i].setValid.setup_bytes(nBytes / SIGCACHE_SHARDS);
         }
-
-        setValid.insert(entry);
+        return nElems;
     }
 };
 
+// Not a function-local static, which would cost a guard check per lookup.
+static CSignatureCache signatureCache;
+
 }
 
-bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+void InitSignatureCache()
 {
-    static CSignatureCache signatureCache;
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements per shard).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = signatureCache.Setup(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
 
+bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(entry)) {
-        if (!store) {
-            signatureCache.Erase(entry);
-        }
+    if (signatureCache.Get(entry, !store))
         return true;
-    }
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
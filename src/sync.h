@@ -158,6 +158,32 @@ public:
     {
         return lock.owns_lock();
     }
+
+    /** Releases a held CMutexLock for its own lifetime and takes it again when it goes out of scope */
+    class reverse_lock
+    {
+    private:
+        CMutexLock& lockHeld;
+        const char* pszName;
+        const char* pszFile;
+        int nLine;
+
+        reverse_lock(const reverse_lock&);
+        reverse_lock& operator=(const reverse_lock&);
+
+    public:
+        reverse_lock(CMutexLock& lockIn, const char* pszNameIn, const char* pszFileIn, int nLineIn) :
+            lockHeld(lockIn), pszName(pszNameIn), pszFile(pszFileIn), nLine(nLineIn)
+        {
+            lockHeld.lock.unlock();
+            LeaveCritical();
+        }
+
+        ~reverse_lock()
+        {
+            lockHeld.Enter(pszName, pszFile, nLine);
+        }
+    };
 };
 
 typedef CMutexLock<CCriticalSection> CCriticalBlock;
@@ -168,6 +194,9 @@ typedef CMutexLock<CCriticalSection> CCriticalBlock;
 #define LOCK(cs) CCriticalBlock PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
 #define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
 #define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
+//! Release the named lock held by this thread for the rest of the scope. If the
+//! thread holds the same recursive mutex further up, it stays locked.
+#define REVERSE_LOCK(name) decltype(name)::reverse_lock PASTE2(reverseblock, __COUNTER__)(name, #name, __FILE__, __LINE__)
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
@@ -366,6 +366,16 @@ BOOST_AUTO_TEST_CASE( divide )
     BOOST_CHECK(R2L / MaxL == ZeroL);
     BOOST_CHECK(MaxL / R2L == 1);
     BOOST_CHECK_THROW(R2L / ZeroL, uint_error);
+
+    // DivideSmall matches the long division for every 32 bit divisor size
+    const uint32_t vSmall[] = {1, 2, 3, 25, 3600, 0x10000, 0xfffffffb, 0xffffffff};
+    for (size_t i = 0; i < sizeof(vSmall) / sizeof(vSmall[0]); i++) {
+        BOOST_CHECK(arith_uint256(R1L).DivideSmall(vSmall[i]) == R1L / arith_uint256(vSmall[i]));
+        BOOST_CHECK(arith_uint256(R2L).DivideSmall(vSmall[i]) == R2L / arith_uint256(vSmall[i]));
+        BOOST_CHECK(arith_uint256(MaxL).DivideSmall(vSmall[i]) == MaxL / arith_uint256(vSmall[i]));
+    }
+    BOOST_CHECK(arith_uint256(ZeroL).DivideSmall(7) == ZeroL);
+    BOOST_CHECK_THROW(arith_uint256(R1L).DivideSmall(0), uint_error);
 }
 
 
@@ -12,6 +12,7 @@
 #include <vector>
 #include <map>
 
+#include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
 
 namespace
@@ -347,4 +348,101 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+// Prefetching the coins of a block must leave the cache in the same state
+// as fetching them one by one: coins created within the block and coins
+// missing from the database are not warmed.
+BOOST_FIXTURE_TEST_CASE(prefetch_block_coins_test, TestingSetup)
+{
+    CCoinsViewTest base;
+    std::vector<uint256> vFunding;
+    {
+        CCoinsViewCacheTest writer(&base);
+        for (unsigned int i = 0; i < 2; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vout.resize(2);
+            tx.vout[0].nValue = 100 + i;
+            tx.vout[1].nValue = 200 + i;
+            CValidationState dummy;
+            UpdateCoins(tx, dummy, writer, 1);
+            vFunding.push_back(tx.GetHash());
+        }
+        writer.Flush();
+    }
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 300;
+    block.vtx.push_back(coinbase);
+    // Spends both funding transactions
+    CMutableTransaction spend;
+    spend.vin.resize(2);
+    spend.vin[0].prevout = COutPoint(vFunding[0], 0);
+    spend.vin[1].prevout = COutPoint(vFunding[1], 1);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 400;
+    block.vtx.push_back(spend);
+    // Spends a coin created within the block
+    CMutableTransaction chained;
+    chained.vin.resize(1);
+    chained.vin[0].prevout = COutPoint(block.vtx[1].GetHash(), 0);
+    chained.vout.resize(1);
+    chained.vout[0].nValue = 500;
+    block.vtx.push_back(chained);
+    // Spends a coin the database does not have
+    uint256 missing = GetRandHash();
+    CMutableTransaction orphan;
+    orphan.vin.resize(1);
+    orphan.vin[0].prevout = COutPoint(missing, 0);
+    orphan.vout.resize(1);
+    orphan.vout[0].nValue = 600;
+    block.vtx.push_back(orphan);
+
+    CCoinsViewCacheTest prefetched(&base);
+    CCoinsViewCacheTest plain(&base);
+    BOOST_CHECK(nScriptCheckThreads > 0);
+    PrefetchBlockCoins(block, prefetched, &base);
+    PrefetchBlockCoins(block, plain, NULL);
+
+    BOOST_CHECK(prefetched.HaveCoinsInCache(vFunding[0]));
+    BOOST_CHECK(prefetched.HaveCoinsInCache(vFunding[1]));
+    BOOST_CHECK(!prefetched.HaveCoinsInCache(block.vtx[1].GetHash()));
+    BOOST_CHECK(!prefetched.HaveCoinsInCache(missing));
+    BOOST_CHECK(!plain.HaveCoinsInCache(vFunding[0]));
+    BOOST_CHECK_EQUAL(prefetched.GetCacheSize(), 2U);
+
+    // A second prefetch leaves the warm entries alone
+    PrefetchBlockCoins(block, prefetched, &base);
+    BOOST_CHECK_EQUAL(prefetched.GetCacheSize(), 2U);
+
+    std::vector<uint256> vTxids(vFunding);
+    vTxids.push_back(missing);
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        vTxids.push_back(tx.GetHash());
+    BOOST_FOREACH(const uint256& txid, vTxids) {
+        const CCoins* pcoinsPrefetched = prefetched.AccessCoins(txid);
+        const CCoins* pcoinsPlain = plain.AccessCoins(txid);
+        BOOST_CHECK_EQUAL(pcoinsPrefetched == NULL, pcoinsPlain == NULL);
+        if (pcoinsPrefetched && pcoinsPlain)
+            BOOST_CHECK(*pcoinsPrefetched == *pcoinsPlain);
+    }
+
+    for (unsigned int i = 0; i < 3; i++) {
+        CValidationState dummy;
+        UpdateCoins(block.vtx[i], dummy, prefetched, 2);
+        UpdateCoins(block.vtx[i], dummy, plain, 2);
+    }
+    BOOST_FOREACH(const uint256& txid, vTxids) {
+        const CCoins* pcoinsPrefetched = prefetched.AccessCoins(txid);
+        const CCoins* pcoinsPlain = plain.AccessCoins(txid);
+        BOOST_CHECK_EQUAL(pcoinsPrefetched == NULL, pcoinsPlain == NULL);
+        if (pcoinsPrefetched && pcoinsPlain)
+            BOOST_CHECK(*pcoinsPrefetched == *pcoinsPlain);
+    }
+    BOOST_CHECK_EQUAL(prefetched.GetCacheSize(), plain.GetCacheSize());
+    BOOST_CHECK_EQUAL(prefetched.DynamicMemoryUsage(), plain.DynamicMemoryUsage());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,12 +2,16 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/x11.h"
+#include "hash.h"
+#include "primitives/block.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_futurocoin.h"
@@ -273,4 +277,76 @@ BOOST_AUTO_TEST_CASE(pbkdf2_hmac_sha512_test) {
     BOOST_CHECK(HexStr(k, k + 64) == "8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71115b59f9e60cd9532fa33e0f75aefe30225c583a186cd82bd4daea9724a3d3b8");
 }
 
+BOOST_AUTO_TEST_CASE(x11_stage_dispatch) {
+    // Whatever X11AutoDetect() picked must agree with the portable sph_* code.
+    X11AutoDetect();
+    unsigned char in[64], expected[64], actual[64];
+    for (int stage = 0; stage < X11_STAGE_COUNT; stage++) {
+        for (int i = 0; i < 256; i++) {
+            for (int j = 0; j < 64; j++) {
+                in[j] = insecure_rand();
+            }
+            X11PortableStage(stage)(expected, in);
+            X11SelectedStage(stage)(actual, in);
+            BOOST_CHECK_MESSAGE(memcmp(expected, actual, 64) == 0, X11StageName(stage));
+        }
+    }
+    BOOST_CHECK(Params().GenesisBlock().GetHash() == Params().GetConsensus().hashGenesisBlock);
+}
+
+BOOST_AUTO_TEST_CASE(x11_batch) {
+    // Batched hashing must match GetHash(), including the partial batch at the end.
+    X11AutoDetect();
+    std::vector<CBlockHeader> headers(2 * X11_BATCH_LANES + 3);
+    for (CBlockHeader& header : headers) {
+        header.nVersion = insecure_rand();
+        header.hashPrevBlock = GetRandHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = insecure_rand();
+        header.nBits = insecure_rand();
+        header.nNonce = insecure_rand();
+    }
+    std::vector<uint256> hashes(headers.size());
+    HashX11Batch(headers.data(), headers.size(), hashes.data());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(x11_nonce_scan) {
+    // Hashing from the midstate must match plain HashX11(), also across the
+    // nonce wrapping around, both with the portable blake512 finish and with
+    // whatever X11AutoDetect() picks (the 4-way AVX2 one where available).
+    CBlockHeader header;
+    header.nVersion = insecure_rand();
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = insecure_rand();
+    header.nBits = insecure_rand();
+    header.nNonce = insecure_rand();
+    const uint32_t nonces[] = {0, 1, insecure_rand(), 0x00ff00ff, 0xfffffffe};
+    const size_t nNonces = sizeof(nonces) / sizeof(nonces[0]);
+
+    X11UsePortable();
+    std::vector<uint256> expected;
+    for (size_t n = 0; n < nNonces; n++) {
+        for (size_t i = 0; i < X11_BATCH_LANES; i++) {
+            header.nNonce = nonces[n] + i;
+            expected.push_back(HashX11(BEGIN(header.nVersion), END(header.nNonce)));
+        }
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        std::string algo = pass == 0 ? "standard" : X11AutoDetect();
+        CX11NonceScanner scanner(header);
+        for (size_t n = 0; n < nNonces; n++) {
+            uint256 hashes[X11_BATCH_LANES];
+            scanner.Hash(nonces[n], hashes);
+            for (size_t i = 0; i < X11_BATCH_LANES; i++) {
+                BOOST_CHECK_MESSAGE(hashes[i] == expected[n * X11_BATCH_LANES + i], algo);
+            }
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
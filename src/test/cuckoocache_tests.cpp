@@ -0,0 +1,109 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "random.h"
+#include "uint256.h"
+
+#include "test/test_futurocoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+/** Same scheme as the signature cache: each hash is one 32-bit word of the key */
+class TestHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, TestHasher> test_cache;
+
+static std::vector<uint256> RandomKeys(size_t n)
+{
+    std::vector<uint256> keys(n);
+    for (size_t i = 0; i < n; i++)
+        keys[i] = GetRandHash();
+    return keys;
+}
+
+static double HitRate(const test_cache& cache, const std::vector<uint256>& keys)
+{
+    size_t nHits = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+        nHits += cache.contains(keys[i], false);
+    return (double)nHits / keys.size();
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_empty)
+{
+    test_cache cache;
+    cache.setup_bytes(1 << 16);
+    std::vector<uint256> keys = RandomKeys(100);
+    BOOST_CHECK(HitRate(cache, keys) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    // Filling the table below one generation (45%) keeps every element
+    test_cache cache;
+    uint32_t nSize = cache.setup_bytes(1 << 18);
+    std::vector<uint256> keys = RandomKeys(nSize * 2 / 5);
+    for (size_t i = 0; i < keys.size(); i++)
+        cache.insert(keys[i]);
+    BOOST_CHECK(HitRate(cache, keys) > 0.99);
+
+    // Inserting the same elements again does not evict anything
+    for (size_t i = 0; i < keys.size(); i++)
+        cache.insert(keys[i]);
+    BOOST_CHECK(HitRate(cache, keys) > 0.99);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_bounded)
+{
+    // Overfilling the table evicts elements but never grows it
+    test_cache cache;
+    uint32_t nSize = cache.setup(1024);
+    BOOST_CHECK_EQUAL(nSize, 1024U);
+    std::vector<uint256> keys = RandomKeys(nSize * 4);
+    for (size_t i = 0; i < keys.size(); i++)
+        cache.insert(keys[i]);
+    double rate = HitRate(cache, keys);
+    BOOST_CHECK(rate > 0);
+    BOOST_CHECK(rate <= 0.25);
+
+    // The most recent elements are the most likely to be kept
+    std::vector<uint256> recent(keys.end() - nSize / 4, keys.end());
+    BOOST_CHECK(HitRate(cache, recent) > 0.9);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    test_cache cache;
+    uint32_t nSize = cache.setup(1024);
+    std::vector<uint256> keys = RandomKeys(nSize * 2 / 5);
+    for (size_t i = 0; i < keys.size(); i++)
+        cache.insert(keys[i]);
+
+    // Erasing only allows the slots to be reused, the elements stay visible
+    for (size_t i = 0; i < keys.size(); i++)
+        BOOST_CHECK(cache.contains(keys[i], true));
+    BOOST_CHECK(HitRate(cache, keys) > 0.99);
+
+    // New elements take the erased slots first
+    std::vector<uint256> keysNew = RandomKeys(nSize * 2 / 5);
+    for (size_t i = 0; i < keysNew.size(); i++)
+        cache.insert(keysNew[i]);
+    BOOST_CHECK(HitRate(cache, keysNew) > 0.99);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -324,4 +324,67 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    CDBOptions options;
+    std::string strError;
+    const size_t nCacheSize = 64 << 20;
+
+    BOOST_CHECK(ParseDBOptions("balanced", nCacheSize, options, strError));
+    BOOST_CHECK_EQUAL(options.nBlockCacheSize, nCacheSize / 2);
+    BOOST_CHECK_EQUAL(options.nWriteBufferSize, nCacheSize / 4);
+    BOOST_CHECK(!options.fCompression);
+    BOOST_CHECK_EQUAL(options.nBloomBits, 10);
+
+    BOOST_CHECK(ParseDBOptions("read", nCacheSize, options, strError));
+    BOOST_CHECK_EQUAL(options.nBlockCacheSize, nCacheSize * 3 / 4);
+    BOOST_CHECK_EQUAL(options.nWriteBufferSize, nCacheSize / 8);
+
+    // Settings override the preset
+    BOOST_CHECK(ParseDBOptions("read,cache=128,writebuffer=8,openfiles=500,bloom=0", nCacheSize, options, strError));
+    BOOST_CHECK_EQUAL(options.nBlockCacheSize, (size_t)128 << 20);
+    BOOST_CHECK_EQUAL(options.nWriteBufferSize, (size_t)8 << 20);
+    BOOST_CHECK_EQUAL(options.nMaxOpenFiles, 500);
+    BOOST_CHECK_EQUAL(options.nBloomBits, 0);
+
+    BOOST_CHECK(ParseDBOptions("compression=0", nCacheSize, options, strError));
+    BOOST_CHECK(!options.fCompression);
+#ifdef SNAPPY
+    BOOST_CHECK(ParseDBOptions("compression=1", nCacheSize, options, strError));
+    BOOST_CHECK(options.fCompression);
+#else
+    // LevelDB built without Snappy would silently ignore it
+    BOOST_CHECK(!ParseDBOptions("compression=1", nCacheSize, options, strError));
+#endif
+
+    BOOST_CHECK(!ParseDBOptions("huge", nCacheSize, options, strError));
+    BOOST_CHECK(!ParseDBOptions("cache=1,read", nCacheSize, options, strError));
+    BOOST_CHECK(!ParseDBOptions("cache=-1", nCacheSize, options, strError));
+    BOOST_CHECK(!ParseDBOptions("cache=x", nCacheSize, options, strError));
+    BOOST_CHECK(!ParseDBOptions("lru=1", nCacheSize, options, strError));
+    BOOST_CHECK(!ParseDBOptions("compact", nCacheSize, options, strError));
+    BOOST_CHECK(!ParseDBOptions("openfiles=73", nCacheSize, options, strError));
+    BOOST_CHECK(ParseDBOptions("openfiles=74", nCacheSize, options, strError));
+
+    // A database opened without a bloom filter (and compressed, if possible) reads back what it wrote
+#ifdef SNAPPY
+    BOOST_CHECK(ParseDBOptions("compression=1,bloom=0", 1 << 20, options, strError));
+#else
+    BOOST_CHECK(ParseDBOptions("bloom=0", 1 << 20, options, strError));
+#endif
+    path ph = temp_directory_path() / unique_path();
+    {
+        CDBWrapper dbw(ph, options, false, true, false);
+        for (int i = 0; i < 100; i++)
+            BOOST_CHECK(dbw.Write(i, std::string(1000, 'a' + i % 26)));
+    }
+    CDBWrapper dbw(ph, options, false, false, false);
+    std::string strValue;
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK(dbw.Read(i, strValue));
+        BOOST_CHECK(strValue == std::string(1000, 'a' + i % 26));
+    }
+    BOOST_CHECK(!dbw.Read(100, strValue));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
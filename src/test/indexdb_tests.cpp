@@ -0,0 +1,291 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "undo.h"
+#include "validation.h"
+
+#include "test/test_futurocoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(indexdb_tests, TestChain100Setup)
+
+static CAmount SumAddressIndex(const uint160& hashBytes, size_t& nEntriesRet)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(GetAddressIndex(hashBytes, 1, addressIndex));
+    nEntriesRet = addressIndex.size();
+    CAmount nSum = 0;
+    for (size_t i = 0; i < addressIndex.size(); i++)
+        nSum += addressIndex[i].second;
+    return nSum;
+}
+
+/** Sign input nIn of tx, spending the output scriptPubKey of key (pay to pubkey or pay to pubkey hash) */
+static void SignInput(CMutableTransaction& tx, unsigned int nIn, const CScript& scriptPubKey, const CKey& key)
+{
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, nIn, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[nIn].scriptSig = CScript() << vchSig;
+    if (scriptPubKey.IsPayToPublicKeyHash())
+        tx.vin[nIn].scriptSig << ToByteVector(key.GetPubKey());
+}
+
+/** The serialized index entries of an address and the given spent outputs */
+static std::vector<unsigned char> GetIndexBytes(const uint160& hashBytes, const std::vector<CSpentIndexKey>& vSpentKeys)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(pindexdb->ReadAddressIndex(hashBytes, 1, addressIndex));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    BOOST_CHECK(pindexdb->ReadAddressUnspentIndex(hashBytes, 1, addressUnspentIndex));
+    CAddressBalanceValue balance;
+    BOOST_CHECK(pindexdb->ReadAddressBalance(hashBytes, 1, balance));
+    ss << addressIndex << addressUnspentIndex << balance;
+    for (size_t i = 0; i < vSpentKeys.size(); i++) {
+        CSpentIndexKey key = vSpentKeys[i];
+        CSpentIndexValue value;
+        BOOST_CHECK(pindexdb->ReadSpentIndex(key, value));
+        ss << value;
+    }
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+/** The serialized undo data of a connected block */
+static std::vector<unsigned char> GetUndoBytes(const CBlockIndex* pindex)
+{
+    CAutoFile filein(OpenUndoFile(pindex->GetUndoPos(), true), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(!filein.IsNull());
+    CBlockUndo blockundo;
+    uint256 hashChecksum;
+    filein >> blockundo >> hashChecksum;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << blockundo << hashChecksum;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_CASE(indexdb_connect_disconnect)
+{
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    // Spend the first coinbase to the P2PKH address of the same key
+    CKeyID keyID = coinbaseKey.GetPubKey().GetID();
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue;
+    tx.vout[0].scriptPubKey = GetScriptForDestination(keyID);
+    SignInput(tx, 0, coinbaseTxns[0].vout[0].scriptPubKey, coinbaseKey);
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, tx), scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // Reads see the update the background writer may not have written yet:
+    // the spent coinbase, the new output and the new coinbase
+    size_t nEntries;
+    CAmount nSum = SumAddressIndex(keyID, nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 3U);
+    BOOST_CHECK_EQUAL(nSum, block.vtx[0].vout[0].nValue);
+    CAmount nBalance, nReceived;
+    BOOST_CHECK(GetAddressBalance(keyID, 1, nBalance, nReceived));
+    BOOST_CHECK_EQUAL(nBalance, nSum);
+
+    CSpentIndexKey spentKey(coinbaseTxns[0].GetHash(), 0);
+    CSpentIndexValue spentValue;
+    BOOST_CHECK(pindexdb->ReadSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(spentValue.txid == tx.GetHash());
+
+    uint256 hashIndexBest;
+    BOOST_CHECK(pindexdb->Flush());
+    BOOST_CHECK(pindexdb->ReadBestBlock(hashIndexBest));
+    BOOST_CHECK(hashIndexBest == block.GetHash());
+
+    // Disconnecting the block takes its entries out again
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), chainActive.Tip()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.hashPrevBlock);
+    nSum = SumAddressIndex(keyID, nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 0U);
+    BOOST_CHECK(GetAddressBalance(keyID, 1, nBalance, nReceived));
+    BOOST_CHECK_EQUAL(nBalance, 0);
+    BOOST_CHECK(!pindexdb->ReadSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(pindexdb->ReadBestBlock(hashIndexBest));
+    BOOST_CHECK(hashIndexBest == block.hashPrevBlock);
+
+    fAddressIndex = false;
+    fSpentIndex = false;
+}
+
+BOOST_AUTO_TEST_CASE(indexdb_parallel_connect)
+{
+    fAddressIndex = true;
+    fSpentIndex = true;
+    const bool fParallelIndexSaved = fParallelIndex;
+    fParallelIndex = false;
+
+    // Split the first coinbase in two levels into 100 outputs, more than the
+    // 64 transactions of one batch of the index thread. A transaction has at
+    // most MAX_OUTPUTS_ALLOWED outputs.
+    const unsigned int nSplit = 10;
+    CKeyID keyID = coinbaseKey.GetPubKey().GetID();
+    CScript scriptKeyID = GetScriptForDestination(keyID);
+    std::vector<CMutableTransaction> vFanOut(nSplit + 1);
+    vFanOut[0].vin.resize(1);
+    vFanOut[0].vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    vFanOut[0].vout.resize(nSplit, CTxOut(coinbaseTxns[0].vout[0].nValue / nSplit, scriptKeyID));
+    SignInput(vFanOut[0], 0, coinbaseTxns[0].vout[0].scriptPubKey, coinbaseKey);
+    std::vector<CSpentIndexKey> vSpentKeys(1, CSpentIndexKey(coinbaseTxns[0].GetHash(), 0));
+    for (unsigned int i = 0; i < nSplit; i++) {
+        CMutableTransaction& tx = vFanOut[i + 1];
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(vFanOut[0].GetHash(), i);
+        tx.vout.resize(nSplit, CTxOut(vFanOut[0].vout[i].nValue / nSplit, scriptKeyID));
+        SignInput(tx, 0, scriptKeyID, coinbaseKey);
+        vSpentKeys.push_back(CSpentIndexKey(vFanOut[0].GetHash(), i));
+    }
+
+    std::vector<CMutableTransaction> vSpends;
+    for (unsigned int i = 0; i < nSplit; i++) {
+        const CMutableTransaction& txPrev = vFanOut[i + 1];
+        for (unsigned int j = 0; j < nSplit; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(txPrev.GetHash(), j);
+            tx.vout.resize(1, CTxOut(txPrev.vout[j].nValue, scriptKeyID));
+            SignInput(tx, 0, scriptKeyID, coinbaseKey);
+            vSpends.push_back(tx);
+            vSpentKeys.push_back(CSpentIndexKey(txPrev.GetHash(), j));
+        }
+    }
+
+    // Connect both blocks serially
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock blockFanOut = CreateAndProcessBlock(vFanOut, scriptPubKey);
+    CBlock blockSpends = CreateAndProcessBlock(vSpends, scriptPubKey);
+    CBlockIndex* pindexFanOut = mapBlockIndex[blockFanOut.GetHash()];
+    CBlockIndex* pindexSpends = mapBlockIndex[blockSpends.GetHash()];
+    BOOST_CHECK(chainActive.Tip() == pindexSpends);
+    std::vector<unsigned char> vchUndoFanOut = GetUndoBytes(pindexFanOut);
+    std::vector<unsigned char> vchUndoSpends = GetUndoBytes(pindexSpends);
+    std::vector<unsigned char> vchIndexes = GetIndexBytes(keyID, vSpentKeys);
+
+    // Disconnect them and forget their undo data, so that it is written again
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), pindexFanOut));
+        BOOST_CHECK(chainActive.Tip() == pindexFanOut->pprev);
+        pindexFanOut->nStatus &= ~BLOCK_HAVE_UNDO;
+        pindexFanOut->nUndoPos = 0;
+        pindexSpends->nStatus &= ~BLOCK_HAVE_UNDO;
+        pindexSpends->nUndoPos = 0;
+        BOOST_CHECK(ReconsiderBlock(state, pindexFanOut));
+    }
+
+    // Connect them again with the index entries built on the index thread
+    fParallelIndex = true;
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindexSpends);
+    BOOST_CHECK(GetUndoBytes(pindexFanOut) == vchUndoFanOut);
+    BOOST_CHECK(GetUndoBytes(pindexSpends) == vchUndoSpends);
+    BOOST_CHECK(GetIndexBytes(keyID, vSpentKeys) == vchIndexes);
+
+    fParallelIndex = fParallelIndexSaved;
+    fAddressIndex = false;
+    fSpentIndex = false;
+}
+
+BOOST_AUTO_TEST_CASE(indexdb_catch_up_ahead)
+{
+    fAddressIndex = true;
+    fSpentIndex = true;
+
+    // Index two blocks, the second one paying to its own key
+    CKey keyAhead, keyBranch;
+    keyAhead.MakeNewKey(true);
+    keyBranch.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CBlock blockAhead = CreateAndProcessBlock(std::vector<CMutableTransaction>(),
+                                              GetScriptForDestination(keyAhead.GetPubKey().GetID()));
+    size_t nEntries;
+    SumAddressIndex(keyAhead.GetPubKey().GetID(), nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 1U);
+
+    // Disconnect the second block without the indexes following, as when the
+    // chain state was not flushed before a crash
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        fAddressIndex = false;
+        fSpentIndex = false;
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), mapBlockIndex[blockAhead.GetHash()]));
+        fAddressIndex = true;
+        fSpentIndex = true;
+        uint256 hashIndexBest;
+        BOOST_CHECK(pindexdb->ReadBestBlock(hashIndexBest));
+        BOOST_CHECK(hashIndexBest == blockAhead.GetHash());
+
+        // Catching up undoes the block the indexes are ahead with
+        BOOST_CHECK(CatchUpIndexDB(Params()));
+        BOOST_CHECK(pindexdb->ReadBestBlock(hashIndexBest));
+        BOOST_CHECK(hashIndexBest == chainActive.Tip()->GetBlockHash());
+    }
+    SumAddressIndex(keyAhead.GetPubKey().GetID(), nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 0U);
+
+    // so a different branch winning leaves no trace of it
+    CBlock blockBranch = CreateAndProcessBlock(std::vector<CMutableTransaction>(),
+                                               GetScriptForDestination(keyBranch.GetPubKey().GetID()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == blockBranch.GetHash());
+    SumAddressIndex(keyAhead.GetPubKey().GetID(), nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 0U);
+    SumAddressIndex(keyBranch.GetPubKey().GetID(), nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 1U);
+
+    fAddressIndex = false;
+    fSpentIndex = false;
+}
+
+BOOST_AUTO_TEST_CASE(indexdb_move_from_blocktree)
+{
+    // Entries as earlier versions kept them in the block index database,
+    // 'a' and 's' are the key prefixes of the address and timestamp indexes
+    uint160 hashBytes = coinbaseKey.GetPubKey().GetID();
+    CAddressIndexKey addressKey(1, hashBytes, 1, 0, coinbaseTxns[0].GetHash(), 0, false);
+    CTimestampIndexKey timestampKey(chainActive.Tip()->nTime, chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(pblocktree->Write(std::make_pair('a', addressKey), (CAmount)COIN));
+    BOOST_CHECK(pblocktree->Write(std::make_pair('s', timestampKey), 0));
+
+    BOOST_CHECK(pindexdb->MoveFromBlockTree(*pblocktree, chainActive.Tip()->GetBlockHash()));
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair('a', addressKey)));
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair('s', timestampKey)));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(pindexdb->ReadAddressIndex(hashBytes, 1, addressIndex));
+    BOOST_CHECK_EQUAL(addressIndex.size(), 1U);
+    BOOST_CHECK_EQUAL(addressIndex[0].second, COIN);
+    std::vector<uint256> hashes;
+    BOOST_CHECK(pindexdb->ReadTimestampIndex(timestampKey.timestamp, timestampKey.timestamp, hashes));
+    BOOST_CHECK_EQUAL(hashes.size(), 1U);
+    BOOST_CHECK(hashes[0] == chainActive.Tip()->GetBlockHash());
+
+    uint256 hashIndexBest;
+    BOOST_CHECK(pindexdb->ReadBestBlock(hashIndexBest));
+    BOOST_CHECK(hashIndexBest == chainActive.Tip()->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
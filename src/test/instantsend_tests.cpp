@@ -0,0 +1,325 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "instantx.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "masternode-sync.h"
+#include "random.h"
+#include "utiltime.h"
+#include "test/test_futurocoin.h"
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+class CInstantSendTest : public CInstantSend
+{
+public:
+    void AddOrphan(const CTxLockVote& vote)
+    {
+        LOCK(cs_instantsend);
+        AddOrphanTxLockVote(vote);
+    }
+
+    bool EraseOrphan(const uint256& nVoteHash)
+    {
+        LOCK(cs_instantsend);
+        std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.find(nVoteHash);
+        if (it == mapTxLockVotesOrphan.end())
+            return false;
+        EraseOrphanTxLockVote(it);
+        return true;
+    }
+
+    size_t CountOrphans()
+    {
+        LOCK(cs_instantsend);
+        return mapTxLockVotesOrphan.size();
+    }
+
+    size_t CountOrphanTxs()
+    {
+        LOCK(cs_instantsend);
+        return mapTxLockVotesOrphanByTx.size();
+    }
+
+    size_t CountOrphanOutpoints()
+    {
+        LOCK(cs_instantsend);
+        return mapTxLockVotesOrphanByOutpoint.size();
+    }
+
+    // Every orphan vote is in both indexes under its own key, and they hold nothing else
+    bool OrphanIndexesInSync()
+    {
+        LOCK(cs_instantsend);
+        size_t nByTx = 0;
+        for (std::map<uint256, std::set<uint256> >::const_iterator it = mapTxLockVotesOrphanByTx.begin(); it != mapTxLockVotesOrphanByTx.end(); ++it) {
+            if (it->second.empty())
+                return false;
+            BOOST_FOREACH(const uint256& nVoteHash, it->second) {
+                std::map<uint256, CTxLockVote>::const_iterator itVote = mapTxLockVotesOrphan.find(nVoteHash);
+                if (itVote == mapTxLockVotesOrphan.end() || itVote->second.GetTxHash() != it->first)
+                    return false;
+            }
+            nByTx += it->second.size();
+        }
+        size_t nByOutpoint = 0;
+        for (std::map<COutPoint, std::set<uint256> >::const_iterator it = mapTxLockVotesOrphanByOutpoint.begin(); it != mapTxLockVotesOrphanByOutpoint.end(); ++it) {
+            if (it->second.empty())
+                return false;
+            BOOST_FOREACH(const uint256& nVoteHash, it->second) {
+                std::map<uint256, CTxLockVote>::const_iterator itVote = mapTxLockVotesOrphan.find(nVoteHash);
+                if (itVote == mapTxLockVotesOrphan.end() || itVote->second.GetOutpoint() != it->first)
+                    return false;
+            }
+            nByOutpoint += it->second.size();
+        }
+        return nByTx == mapTxLockVotesOrphan.size() && nByOutpoint == mapTxLockVotesOrphan.size();
+    }
+
+    void AddLockCandidateWithVote(const uint256& txHash, const CTxLockVote& vote)
+    {
+        LOCK(cs_instantsend);
+        CreateEmptyTxLockCandidate(txHash);
+        std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+        it->second.AddOutPointLock(vote.GetOutpoint());
+        it->second.AddVote(vote);
+        mapTxLockVotes.insert(std::make_pair(vote.GetHash(), vote));
+    }
+
+    void SetMasternodeOrphanVote(const CPubKey& pubKeyMasternode, int64_t nExpireTime)
+    {
+        LOCK(cs_instantsend);
+        SetMasternodeOrphanVoteTime(pubKeyMasternode, nExpireTime);
+    }
+
+    void SetCachedBlockHeight(int nHeight)
+    {
+        LOCK(cs_instantsend);
+        nCachedBlockHeight = nHeight;
+    }
+
+    bool HasLockCandidate(const uint256& txHash)
+    {
+        LOCK(cs_instantsend);
+        return mapTxLockCandidates.count(txHash);
+    }
+
+    bool HasVote(const uint256& nVoteHash)
+    {
+        LOCK(cs_instantsend);
+        return mapTxLockVotes.count(nVoteHash);
+    }
+
+    bool HasMasternodeOrphanVote(const CPubKey& pubKeyMasternode)
+    {
+        LOCK(cs_instantsend);
+        return mapMasternodeOrphanVotes.count(pubKeyMasternode);
+    }
+
+    size_t CountLockCandidateQueue()
+    {
+        LOCK(cs_instantsend);
+        return mmapTxLockCandidatesByConfirmedHeight.size();
+    }
+
+    size_t CountVoteQueue()
+    {
+        LOCK(cs_instantsend);
+        return mmapTxLockVotesByConfirmedHeight.size();
+    }
+
+    size_t CountOrphanQueue()
+    {
+        LOCK(cs_instantsend);
+        return mmapTxLockVotesOrphanByTime.size();
+    }
+
+    size_t CountMasternodeOrphanQueue()
+    {
+        LOCK(cs_instantsend);
+        return mmapMasternodeOrphanVotesByTime.size();
+    }
+};
+
+// CheckAndRemove does nothing until the masternode list is synced
+void CheckAndRemoveSynced(CInstantSend& is, CConnman& connman)
+{
+    masternodeSync.Reset();
+    while (!masternodeSync.IsMasternodeListSynced())
+        masternodeSync.SwitchToNextAsset(connman);
+    is.CheckAndRemove();
+    masternodeSync.Reset();
+}
+
+CPubKey NewMasternodePubKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key.GetPubKey();
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(instantsend_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(orphan_vote_indexes)
+{
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+
+    CInstantSendTest is;
+    uint256 txHashA = GetRandHash();
+    uint256 txHashB = GetRandHash();
+    COutPoint outpointA0(GetRandHash(), 0);
+    COutPoint outpointA1(GetRandHash(), 1);
+    COutPoint outpointB0(GetRandHash(), 0);
+
+    CTxLockVote voteA0(txHashA, outpointA0, NewMasternodePubKey());
+    CTxLockVote voteA0Other(txHashA, outpointA0, NewMasternodePubKey());
+    CTxLockVote voteA1(txHashA, outpointA1, NewMasternodePubKey());
+    CTxLockVote voteB0(txHashB, outpointB0, NewMasternodePubKey());
+    is.AddOrphan(voteA0);
+    is.AddOrphan(voteA0Other);
+    is.AddOrphan(voteA1);
+    is.AddOrphan(voteB0);
+    // Adding a vote again changes nothing
+    is.AddOrphan(voteB0);
+    BOOST_CHECK_EQUAL(is.CountOrphans(), 4U);
+    BOOST_CHECK_EQUAL(is.CountOrphanTxs(), 2U);
+    BOOST_CHECK_EQUAL(is.CountOrphanOutpoints(), 3U);
+    BOOST_CHECK(is.OrphanIndexesInSync());
+
+    // An outpoint stays indexed while one of its votes is left
+    BOOST_CHECK(is.EraseOrphan(voteA0.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountOrphanOutpoints(), 3U);
+    BOOST_CHECK(is.OrphanIndexesInSync());
+    BOOST_CHECK(is.EraseOrphan(voteA0Other.GetHash()));
+    BOOST_CHECK(!is.EraseOrphan(voteA0Other.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountOrphans(), 2U);
+    BOOST_CHECK_EQUAL(is.CountOrphanTxs(), 2U);
+    BOOST_CHECK_EQUAL(is.CountOrphanOutpoints(), 2U);
+    BOOST_CHECK(is.OrphanIndexesInSync());
+
+    // CheckAndRemove erases the timed out votes only
+    SetMockTime(nTime + INSTANTSEND_TIMEOUT_SECONDS + 1);
+    CTxLockVote voteB1(txHashB, COutPoint(GetRandHash(), 1), NewMasternodePubKey());
+    is.AddOrphan(voteB1);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK_EQUAL(is.CountOrphans(), 1U);
+    BOOST_CHECK_EQUAL(is.CountOrphanTxs(), 1U);
+    BOOST_CHECK_EQUAL(is.CountOrphanOutpoints(), 1U);
+    BOOST_CHECK(is.OrphanIndexesInSync());
+    BOOST_CHECK(is.EraseOrphan(voteB1.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountOrphanTxs(), 0U);
+    BOOST_CHECK_EQUAL(is.CountOrphanOutpoints(), 0U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(expiry_queues)
+{
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+    int nKeepLock = Params().GetConsensus().nInstantSendKeepLock;
+    CInstantSendTest is;
+
+    // A refreshed masternode orphan vote time is kept until the new time
+    CPubKey pubKeyMasternode = NewMasternodePubKey();
+    is.SetMasternodeOrphanVote(pubKeyMasternode, nTime + 10);
+    is.SetMasternodeOrphanVote(pubKeyMasternode, nTime + 20);
+    BOOST_CHECK_EQUAL(is.CountMasternodeOrphanQueue(), 2U);
+    SetMockTime(nTime + 11);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK(is.HasMasternodeOrphanVote(pubKeyMasternode));
+    BOOST_CHECK_EQUAL(is.CountMasternodeOrphanQueue(), 1U);
+    SetMockTime(nTime + 21);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK(!is.HasMasternodeOrphanVote(pubKeyMasternode));
+    BOOST_CHECK_EQUAL(is.CountMasternodeOrphanQueue(), 0U);
+
+    // An orphan vote erased before it timed out only leaves a queue entry behind
+    nTime = GetTime();
+    CTxLockVote voteOrphan(GetRandHash(), COutPoint(GetRandHash(), 0), NewMasternodePubKey());
+    is.AddOrphan(voteOrphan);
+    BOOST_CHECK(is.EraseOrphan(voteOrphan.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountOrphanQueue(), 1U);
+    SetMockTime(nTime + INSTANTSEND_TIMEOUT_SECONDS + 1);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK_EQUAL(is.CountOrphanQueue(), 0U);
+    BOOST_CHECK_EQUAL(is.CountOrphans(), 0U);
+
+    // A lock confirmed in the tip (genesis, height 0) and then disconnected again is kept
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1;
+    CTransaction tx(mtx);
+    CTxLockVote vote(tx.GetHash(), mtx.vin[0].prevout, NewMasternodePubKey());
+    is.AddLockCandidateWithVote(tx.GetHash(), vote);
+    const CBlock& block = Params().GenesisBlock();
+    is.SyncTransaction(tx, &block);
+    BOOST_CHECK_EQUAL(is.CountLockCandidateQueue(), 1U);
+    BOOST_CHECK_EQUAL(is.CountVoteQueue(), 1U);
+    is.SyncTransaction(tx, NULL);
+    is.SetCachedBlockHeight(nKeepLock + 1);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK(is.HasLockCandidate(tx.GetHash()));
+    BOOST_CHECK(is.HasVote(vote.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountLockCandidateQueue(), 0U);
+    BOOST_CHECK_EQUAL(is.CountVoteQueue(), 0U);
+
+    // Once confirmed again it expires nKeepLock blocks later
+    is.SyncTransaction(tx, &block);
+    is.SetCachedBlockHeight(nKeepLock);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK(is.HasLockCandidate(tx.GetHash()));
+    BOOST_CHECK(is.HasVote(vote.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountLockCandidateQueue(), 1U);
+    BOOST_CHECK_EQUAL(is.CountVoteQueue(), 1U);
+    is.SetCachedBlockHeight(nKeepLock + 1);
+    CheckAndRemoveSynced(is, *connman);
+    BOOST_CHECK(!is.HasLockCandidate(tx.GetHash()));
+    BOOST_CHECK(!is.HasVote(vote.GetHash()));
+    BOOST_CHECK_EQUAL(is.CountLockCandidateQueue(), 0U);
+    BOOST_CHECK_EQUAL(is.CountVoteQueue(), 0U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(lock_latency_percentiles)
+{
+    CTxLockLatencyStats stats;
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(50), 0);
+
+    stats.Add(7);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(0), 7);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(100), 7);
+
+    // Samples 100..1 in reverse, so the percentile can not just pick by arrival order
+    stats = CTxLockLatencyStats();
+    for (int64_t n = 100; n > 0; n--)
+        stats.Add(n);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(0), 1);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(50), 51);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(90), 91);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(99), 100);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(100), 100);
+
+    // Only the last INSTANTSEND_LATENCY_SAMPLES samples count, the totals keep everything
+    stats = CTxLockLatencyStats();
+    for (int64_t n = 1; n <= (int64_t)INSTANTSEND_LATENCY_SAMPLES + 100; n++)
+        stats.Add(n);
+    BOOST_CHECK_EQUAL(stats.dqRecent.size(), INSTANTSEND_LATENCY_SAMPLES);
+    BOOST_CHECK_EQUAL(stats.nCount, (int64_t)INSTANTSEND_LATENCY_SAMPLES + 100);
+    BOOST_CHECK_EQUAL(stats.nMax, (int64_t)INSTANTSEND_LATENCY_SAMPLES + 100);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(0), 101);
+    BOOST_CHECK_EQUAL(stats.GetRecentPercentile(50), 601);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "consensus/validation.h"
+#include "miner.h"
+#include "pow.h"
 #include "validation.h"
 #include "net.h"
 
@@ -79,4 +82,131 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_FIXTURE_TEST_CASE(read_raw_block, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    const CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pindex = chainActive[50];
+        pos = pindex->GetBlockPos();
+    }
+
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    // Raw bytes are appended after whatever the buffer already holds
+    CSerializeData vchBlock(CMessageHeader::HEADER_SIZE, 'x');
+    BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pos, pindex->GetBlockHeader(), chainparams.MessageStart()));
+    BOOST_CHECK_EQUAL(vchBlock.size(), CMessageHeader::HEADER_SIZE + ssBlock.size());
+    BOOST_CHECK(std::equal(ssBlock.begin(), ssBlock.end(), vchBlock.begin() + CMessageHeader::HEADER_SIZE));
+
+    // A header that does not match the stored block is rejected
+    CSerializeData vchOther;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchOther, pos, pindex->pprev->GetBlockHeader(), chainparams.MessageStart()));
+    BOOST_CHECK(vchOther.empty());
+
+    // A block file that ends inside the block leaves the buffer as it was
+    CDiskBlockPos posTruncated(pos.nFile + 1, MESSAGE_START_SIZE + sizeof(unsigned int));
+    {
+        CAutoFile fileout(OpenBlockFile(CDiskBlockPos(posTruncated.nFile, 0)), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(!fileout.IsNull());
+        fileout << FLATDATA(chainparams.MessageStart()) << (unsigned int)ssBlock.size();
+        fileout.write(&ssBlock[0], ssBlock.size() / 2);
+    }
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchOther, posTruncated, chainparams.MessageStart()));
+    BOOST_CHECK(vchOther.empty());
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, posTruncated, chainparams.MessageStart()));
+    BOOST_CHECK_EQUAL(vchBlock.size(), CMessageHeader::HEADER_SIZE + ssBlock.size());
+}
+// Like TestChain100Setup::CreateAndProcessBlock, with a coinbase that pays
+// half of the block value to scriptPayee as the masternode payment
+static CBlock CreateAndProcessBlockPaying(const CScript& scriptPayee, const CScript& scriptMiner)
+{
+    const CChainParams& chainparams = Params();
+    CBlockTemplate *pblocktemplate = CreateNewBlock(chainparams, scriptMiner);
+    CBlock& block = pblocktemplate->block;
+
+    block.vtx.resize(1);
+    CMutableTransaction txCoinbase(block.vtx[0]);
+    CAmount nValue = block.vtx[0].GetValueOut();
+    txCoinbase.vout.clear();
+    txCoinbase.vout.push_back(CTxOut(nValue / 2, scriptPayee));
+    txCoinbase.vout.push_back(CTxOut(nValue - nValue / 2, scriptMiner));
+    block.vtx[0] = txCoinbase;
+    unsigned int extraNonce = 0;
+    IncrementExtraNonce(&block, chainActive.Tip(), extraNonce);
+
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus())) ++block.nNonce;
+
+    ProcessNewBlock(chainparams, &block, true, NULL, NULL);
+
+    CBlock result = block;
+    delete pblocktemplate;
+    return result;
+}
+
+BOOST_FIXTURE_TEST_CASE(masternode_payment_index, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPayee = CScript() << OP_TRUE;
+    CScript scriptMiner = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CreateAndProcessBlockPaying(scriptPayee, scriptMiner);
+    CreateAndProcessBlockPaying(scriptPayee, scriptMiner);
+    CBlockIndex* pindexOld;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 102);
+        pindexOld = chainActive.Tip();
+    }
+
+    // Newest first, above nMinHeight only
+    std::vector<std::pair<int, unsigned int> > vPayments;
+    int nIndexStart;
+    BOOST_CHECK(GetMasternodePayments(scriptPayee, 0, pindexOld, vPayments, nIndexStart));
+    BOOST_CHECK_EQUAL(nIndexStart, 0);
+    BOOST_CHECK_EQUAL(vPayments.size(), 2U);
+    BOOST_CHECK_EQUAL(vPayments[0].first, 102);
+    BOOST_CHECK_EQUAL(vPayments[0].second, pindexOld->nTime);
+    BOOST_CHECK_EQUAL(vPayments[1].first, 101);
+    vPayments.clear();
+    BOOST_CHECK(GetMasternodePayments(scriptPayee, 101, pindexOld, vPayments, nIndexStart));
+    BOOST_CHECK_EQUAL(vPayments.size(), 1U);
+
+    // Disconnecting a block erases its entries
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(InvalidateBlock(state, chainparams.GetConsensus(), pindexOld));
+        BOOST_CHECK_EQUAL(chainActive.Height(), 101);
+    }
+    vPayments.clear();
+    BOOST_CHECK(GetMasternodePayments(scriptPayee, 0, pindexOld, vPayments, nIndexStart));
+    BOOST_CHECK_EQUAL(vPayments.size(), 1U);
+    BOOST_CHECK_EQUAL(vPayments[0].first, 101);
+
+    // Another block at the same height is found from its own chain only
+    CScript scriptMinerOther = CScript() << OP_TRUE << OP_DROP << OP_TRUE;
+    CreateAndProcessBlockPaying(scriptPayee, scriptMinerOther);
+    const CBlockIndex* pindexNew;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 102);
+        pindexNew = chainActive.Tip();
+    }
+    BOOST_CHECK(pindexNew != pindexOld);
+    vPayments.clear();
+    BOOST_CHECK(GetMasternodePayments(scriptPayee, 0, pindexNew, vPayments, nIndexStart));
+    BOOST_CHECK_EQUAL(vPayments.size(), 2U);
+    BOOST_CHECK_EQUAL(vPayments[0].first, 102);
+    BOOST_CHECK_EQUAL(vPayments[0].second, pindexNew->nTime);
+    vPayments.clear();
+    BOOST_CHECK(GetMasternodePayments(scriptPayee, 0, pindexOld, vPayments, nIndexStart));
+    BOOST_CHECK_EQUAL(vPayments.size(), 1U);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -317,6 +317,95 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     CheckSort<3>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    /* 3rd highest fee */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).SigOps(1).FromTx(tx1));
+
+    /* highest fee */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 2 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).SigOps(0).FromTx(tx2));
+
+    /* lowest fee */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(0LL).FromTx(tx3));
+
+    /* 2nd highest fee */
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 6 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(15000LL).FromTx(tx4));
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.push_back(tx2.GetHash().ToString()); // 20000
+    sortedOrder.push_back(tx4.GetHash().ToString()); // 15000
+    sortedOrder.push_back(tx1.GetHash().ToString()); // 10000
+    sortedOrder.push_back(tx3.GetHash().ToString()); // 0
+    CheckSort<4>(pool, sortedOrder);
+
+    /* tx5 spends tx1 and tx3 and pays enough for all three, which puts the
+     * whole package ahead of tx2 */
+    CMutableTransaction tx5 = CMutableTransaction();
+    tx5.vin.resize(2);
+    tx5.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx5.vin[0].scriptSig = CScript() << OP_11;
+    tx5.vin[1].prevout = COutPoint(tx3.GetHash(), 0);
+    tx5.vin[1].scriptSig = CScript() << OP_11;
+    tx5.vout.resize(1);
+    tx5.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx5.vout[0].nValue = 14 * COIN;
+    pool.addUnchecked(tx5.GetHash(), entry.Fee(200000LL).SigOps(2).FromTx(tx5));
+
+    CTxMemPool::txiter it5 = pool.mapTx.find(tx5.GetHash());
+    CTxMemPool::txiter it1 = pool.mapTx.find(tx1.GetHash());
+    CTxMemPool::txiter it3 = pool.mapTx.find(tx3.GetHash());
+    BOOST_CHECK_EQUAL(it5->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(it5->GetSizeWithAncestors(), it5->GetTxSize() + it1->GetTxSize() + it3->GetTxSize());
+    BOOST_CHECK_EQUAL(it5->GetModFeesWithAncestors(), 210000);
+    BOOST_CHECK_EQUAL(it5->GetSigOpCountWithAncestors(), 3);
+    sortedOrder.insert(sortedOrder.begin(), tx5.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+
+    /* Prioritising a parent changes the package fee of its descendants */
+    pool.PrioritiseTransaction(tx3.GetHash(), tx3.GetHash().ToString(), 0, 5000LL);
+    BOOST_CHECK_EQUAL(it5->GetModFeesWithAncestors(), 215000);
+    BOOST_CHECK_EQUAL(it3->GetModFeesWithAncestors(), 5000);
+
+    /* Mining tx1 takes it out of tx5's ancestor state */
+    std::list<CTransaction> removed;
+    pool.remove(tx1, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(it5->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(it5->GetSizeWithAncestors(), it5->GetTxSize() + it3->GetTxSize());
+    BOOST_CHECK_EQUAL(it5->GetModFeesWithAncestors(), 205000);
+    BOOST_CHECK_EQUAL(it5->GetSigOpCountWithAncestors(), 2);
+
+    /* Removing tx3 with its descendants leaves no packages behind */
+    removed.clear();
+    pool.remove(tx3, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 2);
+    sortedOrder.clear();
+    sortedOrder.push_back(tx2.GetHash().ToString());
+    sortedOrder.push_back(tx4.GetHash().ToString());
+    CheckSort<4>(pool, sortedOrder);
+}
+
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
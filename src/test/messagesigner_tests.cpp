@@ -0,0 +1,105 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messagesigner.h"
+
+#include "key.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "uint256.h"
+#include "validation.h"
+#include "test/test_futurocoin.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+// TestingSetup runs script check threads, which verify the batches
+BOOST_FIXTURE_TEST_SUITE(messagesigner_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(hashsig_cache_invalid)
+{
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CHashSigner::SignHash(hash, key2, vchSig));
+
+    // A signature made with another key is recovered once, and remembered as invalid
+    std::string strError;
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, key1.GetPubKey(), vchSig, strError));
+    BOOST_CHECK(strError.find("Keys don't match") == 0);
+    BOOST_CHECK(!CHashSigner::VerifyHash(hash, key1.GetPubKey(), vchSig, strError));
+    BOOST_CHECK(strError.find("Signature already known to be invalid") == 0);
+
+    // The same signature is valid for the key it was made with
+    BOOST_CHECK(CHashSigner::VerifyHash(hash, key2.GetPubKey(), vchSig, strError));
+
+    // Neither of them is queued for another check
+    CHashSigBatch batch;
+    BOOST_CHECK(!batch.Add(hash, key1.GetPubKey(), vchSig));
+    BOOST_CHECK(!batch.Add(hash, key2.GetPubKey(), vchSig));
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(hashsig_batch_mixed)
+{
+    BOOST_CHECK(nScriptCheckThreads > 1);
+
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+
+    // Every third signature is made with the wrong key, every third one after that is corrupted
+    std::vector<uint256> vHashes;
+    std::vector<std::vector<unsigned char> > vSigs;
+    std::vector<bool> vExpected;
+    CHashSigBatch batch;
+    for (int i = 0; i < 30; i++) {
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(CHashSigner::SignHash(hash, i % 3 == 1 ? key2 : key1, vchSig));
+        if (i % 3 == 2)
+            vchSig[10] ^= 0x01;
+        BOOST_CHECK(batch.Add(hash, key1.GetPubKey(), vchSig));
+        vHashes.push_back(hash);
+        vSigs.push_back(vchSig);
+        vExpected.push_back(i % 3 == 0);
+    }
+    BOOST_CHECK_EQUAL(batch.size(), 30U);
+
+    // One bad signature fails the batch, each one still gets its own result
+    BOOST_CHECK(!batch.Verify());
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        BOOST_CHECK_EQUAL(batch.IsValid(i), (bool)vExpected[i]);
+    }
+
+    // All of the results are cached, good and bad ones alike
+    CHashSigBatch batch2;
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        BOOST_CHECK(!batch2.Add(vHashes[i], key1.GetPubKey(), vSigs[i]));
+        std::string strError;
+        BOOST_CHECK_EQUAL(CHashSigner::VerifyHash(vHashes[i], key1.GetPubKey(), vSigs[i], strError), (bool)vExpected[i]);
+        if (!vExpected[i])
+            BOOST_CHECK(strError.find("Signature already known to be invalid") == 0);
+    }
+
+    // A batch of valid signatures only passes
+    CHashSigBatch batch3;
+    for (int i = 0; i < 10; i++) {
+        std::string strMessage = strprintf("message %d %s", i, GetRandHash().ToString());
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(CMessageSigner::SignMessage(strMessage, vchSig, key2));
+        BOOST_CHECK(batch3.AddMessage(strMessage, key2.GetPubKey(), vchSig));
+    }
+    BOOST_CHECK(batch3.Verify());
+    for (size_t i = 0; i < batch3.size(); i++) {
+        BOOST_CHECK(batch3.IsValid(i));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
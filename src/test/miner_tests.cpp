@@ -7,10 +7,12 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "key.h"
 #include "validation.h"
 #include "masternode-payments.h"
 #include "miner.h"
 #include "pubkey.h"
+#include "script/interpreter.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
@@ -397,4 +399,99 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+// Spend output 0 of txPrev, which pays to key, back to the same key
+static CMutableTransaction SpendToSelf(const CTransaction& txPrev, const CKey& key, CAmount nFee)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(CreateNewBlock_packages, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    entry.SpendsCoinbase(true);
+
+    // Mature a second coinbase
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG);
+
+    // Leave everything to the fee based selection
+    mapArgs["-blockprioritysize"] = "0";
+
+    LOCK(cs_main);
+
+    // A parent without fee is only mined because its child pays for both
+    CMutableTransaction txParent = SpendToSelf(coinbaseTxns[0], coinbaseKey, 0);
+    CMutableTransaction txChild = SpendToSelf(txParent, coinbaseKey, CENT);
+    mempool.addUnchecked(txParent.GetHash(), entry.Fee(0).FromTx(txParent));
+    mempool.addUnchecked(txChild.GetHash(), entry.Fee(CENT).SpendsCoinbase(false).FromTx(txChild));
+
+    CBlockTemplate* pblocktemplate;
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(chainparams, scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txParent.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txChild.GetHash());
+    delete pblocktemplate;
+
+    // The cached template picks up a new transaction without a rebuild
+    CBlockTemplateCache cache(chainparams, scriptPubKey);
+    pblocktemplate = cache.Get();
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    CAmount nCoinbaseValue = pblocktemplate->block.vtx[0].GetValueOut();
+
+    CMutableTransaction txOther = SpendToSelf(coinbaseTxns[1], coinbaseKey, CENT / 2);
+    mempool.addUnchecked(txOther.GetHash(), entry.Fee(CENT / 2).SpendsCoinbase(true).FromTx(txOther));
+    BOOST_CHECK(cache.Get() == pblocktemplate);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    BOOST_CHECK(pblocktemplate->block.vtx[3].GetHash() == txOther.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0].GetValueOut(), nCoinbaseValue + CENT / 2);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -(CENT + CENT / 2));
+    BOOST_CHECK_EQUAL(nLastBlockTx, 3);
+
+    // The appended template is still a valid block
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidity(state, chainparams, pblocktemplate->block, chainActive.Tip(), false, false));
+
+    // Removing a template transaction makes a request rebuild it, but not
+    // sooner than a few seconds after the last rebuild
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+    std::list<CTransaction> removed;
+    mempool.remove(txChild, removed, true);
+    BOOST_CHECK(cache.Get() == pblocktemplate);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4);
+    SetMockTime(nTime + 6);
+    pblocktemplate = cache.Get();
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txOther.GetHash());
+    SetMockTime(0);
+
+    // A package that does not fit is left out without a rebuild
+    unsigned int nTxSize = ::GetSerializeSize(txOther, SER_NETWORK, PROTOCOL_VERSION);
+    mapArgs["-blockmaxsize"] = strprintf("%u", 1000 + 2 * nTxSize);
+    CBlockTemplateCache cacheFull(chainparams, scriptPubKey);
+    pblocktemplate = cacheFull.Get();
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    mempool.addUnchecked(txChild.GetHash(), entry.Fee(CENT).SpendsCoinbase(false).FromTx(txChild));
+    BOOST_CHECK(cacheFull.Get() == pblocktemplate);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    mapArgs.erase("-blockmaxsize");
+
+    mempool.clear();
+    mapArgs.erase("-blockprioritysize");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -174,4 +174,54 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+static void QueueProcessMsg(CNode& node, const char* pszCommand, int nPayload)
+{
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    ssPayload << nPayload;
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    msg.hdr = CMessageHeader(Params().MessageStart(), pszCommand, ssPayload.size());
+    msg.in_data = true;
+    msg.vRecv = ssPayload;
+    msg.nDataPos = ssPayload.size();
+    node.vProcessMsg.push_back(msg);
+}
+
+BOOST_AUTO_TEST_CASE(cnode_peek_process_msg)
+{
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, "", true);
+
+    QueueProcessMsg(node, NetMsgType::TXLOCKVOTE, 1);
+    QueueProcessMsg(node, NetMsgType::INV, 2);
+    QueueProcessMsg(node, NetMsgType::TXLOCKVOTE, 3);
+    QueueProcessMsg(node, NetMsgType::TXLOCKVOTE, 4);
+
+    // Only messages of the requested type, at most nMax of them
+    std::vector<CDataStream> vMessages;
+    node.PeekProcessMsg(NetMsgType::TXLOCKVOTE, 2, vMessages);
+    BOOST_CHECK_EQUAL(vMessages.size(), 2U);
+    int nPayload;
+    vMessages[0] >> nPayload;
+    BOOST_CHECK_EQUAL(nPayload, 1);
+    vMessages[1] >> nPayload;
+    BOOST_CHECK_EQUAL(nPayload, 3);
+
+    // Every message is handed out once
+    vMessages.clear();
+    node.PeekProcessMsg(NetMsgType::TXLOCKVOTE, 64, vMessages);
+    BOOST_CHECK_EQUAL(vMessages.size(), 1U);
+    vMessages[0] >> nPayload;
+    BOOST_CHECK_EQUAL(nPayload, 4);
+
+    vMessages.clear();
+    node.PeekProcessMsg(NetMsgType::TXLOCKVOTE, 64, vMessages);
+    BOOST_CHECK(vMessages.empty());
+
+    // Peeking leaves the queue alone
+    BOOST_CHECK_EQUAL(node.vProcessMsg.size(), 4U);
+    BOOST_CHECK_EQUAL(node.vProcessMsg.front().vRecv.size(), sizeof(int));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
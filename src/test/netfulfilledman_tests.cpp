@@ -0,0 +1,75 @@
+// Copyright (c) 2014-2017 The Dash Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netfulfilledman.h"
+
+#include "chainparams.h"
+#include "netbase.h"
+#include "utiltime.h"
+#include "test/test_futurocoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+class CNetFulfilledRequestManagerTest : public CNetFulfilledRequestManager
+{
+public:
+    size_t CountAddresses()
+    {
+        LOCK(cs_mapFulfilledRequests);
+        return mapFulfilledRequests.size();
+    }
+
+    size_t CountExpiryQueue()
+    {
+        LOCK(cs_mapFulfilledRequests);
+        return mmapFulfilledRequestsByExpiry.size();
+    }
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(netfulfilledman_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(netfulfilledman_expiry)
+{
+    int64_t nTime = GetTime();
+    int64_t nExpireTime = Params().FulfilledRequestExpireTime();
+    SetMockTime(nTime);
+
+    CNetFulfilledRequestManagerTest fulfilledman;
+    CAddress addr1(LookupNumeric("250.1.1.1"), NODE_NONE);
+    CAddress addr2(LookupNumeric("250.1.1.2"), NODE_NONE);
+
+    fulfilledman.AddFulfilledRequest(addr1, "request");
+    fulfilledman.AddFulfilledRequest(addr2, "request");
+    BOOST_CHECK(fulfilledman.HasFulfilledRequest(addr1, "request"));
+    BOOST_CHECK(!fulfilledman.HasFulfilledRequest(addr1, "other"));
+
+    // Refreshed halfway, so addr1 outlives its first expiry time
+    SetMockTime(nTime + nExpireTime / 2);
+    fulfilledman.AddFulfilledRequest(addr1, "request");
+    BOOST_CHECK_EQUAL(fulfilledman.CountExpiryQueue(), 3U);
+
+    // Removed before it expired
+    fulfilledman.RemoveFulfilledRequest(addr2, "request");
+    BOOST_CHECK(!fulfilledman.HasFulfilledRequest(addr2, "request"));
+
+    SetMockTime(nTime + nExpireTime + 1);
+    fulfilledman.CheckAndRemove();
+    BOOST_CHECK(fulfilledman.HasFulfilledRequest(addr1, "request"));
+    BOOST_CHECK(!fulfilledman.HasFulfilledRequest(addr2, "request"));
+    BOOST_CHECK_EQUAL(fulfilledman.CountAddresses(), 1U);
+    BOOST_CHECK_EQUAL(fulfilledman.CountExpiryQueue(), 1U);
+
+    SetMockTime(nTime + nExpireTime / 2 + nExpireTime + 1);
+    BOOST_CHECK(!fulfilledman.HasFulfilledRequest(addr1, "request"));
+    fulfilledman.CheckAndRemove();
+    BOOST_CHECK_EQUAL(fulfilledman.CountAddresses(), 0U);
+    BOOST_CHECK_EQUAL(fulfilledman.CountExpiryQueue(), 0U);
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
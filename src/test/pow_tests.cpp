@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "arith_uint256.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "pow.h"
@@ -166,6 +167,87 @@ BOOST_AUTO_TEST_CASE(get_next_work)
 //     BOOST_CHECK_EQUAL(CalculateNextWorkRequired(&pindexLast, nLastRetargetTime, params), 0x1d00e1fd);
 // }
 
+/* DarkGravityWave as it was before its divisions were sped up and its results cached */
+static unsigned int ReferenceDarkGravityWave(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    const arith_uint256 bnPowLimit = UintToArith256(params.powLimit);
+    int64_t nPastBlocks = 24;
+
+    if (!pindexLast || pindexLast->nHeight < nPastBlocks) {
+        return bnPowLimit.GetCompact();
+    }
+
+    const CBlockIndex *pindex = pindexLast;
+    arith_uint256 bnPastTargetAvg;
+
+    for (unsigned int nCountBlocks = 1; nCountBlocks <= nPastBlocks; nCountBlocks++) {
+        arith_uint256 bnTarget = arith_uint256().SetCompact(pindex->nBits);
+        if (nCountBlocks == 1) {
+            bnPastTargetAvg = bnTarget;
+        } else {
+            bnPastTargetAvg = (bnPastTargetAvg * nCountBlocks + bnTarget) / (nCountBlocks + 1);
+        }
+
+        if(nCountBlocks != nPastBlocks) {
+            pindex = pindex->pprev;
+        }
+    }
+
+    arith_uint256 bnNew(bnPastTargetAvg);
+
+    int64_t nActualTimespan = pindexLast->GetBlockTime() - pindex->GetBlockTime();
+    int64_t nTargetTimespan = nPastBlocks * params.nPowTargetSpacing;
+
+    if (nActualTimespan < nTargetTimespan/3)
+        nActualTimespan = nTargetTimespan/3;
+    if (nActualTimespan > nTargetTimespan*3)
+        nActualTimespan = nTargetTimespan*3;
+
+    bnNew *= nActualTimespan;
+    bnNew /= nTargetTimespan;
+
+    if (bnNew > bnPowLimit) {
+        bnNew = bnPowLimit;
+    }
+
+    return bnNew.GetCompact();
+}
+
+/* GetNextWorkRequired agrees with the reference DGW on random chains, computed fresh and from its cache */
+BOOST_AUTO_TEST_CASE(get_next_work_reference)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+    const arith_uint256 bnPowLimit = UintToArith256(params.powLimit);
+
+    const int nBlocks = 2000;
+    std::vector<uint256> vHashes(nBlocks);
+    std::vector<CBlockIndex> blocks(nBlocks);
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = GetRandHash();
+        blocks[i].phashBlock = &vHashes[i];
+        blocks[i].pprev = i ? &blocks[i - 1] : NULL;
+        blocks[i].nHeight = i;
+        // Block times jump around enough to hit both timespan limits
+        blocks[i].nTime = i ? blocks[i - 1].nTime + GetRand(params.nPowTargetSpacing * 8) : 1408728124;
+        arith_uint256 bnTarget = bnPowLimit >> GetRand(32);
+        bnTarget -= GetRand(1000);
+        blocks[i].nBits = bnTarget.GetCompact();
+    }
+
+    for (int nPass = 0; nPass < 2; nPass++) {
+        for (int i = 0; i < nBlocks; i++) {
+            BOOST_CHECK_EQUAL(GetNextWorkRequired(&blocks[i], NULL, params), ReferenceDarkGravityWave(&blocks[i], params));
+        }
+    }
+
+    // Entries without a hash are never cached
+    CBlockIndex indexNoHash = blocks[nBlocks - 1];
+    indexNoHash.phashBlock = NULL;
+    indexNoHash.nTime += 10 * params.nPowTargetSpacing;
+    BOOST_CHECK_EQUAL(GetNextWorkRequired(&indexNoHash, NULL, params), ReferenceDarkGravityWave(&indexNoHash, params));
+}
+
 BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
 {
     SelectParams(CBaseChainParams::MAIN);
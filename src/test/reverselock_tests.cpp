@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "reverselock.h"
+#include "sync.h"
 #include "test/test_futurocoin.h"
 
 #include <boost/test/unit_test.hpp>
@@ -57,4 +58,23 @@ BOOST_AUTO_TEST_CASE(reverselock_errors)
     BOOST_CHECK(lock.owns_lock());
 }
 
+BOOST_AUTO_TEST_CASE(reverselock_critical_block)
+{
+    CCriticalSection cs;
+    CCriticalBlock lock(cs, "cs", __FILE__, __LINE__);
+    {
+        REVERSE_LOCK(lock);
+        BOOST_CHECK(!static_cast<bool>(lock));
+        // Another thread can take it while it is released
+        bool fLocked = false;
+        boost::thread t([&cs, &fLocked] {
+            TRY_LOCK(cs, lockOther);
+            fLocked = lockOther;
+        });
+        t.join();
+        BOOST_CHECK(fLocked);
+    }
+    BOOST_CHECK(static_cast<bool>(lock));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include "util.h"
 #include "test/test_futurocoin.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -100,4 +101,43 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindexarena_test)
+{
+    // Reserved entries are contiguous, later ones go to new chunks
+    CBlockIndexArena arena;
+    arena.Reserve(1000);
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 1000; i++) {
+        vIndex.push_back(arena.Allocate());
+        BOOST_CHECK(vIndex[i] == vIndex[0] + i);
+        BOOST_CHECK(vIndex[i]->pprev == NULL && vIndex[i]->nHeight == 0);
+    }
+    for (int i = 1000; i < 10000; i++)
+        vIndex.push_back(arena.Allocate());
+    BOOST_CHECK_EQUAL(arena.size(), 10000U);
+
+    for (int i = 0; i < 10000; i++) {
+        vIndex[i]->nHeight = i;
+        vIndex[i]->pprev = (i == 0) ? NULL : vIndex[i - 1];
+        vIndex[i]->BuildSkip();
+    }
+
+    // Splicing moves the storage without moving the entries
+    CBlockIndexArena arenaOther;
+    arenaOther.Splice(arena);
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+    BOOST_CHECK_EQUAL(arenaOther.size(), 10000U);
+    for (int i = 0; i < 100; i++) {
+        int from = insecure_rand() % 10000;
+        int to = insecure_rand() % (from + 1);
+        BOOST_CHECK(vIndex[from]->GetAncestor(to) == vIndex[to]);
+    }
+
+    // Entries allocated after a splice do not overlap the spliced ones
+    CBlockIndex* pindexNew = arena.Allocate();
+    BOOST_CHECK(std::find(vIndex.begin(), vIndex.end(), pindexNew) == vIndex.end());
+    arenaOther.Splice(arena);
+    BOOST_CHECK_EQUAL(arenaOther.size(), 10001U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,12 +9,14 @@
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/x11.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
 #include "net_processing.h"
 #include "pubkey.h"
 #include "random.h"
+#include "script/sigcache.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -39,8 +41,10 @@ extern void noui_connect();
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
         ECC_Start();
+        X11AutoDetect();
         SetupEnvironment();
         SetupNetworking();
+        InitSignatureCache();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(chainName);
@@ -63,8 +67,9 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         pathTemp = GetTempPath() / strprintf("test_futurocoin_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
         boost::filesystem::create_directories(pathTemp);
         mapArgs["-datadir"] = pathTemp.string();
-        pblocktree = new CBlockTreeDB(1 << 20, true);
-        pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+        pblocktree = new CBlockTreeDB(CDBOptions(1 << 20), true);
+        pindexdb = new CIndexDB(CDBOptions(1 << 20), true);
+        pcoinsdbview = new CCoinsViewDB(CDBOptions(1 << 23), true);
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
         InitBlockIndex(chainparams);
 #ifdef ENABLE_WALLET
@@ -76,6 +81,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        threadGroup.create_thread(&ThreadConnectIndex);
         g_connman = std::unique_ptr<CConnman>(new CConnman());
         connman = g_connman.get();
         RegisterNodeSignals(GetNodeSignals());
@@ -95,6 +101,7 @@ TestingSetup::~TestingSetup()
         delete pcoinsTip;
         delete pcoinsdbview;
         delete pblocktree;
+        delete pindexdb;
 #ifdef ENABLE_WALLET
         bitdb.Flush(true);
         bitdb.Reset();
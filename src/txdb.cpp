@@ -14,6 +14,7 @@
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -23,8 +24,11 @@ static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCE = 'd';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_MASTERNODEPAYMENT = 'm';
+static const char DB_MASTERNODEPAYMENT_START = 'M';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -33,7 +37,7 @@ static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(const CDBOptions& dbOptions, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", dbOptions, fMemory, fWipe, true) 
 {
 }
 
@@ -75,7 +79,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(const CDBOptions& dbOptions, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", dbOptions, fMemory, fWipe) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -167,42 +171,175 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+CIndexDB::CIndexDB(const CDBOptions& dbOptions, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "indexes", dbOptions, fMemory, fWipe),
+    nQueued(0), nWritten(0), fStop(false), fFailed(false)
+{
+    writer = boost::thread(boost::bind(&CIndexDB::ThreadIndexWriter, this));
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(&GetObfuscateKey());
-    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+CIndexDB::~CIndexDB()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        fStop = true;
+    }
+    condQueued.notify_one();
+    // The writer empties the queue before it stops
+    writer.join();
+}
+
+void CIndexDB::ThreadIndexWriter()
+{
+    RenameThread("futurocoin-indexdb");
+    while (true) {
+        std::shared_ptr<const CIndexDBUpdate> update;
+        {
+            boost::unique_lock<boost::mutex> lock(csQueue);
+            while (queue.empty() && !fStop)
+                condQueued.wait(lock);
+            if (queue.empty())
+                return;
+            update = queue.front();
+        }
+
+        bool fWritten = false;
+        try {
+            fWritten = WriteUpdate(*update);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
         }
+
+        {
+            boost::unique_lock<boost::mutex> lock(csQueue);
+            if (fWritten) {
+                queue.pop_front();
+                nWritten++;
+            } else {
+                // Nothing after a failed update may be written, ConnectBlock
+                // aborts the node as soon as it queues the next one
+                LogPrintf("%s: failed to write the indexes of block %s\n", __func__, update->hashBlock.ToString());
+                fFailed = true;
+                queue.clear();
+            }
+        }
+        condWritten.notify_all();
     }
-    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+bool CIndexDB::QueueUpdate(const std::shared_ptr<const CIndexDBUpdate>& update)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        while (queue.size() >= MAX_INDEX_DB_QUEUE && !fFailed)
+            condWritten.wait(lock);
+        if (fFailed)
+            return false;
+        queue.push_back(update);
+        nQueued++;
+    }
+    condQueued.notify_one();
+    return true;
+}
+
+bool CIndexDB::WaitForWrites()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    // Blocks connected meanwhile keep the queue filled during the initial
+    // download, so only wait for what is queued now
+    const uint64_t nWaitFor = nQueued;
+    while (nWritten < nWaitFor && !fFailed)
+        condWritten.wait(lock);
+    return !fFailed;
+}
+
+bool CIndexDB::Flush()
+{
+    if (!WaitForWrites())
+        return false;
+    uint256 hashBlock;
+    if (!ReadBestBlock(hashBlock))
+        return true;
+    return WriteBestBlock(hashBlock);
+}
+
+bool CIndexDB::ReadBestBlock(uint256& hashBlock) {
+    return Read(DB_BEST_BLOCK, hashBlock);
+}
+
+bool CIndexDB::WriteBestBlock(const uint256& hashBlock) {
     CDBBatch batch(&GetObfuscateKey());
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+    batch.Write(DB_BEST_BLOCK, hashBlock);
+    return WriteBatch(batch, true);
+}
+
+/** Move the entries with key prefix chKey from one database to the other */
+template <typename K, typename V>
+static bool MoveIndexEntries(CDBWrapper& from, CDBWrapper& to, char chKey)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(from.NewIterator());
+    CDBBatch batchTo(&to.GetObfuscateKey());
+    CDBBatch batchFrom(&from.GetObfuscateKey());
+    size_t nMoved = 0;
+
+    pcursor->Seek(chKey);
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == chKey;
+        if (!fValid || (nMoved > 0 && nMoved % 10000 == 0)) {
+            // The entries are written to their new database before they are
+            // erased from the old one, so an interrupted move picks up again
+            if (!to.WriteBatch(batchTo, true) || !from.WriteBatch(batchFrom))
+                return false;
+            batchTo.Clear();
+            batchFrom.Clear();
         }
+        if (!fValid)
+            break;
+        V value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read index entry", __func__);
+        batchTo.Write(key, value);
+        batchFrom.Erase(key);
+        nMoved++;
+        pcursor->Next();
     }
-    return WriteBatch(batch);
+    LogPrintf("%s: moved %u entries of index '%c'\n", __func__, nMoved, chKey);
+    return true;
+}
+
+bool CIndexDB::MoveFromBlockTree(CBlockTreeDB& blocktree, const uint256& hashBestBlock) {
+    if (!MoveIndexEntries<CAddressIndexKey, CAmount>(blocktree, *this, DB_ADDRESSINDEX) ||
+        !MoveIndexEntries<CAddressUnspentKey, CAddressUnspentValue>(blocktree, *this, DB_ADDRESSUNSPENTINDEX) ||
+        !MoveIndexEntries<CAddressIndexIteratorKey, CAddressBalanceValue>(blocktree, *this, DB_ADDRESSBALANCE) ||
+        !MoveIndexEntries<CTimestampIndexKey, int>(blocktree, *this, DB_TIMESTAMPINDEX) ||
+        !MoveIndexEntries<CSpentIndexKey, CSpentIndexValue>(blocktree, *this, DB_SPENTINDEX))
+        return false;
+    return WriteBestBlock(hashBestBlock);
+}
+
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    if (!WaitForWrites())
+        return false;
+    return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                       size_t nLimit, const CAddressUnspentKey* pkeyFrom) {
+    if (!WaitForWrites())
+        return false;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pkeyFrom) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pkeyFrom));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead++ < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
@@ -221,33 +358,145 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+typedef std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> AddressBalanceDeltaMap;
+
+/**
+ * Sum the deltas of address index entries into per-address balance changes.
+ * Entries whose presence in the database already matches fAdding are skipped,
+ * so connecting or disconnecting the same block twice (e.g. when replaying
+ * blocks after an unclean shutdown) does not count it twice.
+ */
+static void SumAddressBalanceDeltas(const CDBWrapper& db, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect,
+                                    bool fAdding, AddressBalanceDeltaMap& deltas)
+{
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (db.Exists(make_pair(DB_ADDRESSINDEX, it->first)) == fAdding)
+            continue;
+        CAddressBalanceValue& delta = deltas[make_pair(it->first.type, it->first.hashBytes)];
+        CAmount sign = fAdding ? 1 : -1;
+        delta.balance += sign * it->second;
+        if (it->second > 0)
+            delta.received += sign * it->second;
+    }
+}
+
+static void ApplyAddressBalanceDeltas(const CDBWrapper& db, CDBBatch& batch, const AddressBalanceDeltaMap& deltas)
+{
+    for (AddressBalanceDeltaMap::const_iterator it = deltas.begin(); it != deltas.end(); it++) {
+        CAddressIndexIteratorKey key(it->first.first, it->first.second);
+        CAddressBalanceValue value;
+        db.Read(make_pair(DB_ADDRESSBALANCE, key), value); // stays null if there is no record yet
+        value.balance += it->second.balance;
+        value.received += it->second.received;
+        if (value.IsNull())
+            batch.Erase(make_pair(DB_ADDRESSBALANCE, key));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCE, key), value);
+    }
+}
+
+bool CIndexDB::WriteUpdate(const CIndexDBUpdate& update) {
     CDBBatch batch(&GetObfuscateKey());
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+    AddressBalanceDeltaMap deltas;
+    SumAddressBalanceDeltas(*this, update.addressIndexErase, false, deltas);
+    SumAddressBalanceDeltas(*this, update.addressIndex, true, deltas);
+    ApplyAddressBalanceDeltas(*this, batch, deltas);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=update.addressIndexErase.begin(); it!=update.addressIndexErase.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=update.addressIndex.begin(); it!=update.addressIndex.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=update.addressUnspentIndex.begin(); it!=update.addressUnspentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+
+    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=update.spentIndex.begin(); it!=update.spentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+        }
+    }
+
+    for (std::vector<CTimestampIndexKey>::const_iterator it=update.timestampIndex.begin(); it!=update.timestampIndex.end(); it++)
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, *it), 0);
+
+    batch.Write(DB_BEST_BLOCK, update.hashBlock);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CIndexDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) {
+    if (!WaitForWrites())
+        return false;
+    // An address without a record has never been used
+    value.SetNull();
+    Read(make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(type, addressHash)), value);
+    return true;
+}
+
+bool CIndexDB::BuildAddressBalanceIndex() {
+    // Address index keys are sorted by address first, so every address is
+    // summed in one pass without holding more than one total in memory.
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
     CDBBatch batch(&GetObfuscateKey());
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+    std::pair<unsigned int, uint160> current;
+    CAddressBalanceValue total;
+    size_t nAddresses = 0;
+
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey()));
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+        if (!fValid || key.second.type != current.first || key.second.hashBytes != current.second) {
+            if (!total.IsNull()) {
+                batch.Write(make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(current.first, current.second)), total);
+                if (++nAddresses % 10000 == 0) {
+                    if (!WriteBatch(batch))
+                        return false;
+                    batch.Clear();
+                }
+            }
+            if (!fValid)
+                break;
+            current = make_pair(key.second.type, key.second.hashBytes);
+            total.SetNull();
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        total.balance += nValue;
+        if (nValue > 0)
+            total.received += nValue;
+        pcursor->Next();
+    }
+
+    LogPrintf("%s: summed the balances of %u addresses\n", __func__, nAddresses);
+    return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                int start, int end, size_t nLimit, const CAddressIndexKey* pkeyFrom) {
+    if (!WaitForWrites())
+        return false;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
+    if (pkeyFrom) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pkeyFrom));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead++ < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
@@ -269,13 +518,9 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(&GetObfuscateKey());
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+bool CIndexDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+    if (!WaitForWrites())
+        return false;
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -295,6 +540,54 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
+bool CBlockTreeDB::WriteMasternodePayments(const std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > &vect) {
+    CDBBatch batch(&GetObfuscateKey());
+    for (std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_MASTERNODEPAYMENT, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseMasternodePayments(const std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > &vect) {
+    CDBBatch batch(&GetObfuscateKey());
+    for (std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_MASTERNODEPAYMENT, it->first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadMasternodePayments(const uint160 &payeeHash, int nMinHeight, int nMaxHeight,
+                                          std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > &vect) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    // Heights are stored inverted, so this seeks to the newest payment at or below nMaxHeight
+    pcursor->Seek(make_pair(DB_MASTERNODEPAYMENT, CMasternodePaymentKey(payeeHash, nMaxHeight)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CMasternodePaymentKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_MASTERNODEPAYMENT && key.second.payeeHash == payeeHash &&
+            key.second.blockHeight > nMinHeight) {
+            CMasternodePaymentValue value;
+            if (!pcursor->GetValue(value))
+                return error("failed to get masternode payment index value");
+            vect.push_back(make_pair(key.second, value));
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::WriteMasternodePaymentIndexStart(int nHeight) {
+    return Write(DB_MASTERNODEPAYMENT_START, nHeight);
+}
+
+bool CBlockTreeDB::ReadMasternodePaymentIndexStart(int &nHeight) {
+    return Read(DB_MASTERNODEPAYMENT_START, nHeight);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -307,45 +600,180 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts()
+/** Block index records of one key range, decoded by a LoadBlockIndexGuts thread */
+struct CBlockIndexRange
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    /** Height of every record in key order, then the slot of the record in the height ordered entries */
+    std::vector<int> vSlots;
+    /** Hash, previous block hash and entry of every record */
+    std::vector<std::pair<std::pair<uint256, uint256>, CBlockIndex*> > vEntries;
+    std::string strError;
+};
+
+/**
+ * Go through the block index records whose hash starts with a byte in
+ * [nBegin, nEnd). Without pentries, check them and collect their heights.
+ * With fCheckHashes every header is hashed again and compared with the hash
+ * it is stored under. With pentries, decode every record into the entry
+ * range.vSlots assigns to it.
+ */
+static void ReadBlockIndexRange(CBlockTreeDB& db, unsigned int nBegin, unsigned int nEnd, bool fCheckHashes, CBlockIndex* pentries, CBlockIndexRange& range)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
 
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
+    uint256 hashBegin;
+    *hashBegin.begin() = (unsigned char)nBegin;
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, hashBegin));
 
-    // Load mapBlockIndex
+    size_t nRecord = 0;
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+            break;
 
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
+        CDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex)) {
+            range.strError = "failed to read value";
+            return;
+        }
+
+        if (!pentries) {
+            // Entries are stored under the hash of their header, the stored
+            // copy must agree with it. Neither needs the header to be hashed.
+            if (!diskindex.hash.IsNull() && diskindex.hash != key.second) {
+                range.strError = strprintf("stored hash %s does not match key %s", diskindex.hash.ToString(), key.second.ToString());
+                return;
             }
-        } else {
-            break;
+            if (fCheckHashes && diskindex.ComputeBlockHash() != key.second) {
+                range.strError = strprintf("block hash mismatch: %s", diskindex.ToString());
+                return;
+            }
+            if (!CheckProofOfWork(key.second, diskindex.nBits, Params().GetConsensus())) {
+                range.strError = strprintf("CheckProofOfWork failed: %s", diskindex.ToString());
+                return;
+            }
+            if (diskindex.nHeight < 0) {
+                range.strError = strprintf("negative height: %s", diskindex.ToString());
+                return;
+            }
+            range.vSlots.push_back(diskindex.nHeight);
+            pcursor->Next();
+            continue;
+        }
+
+        if (nRecord >= range.vSlots.size()) {
+            range.strError = "records changed while loading";
+            return;
+        }
+
+        // Construct block index object
+        CBlockIndex* pindexNew = &pentries[range.vSlots[nRecord++]];
+        pindexNew->nHeight        = diskindex.nHeight;
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nTx            = diskindex.nTx;
+        range.vEntries.push_back(make_pair(make_pair(key.second, diskindex.hashPrev), pindexNew));
+
+        pcursor->Next();
+    }
+    if (pentries && nRecord != range.vSlots.size())
+        range.strError = "records changed while loading";
+}
+
+/** Run ReadBlockIndexRange on one thread per range, the key space split evenly between them */
+static bool ReadBlockIndexRanges(CBlockTreeDB& db, bool fCheckHashes, CBlockIndex* pentries, std::vector<CBlockIndexRange>& vRanges)
+{
+    {
+        // The threads write to vRanges, so they must be joined before it goes out of scope
+        boost::this_thread::disable_interruption di;
+        boost::thread_group threads;
+        int nThreads = vRanges.size();
+        for (int t = 0; t < nThreads; t++) {
+            unsigned int nBegin = 256 * t / nThreads;
+            unsigned int nEnd = 256 * (t + 1) / nThreads;
+            CBlockIndexRange& range = vRanges[t];
+            threads.create_thread([&db, nBegin, nEnd, fCheckHashes, pentries, &range] {
+                ReadBlockIndexRange(db, nBegin, nEnd, fCheckHashes, pentries, range);
+            });
         }
+        threads.join_all();
+    }
+    boost::this_thread::interruption_point();
+
+    for (size_t t = 0; t < vRanges.size(); t++) {
+        if (!vRanges[t].strError.empty())
+            return error("LoadBlockIndexGuts: %s", vRanges[t].strError);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(bool fCheckHashes)
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Records are spread evenly over the key space, the first byte of a block
+    // hash being its least significant one, so each thread reads one range of
+    // it. Only inserting into mapBlockIndex is serial.
+    int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS));
+    std::vector<CBlockIndexRange> vRanges(nThreads);
+
+    // The records are in hash order. The entries go into one chunk in height
+    // order instead, so walking back along a chain reads memory sequentially
+    // rather than jumping around the whole index. A first pass only collects
+    // the heights, so every entry can be decoded straight into its place.
+    if (!ReadBlockIndexRanges(*this, fCheckHashes, NULL, vRanges))
+        return false;
+    size_t nEntries = 0;
+    int nMaxHeight = -1;
+    for (int t = 0; t < nThreads; t++) {
+        nEntries += vRanges[t].vSlots.size();
+        for (size_t i = 0; i < vRanges[t].vSlots.size(); i++)
+            nMaxHeight = std::max(nMaxHeight, vRanges[t].vSlots[i]);
+    }
+    std::vector<int> vHeightSlot(nMaxHeight + 2, 0);
+    for (int t = 0; t < nThreads; t++) {
+        for (size_t i = 0; i < vRanges[t].vSlots.size(); i++)
+            vHeightSlot[vRanges[t].vSlots[i] + 1]++;
+    }
+    for (int nHeight = 1; nHeight <= nMaxHeight + 1; nHeight++)
+        vHeightSlot[nHeight] += vHeightSlot[nHeight - 1];
+    for (int t = 0; t < nThreads; t++) {
+        for (size_t i = 0; i < vRanges[t].vSlots.size(); i++)
+            vRanges[t].vSlots[i] = vHeightSlot[vRanges[t].vSlots[i]]++;
+    }
+
+    CBlockIndexArena arena;
+    if (nEntries)
+        arena.Reserve(nEntries);
+    CBlockIndex* pentries = NULL;
+    for (size_t i = 0; i < nEntries; i++) {
+        CBlockIndex* pindex = arena.Allocate();
+        if (i == 0)
+            pentries = pindex;
+    }
+    if (!ReadBlockIndexRanges(*this, false, pentries, vRanges))
+        return false;
+    AdoptBlockIndexArena(arena);
+    int64_t nDecoded = GetTimeMillis();
+
+    // Load mapBlockIndex, then link every entry to its parent once all are known
+    for (int t = 0; t < nThreads; t++) {
+        for (size_t i = 0; i < vRanges[t].vEntries.size(); i++)
+            vRanges[t].vEntries[i].second = InsertBlockIndex(vRanges[t].vEntries[i].first.first, vRanges[t].vEntries[i].second);
+    }
+    for (int t = 0; t < nThreads; t++) {
+        for (size_t i = 0; i < vRanges[t].vEntries.size(); i++)
+            vRanges[t].vEntries[i].second->pprev = InsertBlockIndex(vRanges[t].vEntries[i].first.second);
     }
 
+    LogPrintf("%s: decoded %u entries with %d threads in %dms%s, inserted in %dms\n", __func__, nEntries, nThreads,
+              nDecoded - nStart, fCheckHashes ? " (hashes checked)" : "", GetTimeMillis() - nDecoded);
     return true;
 }
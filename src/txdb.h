@@ -9,11 +9,17 @@
 #include "coins.h"
 #include "dbwrapper.h"
 
+#include <deque>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 class CBlockFileInfo;
 class CBlockIndex;
 struct CDiskTxPos;
@@ -22,10 +28,14 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CMasternodePaymentKey;
+struct CMasternodePaymentValue;
+struct CIndexDBUpdate;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -34,6 +44,15 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -chainstatedbprofile default, see ParseDBOptions()
+static const char* const DEFAULT_CHAINSTATE_DB_PROFILE = "balanced";
+//! -indexdbprofile default, see ParseDBOptions(). The large, rarely read address
+//! index is compressed if LevelDB was built with Snappy.
+#ifdef SNAPPY
+static const char* const DEFAULT_INDEX_DB_PROFILE = "balanced,compression=1";
+#else
+static const char* const DEFAULT_INDEX_DB_PROFILE = "balanced";
+#endif
 
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
@@ -41,7 +60,7 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CDBWrapper db;
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(const CDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
@@ -54,7 +73,7 @@ public:
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(const CDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
@@ -66,21 +85,92 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool WriteMasternodePayments(const std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > &vect);
+    bool EraseMasternodePayments(const std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > &vect);
+    /** Read the payments to a payee at heights nMinHeight+1..nMaxHeight, newest first, as (height, block time) */
+    bool ReadMasternodePayments(const uint160 &payeeHash, int nMinHeight, int nMaxHeight,
+                                std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > &vect);
+    bool WriteMasternodePaymentIndexStart(int nHeight);
+    bool ReadMasternodePaymentIndexStart(int &nHeight);
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue);
+    /**
+     * Load mapBlockIndex. Entries are keyed by the block hash they were
+     * stored with, with fCheckHashes every header is hashed again to verify it.
+     */
+    bool LoadBlockIndexGuts(bool fCheckHashes);
+};
+
+//! Index updates queued for the index database before ConnectBlock waits for the writer
+static const unsigned int MAX_INDEX_DB_QUEUE = 64;
+
+/**
+ * Access to the address, spent and timestamp index database (indexes/).
+ * Block updates are written by a background thread, so compactions of the
+ * large address index do not stall connecting blocks. Every update is
+ * written in one batch together with the block it brings the indexes to,
+ * which tells how far the indexes got after a crash. Reads wait for the
+ * queued updates to be written first.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(const CDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
+    ~CIndexDB();
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+
+    boost::mutex csQueue;
+    //! signalled when an update is queued or the writer should stop
+    boost::condition_variable condQueued;
+    //! signalled when an update was written
+    boost::condition_variable condWritten;
+    //! updates to write in order, the front one stays queued while it is written
+    std::deque<std::shared_ptr<const CIndexDBUpdate> > queue;
+    //! number of updates queued and written so far, an update's sequence number is its position
+    uint64_t nQueued;
+    uint64_t nWritten;
+    bool fStop;
+    bool fFailed;
+    boost::thread writer;
+
+    void ThreadIndexWriter();
+    bool WriteUpdate(const CIndexDBUpdate& update);
+    /** Wait until the updates queued so far are written, later ones are not waited for */
+    bool WaitForWrites();
+public:
+    /**
+     * Queue the index changes of a connected or disconnected block. Returns
+     * false if an earlier update could not be written.
+     */
+    bool QueueUpdate(const std::shared_ptr<const CIndexDBUpdate>& update);
+    /** Wait for the queued updates and sync them to disk */
+    bool Flush();
+    /** The block the written updates brought the indexes to, null if none */
+    bool ReadBestBlock(uint256& hashBlock);
+    bool WriteBestBlock(const uint256& hashBlock);
+    /** Move the indexes kept in the block index database by earlier versions, they are at hashBestBlock */
+    bool MoveFromBlockTree(CBlockTreeDB& blocktree, const uint256& hashBestBlock);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    /**
+     * Read the unspent outputs of an address in key (txid) order. At most nLimit
+     * entries are read if nLimit is not 0, starting at pkeyFrom if given.
+     */
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 size_t nLimit = 0, const CAddressUnspentKey* pkeyFrom = NULL);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+    bool BuildAddressBalanceIndex();
+    /**
+     * Read the deltas of an address in key (height) order, limited to heights
+     * start..end if both are set. At most nLimit entries are read if nLimit is
+     * not 0, starting at pkeyFrom if given.
+     */
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+                          int start = 0, int end = 0, size_t nLimit = 0, const CAddressIndexKey* pkeyFrom = NULL);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
-    bool WriteFlag(const std::string &name, bool fValue);
-    bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -127,6 +127,12 @@ public:
         return ReadLE64(data);
     }
 
+    /** The little-endian 64-bit word at position pos (0-3). */
+    uint64_t GetUint64(int pos) const
+    {
+        return ReadLE64(data + pos * 8);
+    }
+
     /** A more secure, salted hash function.
      * @note This hash is not stable between little and big endian.
      */
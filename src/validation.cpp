@@ -43,6 +43,7 @@
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
@@ -62,6 +63,8 @@ using namespace std;
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+/** Storage of the CBlockIndex entries of mapBlockIndex (protected by cs_main) */
+static CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
@@ -73,6 +76,7 @@ bool fTxIndex = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fParallelIndex = DEFAULT_PARALLEL_INDEX;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -185,7 +189,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CIndexDB *pindexdb = NULL;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -838,20 +844,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                 // Save these to avoid repeated lookups
                 setIterConflicting.insert(mi);
 
-                // If this entry is "dirty", then we don't have descendant
-                // state for this transaction, which means we probably have
-                // lots of in-mempool descendants.
-                // Don't allow replacements of dirty transactions, to ensure
-                // that we don't spend too much time walking descendants.
-                // This should be rare.
-                if (mi->IsDirty()) {
-                    return state.DoS(0,
-                            error("AcceptToMemoryPool: rejecting replacement %s; cannot replace tx %s with untracked descendants",
-                                hash.ToString(),
-                                mi->GetTx().GetHash().ToString()),
-                            REJECT_NONSTANDARD, "too many potential replacements");
-                }
-
                 // Don't allow the replacement to reduce the feerate of the
                 // mempool.
                 //
@@ -982,7 +974,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                     FormatMoney(nModifiedFees - nConflictingFees),
                     (int)nSize - (int)nConflictingSize);
         }
-        pool.RemoveStaged(allConflicting);
+        pool.RemoveStaged(allConflicting, false);
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
@@ -1032,7 +1024,7 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::v
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, hashes))
+    if (!pindexdb->ReadTimestampIndex(high, low, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -1046,31 +1038,92 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!pindexdb->ReadSpentIndex(key, value))
         return false;
 
     return true;
 }
 
 bool GetAddressIndex(uint160 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     size_t nLimit, const CAddressIndexKey* pkeyFrom)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pindexdb->ReadAddressIndex(addressHash, type, addressIndex, start, end, nLimit, pkeyFrom))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAmount &balance, CAmount &received)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    CAddressBalanceValue value;
+    if (!pindexdb->ReadAddressBalance(addressHash, type, value))
+        return error("unable to get balance for address");
+
+    balance = value.balance;
+    received = value.received;
+    return true;
+}
+
+/** First height the masternode payment index covers, blocks below it were connected without it */
+static int nMasternodePaymentIndexStart = 0;
+
+/** Masternode payment index entries of the coinbase outputs of a block that pay the masternode payment */
+static void GetMasternodePaymentEntries(const CBlock& block, const CBlockIndex* pindex,
+                                        std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> >& vEntries)
+{
+    const CTransaction& txCoinbase = block.vtx[0];
+    CAmount nMasternodePayment = GetMasternodePayment(pindex->nHeight, txCoinbase.GetValueOut());
+    if (nMasternodePayment <= 0)
+        return;
+    BOOST_FOREACH(const CTxOut& txout, txCoinbase.vout) {
+        if (txout.nValue == nMasternodePayment) {
+            uint160 payeeHash = Hash160(txout.scriptPubKey.begin(), txout.scriptPubKey.end());
+            vEntries.push_back(std::make_pair(CMasternodePaymentKey(payeeHash, pindex->nHeight),
+                                              CMasternodePaymentValue(pindex->GetBlockHash(), pindex->nTime)));
+        }
+    }
+}
+
+bool GetMasternodePayments(const CScript& payee, int nMinHeight, const CBlockIndex* pindex,
+                           std::vector<std::pair<int, unsigned int> >& vPayments, int& nIndexStartRet)
+{
+    nIndexStartRet = nMasternodePaymentIndexStart;
+    if (pindex->nHeight <= nMinHeight)
+        return true;
+
+    uint160 payeeHash = Hash160(payee.begin(), payee.end());
+    std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > vEntries;
+    if (!pblocktree->ReadMasternodePayments(payeeHash, nMinHeight, pindex->nHeight, vEntries))
+        return error("unable to get masternode payments for payee");
+
+    // The index is written apart from the chain state, so after an unclean
+    // shutdown it can still hold entries of blocks that were reorganized away.
+    // Block index entries never change once created, so no cs_main is needed.
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        const CBlockIndex* pindexPayment = pindex->GetAncestor(vEntries[i].first.blockHeight);
+        if (!pindexPayment || pindexPayment->GetBlockHash() != vEntries[i].second.blockHash)
+            continue;
+        vPayments.push_back(std::make_pair(vEntries[i].first.blockHeight, vEntries[i].second.nTime));
+    }
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       size_t nLimit, const CAddressUnspentKey* pkeyFrom)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pindexdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, nLimit, pkeyFrom))
         return error("unable to get txids for address");
 
     return true;
@@ -1202,6 +1255,58 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // The serialized block is preceded by the message start and its size, see WriteBlockToDisk
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("ReadRawBlockFromDisk: invalid block position %s", pos.ToString());
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int));
+
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    // Append, so callers can reserve room for a message header in front of the block
+    size_t nOffset = vchBlock.size();
+    try {
+        CMessageHeader::MessageStartChars blockMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blockMessageStart) >> nSize;
+        if (memcmp(blockMessageStart, messageStart, MESSAGE_START_SIZE) != 0)
+            return error("%s: block magic mismatch at %s", __func__, pos.ToString());
+        if (nSize < 80 || nSize > MAX_SIZE)
+            return error("%s: invalid block size %u at %s", __func__, nSize, pos.ToString());
+
+        vchBlock.resize(nOffset + nSize);
+        filein.read(&vchBlock[nOffset], nSize);
+    }
+    catch (const std::exception& e) {
+        // Leave the buffer as it was, e.g. when the file ends early
+        vchBlock.resize(nOffset);
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CDiskBlockPos& pos, const CBlockHeader& header, const CMessageHeader::MessageStartChars& messageStart)
+{
+    size_t nOffset = vchBlock.size();
+    if (!ReadRawBlockFromDisk(vchBlock, pos, messageStart))
+        return false;
+
+    // Compare the stored header with the expected one instead of rehashing it
+    CDataStream ssHeader(SER_DISK, CLIENT_VERSION);
+    ssHeader << header;
+    if (vchBlock.size() - nOffset < ssHeader.size() ||
+        memcmp(&vchBlock[nOffset], &ssHeader[0], ssHeader.size()) != 0) {
+        vchBlock.resize(nOffset);
+        return error("ReadRawBlockFromDisk(CSerializeData&, CDiskBlockPos&, CBlockHeader&): header doesn't match block %s at %s",
+                header.GetHash().ToString(), pos.ToString());
+    }
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1668,6 +1773,160 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const CO
     return fClean;
 }
 
+/** Address and spent index entries of a block, written once ConnectBlock found it valid or DisconnectBlock undid it */
+struct CConnectIndexEntries
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+};
+
+/** Address index key of a script, type 0 if it is not indexed */
+static void GetAddressIndexKey(const CScript& script, uint160& hashBytes, int& addressType)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(vector <unsigned char>(script.begin()+2, script.begin()+22));
+        addressType = 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(vector <unsigned char>(script.begin()+3, script.begin()+23));
+        addressType = 1;
+    } else if (script.IsPayToPublicKey()) {
+        hashBytes = Hash160(script.begin()+1, script.end()-1);
+        addressType = 1;
+    } else {
+        hashBytes.SetNull();
+        addressType = 0;
+    }
+}
+
+/**
+ * Add the index entries of the i-th transaction of a block at nHeight. The
+ * spent outputs are taken from txundo, which UpdateCoins filled in when the
+ * transaction was connected (NULL for the coinbase).
+ */
+static void IndexConnectedTransaction(const CTransaction& tx, unsigned int i, const CTxUndo* ptxundo, int nHeight, CConnectIndexEntries& entries)
+{
+    const uint256 txhash = tx.GetHash();
+
+    if (ptxundo) {
+        assert(ptxundo->vprevout.size() == tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const CTxIn& input = tx.vin[j];
+            const CTxOut& prevout = ptxundo->vprevout[j].txout;
+            uint160 hashBytes;
+            int addressType;
+            GetAddressIndexKey(prevout.scriptPubKey, hashBytes, addressType);
+
+            if (fAddressIndex && addressType > 0) {
+                // record spending activity
+                entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                // remove address from unspent index
+                entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+            }
+
+            if (fSpentIndex) {
+                // add the spent index to determine the txid and input that spent an output
+                // and to find the amount and address from an input
+                entries.spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, addressType, hashBytes)));
+            }
+        }
+    }
+
+    if (fAddressIndex) {
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            uint160 hashBytes;
+            int addressType;
+            GetAddressIndexKey(out.scriptPubKey, hashBytes, addressType);
+            if (addressType == 0)
+                continue;
+
+            // record receiving activity
+            entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+
+            // record unspent output
+            entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
+    }
+}
+
+/** The index database update of a connected block, takes its entries */
+static std::shared_ptr<const CIndexDBUpdate> GetConnectIndexUpdate(const CBlockIndex* pindex, CConnectIndexEntries& entries)
+{
+    std::shared_ptr<CIndexDBUpdate> update = std::make_shared<CIndexDBUpdate>();
+    update->hashBlock = pindex->GetBlockHash();
+    update->addressIndex.swap(entries.addressIndex);
+    update->addressUnspentIndex.swap(entries.addressUnspentIndex);
+    update->spentIndex.swap(entries.spentIndex);
+    if (fTimestampIndex)
+        update->timestampIndex.push_back(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+    return update;
+}
+
+/**
+ * Add the index entries that undo the i-th transaction of a block at nHeight,
+ * in reverse order of its outputs and inputs. The spent outputs are taken
+ * from txundo (NULL for the coinbase).
+ */
+static void IndexDisconnectedTransaction(const CTransaction& tx, unsigned int i, const CTxUndo* ptxundo, int nHeight, CConnectIndexEntries& entries)
+{
+    const uint256 txhash = tx.GetHash();
+
+    if (fAddressIndex) {
+        for (unsigned int k = tx.vout.size(); k-- > 0;) {
+            const CTxOut &out = tx.vout[k];
+            uint160 hashBytes;
+            int addressType;
+            GetAddressIndexKey(out.scriptPubKey, hashBytes, addressType);
+            if (addressType == 0)
+                continue;
+
+            // undo receiving activity
+            entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+
+            // undo unspent index
+            entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue()));
+        }
+    }
+
+    if (ptxundo) {
+        assert(ptxundo->vprevout.size() == tx.vin.size());
+        for (unsigned int j = tx.vin.size(); j-- > 0;) {
+            const CTxIn& input = tx.vin[j];
+            const CTxInUndo& undo = ptxundo->vprevout[j];
+            const CTxOut& prevout = undo.txout;
+
+            if (fSpentIndex) {
+                // undo and delete the spent index
+                entries.spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
+            }
+
+            uint160 hashBytes;
+            int addressType;
+            GetAddressIndexKey(prevout.scriptPubKey, hashBytes, addressType);
+            if (fAddressIndex && addressType > 0) {
+                // undo spending activity
+                entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                // restore unspent index
+                entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+            }
+        }
+    }
+}
+
+/** The index database update of a disconnected block, takes its entries */
+static std::shared_ptr<const CIndexDBUpdate> GetDisconnectIndexUpdate(const CBlockIndex* pindex, CConnectIndexEntries& entries)
+{
+    std::shared_ptr<CIndexDBUpdate> update = std::make_shared<CIndexDBUpdate>();
+    update->hashBlock = pindex->pprev->GetBlockHash();
+    update->addressIndexErase.swap(entries.addressIndex);
+    update->addressUnspentIndex.swap(entries.addressUnspentIndex);
+    update->spentIndex.swap(entries.spentIndex);
+    return update;
+}
+
 bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -1687,50 +1946,11 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock(): block and undo data inconsistent");
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
 
-        if (fAddressIndex) {
-
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    // undo receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(2, uint160(hashBytes), hash, k), CAddressUnspentValue()));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-
-                    // undo receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, uint160(hashBytes), hash, k), CAddressUnspentValue()));
-
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-                    uint160 hashBytes(Hash160(out.scriptPubKey.begin()+1, out.scriptPubKey.end()-1));
-                    addressIndex.push_back(make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, hashBytes, hash, k), CAddressUnspentValue()));
-                } else {
-                    continue;
-                }
-
-            }
-
-        }
-
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         {
@@ -1760,49 +1980,10 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
-
-                const CTxIn input = tx.vin[j];
-
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
-
-                if (fAddressIndex) {
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-
-                        // undo spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(2, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
-
-                        // undo spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-                        uint160 hashBytes(Hash160(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.end()-1));
-                        addressIndex.push_back(make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, hash, j, false), prevout.nValue));
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, hashBytes, hash, j), CAddressUnspentValue()));
-                    } else {
-                        continue;
-                    }
-                }
-
             }
         }
     }
 
-
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -1811,15 +1992,19 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         return true;
     }
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to delete address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
+    if (fAddressIndex || fSpentIndex || fTimestampIndex) {
+        CConnectIndexEntries entries;
+        for (int i = block.vtx.size() - 1; i >= 0; i--)
+            IndexDisconnectedTransaction(block.vtx[i], i, i > 0 ? &blockUndo.vtxundo[i - 1] : NULL, pindex->nHeight, entries);
+        if (!pindexdb->QueueUpdate(GetDisconnectIndexUpdate(pindex, entries)))
+            return AbortNode(state, "Failed to write address and spent indexes");
     }
 
+    std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > vMasternodePayments;
+    GetMasternodePaymentEntries(block, pindex, vMasternodePayments);
+    if (!pblocktree->EraseMasternodePayments(vMasternodePayments))
+        return AbortNode(state, "Failed to delete masternode payment index");
+
     return fClean;
 }
 
@@ -1848,13 +2033,100 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CParallelCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck() {
     RenameThread("futurocoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+bool RunParallelChecks(std::vector<CParallelCheck>& vChecks, bool fWait)
+{
+    if (!nScriptCheckThreads)
+        return false;
+    if (fWait) {
+        CCheckQueueControl<CParallelCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+        return true;
+    }
+    CCheckQueueControl<CParallelCheck> control(&scriptcheckqueue, boost::try_to_lock);
+    if (!control.IsActive())
+        return false;
+    control.Add(vChecks);
+    control.Wait();
+    return true;
+}
+
+/** Coins of one transaction, read from the coins database ahead of ConnectBlock */
+struct CPrefetchedCoins
+{
+    uint256 txid;
+    CCoins coins;
+    bool fFound;
+
+    CPrefetchedCoins(const uint256& txidIn) : txid(txidIn), fFound(false) {}
+};
+
+/** Read the coins of one CPrefetchedCoins entry, run on a script check thread */
+static bool ReadPrefetchedCoins(const CCoinsView* pdbview, CPrefetchedCoins* pentry)
+{
+    try {
+        pentry->fFound = pdbview->GetCoins(pentry->txid, pentry->coins);
+    } catch (const std::runtime_error& e) {
+        // Leave it to ConnectBlock, whose read of these coins goes
+        // through the error catcher and shuts down cleanly.
+        pentry->fFound = false;
+    }
+    return true;
+}
+
+static int64_t nTimePrefetch = 0;
+
+void PrefetchBlockCoins(const CBlock& block, CCoinsViewCache& view, const CCoinsView* pdbview)
+{
+    if (!nScriptCheckThreads || !pdbview)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::set<uint256> setSkip;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        // Outputs created within the block are not in the database
+        setSkip.insert(tx.GetHash());
+    }
+    std::vector<CPrefetchedCoins> vPrefetch;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+            const uint256& txid = txin.prevout.hash;
+            if (!setSkip.insert(txid).second || view.HaveCoinsInCache(txid))
+                continue;
+            vPrefetch.push_back(CPrefetchedCoins(txid));
+        }
+    }
+    if (vPrefetch.empty())
+        return;
+
+    // vPrefetch does not change size from here on, the checks point into it
+    std::vector<CParallelCheck> vChecks;
+    vChecks.reserve(vPrefetch.size());
+    for (size_t i = 0; i < vPrefetch.size(); i++)
+        vChecks.push_back(CParallelCheck(boost::bind(&ReadPrefetchedCoins, pdbview, &vPrefetch[i])));
+    if (!RunParallelChecks(vChecks, true))
+        return;
+
+    unsigned int nFound = 0;
+    BOOST_FOREACH(CPrefetchedCoins& entry, vPrefetch) {
+        if (entry.fFound) {
+            view.WarmCoins(entry.txid, entry.coins);
+            nFound++;
+        }
+    }
+    int64_t nTimeEnd = GetTimeMicros(); nTimePrefetch += nTimeEnd - nTimeStart;
+    LogPrint("bench", "  - Prefetch %u/%u coins: %.2fms [%.2fs]\n", nFound, (unsigned int)vPrefetch.size(), 0.001 * (nTimeEnd - nTimeStart), nTimePrefetch * 0.000001);
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1928,6 +2200,148 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+/** Number of transactions ConnectBlock connects between two wake-ups of the index thread */
+static const unsigned int CONNECT_INDEX_BATCH = 64;
+
+/**
+ * Builds the index entries of a block on a long-lived thread while
+ * ConnectBlock is still connecting it, so index building overlaps with the
+ * serial UTXO work and the script checks. ConnectBlock hands over the
+ * connected transactions in batches, their undo data is complete by then.
+ * Only one block is connected at a time (cs_main), so there is one job.
+ * The undo data itself and the masternode payment checks stay on the
+ * connecting thread: UpdateCoins records each spent coin as it takes it out
+ * of the view, and the payment checks take the masternode locks.
+ */
+class CConnectIndexer
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    bool fRunning;
+    //! the thread is indexing transactions outside the lock
+    bool fBusy;
+
+    const CBlock* pblock;
+    const CBlockUndo* pblockundo;
+    int nHeight;
+    unsigned int nConnected;
+    unsigned int nIndexed;
+    CConnectIndexEntries entries;
+
+public:
+    CConnectIndexer() : fRunning(false), fBusy(false), pblock(NULL), pblockundo(NULL), nHeight(0), nConnected(0), nIndexed(0) {}
+
+    void Thread()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = true;
+        try {
+            while (true) {
+                while (!pblock || nIndexed >= nConnected)
+                    condWork.wait(lock);
+                const unsigned int nBegin = nIndexed;
+                const unsigned int nEnd = nConnected;
+                fBusy = true;
+                lock.unlock();
+                // blockundo.vtxundo was sized up front, ConnectBlock only assigns
+                // the entries of later transactions meanwhile.
+                for (unsigned int i = nBegin; i < nEnd; i++)
+                    IndexConnectedTransaction(pblock->vtx[i], i, i > 0 ? &pblockundo->vtxundo[i - 1] : NULL, nHeight, entries);
+                lock.lock();
+                fBusy = false;
+                nIndexed = nEnd;
+                condDone.notify_all();
+            }
+        } catch (const boost::thread_interrupted&) {
+            // The wait took the lock again before throwing
+            fRunning = false;
+            condDone.notify_all();
+            throw;
+        }
+    }
+
+    /** Start indexing a block, returns false if the thread is not running */
+    bool Start(const CBlock& block, const CBlockUndo& blockundo, int nHeightIn)
+    {
+        assert(blockundo.vtxundo.size() + 1 == block.vtx.size());
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning)
+            return false;
+        pblock = &block;
+        pblockundo = &blockundo;
+        nHeight = nHeightIn;
+        nConnected = 0;
+        nIndexed = 0;
+        entries = CConnectIndexEntries();
+        return true;
+    }
+
+    /** The first nTx transactions are connected */
+    void Connected(unsigned int nTx)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nConnected = nTx;
+        }
+        condWork.notify_one();
+    }
+
+    /** Wait for all transactions to be indexed and take the entries */
+    void Finish(CConnectIndexEntries& entriesRet)
+    {
+        boost::this_thread::disable_interruption di;
+        const unsigned int nTx = pblock->vtx.size();
+        Connected(nTx);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nIndexed < nTx && fRunning)
+            condDone.wait(lock);
+        // If the thread was stopped meanwhile, index the rest here
+        for (unsigned int i = nIndexed; i < nTx; i++)
+            IndexConnectedTransaction(pblock->vtx[i], i, i > 0 ? &pblockundo->vtxundo[i - 1] : NULL, nHeight, entries);
+        std::swap(entries, entriesRet);
+        pblock = NULL;
+        pblockundo = NULL;
+    }
+
+    /** Drop the job, e.g. if the block turned out to be invalid */
+    void Stop()
+    {
+        boost::this_thread::disable_interruption di;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (fBusy)
+            condDone.wait(lock);
+        pblock = NULL;
+        pblockundo = NULL;
+        nConnected = 0;
+        nIndexed = 0;
+    }
+};
+
+static CConnectIndexer connectIndexer;
+
+void ThreadConnectIndex()
+{
+    RenameThread("futurocoin-connidx");
+    connectIndexer.Thread();
+}
+
+/** Stops the indexer job when ConnectBlock returns, before the block and its undo data go away */
+class CConnectIndexerJob
+{
+private:
+    const bool fActive;
+
+public:
+    explicit CConnectIndexerJob(bool fActiveIn) : fActive(fActiveIn) {}
+    ~CConnectIndexerJob()
+    {
+        if (fActive)
+            connectIndexer.Stop();
+    }
+};
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -2053,7 +2467,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    CCheckQueueControl<CParallelCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2062,15 +2476,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
-    blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    // Sized up front so the index thread can read finished entries while
+    // later ones are filled in, see CConnectIndexer
+    blockundo.vtxundo.resize(block.vtx.size() - 1);
+
+    // The index entries are only needed if the block is actually connected.
+    // With -parindex they are built on the index thread as transactions get
+    // connected, its job is finished (or dropped) before blockundo goes away.
+    CConnectIndexEntries indexEntries;
+    bool fBuildIndexes = !fJustCheck && (fAddressIndex || fSpentIndex);
+    bool fIndexInParallel = fBuildIndexes && fParallelIndex && connectIndexer.Start(block, blockundo, pindex->nHeight);
+    CConnectIndexerJob indexerJob(fIndexInParallel);
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
-        const uint256 txhash = tx.GetHash();
 
         nInputs += tx.vin.size();
         nSigOps += GetLegacySigOpCount(tx);
@@ -2097,46 +2517,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
 
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-                    uint160 hashBytes;
-                    int addressType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-                        hashBytes = Hash160(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.end()-1);
-                        addressType = 1;
-                    } else {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                    }
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-
-            }
-
             if (fStrictPayToScriptHash)
             {
                 // Add in sigops done by pay-to-script-hash inputs;
@@ -2155,47 +2535,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
-            control.Add(vChecks);
-        }
-
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-                    uint160 hashBytes(Hash160(out.scriptPubKey.begin()+1, out.scriptPubKey.end()-1));
-                    addressIndex.push_back(make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue));
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                } else {
-                    continue;
-                }
-
-            }
+            std::vector<CParallelCheck> vParallelChecks(vChecks.size());
+            for (size_t j = 0; j < vChecks.size(); j++)
+                vParallelChecks[j].SwapScriptCheck(vChecks[j]);
+            control.Add(vParallelChecks);
         }
 
         CTxUndo undoDummy;
-        if (i > 0) {
-            blockundo.vtxundo.push_back(CTxUndo());
+        UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo[i - 1], pindex->nHeight);
+
+        if (fIndexInParallel) {
+            if ((i + 1) % CONNECT_INDEX_BATCH == 0)
+                connectIndexer.Connected(i + 1);
+        } else if (fBuildIndexes) {
+            IndexConnectedTransaction(tx, i, i > 0 ? &blockundo.vtxundo[i - 1] : NULL, pindex->nHeight, indexEntries);
         }
-        UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
@@ -2226,6 +2580,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (!control.Wait())
         return state.DoS(100, false);
+    if (fIndexInParallel)
+        connectIndexer.Finish(indexEntries);
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
@@ -2255,23 +2611,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
+    // Written by the index database in the background
+    if (fAddressIndex || fSpentIndex || fTimestampIndex)
+        if (!pindexdb->QueueUpdate(GetConnectIndexUpdate(pindex, indexEntries)))
+            return AbortNode(state, "Failed to write address, spent and timestamp indexes");
 
-    if (fTimestampIndex)
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
+    std::vector<std::pair<CMasternodePaymentKey, CMasternodePaymentValue> > vMasternodePayments;
+    GetMasternodePaymentEntries(block, pindex, vMasternodePayments);
+    if (!pblocktree->WriteMasternodePayments(vMasternodePayments))
+        return AbortNode(state, "Failed to write masternode payment index");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2377,6 +2725,10 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // overwrite one. Still, use a conservative safety factor of 2.
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
+        // The indexes may be ahead of the chainstate but never behind it, so
+        // after a crash reconnecting blocks from the chainstate on fixes them.
+        if (!pindexdb->Flush())
+            return AbortNode(state, "Failed to write to index database");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
@@ -2535,6 +2887,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    PrefetchBlockCoins(*pblock, *pcoinsTip, pcoinsdbview);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(*pblock, state, pindexNew, view);
@@ -2921,17 +3274,16 @@ bool ReconsiderBlock(CValidationState& state, CBlockIndex *pindex) {
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3089,10 +3441,10 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, bool fCheckPOW)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus()))
+    if (fCheckPOW && !CheckProofOfWork(hash, block.nBits, Params().GetConsensus()))
         return state.DoS(50, error("CheckBlockHeader(): proof of work failed"),
                          REJECT_INVALID, "high-hash");
 
@@ -3104,6 +3456,11 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+{
+    return CheckBlockHeader(block, fCheckPOW ? block.GetHash() : uint256(), state, fCheckPOW);
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3313,11 +3670,10 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
 
@@ -3334,7 +3690,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, hash, state, true))
             return false;
 
         // Get prev block index
@@ -3354,7 +3710,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return false;
     }
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3368,12 +3724,13 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 }
 
 // Exposed wrapper for AcceptBlockHeader
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, const std::vector<uint256>& hashes, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
+    assert(hashes.size() == headers.size());
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
-            if (!AcceptBlockHeader(header, state, chainparams, ppindex)) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!AcceptBlockHeader(headers[i], hashes[i], state, chainparams, ppindex)) {
                 return false;
             }
         }
@@ -3391,7 +3748,7 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    if (!AcceptBlockHeader(block, block.GetHash(), state, chainparams, &pindex))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3683,22 +4040,113 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("InsertBlockIndex(): new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
+CBlockIndex * InsertBlockIndex(const uint256& hash, CBlockIndex* pindex)
+{
+    std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(make_pair(hash, pindex));
+    if (!ret.second) {
+        // Already created as the parent of another entry, fill that one in
+        CBlockIndex* pindexExisting = ret.first->second;
+        *pindexExisting = *pindex;
+        pindex = pindexExisting;
+    }
+    pindex->phashBlock = &(ret.first->first);
+    return pindex;
+}
+
+void AdoptBlockIndexArena(CBlockIndexArena& arena)
+{
+    mapBlockIndex.reserve(mapBlockIndex.size() + arena.size());
+    blockIndexArena.Splice(arena);
+}
+
+/** How many entries ahead LoadBlockIndexDB prefetches while walking the block index by height */
+static const size_t BLOCK_INDEX_PREFETCH_DISTANCE = 8;
+
+static inline void PrefetchBlockIndex(const CBlockIndex* pindex)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(pindex);
+#endif
+}
+
+bool CatchUpIndexDB(const CChainParams& chainparams)
+{
+    uint256 hashIndexBest;
+    const CBlockIndex* pindexFork = chainActive.Genesis();
+    if (pindexdb->ReadBestBlock(hashIndexBest)) {
+        BlockMap::iterator mi = mapBlockIndex.find(hashIndexBest);
+        if (mi == mapBlockIndex.end())
+            return error("%s: the indexes are at unknown block %s, rebuild them with -reindex", __func__, hashIndexBest.ToString());
+        const CBlockIndex* pindexIndexBest = mi->second;
+        pindexFork = chainActive.FindFork(pindexIndexBest);
+        if (pindexFork != pindexIndexBest) {
+            // Ahead of the chain state or on a branch it is not on, undo it
+            // back to the fork. Even blocks ahead on the same chain are not
+            // sure to be connected again, another branch may win first.
+            LogPrintf("%s: indexes are at block %s off the active chain, rewinding %d blocks...\n", __func__,
+                      hashIndexBest.ToString(), pindexIndexBest->nHeight - pindexFork->nHeight);
+            for (const CBlockIndex* pindex = pindexIndexBest; pindex != pindexFork; pindex = pindex->pprev) {
+                boost::this_thread::interruption_point();
+                CBlock block;
+                if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+                    return error("%s: failed to read block %s, rebuild the indexes with -reindex", __func__, pindex->GetBlockHash().ToString());
+                CBlockUndo blockundo;
+                CDiskBlockPos pos = pindex->GetUndoPos();
+                if (pos.IsNull() || !UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash()))
+                    return error("%s: failed to read undo data of block %s, rebuild the indexes with -reindex", __func__, pindex->GetBlockHash().ToString());
+                if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+                    return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+
+                CConnectIndexEntries entries;
+                for (int i = block.vtx.size() - 1; i >= 0; i--)
+                    IndexDisconnectedTransaction(block.vtx[i], i, i > 0 ? &blockundo.vtxundo[i - 1] : NULL, pindex->nHeight, entries);
+                if (!pindexdb->QueueUpdate(GetDisconnectIndexUpdate(pindex, entries)))
+                    return error("%s: failed to write the indexes", __func__);
+            }
+        }
+    }
+
+    int nBlocks = chainActive.Height() - pindexFork->nHeight;
+    if (nBlocks <= 0)
+        return pindexdb->Flush();
+    LogPrintf("%s: indexing %d blocks the indexes are behind...\n", __func__, nBlocks);
+    for (const CBlockIndex* pindex = chainActive.Next(pindexFork); pindex; pindex = chainActive.Next(pindex)) {
+        boost::this_thread::interruption_point();
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+            return error("%s: failed to read block %s, rebuild the indexes with -reindex", __func__, pindex->GetBlockHash().ToString());
+        CBlockUndo blockundo;
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data of block %s, rebuild the indexes with -reindex", __func__, pindex->GetBlockHash().ToString());
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+
+        CConnectIndexEntries entries;
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            IndexConnectedTransaction(block.vtx[i], i, i > 0 ? &blockundo.vtxundo[i - 1] : NULL, pindex->nHeight, entries);
+        if (!pindexdb->QueueUpdate(GetConnectIndexUpdate(pindex, entries)))
+            return error("%s: failed to write the indexes", __func__);
+    }
+    return pindexdb->Flush();
+}
+
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts())
+    int64_t nStart = GetTimeMillis();
+    if (!pblocktree->LoadBlockIndexGuts(GetBoolArg("-checkblockindexhashes", DEFAULT_CHECKBLOCKINDEXHASHES)))
         return false;
 
     boost::this_thread::interruption_point();
+    int64_t nLoaded = GetTimeMillis();
 
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
@@ -3709,10 +4157,34 @@ bool static LoadBlockIndexDB()
         vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+    int64_t nSorted = GetTimeMillis();
+
+    // The proof of each block is a 256-bit division, done for all of them in
+    // parallel. Only summing them up along the chain has to follow the heights.
+    std::vector<arith_uint256> vProof(vSortedByHeight.size());
     {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        // The threads write to vProof, so they must be joined before it goes out of scope
+        boost::this_thread::disable_interruption di;
+        int nThreads = std::max(1, std::min((int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS));
+        boost::thread_group threads;
+        for (int t = 0; t < nThreads; t++) {
+            threads.create_thread([&vSortedByHeight, &vProof, nThreads, t] {
+                for (size_t i = t; i < vSortedByHeight.size(); i += nThreads)
+                    vProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+            });
+        }
+        threads.join_all();
+    }
+    int64_t nProved = GetTimeMillis();
+
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
+    {
+        // Fetch the next entries early, the hardware prefetcher cannot follow the pointers
+        if (i + BLOCK_INDEX_PREFETCH_DISTANCE < vSortedByHeight.size())
+            PrefetchBlockIndex(vSortedByHeight[i + BLOCK_INDEX_PREFETCH_DISTANCE].second);
+
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vProof[i];
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -3736,6 +4208,9 @@ bool static LoadBlockIndexDB()
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    int64_t nLinked = GetTimeMillis();
+    LogPrintf("%s: %u entries, load %dms, sort %dms, block proofs %dms, chain work and skip list %dms\n", __func__,
+              vSortedByHeight.size(), nLoaded - nStart, nSorted - nLoaded, nProved - nSorted, nLinked - nProved);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -3798,12 +4273,47 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Earlier versions kept the indexes in the block index database
+    bool fIndexDB = false;
+    pblocktree->ReadFlag("indexdb", fIndexDB);
+    if (!fIndexDB) {
+        if (fAddressIndex || fSpentIndex || fTimestampIndex) {
+            LogPrintf("%s: moving the address, spent and timestamp indexes to their own database...\n", __func__);
+            if (!pindexdb->MoveFromBlockTree(*pblocktree, pcoinsTip->GetBestBlock()))
+                return error("%s: failed to move the indexes", __func__);
+        }
+        pblocktree->WriteFlag("indexdb", true);
+    }
+
+    // Address indexes built before per-address balances were kept get them summed once
+    bool fAddressBalanceIndex = false;
+    pblocktree->ReadFlag("addressbalanceindex", fAddressBalanceIndex);
+    if (fAddressIndex && !fAddressBalanceIndex) {
+        LogPrintf("%s: building address balance index...\n", __func__);
+        if (!pindexdb->BuildAddressBalanceIndex())
+            return error("%s: failed to build address balance index", __func__);
+        pblocktree->WriteFlag("addressbalanceindex", true);
+    }
+
+    // Check where the masternode payment index starts
+    bool fMasternodePaymentIndexStart = pblocktree->ReadMasternodePaymentIndexStart(nMasternodePaymentIndexStart);
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
 
+    if ((fAddressIndex || fSpentIndex || fTimestampIndex) && !CatchUpIndexDB(chainparams))
+        return false;
+
+    // Databases created before the masternode payment index fill it from the next block on
+    if (!fMasternodePaymentIndexStart) {
+        nMasternodePaymentIndexStart = chainActive.Height() + 1;
+        pblocktree->WriteMasternodePaymentIndexStart(nMasternodePaymentIndexStart);
+    }
+    LogPrintf("%s: masternode payment index starts at height %d\n", __func__, nMasternodePaymentIndexStart);
+
     PruneBlockIndexCandidates();
 
     LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
@@ -3924,10 +4434,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 }
 
@@ -3954,6 +4462,8 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    // Balances are kept up to date from the first block on
+    pblocktree->WriteFlag("addressbalanceindex", true);
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -3962,6 +4472,13 @@ bool InitBlockIndex(const CChainParams& chainparams)
     fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
     pblocktree->WriteFlag("spentindex", fSpentIndex);
 
+    // The indexes are kept in their own database
+    pblocktree->WriteFlag("indexdb", true);
+
+    // The masternode payment index is always kept, from the first block on
+    nMasternodePaymentIndexStart = 0;
+    pblocktree->WriteMasternodePaymentIndexStart(nMasternodePaymentIndexStart);
+
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -3976,7 +4493,7 @@ bool InitBlockIndex(const CChainParams& chainparams)
                 return error("%s: FindBlockPos failed", __func__);
             if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
                 return error("%s: writing genesis block to disk failed", __func__);
-            CBlockIndex *pindex = AddToBlockIndex(block);
+            CBlockIndex *pindex = AddToBlockIndex(block, block.GetHash());
             if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
                 return error("%s: genesis block not accepted", __func__);
             if (!ActivateBestChain(state, chainparams, &block))
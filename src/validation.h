@@ -16,6 +16,7 @@
 #include "coins.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "script/script_error.h"
+#include "support/allocators/zeroafterfree.h"
 #include "sync.h"
 #include "versionbits.h"
 #include "spentindex.h"
@@ -33,9 +34,13 @@
 
 #include <boost/unordered_map.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 class CBlockIndex;
+class CBlockIndexArena;
 class CBlockTreeDB;
+class CCoinsViewDB;
+class CIndexDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -124,6 +129,8 @@ static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+/** Default for -parindex, build the index entries of a block while connecting it */
+static const bool DEFAULT_PARALLEL_INDEX = true;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -133,6 +140,14 @@ static const bool DEFAULT_ENABLE_REPLACEMENT = false;
 /** Maximum number of headers to announce when relaying blocks with headers message.*/
 static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular BLOCK response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of peers we ask to announce new blocks to us with compact blocks (BIP152 high-bandwidth mode). */
+static const unsigned int MAX_CMPCTBLOCK_HB_PEERS = 3;
+
 /** Maximum number of outputs to be allowed in a single transaction. */
 static const unsigned int MAX_OUTPUTS_ALLOWED = 11;
 
@@ -154,7 +169,11 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+extern bool fParallelIndex;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fTimestampIndex;
+extern bool fSpentIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
@@ -192,6 +211,8 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = MIN_BLOCKS_TO_KEEP;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Recompute the hash of every block index entry at startup instead of trusting the stored one */
+static const bool DEFAULT_CHECKBLOCKINDEXHASHES = false;
 
 // Require that user allocate at least 945MB for block & undo files (blk???.dat and rev???.dat)
 // At 2MB per block, 288 blocks = 576MB.
@@ -227,11 +248,12 @@ bool ProcessNewBlock(const CChainParams& chainparams, const CBlock* pblock, bool
  * Process incoming block headers.
  *
  * @param[in]  block The block headers themselves
+ * @param[in]  hashes The hashes of the block headers, as computed by HashX11Batch
  * @param[out] state This may be set to an Error state if any error occurred processing them
  * @param[in]  chainparams The params for the chain we want to connect to
  * @param[out] ppindex If set, the pointer will be set to point to the last new block index object for the given headers
  */
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL);
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, const std::vector<uint256>& hashes, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL);
 
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
@@ -247,10 +269,14 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex();
+/** Bring the index database to the tip of the active chain from the block and undo data, e.g. after it was lost or written past the chain state */
+bool CatchUpIndexDB(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run the thread building index entries while blocks are connected, see -parindex */
+void ThreadConnectIndex();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -294,6 +320,13 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(uint256 hash);
+/**
+ * Add an entry that was decoded into an arena passed to AdoptBlockIndexArena
+ * under the given hash. Returns the entry now in mapBlockIndex.
+ */
+CBlockIndex * InsertBlockIndex(const uint256& hash, CBlockIndex* pindex);
+/** Move the entries of arena into the block index storage and make room for them in mapBlockIndex */
+void AdoptBlockIndexArena(CBlockIndexArena& arena);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
@@ -586,6 +619,114 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Running totals of all address index deltas of one address, kept up to date by CIndexDB */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0;
+    }
+};
+
+/**
+ * A block of the active chain that paid the masternode payment to a payee,
+ * keyed by the Hash160 of the payee script. Heights are stored inverted so
+ * the newest payment of a payee sorts first. The value is the block time.
+ */
+struct CMasternodePaymentKey {
+    uint160 payeeHash;
+    int blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 24;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        payeeHash.Serialize(s, nType, nVersion);
+        // Heights are stored big-endian and inverted for key ordering in LevelDB
+        ser_writedata32be(s, ~(uint32_t)blockHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        payeeHash.Unserialize(s, nType, nVersion);
+        blockHeight = ~ser_readdata32be(s);
+    }
+
+    CMasternodePaymentKey(const uint160& payeeHashIn, int nHeight) {
+        payeeHash = payeeHashIn;
+        blockHeight = nHeight;
+    }
+
+    CMasternodePaymentKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        payeeHash.SetNull();
+        blockHeight = 0;
+    }
+};
+
+struct CMasternodePaymentValue {
+    //! the paying block, entries of blocks that are not on the chain any more are skipped
+    uint256 blockHash;
+    unsigned int nTime;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockHash);
+        READWRITE(nTime);
+    }
+
+    CMasternodePaymentValue(const uint256& blockHashIn, unsigned int nTimeIn) {
+        blockHash = blockHashIn;
+        nTime = nTimeIn;
+    }
+
+    CMasternodePaymentValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHash.SetNull();
+        nTime = 0;
+    }
+};
+
+/** Index changes of one connected or disconnected block, see CIndexDB::QueueUpdate() */
+struct CIndexDBUpdate
+{
+    //! the block the indexes are at once the update is written
+    uint256 hashBlock;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndexErase;
+    //! null values erase the entry
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    //! null values erase the entry
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<CTimestampIndexKey> timestampIndex;
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -716,18 +857,78 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * A job for the script check threads: one of the script checks of a block,
+ * or any other work passed as a function, such as reading the coins a block
+ * spends before it is connected.
+ */
+class CParallelCheck
+{
+private:
+    CScriptCheck scriptCheck;
+    boost::function<bool()> func;
+
+public:
+    CParallelCheck() {}
+    explicit CParallelCheck(const boost::function<bool()>& funcIn) : func(funcIn) {}
+
+    bool operator()() { return func ? func() : scriptCheck(); }
+
+    void swap(CParallelCheck &check) {
+        scriptCheck.swap(check.scriptCheck);
+        func.swap(check.func);
+    }
+
+    /** Take over a script check, leaving an empty one behind */
+    void SwapScriptCheck(CScriptCheck &check) { scriptCheck.swap(check); }
+};
+
+/**
+ * Run checks on the script check threads, the calling thread joins them.
+ * Returns whether they were run: not if there are no script check threads
+ * or, unless fWait is set, another batch is using them right now (e.g. a
+ * block is being connected). The checks report their results themselves,
+ * the return values of operator() are not collected.
+ */
+bool RunParallelChecks(std::vector<CParallelCheck>& vChecks, bool fWait);
+
+/**
+ * Read the coins spent by a block that are not in view yet from pdbview, the
+ * database view is backed by, in parallel on the script check threads, and
+ * add them to view as a cache miss would. ConnectBlock then does not stall on
+ * one database read per miss. Without script check threads nothing is read.
+ */
+void PrefetchBlockCoins(const CBlock& block, CCoinsViewCache& view, const CCoinsView* pdbview);
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0, size_t nLimit = 0, const CAddressIndexKey* pkeyFrom = NULL);
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       size_t nLimit = 0, const CAddressUnspentKey* pkeyFrom = NULL);
+bool GetAddressBalance(uint160 addressHash, int type, CAmount &balance, CAmount &received);
+/**
+ * Heights and times of the blocks in (nMinHeight, pindex->nHeight] on the
+ * chain ending at pindex that paid the masternode payment to payee, newest
+ * first. Blocks below nIndexStartRet were connected before the index existed
+ * and are missing.
+ */
+bool GetMasternodePayments(const CScript& payee, int nMinHeight, const CBlockIndex* pindex,
+                           std::vector<std::pair<int, unsigned int> >& vPayments, int& nIndexStartRet);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized bytes of a block as stored on disk, appending them to vchBlock */
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+/**
+ * Same as above, checking that the stored block has the given header. pos and header are
+ * copied from the block index under cs_main, the read itself does not need cs_main.
+ */
+bool ReadRawBlockFromDisk(CSerializeData& vchBlock, const CDiskBlockPos& pos, const CBlockHeader& header, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -833,9 +1034,15 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coins database below pcoinsTip, read directly by the coin prefetcher (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the address, spent and timestamp index database */
+extern CIndexDB *pindexdb;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -41,4 +41,8 @@ static const int NO_BLOOM_VERSION = 70201;
 //! "sendheaders" command and announcing blocks with headers starts with this version
 static const int SENDHEADERS_VERSION = 70201;
 
+//! "sendcmpct" is sent to peers from this version on. Compact blocks are negotiated
+//! by "sendcmpct" alone, peers that do not know it ignore it as an unknown command.
+static const int SHORT_IDS_BLOCKS_VERSION = 70208;
+
 #endif // BITCOIN_VERSION_H